@@ -0,0 +1,625 @@
+#pragma once
+
+/*
+ Bounding volume hierarchy over the scene's boxes for CPU ray queries.
+ Every object is the unit cube transformed by its model matrix, so rays are tested against the
+ world-space bounds in the tree and then exactly against the box in its local space.
+ The tree is built binary with midpoint splits and then collapsed into a tree with four children per
+ node, whose bounds are stored per axis so one ray is tested against all four with SSE. Besides rays
+ it answers swept-sphere queries for collision, against the world-space bounds grown by the radius,
+ and batches of rays spread over a thread pool.
+ Objects that move are refit in place: their boxes and the bounds of the nodes above them grow or
+ shrink without touching the rest of the tree, so the cost follows what moved rather than the scene.
+*/
+
+#include <glm/glm.hpp>
+
+#include <emmintrin.h>
+
+#include <vector>
+#include <algorithm>
+
+#include "Scene.h"
+#include "ThreadPool.h"
+
+struct Ray {
+	glm::vec3 origin;
+	glm::vec3 direction;
+	glm::vec3 inverseDirection;
+
+	Ray() {}
+
+	Ray(const glm::vec3& origin, const glm::vec3& direction)
+		: origin(origin), direction(direction), inverseDirection(1.0f / direction)
+	{
+	}
+};
+
+struct RayHit {
+	float t;
+	int object;			// index into the objects the tree was built from
+	int face;			// cube side in the order of cubeVertices: -z, +z, -x, +x, -y, +y
+	glm::vec3 normal;	// world-space normal of the hit side
+};
+
+class Bvh
+{
+public:
+	Bvh() {}
+
+	// builds the tree over every object whose entry in include is true (all of them when include is NULL)
+	// ------------------------------------------------------------------------
+	void build(const std::vector<ObjectData>& objects, const std::vector<bool>* include = NULL)
+	{
+		boxes.clear();
+		nodes.clear();
+		nodeParents.clear();
+		objectBoxes.assign(objects.size(), -1);
+		depth = 0;
+
+		//the splits move small records around, the inverse matrices are added once the order is known
+		std::vector<BuildBox> buildBoxes;
+		buildBoxes.reserve(objects.size());
+		for (size_t i = 0; i < objects.size(); i++)
+		{
+			if (include != NULL && !(*include)[i])
+			{
+				continue;
+			}
+
+			BuildBox box;
+			ObjectBounds bounds = computeCubeBounds(objects[i].transform);
+			box.min = glm::vec3(bounds.center - bounds.extents);
+			box.max = glm::vec3(bounds.center + bounds.extents);
+			box.object = (int)i;
+			buildBoxes.push_back(box);
+		}
+
+		if (buildBoxes.empty())
+		{
+			return;
+		}
+
+		std::vector<BinaryNode> binaryNodes;
+		binaryNodes.reserve(buildBoxes.size() * 2);
+		binaryNodes.push_back(BinaryNode());
+		subdivide(buildBoxes, binaryNodes, 0, 0, (int)buildBoxes.size(), 0);
+
+		nodes.reserve(binaryNodes.size() / 3 + 1);
+		nodeParents.reserve(binaryNodes.size() / 3 + 1);
+		nodes.push_back(Node());
+		nodeParents.push_back(Slot());
+		boxSlots.resize(buildBoxes.size());
+		collapse(binaryNodes, 0, 0, 1);
+
+		boxes.resize(buildBoxes.size());
+		for (size_t i = 0; i < buildBoxes.size(); i++)
+		{
+			boxes[i].min = buildBoxes[i].min;
+			boxes[i].max = buildBoxes[i].max;
+			boxes[i].inverseModel = glm::inverse(getModelMatrix(objects[buildBoxes[i].object].transform));
+			boxes[i].object = buildBoxes[i].object;
+			objectBoxes[boxes[i].object] = (int)i;
+		}
+	}
+
+	// updates the boxes of the objects in ranges after they moved and the bounds of the nodes above them,
+	// the objects have to be the ones the tree was built from
+	// ------------------------------------------------------------------------
+	void refit(const std::vector<ObjectData>& objects, const std::vector<ObjectRange>& ranges)
+	{
+		for (size_t i = 0; i < ranges.size(); i++)
+		{
+			for (unsigned int j = ranges[i].first; j < ranges[i].first + ranges[i].count && j < objectBoxes.size(); j++)
+			{
+				int boxIndex = objectBoxes[j];
+				if (boxIndex < 0)
+				{
+					continue;
+				}
+
+				Box& box = boxes[boxIndex];
+				ObjectBounds bounds = computeCubeBounds(objects[j].transform);
+				box.min = glm::vec3(bounds.center - bounds.extents);
+				box.max = glm::vec3(bounds.center + bounds.extents);
+				box.inverseModel = glm::inverse(getModelMatrix(objects[j].transform));
+
+				//the leaf around the box, then every node up to the root until the bounds stop changing
+				Slot slot = boxSlots[boxIndex];
+				const Node& leafNode = nodes[slot.node];
+				glm::vec3 min = boxes[leafNode.child[slot.slot]].min;
+				glm::vec3 max = boxes[leafNode.child[slot.slot]].max;
+				for (int k = leafNode.child[slot.slot] + 1; k < leafNode.child[slot.slot] + leafNode.count[slot.slot]; k++)
+				{
+					min = glm::min(min, boxes[k].min);
+					max = glm::max(max, boxes[k].max);
+				}
+				while (slot.node >= 0 && setSlotBounds(slot, min, max))
+				{
+					getNodeBounds(nodes[slot.node], min, max);
+					slot = nodeParents[slot.node];
+				}
+			}
+		}
+	}
+
+	// closest hit along the ray up to tMax
+	// ------------------------------------------------------------------------
+	bool intersect(const Ray& ray, float tMax, RayHit& hit) const
+	{
+		hit.t = tMax;
+		hit.object = -1;
+		traverse(ray, 0.0f, hit, false);
+		return hit.object >= 0;
+	}
+
+	// closest hits of count rays, spread over the pool
+	// ------------------------------------------------------------------------
+	void intersect(const Ray* rays, int count, float tMax, RayHit* hits, ThreadPool& pool) const
+	{
+		pool.parallelFor(count, 256, [this, rays, tMax, hits](int begin, int end) {
+			for (int i = begin; i < end; i++)
+			{
+				intersect(rays[i], tMax, hits[i]);
+			}
+		});
+	}
+
+	// any hit along the ray up to tMax, for shadow rays
+	// ------------------------------------------------------------------------
+	bool occluded(const Ray& ray, float tMax) const
+	{
+		RayHit hit;
+		hit.t = tMax;
+		hit.object = -1;
+		traverse(ray, 0.0f, hit, true);
+		return hit.object >= 0;
+	}
+
+	// first contact of a sphere moving from center by motion, hit.t is the fraction of motion travelled.
+	// Boxes are tested by their world-space bounds, boxes the sphere already overlaps are ignored so it
+	// can always move out of them.
+	// ------------------------------------------------------------------------
+	bool sweepSphere(const glm::vec3& center, float radius, const glm::vec3& motion, RayHit& hit) const
+	{
+		hit.t = 1.0f;
+		hit.object = -1;
+		traverse(Ray(center, motion), radius, hit, false);
+		return hit.object >= 0;
+	}
+
+	size_t getNodeCount() const
+	{
+		return nodes.size();
+	}
+
+	size_t getBoxCount() const
+	{
+		return boxes.size();
+	}
+
+	// levels of four-wide nodes, at most MAX_DEPTH
+	int getDepth() const
+	{
+		return depth;
+	}
+
+private:
+	static const int MAX_LEAF_SIZE = 2;
+	static const int MAX_DEPTH = 64;		// of the binary tree, deeper nodes become leaves of more than MAX_LEAF_SIZE boxes
+	// a visited node takes one entry off the traversal stack and puts up to four on it
+	static const int STACK_SIZE = MAX_DEPTH * 3 + 1;
+
+	struct Box {
+		glm::vec3 min;
+		glm::vec3 max;
+		glm::mat4 inverseModel;
+		int object;
+	};
+
+	struct BuildBox {
+		glm::vec3 min;
+		glm::vec3 max;
+		int object;
+
+		// twice the centroid, only compared
+		glm::vec3 getCentroid() const
+		{
+			return min + max;
+		}
+	};
+
+	// inner nodes keep their children at first and first + 1, leaves keep count boxes starting at first
+	struct BinaryNode {
+		glm::vec3 min;
+		glm::vec3 max;
+		int first = 0;
+		int count = 0;
+	};
+
+	// bounds of the four children per axis, unused slots have child -1.
+	// A child with count 0 is the node at child[i], otherwise count boxes starting at child[i].
+	struct Node {
+		float minX[4], minY[4], minZ[4];
+		float maxX[4], maxY[4], maxZ[4];
+		int child[4];
+		int count[4];
+
+		Node()
+		{
+			for (int i = 0; i < 4; i++)
+			{
+				minX[i] = minY[i] = minZ[i] = 0.0f;
+				maxX[i] = maxY[i] = maxZ[i] = 0.0f;
+				child[i] = -1;
+				count[i] = 0;
+			}
+		}
+	};
+
+	// child slot of a node, the parent of the root has node -1
+	struct Slot {
+		int node = -1;
+		int slot = 0;
+	};
+
+	std::vector<Box> boxes;
+	std::vector<Node> nodes;
+	int depth = 0;
+
+	// for refit(): the slot every node and every box sits in, the box of every object or -1
+	std::vector<Slot> nodeParents;
+	std::vector<Slot> boxSlots;
+	std::vector<int> objectBoxes;
+
+	// depth of nodeIndex in the binary tree, the splits stop at MAX_DEPTH so the traversal stack cannot overflow
+	void subdivide(std::vector<BuildBox>& buildBoxes, std::vector<BinaryNode>& binaryNodes, int nodeIndex, int begin, int end, int nodeDepth)
+	{
+		glm::vec3 boundsMin = buildBoxes[begin].min;
+		glm::vec3 boundsMax = buildBoxes[begin].max;
+		glm::vec3 centroidMin = buildBoxes[begin].getCentroid();
+		glm::vec3 centroidMax = centroidMin;
+		for (int i = begin + 1; i < end; i++)
+		{
+			boundsMin = glm::min(boundsMin, buildBoxes[i].min);
+			boundsMax = glm::max(boundsMax, buildBoxes[i].max);
+			centroidMin = glm::min(centroidMin, buildBoxes[i].getCentroid());
+			centroidMax = glm::max(centroidMax, buildBoxes[i].getCentroid());
+		}
+
+		binaryNodes[nodeIndex].min = boundsMin;
+		binaryNodes[nodeIndex].max = boundsMax;
+
+		if (end - begin <= MAX_LEAF_SIZE || nodeDepth >= MAX_DEPTH - 1)
+		{
+			binaryNodes[nodeIndex].first = begin;
+			binaryNodes[nodeIndex].count = end - begin;
+			return;
+		}
+
+		//splits the widest axis of the centroids in the middle, one pass per level, when every centroid
+		//ends up on one side they are all at the same position and the boxes are split by count
+		glm::vec3 size = centroidMax - centroidMin;
+		int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+		float split = (centroidMin[axis] + centroidMax[axis]) * 0.5f;
+		int middle = (int)(std::partition(buildBoxes.begin() + begin, buildBoxes.begin() + end,
+			[axis, split](const BuildBox& box) { return box.min[axis] + box.max[axis] < split; }) - buildBoxes.begin());
+		if (middle == begin || middle == end)
+		{
+			middle = (begin + end) / 2;
+		}
+
+		int left = (int)binaryNodes.size();
+		binaryNodes.push_back(BinaryNode());
+		binaryNodes.push_back(BinaryNode());
+		binaryNodes[nodeIndex].first = left;
+		binaryNodes[nodeIndex].count = 0;
+
+		subdivide(buildBoxes, binaryNodes, left, begin, middle, nodeDepth + 1);
+		subdivide(buildBoxes, binaryNodes, left + 1, middle, end, nodeDepth + 1);
+	}
+
+	// fills node with up to four descendants of the binary node, opening the largest inner one first.
+	// nodeDepth counts the four-wide levels down to node
+	void collapse(const std::vector<BinaryNode>& binaryNodes, int binaryIndex, int nodeIndex, int nodeDepth)
+	{
+		depth = std::max(depth, nodeDepth);
+
+		int children[4];
+		int childCount = 0;
+		const BinaryNode& binaryNode = binaryNodes[binaryIndex];
+		if (binaryNode.count > 0)
+		{
+			children[childCount++] = binaryIndex;
+		}
+		else
+		{
+			children[childCount++] = binaryNode.first;
+			children[childCount++] = binaryNode.first + 1;
+		}
+
+		while (childCount < 4)
+		{
+			int largest = -1;
+			float largestArea = -1.0f;
+			for (int i = 0; i < childCount; i++)
+			{
+				const BinaryNode& candidate = binaryNodes[children[i]];
+				glm::vec3 size = candidate.max - candidate.min;
+				float area = size.x * size.y + size.y * size.z + size.z * size.x;
+				if (candidate.count == 0 && area > largestArea)
+				{
+					largest = i;
+					largestArea = area;
+				}
+			}
+			if (largest < 0)
+			{
+				break;
+			}
+
+			int opened = children[largest];
+			children[largest] = binaryNodes[opened].first;
+			children[childCount++] = binaryNodes[opened].first + 1;
+		}
+
+		for (int i = 0; i < childCount; i++)
+		{
+			const BinaryNode& child = binaryNodes[children[i]];
+			nodes[nodeIndex].minX[i] = child.min.x;
+			nodes[nodeIndex].minY[i] = child.min.y;
+			nodes[nodeIndex].minZ[i] = child.min.z;
+			nodes[nodeIndex].maxX[i] = child.max.x;
+			nodes[nodeIndex].maxY[i] = child.max.y;
+			nodes[nodeIndex].maxZ[i] = child.max.z;
+
+			Slot slot;
+			slot.node = nodeIndex;
+			slot.slot = i;
+			if (child.count > 0)
+			{
+				nodes[nodeIndex].child[i] = child.first;
+				nodes[nodeIndex].count[i] = child.count;
+				for (int j = child.first; j < child.first + child.count; j++)
+				{
+					boxSlots[j] = slot;
+				}
+			}
+			else
+			{
+				//the reference into nodes is not kept, collapsing the child grows the vector
+				int childNode = (int)nodes.size();
+				nodes.push_back(Node());
+				nodeParents.push_back(slot);
+				nodes[nodeIndex].child[i] = childNode;
+				collapse(binaryNodes, children[i], childNode, nodeDepth + 1);
+			}
+		}
+	}
+
+	// stores the bounds of a child slot, false when they did not change
+	bool setSlotBounds(const Slot& slot, const glm::vec3& min, const glm::vec3& max)
+	{
+		Node& node = nodes[slot.node];
+		int i = slot.slot;
+		if (node.minX[i] == min.x && node.minY[i] == min.y && node.minZ[i] == min.z
+			&& node.maxX[i] == max.x && node.maxY[i] == max.y && node.maxZ[i] == max.z)
+		{
+			return false;
+		}
+		node.minX[i] = min.x;
+		node.minY[i] = min.y;
+		node.minZ[i] = min.z;
+		node.maxX[i] = max.x;
+		node.maxY[i] = max.y;
+		node.maxZ[i] = max.z;
+		return true;
+	}
+
+	// union of the used child slots of node
+	static void getNodeBounds(const Node& node, glm::vec3& min, glm::vec3& max)
+	{
+		min = glm::vec3(node.minX[0], node.minY[0], node.minZ[0]);
+		max = glm::vec3(node.maxX[0], node.maxY[0], node.maxZ[0]);
+		for (int i = 1; i < 4 && node.child[i] >= 0; i++)
+		{
+			min = glm::min(min, glm::vec3(node.minX[i], node.minY[i], node.minZ[i]));
+			max = glm::max(max, glm::vec3(node.maxX[i], node.maxY[i], node.maxZ[i]));
+		}
+	}
+
+	// slab test against the unit cube in the box's local space, the ray parameter is the same in both spaces
+	static bool intersectBox(const Ray& ray, const Box& box, RayHit& hit)
+	{
+		glm::vec3 origin = glm::vec3(box.inverseModel * glm::vec4(ray.origin, 1.0f));
+		glm::vec3 direction = glm::vec3(box.inverseModel * glm::vec4(ray.direction, 0.0f));
+
+		float enter = -1e30f;
+		float exit = 1e30f;
+		int enterAxis = 0;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			if (direction[axis] == 0.0f)
+			{
+				if (origin[axis] < -0.5f || origin[axis] > 0.5f)
+				{
+					return false;
+				}
+				continue;
+			}
+
+			float t0 = (-0.5f - origin[axis]) / direction[axis];
+			float t1 = (0.5f - origin[axis]) / direction[axis];
+			if (t0 > t1)
+			{
+				std::swap(t0, t1);
+			}
+			if (t0 > enter)
+			{
+				enter = t0;
+				enterAxis = axis;
+			}
+			exit = std::min(exit, t1);
+		}
+
+		//rays starting inside a box do not hit it
+		if (enter > exit || enter <= 0.0f || enter >= hit.t)
+		{
+			return false;
+		}
+
+		bool positive = direction[enterAxis] < 0.0f;
+		glm::vec3 localNormal = glm::vec3(0.0f);
+		localNormal[enterAxis] = positive ? 1.0f : -1.0f;
+
+		static const int faces[3][2] = { { 2, 3 }, { 4, 5 }, { 0, 1 } };
+
+		hit.t = enter;
+		hit.object = box.object;
+		hit.face = faces[enterAxis][positive ? 1 : 0];
+		hit.normal = glm::normalize(glm::vec3(glm::transpose(box.inverseModel) * glm::vec4(localNormal, 0.0f)));
+		return true;
+	}
+
+	// the same slab test against the world-space bounds grown by radius, face is left out
+	static bool intersectGrownBounds(const Ray& ray, const Box& box, float radius, RayHit& hit)
+	{
+		float enter = -1e30f;
+		float exit = 1e30f;
+		int enterAxis = 0;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float min = box.min[axis] - radius;
+			float max = box.max[axis] + radius;
+			if (ray.direction[axis] == 0.0f)
+			{
+				if (ray.origin[axis] <= min || ray.origin[axis] >= max)
+				{
+					return false;
+				}
+				continue;
+			}
+
+			float t0 = (min - ray.origin[axis]) * ray.inverseDirection[axis];
+			float t1 = (max - ray.origin[axis]) * ray.inverseDirection[axis];
+			if (t0 > t1)
+			{
+				std::swap(t0, t1);
+			}
+			if (t0 > enter)
+			{
+				enter = t0;
+				enterAxis = axis;
+			}
+			exit = std::min(exit, t1);
+		}
+
+		if (enter > exit || enter < 0.0f || enter >= hit.t)
+		{
+			return false;
+		}
+
+		hit.t = enter;
+		hit.object = box.object;
+		hit.face = -1;
+		hit.normal = glm::vec3(0.0f);
+		hit.normal[enterAxis] = ray.direction[enterAxis] < 0.0f ? 1.0f : -1.0f;
+		return true;
+	}
+
+	// entry distances of the ray into the four child bounds of node grown by radius, the mask has a bit
+	// for every used child entered before tMax
+	static int intersectChildren(const Node& node, const __m128 origin[3], const __m128 inverseDirection[3], __m128 radius, float tMax, __m128& enter)
+	{
+		__m128 tx0 = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(node.minX), radius), origin[0]), inverseDirection[0]);
+		__m128 tx1 = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_loadu_ps(node.maxX), radius), origin[0]), inverseDirection[0]);
+		__m128 ty0 = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(node.minY), radius), origin[1]), inverseDirection[1]);
+		__m128 ty1 = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_loadu_ps(node.maxY), radius), origin[1]), inverseDirection[1]);
+		__m128 tz0 = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(node.minZ), radius), origin[2]), inverseDirection[2]);
+		__m128 tz1 = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_loadu_ps(node.maxZ), radius), origin[2]), inverseDirection[2]);
+
+		enter = _mm_max_ps(_mm_max_ps(_mm_min_ps(tx0, tx1), _mm_min_ps(ty0, ty1)), _mm_max_ps(_mm_min_ps(tz0, tz1), _mm_setzero_ps()));
+		__m128 exit = _mm_min_ps(_mm_min_ps(_mm_max_ps(tx0, tx1), _mm_max_ps(ty0, ty1)), _mm_min_ps(_mm_max_ps(tz0, tz1), _mm_set1_ps(tMax)));
+		__m128 used = _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_loadu_si128((const __m128i*)node.child), _mm_set1_epi32(-1)));
+		return _mm_movemask_ps(_mm_and_ps(_mm_cmple_ps(enter, exit), used));
+	}
+
+	// radius 0 tests rays exactly against the boxes, a larger one sweeps a sphere against the grown bounds
+	void traverse(const Ray& ray, float radius, RayHit& hit, bool anyHit) const
+	{
+		if (nodes.empty())
+		{
+			return;
+		}
+
+		__m128 origin[3] = { _mm_set1_ps(ray.origin.x), _mm_set1_ps(ray.origin.y), _mm_set1_ps(ray.origin.z) };
+		__m128 inverseDirection[3] = { _mm_set1_ps(ray.inverseDirection.x), _mm_set1_ps(ray.inverseDirection.y), _mm_set1_ps(ray.inverseDirection.z) };
+		__m128 grow = _mm_set1_ps(radius);
+
+		//nodes and leaves still to visit with the distance at which the ray enters them
+		struct StackEntry {
+			int child;
+			int count;
+			float enter;
+		};
+		StackEntry stack[STACK_SIZE];
+		int stackSize = 0;
+		stack[stackSize++] = { 0, 0, 0.0f };
+
+		while (stackSize > 0)
+		{
+			StackEntry entry = stack[--stackSize];
+			if (entry.enter > hit.t)
+			{
+				continue;
+			}
+
+			if (entry.count > 0)
+			{
+				for (int i = entry.child; i < entry.child + entry.count; i++)
+				{
+					bool found = radius > 0.0f ? intersectGrownBounds(ray, boxes[i], radius, hit) : intersectBox(ray, boxes[i], hit);
+					if (found && anyHit)
+					{
+						return;
+					}
+				}
+				continue;
+			}
+
+			const Node& node = nodes[entry.child];
+			__m128 enter;
+			int mask = intersectChildren(node, origin, inverseDirection, grow, hit.t, enter);
+			if (mask == 0)
+			{
+				continue;
+			}
+
+			float enterDistances[4];
+			_mm_storeu_ps(enterDistances, enter);
+
+			//pushed farthest first so the nearest child is visited next and shrinks hit.t for the others
+			StackEntry children[4];
+			int childCount = 0;
+			for (int i = 0; i < 4; i++)
+			{
+				if (mask & (1 << i))
+				{
+					StackEntry child = { node.child[i], node.count[i], enterDistances[i] };
+					int position = childCount++;
+					while (position > 0 && children[position - 1].enter < child.enter)
+					{
+						children[position] = children[position - 1];
+						position--;
+					}
+					children[position] = child;
+				}
+			}
+			//the tree is at most MAX_DEPTH levels deep, so the children always fit
+			for (int i = 0; i < childCount; i++)
+			{
+				stack[stackSize++] = children[i];
+			}
+		}
+	}
+};
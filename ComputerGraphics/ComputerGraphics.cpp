@@ -4,8 +4,35 @@
 #include <SDL_opengl.h>
 #include <gl/GLU.h>
 #include <glm/glm.hpp>
+#include "GLState.h"
+#include "MemoryTracker.h"
 #include "Shader.h"
+#include "ShaderVariants.h"
+#include "StartupLoader.h"
 #include "Camera.h"
+#include "FrameCapture.h"
+#include "GLTraceReplay.h"
+#include "StreamBuffer.h"
+#include "UploadWorker.h"
+#include "Scene.h"
+#include "MeshRegistry.h"
+#include "MeshImporter.h"
+#include "ObjectTransforms.h"
+#include "GpuDrivenRenderer.h"
+#include "FrameArena.h"
+#include "FrameGraph.h"
+#include "PostProcess.h"
+#include "Ssao.h"
+#include "Translucency.h"
+#include "PlanarReflection.h"
+#include "Hud.h"
+#include "DynamicResolution.h"
+#include "SceneReplicator.h"
+#include "SceneAnimation.h"
+#include "ThreadPool.h"
+#include "LightmapBaker.h"
+#include "Bvh.h"
+#include "SoftwareRenderer.h"
 #include "glm/ext.hpp"
 #include "glm/gtx/string_cast.hpp"
 
@@ -17,36 +44,253 @@
 //general function
 bool init();
 bool initGL();
+void requestStartupShaders();
 void render();
+void renderScenePass(const glm::mat4&);
+void renderReflectionPass();
+void recordFrameObjects();
+void renderTranslucentPass();
+void runPostBenchmark();
+void runSsaoBenchmark();
+void runUploadBenchmark();
+bool runAllocationCheck();
+bool replayTrace(const std::string&);
 void close();
 void handleKeyDown(const SDL_KeyboardEvent&);
 void handleMouseMotion(const SDL_MouseMotionEvent&);
 void handleMouseWheel(const SDL_MouseWheelEvent&);
+void handleWindowResize(int, int);
+void updateRenderSize();
+HudCounters getHudCounters();
+
+//walkthrough functions
+void updateWalkthrough(float);
+
+//lightmap functions
+bool bakeLightmaps();
+void bindLightmaps();
+
+//spatial query functions
+void updateSceneBvh();
+void moveCamera(Camera_Movement);
+void pickObject(int, int);
+void runRayQueryBenchmark();
+
+//software renderer functions
+void initSoftwareRenderer();
+SoftwareShading getSoftwareShading();
+SoftwareRenderStats renderSoftware(ThreadPool&);
+void runSoftwareScaling();
+void compareWithSoftware();
 
 //element functions
+void drawScene();
+void recordScene();
+void replicateScene();
+void addScenePrefab(const std::string&, bool, std::initializer_list<void(*)()>);
+void drawRecordedScene();
+void initAnimation();
+void updateAnimation();
+void switchLampRecords();
+glm::vec3 getLampEmission(unsigned int);
+void beginAnimationNode(unsigned int);
+void endAnimationNode();
 void drawRoom();
 void drawBed();
 void drawWardrobe();
 void drawNightStand();
 void drawShelfs();
 void drawMirrorTable();
+void drawDrawerBox(glm::vec3, glm::vec3);
 
 void drawNightStandLamp();
 void drawCeilingLight();
+void drawImportedMeshes();
 
 //objects function
-GLuint createCube();
+void getCubeIndices(GLuint[36]);
+void registerMeshes(const std::vector<std::string>&);
+GLuint createGeometry();
+void resizeObjectIndexBuffer(unsigned int);
 void drawCube();
+void drawMesh(unsigned int);
+void drawFrameObjects();
+void drawFrameTranslucentObjects();
+void drawFrameReflectedObjects();
 
 //helper functions
-glm::mat4 generateDefaultModelMatrixCube(glm::mat4);
+FrameData getFrameData();
+unsigned int getShaderFeatures();
+void initSceneShader(Shader&);
+ObjectTransform generateDefaultTransformCube(ObjectTransform);
+void setModelTransform(const ObjectTransform&);
 void setMaterialValues(glm::vec3, glm::vec3, glm::vec3 = glm::vec3(0.0f, 0.0f, 0.0f), float = 0.2f * 128);
+void setMaterialOpacity(float);
 
 SDL_Window* gWindow = NULL;
+GLState glState;
 SDL_GLContext gContext;
-GLuint gVertexArrayObjectCube;
-
-Shader shader;
+SDL_GLContext gUploadContext = NULL;	// shares its objects with gContext, current on the upload worker
+GLuint gSceneVertexArray;
+GLuint gObjectIndexBuffer;
+unsigned int gObjectIndexCapacity = 0;
+
+//each side of the cube with its own vertices to use different normals
+const float cubeVertices[] = {
+	//front side
+	-0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+	0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+	0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+	-0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+
+	//back side
+	-0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
+	0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
+	0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
+	-0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
+
+	//left side
+	-0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
+	-0.5f,  0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
+	-0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
+	-0.5f, -0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
+
+	//right side
+	0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
+	0.5f,  0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
+	0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
+	0.5f, -0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
+
+	//bottom side
+	-0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,
+	0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,
+	0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
+	-0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
+
+	//top side
+	-0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,
+	0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,
+	0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
+	-0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f
+};
+const int cubeVertexCount = 24;
+
+//the cube and the meshes imported with --import share one vertex and index buffer
+MeshRegistry meshRegistry;
+MeshImporter meshImporter;
+
+//scene shader variants, shader points at the one matching the current lamp states
+ShaderVariants shaderVariants;
+Shader* shader = NULL;
+
+//shader sources are read while the window is created and the programs compile in parallel
+StartupLoader startupLoader;
+
+//memory of every subsystem, the CPU side is counted by operator new/delete at the end of this file
+MemoryCounters cpuMemory;
+GpuMemoryTracker gpuMemory;
+
+//per-frame data is streamed through a persistently mapped buffer
+const unsigned int maxFrameObjects = 4096;
+const unsigned int maxReplicatedFrameObjects = 262144;
+unsigned int frameObjectLimit = maxFrameObjects;
+StreamBuffer streamBuffer;
+
+//large uploads are copied and issued by a thread with a context of its own
+UploadWorker uploadWorker;
+GLint uniformBufferAlignment = 256;
+GLint storageBufferAlignment = 256;
+
+GLintptr frameDataOffset = 0;		// of the FrameData of the main view in the stream buffer
+
+//object records of the current frame, written straight into the stream buffer by drawMesh()
+ObjectData* frameObjects = NULL;
+GLintptr frameObjectOffset = 0;		// of the records in the stream buffer
+unsigned int frameObjectCount = 0;
+unsigned int frameObjectCapacity = 0;
+std::vector<unsigned int> frameObjectMeshes;	// the draws read the meshes here, not from the mapped buffer
+std::vector<ObjectBounds> frameObjectBounds;	// only while the mirror is in view, to cull its reflection
+
+//indices of the recorded objects with an opacity below 1 in ascending order, the scene pass leaves them
+//to the translucent pass
+std::vector<unsigned int> frameTranslucentObjects;
+unsigned int frameTranslucentCount = 0;
+
+//records carry translation, rotation and scale, a compute pass turns them into model and normal matrices
+ObjectTransforms objectTransforms;
+
+ObjectTransform currentTransform;
+Material currentMaterial;
+
+//GPU-driven mode keeps the whole scene on the GPU and culls it with a compute shader
+GpuDrivenRenderer gpuDrivenRenderer;
+bool gpuDrivenMode = false;
+bool recordingScene = false;
+bool sceneRecorded = false;	// sceneObjects holds the current scene
+bool sceneDirty = true;		// the GPU copy of the scene is out of date
+std::vector<ObjectData> sceneObjects;
+std::vector<ObjectBounds> sceneBounds;
+
+//stress test scenes, the furniture of the room instantiated over a grid of rooms and floors
+SceneReplicator sceneReplicator;
+
+//doors and drawers move with their animation node, drawMesh() moves the objects drawn while one is set
+SceneAnimation sceneAnimation;
+unsigned int currentAnimationNode = NO_ANIMATION_NODE;
+bool animationAnchorPending = false;	// the next object drawn anchors the motion of the node
+ObjectTransform currentAnimationMotion;
+unsigned int wardrobeLeftDoorNode = NO_ANIMATION_NODE;
+unsigned int wardrobeRightDoorNode = NO_ANIMATION_NODE;
+unsigned int wardrobeTopDrawerNode = NO_ANIMATION_NODE;
+unsigned int wardrobeBottomDrawerNode = NO_ANIMATION_NODE;
+unsigned int mirrorTableDrawerNode = NO_ANIMATION_NODE;
+
+//the mirror of the mirror table, its front face shows the planar reflection of the room
+const glm::vec3 mirrorPosition = glm::vec3(4.8f, 0.9f, 4.7f);
+const glm::vec3 mirrorScale = glm::vec3(0.36f, 0.5f, 0.0001f);
+
+//transient data of the frame in progress, pass callbacks and the scratch data of the frame graph
+FrameArena frameArena;
+const size_t frameArenaCapacity = 64 * 1024;
+
+//render passes are declared every frame, the graph orders them and pools their render targets
+FrameGraph frameGraph;
+
+//the scene is rendered in HDR at renderWidth x renderHeight and tonemapped by compute passes
+PostProcess postProcess;
+Ssao ssao;
+Translucency translucency;
+PlanarReflection planarReflection;
+Hud hud;
+int renderWidth = 1280;
+int renderHeight = 720;
+
+//the window can be resized, the render size follows it at the scale the GPU time allows
+int windowWidth = 1280;
+int windowHeight = 720;
+DynamicResolution dynamicResolution;
+
+//CPU work is spread over every core
+ThreadPool threadPool;
+
+//baked lamp lighting, the lightmap variant of the scene shader reads one irradiance map per lamp
+bool lightmapMode = false;
+bool lightmapsBaked = false;
+bool bakeScalingReport = false;
+GLuint gLightmapTextures[2] = { 0, 0 };
+GLuint gLightmapRectBuffer = 0;
+
+//CPU reference renderer, P compares it with the GL frame
+SoftwareRenderer softwareRenderer;
+bool softwareCompareRequested = false;
+
+//camera collision and picking query a BVH over the recorded scene
+Bvh sceneBvh;
+bool sceneBvhDirty = true;		// sceneObjects changed since the BVH was built
+bool cameraCollision = true;
+const float cameraRadius = 0.3f;
+const float cameraSkin = 0.01f;	// kept between the camera and what it runs into
+int selectedObject = -1;
 
 const glm::vec3 eyes = glm::vec3(4.0f, 2.0f, 13.0f);
 
@@ -65,14 +309,326 @@ bool firstMouse = true;
 bool ceilingLampStatus = false;
 bool nightLampStatus = false;
 
+//the emissive parts of the lamps are marked when the scene is recorded, a switch patches their records
+const unsigned int CEILING_LAMP = 0;
+const unsigned int NIGHT_LAMP = 1;
+unsigned int currentLamp = NO_LAMP;
+std::vector<unsigned int> lampRecords;
+std::vector<ObjectRange> lampRanges;
+
 Camera camera(eyes);
 
+FrameCapture frameCapture;
+std::string capturePath = "capture";
+CaptureFormat captureFormat = CAPTURE_PNG;
+
+//GL calls of the first frames can be recorded and replayed on their own
+GLTraceRecorder glTrace;
+std::string tracePath;
+unsigned int traceFrames = 120;
+
+//scripted camera path used for benchmarking and capture, position + yaw/pitch per keyframe
+struct WalkthroughKey {
+	glm::vec3 position;
+	float yaw;
+	float pitch;
+};
+
+const WalkthroughKey walkthroughKeys[] = {
+	{ glm::vec3(4.0f, 2.0f, 13.0f), -90.0f, 0.0f },
+	{ glm::vec3(2.5f, 2.5f, 10.0f), -120.0f, -10.0f },
+	{ glm::vec3(2.0f, 2.0f, 7.0f), -30.0f, -5.0f },
+	{ glm::vec3(5.0f, 2.5f, 8.0f), 30.0f, -15.0f },
+	{ glm::vec3(7.0f, 2.0f, 11.0f), -150.0f, 0.0f },
+	{ glm::vec3(4.0f, 2.0f, 13.0f), -90.0f, 0.0f }
+};
+const float walkthroughSegmentDuration = 2.0f;
+const float walkthroughFrameStep = 1.0f / 60.0f;
+
+bool walkthroughMode = false;
+float walkthroughTime = 0.0f;
+
 int main(int argc, char* args[])
 {
-	init();
+	startupLoader.begin();
+
+	bool captureRequested = false;
+	bool lightmapsRequested = false;
+	std::string softwarePath;
+	bool softwareScaling = false;
+	bool postBenchmark = false;
+	bool ssaoBenchmark = false;
+	bool uploadBenchmark = false;
+	bool allocationCheck = false;
+	bool rayBenchmark = false;
+	std::string replayPath;
+	std::vector<std::string> importPaths;
+	float fixedRenderScale = 0.0f;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = args[i];
+		if (arg == "--walkthrough")
+		{
+			walkthroughMode = true;
+		}
+		else if (arg == "--capture" && i + 1 < argc)
+		{
+			captureRequested = true;
+			capturePath = args[++i];
+		}
+		else if (arg == "--y4m")
+		{
+			captureFormat = CAPTURE_Y4M;
+		}
+		else if (arg == "--gpu-driven")
+		{
+			gpuDrivenMode = true;
+		}
+		else if (arg == "--packed-instances")
+		{
+			gpuDrivenRenderer.packedInstances = true;
+		}
+		else if (arg == "--lightmaps")
+		{
+			lightmapsRequested = true;
+		}
+		else if (arg == "--bake-scaling")
+		{
+			bakeScalingReport = true;
+			lightmapsRequested = true;
+		}
+		else if (arg == "--software" && i + 1 < argc)
+		{
+			softwarePath = args[++i];
+		}
+		else if (arg == "--software-scaling")
+		{
+			softwareScaling = true;
+		}
+		else if (arg == "--target-frame-time" && i + 1 < argc)
+		{
+			dynamicResolution.targetMilliseconds = (float)atof(args[++i]);
+		}
+		else if (arg == "--render-scale" && i + 1 < argc)
+		{
+			fixedRenderScale = (float)atof(args[++i]);
+		}
+		else if (arg == "--post-benchmark")
+		{
+			postBenchmark = true;
+		}
+		else if (arg == "--ssao-benchmark")
+		{
+			ssaoBenchmark = true;
+		}
+		else if (arg == "--upload-benchmark")
+		{
+			uploadBenchmark = true;
+		}
+		else if (arg == "--no-ssao")
+		{
+			ssao.enabled = false;
+		}
+		else if (arg == "--reflection-scale" && i + 1 < argc)
+		{
+			planarReflection.resolutionScale = glm::clamp((float)atof(args[++i]), 0.05f, 1.0f);
+		}
+		else if (arg == "--no-reflection")
+		{
+			planarReflection.enabled = false;
+		}
+		else if (arg == "--allocation-check")
+		{
+			allocationCheck = true;
+		}
+		else if (arg == "--serial-startup")
+		{
+			startupLoader.serial = true;
+		}
+		else if (arg == "--ray-benchmark")
+		{
+			rayBenchmark = true;
+		}
+		else if (arg == "--trace" && i + 1 < argc)
+		{
+			tracePath = args[++i];
+		}
+		else if (arg == "--trace-frames" && i + 1 < argc)
+		{
+			traceFrames = (unsigned int)atoi(args[++i]);
+		}
+		else if (arg == "--replay" && i + 1 < argc)
+		{
+			replayPath = args[++i];
+		}
+		else if (arg == "--import" && i + 1 < argc)
+		{
+			importPaths.push_back(args[++i]);
+		}
+		else if (arg == "--replicate" && i + 3 < argc)
+		{
+			int roomsX = atoi(args[++i]);
+			int roomsZ = atoi(args[++i]);
+			int floors = atoi(args[++i]);
+			sceneReplicator.setGrid(roomsX, roomsZ, floors);
+		}
+		else if (arg == "--replicate-objects" && i + 1 < argc)
+		{
+			sceneReplicator.setObjectTarget((unsigned int)atoi(args[++i]));
+		}
+		else if (arg == "--seed" && i + 1 < argc)
+		{
+			sceneReplicator.seed = (unsigned int)atoi(args[++i]);
+		}
+		else if (arg == "--hud")
+		{
+			hud.visible = true;
+		}
+		else if (arg == "--animate")
+		{
+			sceneAnimation.looping = true;
+		}
+		else if (arg == "--ceiling-lamp")
+		{
+			ceilingLampStatus = true;
+		}
+		else if (arg == "--night-lamp")
+		{
+			nightLampStatus = true;
+		}
+	}
+
+	//a trace is replayed in a hidden window of its own, without the scene or any of the renderers
+	if (!replayPath.empty())
+	{
+		return replayTrace(replayPath) ? 0 : 1;
+	}
+
+	threadPool.init();
+	registerMeshes(importPaths);
+	initAnimation();
+	initSoftwareRenderer();
+
+	//the replicated scene is built once up front, the classic path streams as much of it as fits a frame
+	if (sceneReplicator.enabled)
+	{
+		recordScene();
+		sceneReplicator.printStats();
+		frameObjectLimit = (unsigned int)std::min(sceneObjects.size(), (size_t)maxReplicatedFrameObjects);
+		frameObjectLimit = std::max(frameObjectLimit, maxFrameObjects);
+		if (sceneObjects.size() > frameObjectLimit)
+		{
+			std::cout << "The classic path draws the first " << frameObjectLimit << " objects, press G for GPU-driven rendering of all of them" << std::endl;
+		}
+	}
+
+	//like the software renderer, ray queries run without a window or GL context
+	if (rayBenchmark)
+	{
+		runRayQueryBenchmark();
+		threadPool.release();
+		return 0;
+	}
+
+	//the software renderer runs without a window or GL context
+	if (!softwarePath.empty() || softwareScaling)
+	{
+		recordScene();
+		if (softwareScaling)
+		{
+			runSoftwareScaling();
+		}
+		if (!softwarePath.empty())
+		{
+			SoftwareRenderStats stats = renderSoftware(threadPool);
+			std::vector<unsigned char> png;
+			FrameCapture::encodePNG(softwareRenderer.getImage(), softwareRenderer.getWidth(), softwareRenderer.getHeight(), png);
+			std::ofstream file(softwarePath.c_str(), std::ios::binary);
+			file.write((const char*)png.data(), png.size());
+			std::cout << "Software frame: " << stats.totalMilliseconds << " ms on " << stats.threads << " threads, written to " << softwarePath << std::endl;
+		}
+		threadPool.release();
+		return 0;
+	}
+
+	if (fixedRenderScale > 0.0f)
+	{
+		dynamicResolution.setFixedScale(fixedRenderScale);
+	}
+
+	shaderVariants.init("./Shaders/vertex.vert", "./Shaders/fragment.frag", initSceneShader);
+	requestStartupShaders();
+	startupLoader.startReading(threadPool);
+
+	//nothing can be drawn without the window, the context and the buffers every frame writes to
+	if (!init())
+	{
+		std::cout << "ERROR::MAIN::INIT_FAILED" << std::endl;
+		//close() releases GL objects, without a context only the threads and SDL are left to stop
+		if (gContext != NULL)
+		{
+			close();
+		}
+		else
+		{
+			startupLoader.stopReading();
+			threadPool.release();
+			SDL_DestroyWindow(gWindow);
+			SDL_Quit();
+		}
+		return 1;
+	}
+
 	SDL_Event event;
 	bool quit = false;
 
+	if (walkthroughMode)
+	{
+		//measure the real frame rate, not the display refresh
+		SDL_GL_SetSwapInterval(0);
+	}
+
+	if (lightmapsRequested)
+	{
+		lightmapsBaked = bakeLightmaps();
+		lightmapMode = lightmapsBaked;
+		shader = &shaderVariants.get(getShaderFeatures());
+	}
+
+	if (postBenchmark)
+	{
+		runPostBenchmark();
+		quit = true;
+	}
+
+	if (ssaoBenchmark)
+	{
+		runSsaoBenchmark();
+		quit = true;
+	}
+
+	if (uploadBenchmark)
+	{
+		runUploadBenchmark();
+		quit = true;
+	}
+
+	int exitCode = 0;
+	if (allocationCheck)
+	{
+		exitCode = runAllocationCheck() ? 0 : 1;
+		quit = true;
+	}
+
+	if (captureRequested)
+	{
+		frameCapture.start(capturePath, windowWidth, windowHeight, captureFormat);
+	}
+
+	Uint64 walkthroughStart = SDL_GetPerformanceCounter();
+	unsigned int walkthroughFrames = 0;
+
 	std::cout << "Press W for moving forward" << std::endl;
 	std::cout << "Press A for moving left" << std::endl;
 	std::cout << "Press S for moving backwards" << std::endl;
@@ -83,11 +639,30 @@ int main(int argc, char* args[])
 	std::cout << "Press 1 for ceiling lamp" << std::endl;
 	std::cout << "Press 2 for night stand lamp" << std::endl;
 	std::cout << std::endl;
+	std::cout << "Press C to start/stop capturing frames" << std::endl;
+	std::cout << "Press G to toggle GPU-driven rendering" << std::endl;
+	std::cout << "Press H to toggle hi-z occlusion culling in GPU-driven mode" << std::endl;
+	std::cout << "Press I to toggle packed instance records in GPU-driven mode" << std::endl;
+	std::cout << "Press L to toggle baked lightmaps (baked on first use)" << std::endl;
+	std::cout << "Press B to toggle bloom" << std::endl;
+	std::cout << "Press O to cycle the SSAO resolution and quality, the last step switches it off" << std::endl;
+	std::cout << "Press X to cycle the mirror reflection resolution, the last step switches it off" << std::endl;
+	std::cout << "Press V to toggle dynamic resolution" << std::endl;
+	std::cout << "Press P to compare the frame with the software renderer" << std::endl;
+	std::cout << "Press M to print the memory use of every subsystem" << std::endl;
+	std::cout << "Press K to toggle camera collision" << std::endl;
+	std::cout << "Press E to open or close the doors and drawers" << std::endl;
+	std::cout << "Press F1 to toggle the performance overlay" << std::endl;
+	std::cout << std::endl;
 	std::cout << "Use mouse scroll to zoom in and out" << std::endl;
 	std::cout << "Use mouse movement to change the view angle" << std::endl;
+	std::cout << "Click an object to select it" << std::endl;
+
+	Uint64 previousFrameStart = SDL_GetPerformanceCounter();
 
 	while (!quit)
 	{
+		Uint64 frameStart = SDL_GetPerformanceCounter();
 
 		float currentFrame = SDL_GetTicks() / 1000.0f;
 		deltaTime = currentFrame - lastFrame;
@@ -124,18 +699,88 @@ int main(int argc, char* args[])
 			case SDL_MOUSEWHEEL:
 				handleMouseWheel(event.wheel);
 				break;
+
+			case SDL_MOUSEBUTTONDOWN:
+				if (event.button.button == SDL_BUTTON_LEFT)
+				{
+					pickObject(event.button.x, event.button.y);
+				}
+				break;
+
+			case SDL_WINDOWEVENT:
+				if (event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+				{
+					handleWindowResize(event.window.data1, event.window.data2);
+				}
+				break;
 			}
 
 		}
 
+		if (walkthroughMode)
+		{
+			updateWalkthrough(walkthroughFrameStep);
+			walkthroughFrames++;
+			if (walkthroughTime >= walkthroughSegmentDuration * (sizeof(walkthroughKeys) / sizeof(walkthroughKeys[0]) - 1))
+			{
+				quit = true;
+			}
+		}
+
+		startupLoader.update();
+		updateRenderSize();
 		render();
 
+		//the CPU time covers the events and the recording of the frame, not the wait for the swap
+		double ticksPerMillisecond = SDL_GetPerformanceFrequency() / 1000.0;
+		hud.addSample((float)((frameStart - previousFrameStart) / ticksPerMillisecond),
+			(float)((SDL_GetPerformanceCounter() - frameStart) / ticksPerMillisecond), (float)frameGraph.getFrameMilliseconds());
+		previousFrameStart = frameStart;
+
+		if (softwareCompareRequested)
+		{
+			compareWithSoftware();
+			softwareCompareRequested = false;
+		}
+
+		frameCapture.captureFrame();
+
 		SDL_GL_SwapWindow(gWindow);
+		startupLoader.firstFramePresented();
+		glTrace.endFrame();
 	}
 
+	if (walkthroughMode)
+	{
+		double seconds = (double)(SDL_GetPerformanceCounter() - walkthroughStart) / SDL_GetPerformanceFrequency();
+		std::cout << "Walkthrough: " << walkthroughFrames << " frames in " << seconds << " s, "
+			<< (walkthroughFrames / seconds) << " fps, " << (seconds * 1000.0 / walkthroughFrames) << " ms/frame" << std::endl;
+	}
+
+	std::cout << "Stream buffer: " << streamBuffer.stats.bytesStreamed << " bytes streamed, "
+		<< streamBuffer.stats.frameBytesStreamed << " bytes last frame, "
+		<< streamBuffer.stats.fenceWaits << " fence waits (" << streamBuffer.stats.fenceWaitMilliseconds << " ms)" << std::endl;
+	uploadWorker.printStats();
+	if (gpuDrivenRenderer.isScenePacked())
+	{
+		gpuDrivenRenderer.getPackedInstances().printStats();
+	}
+	sceneAnimation.printStats();
+	planarReflection.printStats();
+	glState.printStats();
+	frameGraph.printStats();
+	frameGraph.printTimings();
+	dynamicResolution.printStats();
+	frameArena.printStats();
+	startupLoader.printStats();
+	std::cout << "Shader variants compiled: " << shaderVariants.getVariantCount() << std::endl;
+	printMemoryStats();
+
+	frameCapture.stop();
+
 	close();
 
-	return 0;
+	return exitCode;
 }
 
 
@@ -144,19 +789,19 @@ void handleKeyDown(const SDL_KeyboardEvent& key)
 	switch (key.keysym.sym)
 	{
 	case SDLK_a:
-		camera.ProcessKeyboard(LEFT, deltaTime);
+		moveCamera(LEFT);
 		break;
 
 	case SDLK_d:
-		camera.ProcessKeyboard(RIGHT, deltaTime);
+		moveCamera(RIGHT);
 		break;
 
 	case SDLK_w:
-		camera.ProcessKeyboard(FORWARD, deltaTime);
+		moveCamera(FORWARD);
 		break;
 
 	case SDLK_s:
-		camera.ProcessKeyboard(BACKWARD, deltaTime);
+		moveCamera(BACKWARD);
 		break;
 
 	case SDLK_r:
@@ -172,7 +817,8 @@ void handleKeyDown(const SDL_KeyboardEvent& key)
 			ceilingLampStatus = true;
 		}
 
-		shader.setBool("ceilingLampStatus", ceilingLampStatus);
+		shader = &shaderVariants.get(getShaderFeatures());
+		switchLampRecords();
 		break;
 
 
@@ -185,156 +831,1291 @@ void handleKeyDown(const SDL_KeyboardEvent& key)
 			nightLampStatus = true;
 		}
 
-		shader.setBool("nightLampStatus", nightLampStatus);
+		shader = &shaderVariants.get(getShaderFeatures());
+		switchLampRecords();
 		break;
 
-	}
-}
+	case SDLK_c:
+		if (frameCapture.isActive())
+		{
+			frameCapture.stop();
+		}
+		else {
+			frameCapture.start(capturePath, windowWidth, windowHeight, captureFormat);
+		}
+		break;
 
-void handleMouseMotion(const SDL_MouseMotionEvent& motion) {
-	if (firstMouse)
-	{
-		lastX = motion.x;
-		lastY = motion.y;
-		firstMouse = false;
-	}
-	else
-	{
-		camera.ProcessMouseMovement(motion.x - lastX, lastY - motion.y);
-		lastX = motion.x;
-		lastY = motion.y;
-	}
-}
+	case SDLK_g:
+		gpuDrivenMode = !gpuDrivenMode;
+		if (gpuDrivenMode)
+		{
+			gpuDrivenRenderer.finishShaders();
+		}
+		shader = &shaderVariants.get(getShaderFeatures());
+		break;
 
-void handleMouseWheel(const SDL_MouseWheelEvent& wheel) {
-	camera.ProcessMouseScroll(wheel.y);
-}
+	case SDLK_h:
+		gpuDrivenRenderer.occlusionCulling = !gpuDrivenRenderer.occlusionCulling;
+		break;
 
+	case SDLK_i:
+		gpuDrivenRenderer.packedInstances = !gpuDrivenRenderer.packedInstances;
+		shader = &shaderVariants.get(getShaderFeatures());
+		sceneDirty = true;
+		break;
 
-bool init()
-{
-	bool success = true;
+	case SDLK_p:
+		softwareCompareRequested = true;
+		break;
 
-	if (SDL_Init(SDL_INIT_VIDEO) < 0)
-	{
-		printf("SDL could not initialize! SDL Error: %s\n", SDL_GetError());
-		success = false;
-	}
-	else
-	{
-		SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
-		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
-		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+	case SDLK_b:
+		postProcess.bloom = !postProcess.bloom;
+		break;
 
-		gWindow = SDL_CreateWindow("3D room", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 1280, 720, SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN);
+	case SDLK_o:
+		ssao.cycleSetting();
+		break;
 
-		if (gWindow == NULL)
+	case SDLK_x:
+		planarReflection.cycleSetting();
+		break;
+
+	case SDLK_m:
+		printMemoryStats();
+		break;
+
+	case SDLK_k:
+		cameraCollision = !cameraCollision;
+		std::cout << "Camera collision " << (cameraCollision ? "on" : "off") << std::endl;
+		break;
+
+	case SDLK_F1:
+		hud.toggle();
+		break;
+
+	case SDLK_e:
+		sceneAnimation.toggle();
+		std::cout << (sceneAnimation.isOpening() ? "Opening" : "Closing") << " the doors and drawers" << std::endl;
+		break;
+
+	case SDLK_v:
+		dynamicResolution.enabled = !dynamicResolution.enabled;
+		if (!dynamicResolution.enabled)
 		{
-			printf("Window could not be created! SDL Error: %s\n", SDL_GetError());
-			success = false;
+			dynamicResolution.reset();
 		}
-		else
-		{
-			gContext = SDL_GL_CreateContext(gWindow);
-			if (gContext == NULL)
-			{
-				printf("OpenGL context could not be created! SDL Error: %s\n", SDL_GetError());
-				success = false;
-			}
-			else
-			{
-				//Use Vsync
-				if (SDL_GL_SetSwapInterval(1) < 0)
-				{
-					printf("Warning: Unable to set VSync! SDL Error: %s\n", SDL_GetError());
-				}
+		break;
 
-				//Initialize OpenGL
-				if (!initGL())
-				{
-					printf("Unable to initialize OpenGL!\n");
-					success = false;
-				}
-			}
+	case SDLK_l:
+		if (!lightmapsBaked)
+		{
+			lightmapsBaked = bakeLightmaps();
 		}
+		lightmapMode = lightmapsBaked && !lightmapMode;
+		shader = &shaderVariants.get(getShaderFeatures());
+		break;
 
 	}
-
-	return success;
 }
 
-
-bool initGL()
+void updateWalkthrough(float step)
 {
-	bool success = true;
-	GLenum error = GL_NO_ERROR;
-
-	glewInit();
+	const int keyCount = sizeof(walkthroughKeys) / sizeof(walkthroughKeys[0]);
 
-	error = glGetError();
+	walkthroughTime += step;
 
-	if (error != GL_NO_ERROR)
+	int segment = (int)(walkthroughTime / walkthroughSegmentDuration);
+	if (segment >= keyCount - 1)
 	{
-		printf("Error initializing OpenGL! %s\n", gluErrorString(error));
-		success = false;
+		segment = keyCount - 2;
 	}
 
-	glClearColor(0, 0, 0, 1);
-
-	shader.Load("./Shaders/vertex.vert", "./Shaders/fragment.frag");
-	shader.use();
-
-	shader.setVec3("ceilingLampLight.diffuse", glm::vec3(1.0f, 1.0f, 1.0f));
-	shader.setVec3("ceilingLampLight.position", ceilingLightPosition);
+	float t = glm::clamp(walkthroughTime / walkthroughSegmentDuration - segment, 0.0f, 1.0f);
+	t = t * t * (3.0f - 2.0f * t);
 
-	shader.setVec3("nightLampLight.diffuse", glm::vec3(1.0f, 1.0f, 1.0f));
-	shader.setVec3("nightLampLight.position", nightLampLightPosition);
-	shader.setVec3("nightLampLightDirection", nightLampLightDirection);
+	const WalkthroughKey& from = walkthroughKeys[segment];
+	const WalkthroughKey& to = walkthroughKeys[segment + 1];
 
-	shader.setFloat("nightLampLightCutOff", glm::cos(glm::radians(35.0f)));
-
-	shader.setFloat("nightLampLightOuterCutOff", glm::cos(glm::radians(40.0f)));
+	camera = Camera(glm::mix(from.position, to.position, t), glm::vec3(0.0f, 1.0f, 0.0f),
+		glm::mix(from.yaw, to.yaw, t), glm::mix(from.pitch, to.pitch, t));
+}
 
-	gVertexArrayObjectCube = createCube();
+//bakes one irradiance map per lamp on all cores and uploads the atlas, the scene geometry is static
+bool bakeLightmaps()
+{
+	//every object gets its own atlas rectangle, that does not scale to a replicated scene
+	if (sceneReplicator.enabled)
+	{
+		std::cout << "Lightmaps are not baked for replicated scenes" << std::endl;
+		return false;
+	}
 
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	recordScene();
 
-	glEnable(GL_DEPTH_TEST);
+	MemoryScope scope(MEMORY_TAG_LIGHTMAPS);
 
-	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	std::vector<LightmapLight> lights(2);
+	lights[0].position = ceilingLightPosition;
+	lights[0].color = glm::vec3(1.0f, 1.0f, 1.0f);
 
-	return success;
-}
+	lights[1].position = nightLampLightPosition;
+	lights[1].color = glm::vec3(1.0f, 1.0f, 1.0f);
+	lights[1].spot = true;
+	lights[1].direction = nightLampLightDirection;
+	lights[1].cutOff = glm::cos(glm::radians(35.0f));
+	lights[1].outerCutOff = glm::cos(glm::radians(40.0f));
 
-void close()
-{
-	glDeleteProgram(shader.ID);
+	LightmapBaker baker;
+	baker.init(sceneObjects, lights);
 
-	glDeleteVertexArrays(1, &gVertexArrayObjectCube);
+	std::vector<glm::vec3> irradiance;
 
+	if (bakeScalingReport)
+	{
+		//same bake with a growing number of threads
+		double singleThreadRate = 0.0;
+		unsigned int maxThreads = threadPool.getThreadCount();
+		for (unsigned int threads = 1; ; threads = threads * 2 < maxThreads ? threads * 2 : maxThreads)
+		{
+			ThreadPool pool;
+			pool.init(threads);
+			LightmapBakeStats stats = baker.bake(lights[0], pool, irradiance);
+			if (threads == 1)
+			{
+				singleThreadRate = stats.raysPerSecond();
+			}
+			std::cout << "Bake scaling: " << threads << " threads, " << stats.raysPerSecond() / 1e6 << " Mrays/s, "
+				<< stats.raysPerSecond() / singleThreadRate << "x" << std::endl;
+			if (threads == maxThreads)
+			{
+				break;
+			}
+		}
+	}
+
+	for (int i = 0; i < 2; i++)
+	{
+		LightmapBakeStats stats = baker.bake(lights[i], threadPool, irradiance);
+		std::cout << "Lightmap " << i << ": " << baker.getWidth() << "x" << baker.getHeight() << ", " << stats.texels << " texels, "
+			<< stats.rays << " rays in " << stats.seconds << " s on " << stats.threads << " threads ("
+			<< stats.raysPerSecond() / 1e6 << " Mrays/s)" << std::endl;
+
+		gLightmapTextures[i] = gpuMemory.createTexture2D(1, GL_RGB16F, baker.getWidth(), baker.getHeight());
+		glTextureSubImage2D(gLightmapTextures[i], 0, 0, 0, baker.getWidth(), baker.getHeight(), GL_RGB, GL_FLOAT, irradiance.data());
+		glTextureParameteri(gLightmapTextures[i], GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTextureParameteri(gLightmapTextures[i], GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTextureParameteri(gLightmapTextures[i], GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTextureParameteri(gLightmapTextures[i], GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+
+	const std::vector<LightmapRects>& rects = baker.getRects();
+	gLightmapRectBuffer = gpuMemory.createBuffer(rects.size() * sizeof(LightmapRects), rects.data(), 0);
+
+	return true;
+}
+
+void bindLightmaps()
+{
+	if (!lightmapMode)
+	{
+		return;
+	}
+
+	glState.bindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHTMAP_RECTS_BINDING, gLightmapRectBuffer);
+	glState.bindTextureUnit(CEILING_LAMP_LIGHTMAP_UNIT, gLightmapTextures[0]);
+	glState.bindTextureUnit(NIGHT_LAMP_LIGHTMAP_UNIT, gLightmapTextures[1]);
+}
+
+void initSoftwareRenderer()
+{
+	GLuint indices[36];
+	getCubeIndices(indices);
+	softwareRenderer.setMesh(cubeVertices, cubeVertexCount, indices, 36);
+	softwareRenderer.resize(windowWidth, windowHeight);
+}
+
+//the uniforms initSceneShader() and the lamp variants give the GL path
+SoftwareShading getSoftwareShading()
+{
+	SoftwareShading shading;
+
+	shading.ceilingLamp.enabled = ceilingLampStatus;
+	shading.ceilingLamp.position = ceilingLightPosition;
+	shading.ceilingLamp.diffuse = glm::vec3(1.0f, 1.0f, 1.0f);
+
+	shading.nightLamp.enabled = nightLampStatus;
+	shading.nightLamp.position = nightLampLightPosition;
+	shading.nightLamp.diffuse = glm::vec3(1.0f, 1.0f, 1.0f);
+	shading.nightLampDirection = nightLampLightDirection;
+	shading.nightLampCutOff = glm::cos(glm::radians(35.0f));
+	shading.nightLampOuterCutOff = glm::cos(glm::radians(40.0f));
+	shading.exposure = postProcess.exposure;
+	shading.shoulderStart = postProcess.shoulderStart;
+
+	return shading;
+}
+
+//renders the recorded scene from the current camera
+SoftwareRenderStats renderSoftware(ThreadPool& pool)
+{
+	FrameData frame = getFrameData();
+	SoftwareShading shading = getSoftwareShading();
+	return softwareRenderer.render(sceneObjects, frame, shading, pool);
+}
+
+//same frame with a growing number of threads, the best of a few runs each
+void runSoftwareScaling()
+{
+	const int runs = 5;
+	double singleThreadMilliseconds = 0.0;
+	unsigned int maxThreads = threadPool.getThreadCount();
+	for (unsigned int threads = 1; ; threads = threads * 2 < maxThreads ? threads * 2 : maxThreads)
+	{
+		ThreadPool pool;
+		pool.init(threads);
+
+		SoftwareRenderStats best;
+		for (int i = 0; i < runs; i++)
+		{
+			SoftwareRenderStats stats = renderSoftware(pool);
+			if (i == 0 || stats.totalMilliseconds < best.totalMilliseconds)
+			{
+				best = stats;
+			}
+		}
+		if (threads == 1)
+		{
+			singleThreadMilliseconds = best.totalMilliseconds;
+		}
+
+		std::cout << "Software scaling: " << threads << " threads, " << best.totalMilliseconds << " ms (geometry "
+			<< best.geometryMilliseconds << ", binning " << best.binningMilliseconds << ", raster " << best.rasterMilliseconds << "), "
+			<< singleThreadMilliseconds / best.totalMilliseconds << "x, " << best.triangles << " triangles" << std::endl;
+
+		if (threads == maxThreads)
+		{
+			break;
+		}
+	}
+}
+
+//renders the current view on the CPU and diffs it against the GL back buffer
+void compareWithSoftware()
+{
+	softwareRenderer.resize(windowWidth, windowHeight);
+	recordScene();
+	SoftwareRenderStats stats = renderSoftware(threadPool);
+	const std::vector<unsigned char>& software = softwareRenderer.getImage();
+
+	std::vector<unsigned char> hardware(software.size());
+	glState.bindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	glReadPixels(0, 0, softwareRenderer.getWidth(), softwareRenderer.getHeight(), GL_RGBA, GL_UNSIGNED_BYTE, hardware.data());
+
+	unsigned long long differenceSum = 0;
+	unsigned int differentPixels = 0;
+	size_t pixelCount = software.size() / 4;
+	for (size_t i = 0; i < pixelCount; i++)
+	{
+		int maxDifference = 0;
+		for (int c = 0; c < 3; c++)
+		{
+			int difference = std::abs((int)software[i * 4 + c] - (int)hardware[i * 4 + c]);
+			differenceSum += difference;
+			maxDifference = std::max(maxDifference, difference);
+		}
+		if (maxDifference > 8)
+		{
+			differentPixels++;
+		}
+	}
+
+	std::vector<unsigned char> png;
+	FrameCapture::encodePNG(software, softwareRenderer.getWidth(), softwareRenderer.getHeight(), png);
+	std::ofstream("software.png", std::ios::binary).write((const char*)png.data(), png.size());
+	FrameCapture::encodePNG(hardware, softwareRenderer.getWidth(), softwareRenderer.getHeight(), png);
+	std::ofstream("gl.png", std::ios::binary).write((const char*)png.data(), png.size());
+
+	std::cout << "Software comparison: " << stats.totalMilliseconds << " ms on " << stats.threads << " threads, mean difference "
+		<< (double)differenceSum / (pixelCount * 3) << ", " << 100.0 * differentPixels / pixelCount
+		<< "% pixels off by more than 8 (software.png, gl.png)" << std::endl;
+}
+
+void handleMouseMotion(const SDL_MouseMotionEvent& motion) {
+	if (firstMouse)
+	{
+		lastX = motion.x;
+		lastY = motion.y;
+		firstMouse = false;
+	}
+	else
+	{
+		camera.ProcessMouseMovement(motion.x - lastX, lastY - motion.y);
+		lastX = motion.x;
+		lastY = motion.y;
+	}
+}
+
+void handleMouseWheel(const SDL_MouseWheelEvent& wheel) {
+	camera.ProcessMouseScroll(wheel.y);
+}
+
+void handleWindowResize(int width, int height)
+{
+	windowWidth = width > 1 ? width : 1;
+	windowHeight = height > 1 ? height : 1;
+
+	//the capture files have a fixed frame size
+	if (frameCapture.isActive())
+	{
+		frameCapture.stop();
+		std::cout << "Capture stopped, the window was resized" << std::endl;
+	}
+}
+
+//picks the render size for the next frame from the GPU time of the last measured one
+void updateRenderSize()
+{
+	dynamicResolution.update(frameGraph.getFrameMilliseconds());
+	dynamicResolution.getRenderSize(windowWidth, windowHeight, renderWidth, renderHeight);
+}
+
+
+//what the overlay shows of the last completed frame
+HudCounters getHudCounters()
+{
+	HudCounters counters;
+	counters.renderWidth = renderWidth;
+	counters.renderHeight = renderHeight;
+	counters.windowWidth = windowWidth;
+	counters.windowHeight = windowHeight;
+	counters.state = glState.lastFrameStats;
+	if (gpuDrivenMode)
+	{
+		counters.objects = gpuDrivenRenderer.getObjectCount();
+		counters.submitted = gpuDrivenRenderer.getVisibleCount();
+	}
+	else
+	{
+		//the classic path does not cull, a replicated scene is cut off at the frame object limit instead
+		counters.objects = frameObjectCount;
+		counters.submitted = frameObjectCount;
+	}
+	counters.cpuBytes = cpuMemory.live[MEMORY_TAG_COUNT];
+	counters.gpuBytes = gpuMemory.counters.live[MEMORY_TAG_COUNT];
+	return counters;
+}
+
+
+bool init()
+{
+	bool success = true;
+
+	if (SDL_Init(SDL_INIT_VIDEO) < 0)
+	{
+		printf("SDL could not initialize! SDL Error: %s\n", SDL_GetError());
+		success = false;
+	}
+	else
+	{
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 5);
+
+		gWindow = SDL_CreateWindow("3D room", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, windowWidth, windowHeight, SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
+
+		if (gWindow == NULL)
+		{
+			printf("Window could not be created! SDL Error: %s\n", SDL_GetError());
+			success = false;
+		}
+		else
+		{
+			gContext = SDL_GL_CreateContext(gWindow);
+			if (gContext == NULL)
+			{
+				printf("OpenGL context could not be created! SDL Error: %s\n", SDL_GetError());
+				success = false;
+			}
+			else
+			{
+				//the upload worker's context, creating it makes it current so the render context is made current again
+				SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1);
+				gUploadContext = SDL_GL_CreateContext(gWindow);
+				if (gUploadContext == NULL)
+				{
+					printf("Warning: Unable to create the upload context, uploads stay on the render thread! SDL Error: %s\n", SDL_GetError());
+				}
+				SDL_GL_MakeCurrent(gWindow, gContext);
+
+				//Use Vsync
+				if (SDL_GL_SetSwapInterval(1) < 0)
+				{
+					printf("Warning: Unable to set VSync! SDL Error: %s\n", SDL_GetError());
+				}
+
+				//Initialize OpenGL
+				if (!initGL())
+				{
+					printf("Unable to initialize OpenGL!\n");
+					success = false;
+				}
+			}
+		}
+
+	}
+
+	return success;
+}
+
+
+bool initGL()
+{
+	bool success = true;
+	GLenum error = GL_NO_ERROR;
+
+	glewInit();
+
+	//the trace starts with the context, so the replay creates every object it uses
+	if (!tracePath.empty())
+	{
+		glTrace.start(tracePath, windowWidth, windowHeight, traceFrames);
+	}
+
+	error = glGetError();
+
+	if (error != GL_NO_ERROR)
+	{
+		printf("Error initializing OpenGL! %s\n", gluErrorString(error));
+		success = false;
+	}
+
+	//the programs whose sources are in compile while the buffers are created
+	startupLoader.contextCreated();
+	startupLoader.submit(false);
+
+	glClearColor(0, 0, 0, 1);
+
+	gSceneVertexArray = createGeometry();
+
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformBufferAlignment);
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storageBufferAlignment);
+
+	GLsizeiptr streamBytesPerFrame = 2 * (sizeof(FrameData) + uniformBufferAlignment) + frameObjectLimit * sizeof(ObjectData) + storageBufferAlignment
+		+ Hud::MAX_QUADS * sizeof(HudQuad) + storageBufferAlignment;
+	if (!streamBuffer.init(streamBytesPerFrame))
+	{
+		printf("Unable to create the stream buffer!\n");
+		success = false;
+	}
+	if (gUploadContext != NULL && !uploadWorker.init(gWindow, gUploadContext))
+	{
+		printf("Warning: Unable to start the upload worker!\n");
+	}
+	objectTransforms.init(frameObjectLimit);
+	{
+		MemoryScope scope(MEMORY_TAG_STREAMING);
+		frameObjectMeshes.assign(frameObjectLimit, CUBE_MESH);
+		frameTranslucentObjects.assign(frameObjectLimit, 0);
+		frameObjectBounds.assign(frameObjectLimit, ObjectBounds());
+	}
+
+	startupLoader.submit(false);
+
+	if (!gpuDrivenRenderer.init(renderWidth, renderHeight))
+	{
+		printf("GPU-driven rendering is not available!\n");
+		gpuDrivenMode = false;
+	}
+
+	postProcess.init();
+	hud.init(streamBuffer, storageBufferAlignment);
+
+	//the front face of the mirror cube, generateDefaultTransformCube() makes the unit cube 3 long
+	planarReflection.init();
+	planarReflection.setMirror(mirrorPosition + glm::vec3(0.0f, 0.0f, 3.0f * mirrorScale.z),
+		glm::vec3(3.0f * mirrorScale.x, 0.0f, 0.0f), glm::vec3(0.0f, 3.0f * mirrorScale.y, 0.0f));
+
+	frameArena.init(frameArenaCapacity);
+
+	startupLoader.finishRequired();
+	shader = &shaderVariants.get(getShaderFeatures());
+	shader->use();
+
+	glState.setEnabled(GL_BLEND, true);
+	glState.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	glState.setEnabled(GL_DEPTH_TEST, true);
+
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+	return success;
+}
+
+//the programs of the first frame are required. In parallel startup the other lamp combinations and the
+//GPU-driven programs keep compiling while the first frames are shown, serial startup loads what it used to.
+void requestStartupShaders()
+{
+	shaderVariants.request(startupLoader, getShaderFeatures(), true);
+	shaderVariants.request(startupLoader, getShaderFeatures() | FEATURE_TRANSLUCENT, true);
+	objectTransforms.requestShaders(startupLoader);
+	postProcess.requestShaders(startupLoader);
+	ssao.requestShaders(startupLoader);
+	translucency.requestShaders(startupLoader);
+	planarReflection.requestShaders(startupLoader);
+	hud.requestShaders(startupLoader);
+	gpuDrivenRenderer.requestShaders(startupLoader, gpuDrivenMode || startupLoader.serial);
+
+	if (startupLoader.serial)
+	{
+		return;
+	}
+
+	const unsigned int lampFeatures[4] = { 0, FEATURE_CEILING_LAMP, FEATURE_NIGHT_LAMP | FEATURE_NIGHT_LAMP_SPOT,
+		FEATURE_CEILING_LAMP | FEATURE_NIGHT_LAMP | FEATURE_NIGHT_LAMP_SPOT };
+	for (int i = 0; i < 4; i++)
+	{
+		shaderVariants.request(startupLoader, lampFeatures[i], false);
+		shaderVariants.request(startupLoader, lampFeatures[i] | FEATURE_TRANSLUCENT, false);
+	}
+}
+
+void close()
+{
+	glTrace.stop();
+	startupLoader.finishAll();
+	shaderVariants.release();
+	shader = NULL;
+
+	uploadWorker.release();
+	streamBuffer.release();
+	objectTransforms.release();
+	gpuDrivenRenderer.release();
+	frameGraph.release();
+	postProcess.release();
+	ssao.release();
+	translucency.release();
+	planarReflection.release();
+	hud.release();
+	frameArena.release();
+
+	glState.deleteTextures(2, gLightmapTextures);
+	glState.deleteBuffers(1, &gLightmapRectBuffer);
+	threadPool.release();
+
+	meshRegistry.release();
+	glState.deleteBuffers(1, &gObjectIndexBuffer);
+
+	gpuMemory.printLeaks();
+
+	if (gUploadContext != NULL)
+	{
+		SDL_GL_DeleteContext(gUploadContext);
+		gUploadContext = NULL;
+	}
 	SDL_GL_DeleteContext(gContext);
 
-	SDL_DestroyWindow(gWindow);
-	gWindow = NULL;
+	SDL_DestroyWindow(gWindow);
+	gWindow = NULL;
+
+	SDL_Quit();
+}
+
+void render()
+{
+	uploadWorker.update();
+	streamBuffer.beginFrame();
+	glState.beginFrame();
+
+	FrameData frame = getFrameData();
+
+	StreamAllocation frameBlock = streamBuffer.allocate(sizeof(FrameData), uniformBufferAlignment);
+	*(FrameData*)frameBlock.data = frame;
+	streamBuffer.written(frameBlock.data, sizeof(FrameData));
+	glState.bindBufferRange(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, streamBuffer.ID, frameBlock.offset, sizeof(FrameData));
+	frameDataOffset = frameBlock.offset;
+
+	//before anything moves, so the objects that do can be tested against the mirrored view
+	planarReflection.beginFrame(frame, renderWidth, renderHeight, getShaderFeatures());
+
+	if (!sceneRecorded && (gpuDrivenMode || sceneReplicator.enabled))
+	{
+		recordScene();
+	}
+
+	updateAnimation();
+
+	if (gpuDrivenMode && sceneDirty)
+	{
+		resizeObjectIndexBuffer((unsigned int)sceneObjects.size());
+		gpuDrivenRenderer.uploadScene(sceneObjects, sceneBounds, objectTransforms);
+		sceneDirty = false;
+		//the packed records are turned off again when the scene does not fit them
+		shader = &shaderVariants.get(getShaderFeatures());
+	}
+	else if (gpuDrivenMode)
+	{
+		gpuDrivenRenderer.updateRanges(sceneObjects, sceneBounds, sceneAnimation.getRanges(), objectTransforms);
+	}
+	else
+	{
+		recordFrameObjects();
+	}
+
+	frameGraph.reset();
+
+	FrameGraphResource sceneColor = frameGraph.createTexture("SceneColor", FrameGraphTextureDesc(renderWidth, renderHeight, GL_R11F_G11F_B10F));
+	FrameGraphResource sceneDepth = frameGraph.createTexture("SceneDepth", FrameGraphTextureDesc(renderWidth, renderHeight, GL_DEPTH_COMPONENT32F));
+	FrameGraphResource backbuffer = frameGraph.importBackbuffer("Backbuffer", windowWidth, windowHeight);
+
+	//declared first, so the reflection is rendered before the scene pass culls the main view
+	FrameGraphResource reflection = planarReflection.addReflectionPass(frameGraph, []() {
+		renderReflectionPass();
+	});
+
+	glm::mat4 viewProjection = frame.projection * frame.view;
+	int scenePass = frameGraph.addPass("Scene", [viewProjection](const FrameGraph&) {
+		hud.beginPrimitiveQuery();
+		renderScenePass(viewProjection);
+		hud.endPrimitiveQuery();
+	});
+	frameGraph.writeColor(scenePass, sceneColor);
+	frameGraph.writeDepth(scenePass, sceneDepth);
+
+	//the ambient term and the normals go to extra targets of the scene pass, SSAO darkens the ambient part
+	if (ssao.enabled)
+	{
+		FrameGraphResource sceneAmbient = frameGraph.createTexture("SceneAmbient", FrameGraphTextureDesc(renderWidth, renderHeight, GL_R11F_G11F_B10F));
+		FrameGraphResource sceneNormal = frameGraph.createTexture("SceneNormal", FrameGraphTextureDesc(renderWidth, renderHeight, GL_RGB10_A2));
+		frameGraph.writeColor(scenePass, sceneAmbient);
+		frameGraph.writeColor(scenePass, sceneNormal);
+		ssao.addPasses(frameGraph, sceneColor, sceneAmbient, sceneNormal, sceneDepth);
+	}
+
+	//after SSAO, which would darken the reflection with the ambient term of the mirror cube
+	if (reflection >= 0)
+	{
+		planarReflection.addMirrorPass(frameGraph, reflection, sceneColor, sceneDepth);
+	}
+
+	//the depth pyramid outlives the frame, so the pass is never culled while occlusion culling is on
+	if (gpuDrivenMode && gpuDrivenRenderer.occlusionCulling)
+	{
+		if (gpuDrivenRenderer.getTargetWidth() != renderWidth || gpuDrivenRenderer.getTargetHeight() != renderHeight)
+		{
+			gpuDrivenRenderer.resize(renderWidth, renderHeight);
+		}
+
+		FrameGraphResource hiZ = frameGraph.importTexture("HiZ", gpuDrivenRenderer.getHiZTexture(),
+			FrameGraphTextureDesc(renderWidth, renderHeight, GL_R32F, gpuDrivenRenderer.getHiZLevels()));
+
+		int hiZPass = frameGraph.addPass("HiZ", [sceneDepth](const FrameGraph& graph) {
+			gpuDrivenRenderer.buildHiZ(graph.getTexture(sceneDepth));
+		});
+		frameGraph.read(hiZPass, sceneDepth);
+		frameGraph.write(hiZPass, hiZ);
+	}
+
+	//translucent objects are drawn after the opaque scene is complete
+	if (gpuDrivenMode ? gpuDrivenRenderer.getTranslucentCount() > 0 : frameTranslucentCount > 0)
+	{
+		translucency.addPasses(frameGraph, sceneColor, sceneDepth, []() {
+			renderTranslucentPass();
+		});
+	}
+
+	FrameGraphResource ldrColor = postProcess.addPasses(frameGraph, sceneColor);
+	postProcess.addPresentPass(frameGraph, ldrColor, backbuffer);
+
+	if (hud.visible)
+	{
+		hud.addPass(frameGraph, backbuffer, getHudCounters());
+	}
+
+	frameGraph.compile();
+	frameGraph.execute();
+
+	streamBuffer.endFrame();
+	glState.endFrame();
+	frameArena.reset();
+
+	//std::cout << glm::to_string(camera.Position) << std::endl;
+
+}
+
+//draws the scene into the targets the frame graph has bound
+void renderScenePass(const glm::mat4& viewProjection)
+{
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	if (gpuDrivenMode)
+	{
+		gpuDrivenRenderer.cull(viewProjection, meshRegistry.getRangeBuffer());
+
+		shader->use();
+		bindLightmaps();
+		gpuDrivenRenderer.draw(gSceneVertexArray);
+		return;
+	}
+
+	shader->use();
+	bindLightmaps();
+	//the passes since the records were written may have bound other buffers
+	objectTransforms.bindFrame(streamBuffer.ID, frameObjectOffset, frameObjectCount);
+	drawFrameObjects();
+}
+
+//records the objects of the classic path for every pass of the frame, before the passes are declared
+void recordFrameObjects()
+{
+	//reserve room for every object, the unused tail is handed back once the frame is recorded
+	StreamAllocation objectBlock = streamBuffer.allocate(frameObjectLimit * sizeof(ObjectData), storageBufferAlignment);
+	frameObjects = (ObjectData*)objectBlock.data;
+	frameObjectOffset = objectBlock.offset;
+	frameObjectCount = 0;
+	frameObjectCapacity = frameObjectLimit;
+	frameTranslucentCount = 0;
+
+	if (sceneReplicator.enabled)
+	{
+		drawRecordedScene();
+	}
+	else
+	{
+		drawScene();
+	}
+
+	//the matrices of every recorded object in one dispatch
+	objectTransforms.computeFrame(streamBuffer.ID, objectBlock.offset, frameObjectCount);
+
+	streamBuffer.trim(objectBlock, frameObjectCount * sizeof(ObjectData));
+}
+
+//draws the opaque scene from the mirrored camera into the reflection targets the frame graph has bound
+void renderReflectionPass()
+{
+	StreamAllocation frameBlock = streamBuffer.allocate(sizeof(FrameData), uniformBufferAlignment);
+	*(FrameData*)frameBlock.data = planarReflection.getReflectedFrame();
+	streamBuffer.written(frameBlock.data, sizeof(FrameData));
+	glState.bindBufferRange(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, streamBuffer.ID, frameBlock.offset, sizeof(FrameData));
+
+	if (gpuDrivenMode)
+	{
+		gpuDrivenRenderer.cull(planarReflection.getCullMatrix(), meshRegistry.getRangeBuffer(), false);
+
+		shader->use();
+		bindLightmaps();
+		gpuDrivenRenderer.draw(gSceneVertexArray);
+	}
+	else
+	{
+		shader->use();
+		bindLightmaps();
+		objectTransforms.bindFrame(streamBuffer.ID, frameObjectOffset, frameObjectCount);
+		drawFrameReflectedObjects();
+	}
+
+	glState.bindBufferRange(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, streamBuffer.ID, frameDataOffset, sizeof(FrameData));
+}
+
+//draws the objects the scene pass left out into the translucency targets the frame graph has bound
+void renderTranslucentPass()
+{
+	if (gpuDrivenMode ? gpuDrivenRenderer.getTranslucentCount() == 0 : frameTranslucentCount == 0)
+	{
+		return;
+	}
+
+	translucency.beginAccumulation();
+
+	shaderVariants.get(getShaderFeatures() | FEATURE_TRANSLUCENT).use();
+	bindLightmaps();
+	if (gpuDrivenMode)
+	{
+		gpuDrivenRenderer.drawTranslucent(gSceneVertexArray);
+	}
+	else
+	{
+		//the passes since the scene pass may have bound other buffers
+		objectTransforms.bindFrame(streamBuffer.ID, frameObjectOffset, frameObjectCount);
+		drawFrameTranslucentObjects();
+	}
+
+	translucency.endAccumulation();
+}
+
+//GPU times of the frame graph passes at common resolutions, the window keeps its size
+void runPostBenchmark()
+{
+	const int sizes[3][2] = { { 1280, 720 }, { 2560, 1440 }, { 3840, 2160 } };
+	const char* postPasses[3] = { "BloomDownsample", "BloomUpsample", "Tonemap" };
+	const int warmupFrames = 10;
+	const int measuredFrames = 60;
+
+	SDL_GL_SetSwapInterval(0);
+	startupLoader.finishAll();
+
+	for (int i = 0; i < 3; i++)
+	{
+		renderWidth = sizes[i][0];
+		renderHeight = sizes[i][1];
+
+		for (int frame = 0; frame < warmupFrames + measuredFrames; frame++)
+		{
+			if (frame == warmupFrames)
+			{
+				frameGraph.resetTimings();
+			}
+			render();
+			SDL_GL_SwapWindow(gWindow);
+		}
+
+		double postMilliseconds = 0.0;
+		for (int j = 0; j < 3; j++)
+		{
+			const FrameGraphPassTiming* timing = frameGraph.getTiming(postPasses[j]);
+			postMilliseconds += timing != NULL ? timing->getAverage() : 0.0;
+		}
+		const FrameGraphPassTiming* sceneTiming = frameGraph.getTiming("Scene");
+		double sceneMilliseconds = sceneTiming != NULL ? sceneTiming->getAverage() : 0.0;
+
+		std::cout << renderWidth << "x" << renderHeight << " ";
+		frameGraph.printTimings();
+		std::cout << renderWidth << "x" << renderHeight << " post chain " << postMilliseconds << " ms, "
+			<< (sceneMilliseconds > 0.0 ? 100.0 * postMilliseconds / sceneMilliseconds : 0.0) << "% of the scene pass" << std::endl;
+	}
+
+	updateRenderSize();
+}
+
+//GPU time of the SSAO passes at 1080p for every setting, the scene pass is measured without SSAO as well
+//because it writes two more targets with it
+void runSsaoBenchmark()
+{
+	const char* ssaoPasses[3] = { "SsaoOcclusion", "SsaoBlur", "SsaoApply" };
+	const int warmupFrames = 10;
+	const int measuredFrames = 60;
+
+	SDL_GL_SetSwapInterval(0);
+	startupLoader.finishAll();
+	renderWidth = 1920;
+	renderHeight = 1080;
+
+	bool wasEnabled = ssao.enabled;
+	int previousSetting = ssao.setting;
+	double sceneWithoutSsao = 0.0;
+
+	for (int i = -1; i < Ssao::SETTING_COUNT; i++)
+	{
+		ssao.enabled = i >= 0;
+		ssao.setting = i >= 0 ? i : 0;
+
+		for (int frame = 0; frame < warmupFrames + measuredFrames; frame++)
+		{
+			if (frame == warmupFrames)
+			{
+				frameGraph.resetTimings();
+			}
+			render();
+			SDL_GL_SwapWindow(gWindow);
+		}
+
+		const FrameGraphPassTiming* sceneTiming = frameGraph.getTiming("Scene");
+		double sceneMilliseconds = sceneTiming != NULL ? sceneTiming->getAverage() : 0.0;
+		if (i < 0)
+		{
+			sceneWithoutSsao = sceneMilliseconds;
+			std::cout << "SSAO off: scene pass " << sceneMilliseconds << " ms" << std::endl;
+			continue;
+		}
+
+		double passMilliseconds[3];
+		double ssaoMilliseconds = 0.0;
+		for (int j = 0; j < 3; j++)
+		{
+			const FrameGraphPassTiming* timing = frameGraph.getTiming(ssaoPasses[j]);
+			passMilliseconds[j] = timing != NULL ? timing->getAverage() : 0.0;
+			ssaoMilliseconds += passMilliseconds[j];
+		}
+
+		std::cout << "SSAO " << ssao.getSetting().name << ": " << ssaoMilliseconds << " ms (occlusion " << passMilliseconds[0]
+			<< ", blur " << passMilliseconds[1] << ", apply " << passMilliseconds[2] << "), scene pass "
+			<< sceneMilliseconds - sceneWithoutSsao << " ms slower with the extra targets" << std::endl;
+	}
+
+	ssao.enabled = wasEnabled;
+	ssao.setting = previousSetting;
+	updateRenderSize();
+}
+
+//streams 1 GB of synthetic assets, buffers and the mip chains of textures, into the GPU while the scene is
+//rendered: once through the upload worker and once with the uploads on the render thread, one asset a frame.
+//The worst frame is what the worker is there for, the total time shows what it costs
+void runUploadBenchmark()
+{
+	const GLsizeiptr totalBytes = 1024 * 1024 * 1024;
+	const GLsizeiptr bufferBytes = 32 * 1024 * 1024;
+	const GLsizei textureSize = 2048;
+	const GLsizei textureLevels = 12;
+	const int destinationCount = 4;
+	const GLsizeiptr pendingLimit = 128 * 1024 * 1024;		// handed to the worker and not complete
+	const double timeoutSeconds = 120.0;					// for the worker to finish its phase
+
+	SDL_GL_SetSwapInterval(0);
+	startupLoader.finishAll();
+
+	if (!uploadWorker.isRunning())
+	{
+		std::cout << "ERROR::UPLOAD_BENCHMARK::NO_UPLOAD_WORKER" << std::endl;
+		return;
+	}
+
+	GLuint buffers[destinationCount];
+	GLuint textures[destinationCount];
+	std::vector<unsigned char> source;
+	{
+		MemoryScope scope(MEMORY_TAG_UPLOADS);
+		for (int i = 0; i < destinationCount; i++)
+		{
+			buffers[i] = gpuMemory.createBuffer(bufferBytes, NULL, GL_DYNAMIC_STORAGE_BIT);
+			textures[i] = gpuMemory.createTexture2D(textureLevels, GL_RGBA8, textureSize, textureSize);
+		}
+		//every asset is read from the same data, the largest one is a buffer
+		source.resize(bufferBytes);
+	}
+	for (size_t i = 0; i < source.size(); i++)
+	{
+		source[i] = (unsigned char)(i * 7 + (i >> 12));
+	}
+
+	for (int phase = 0; phase < 2; phase++)
+	{
+		bool threaded = phase == 0;
+		GLsizeiptr issuedBytes = 0;
+		unsigned long long lastTicket = 0;
+		int asset = 0;		// even ones are buffers, odd ones textures
+		int level = 0;		// of the texture in progress
+		unsigned int frames = 0;
+		double worstMilliseconds = 0.0;
+		Uint64 phaseStart = SDL_GetPerformanceCounter();
+
+		while (issuedBytes < totalBytes || (threaded && !uploadWorker.isComplete(lastTicket)))
+		{
+			Uint64 frameStart = SDL_GetPerformanceCounter();
+
+			//a worker that stopped or copies that never finish must not hang the benchmark
+			double phaseSeconds = (double)(frameStart - phaseStart) / SDL_GetPerformanceFrequency();
+			if (threaded && (!uploadWorker.isRunning() || phaseSeconds > timeoutSeconds))
+			{
+				std::cout << "ERROR::UPLOAD_BENCHMARK::UPLOADS_NOT_COMPLETE" << std::endl;
+				break;
+			}
+
+			//the worker gets one job per buffer or texture level until enough is in flight, the render thread
+			//uploads a whole asset
+			bool assetDone = false;
+			while (issuedBytes < totalBytes && !assetDone && (!threaded || uploadWorker.getPendingBytes() < pendingLimit))
+			{
+				int destination = (asset / 2) % destinationCount;
+				GLsizeiptr bytes = 0;
+				if (asset % 2 == 0)
+				{
+					bytes = bufferBytes;
+					if (threaded)
+					{
+						unsigned long long ticket = uploadWorker.uploadBuffer(buffers[destination], 0, bytes, source.data());
+						if (ticket == 0)
+						{
+							break;
+						}
+						lastTicket = ticket;
+					}
+					else
+					{
+						glNamedBufferSubData(buffers[destination], 0, bytes, source.data());
+					}
+				}
+				else
+				{
+					GLsizei size = textureSize >> level;
+					bytes = (GLsizeiptr)size * size * 4;
+					if (threaded)
+					{
+						unsigned long long ticket = uploadWorker.uploadTexture(textures[destination], level, size, size, GL_RGBA, GL_UNSIGNED_BYTE, source.data());
+						if (ticket == 0)
+						{
+							break;
+						}
+						lastTicket = ticket;
+					}
+					else
+					{
+						glTextureSubImage2D(textures[destination], level, 0, 0, size, size, GL_RGBA, GL_UNSIGNED_BYTE, source.data());
+					}
+					level++;
+				}
+
+				issuedBytes += bytes;
+				if (asset % 2 == 0 || level == textureLevels)
+				{
+					asset++;
+					level = 0;
+					assetDone = !threaded;
+				}
+			}
+
+			render();
+			SDL_GL_SwapWindow(gWindow);
+
+			double frameMilliseconds = (double)(SDL_GetPerformanceCounter() - frameStart) * 1000.0 / SDL_GetPerformanceFrequency();
+			worstMilliseconds = frameMilliseconds > worstMilliseconds ? frameMilliseconds : worstMilliseconds;
+			frames++;
+		}
+		glFinish();
+
+		double seconds = (double)(SDL_GetPerformanceCounter() - phaseStart) / SDL_GetPerformanceFrequency();
+		std::cout << (threaded ? "Upload worker: " : "Render thread: ") << issuedBytes / (1024 * 1024) << " MB in " << seconds << " s, "
+			<< frames << " frames, worst frame " << worstMilliseconds << " ms, average " << seconds * 1000.0 / frames << " ms" << std::endl;
+	}
+
+	glState.deleteBuffers(destinationCount, buffers);
+	glState.deleteTextures(destinationCount, textures);
+}
+
+//renders frames until everything is created and reports heap allocations of the frames after that,
+//a steady-state frame must not allocate. The render size is held, a new size creates render targets.
+bool runAllocationCheck()
+{
+	const int warmupFrames = 30;
+	const int measuredFrames = 120;
+
+	SDL_GL_SetSwapInterval(0);
+	startupLoader.finishAll();
+	dynamicResolution.setFixedScale(dynamicResolution.getScale());
+
+	//animations advance like at 60 fps, so running ones are part of the check
+	deltaTime = 1.0f / 60.0f;
+
+	for (int frame = 0; frame < warmupFrames; frame++)
+	{
+		updateRenderSize();
+		render();
+		SDL_GL_SwapWindow(gWindow);
+	}
+
+	long long allocationsBefore = cpuMemory.allocationsMade[MEMORY_TAG_COUNT];
+	long long worstFrame = 0;
+	for (int frame = 0; frame < measuredFrames; frame++)
+	{
+		long long frameStart = cpuMemory.allocationsMade[MEMORY_TAG_COUNT];
+		updateRenderSize();
+		render();
+		SDL_GL_SwapWindow(gWindow);
+		worstFrame = std::max(worstFrame, cpuMemory.allocationsMade[MEMORY_TAG_COUNT] - frameStart);
+	}
+	long long allocations = cpuMemory.allocationsMade[MEMORY_TAG_COUNT] - allocationsBefore;
+
+	std::cout << "Allocation check: " << allocations << " heap allocations in " << measuredFrames << " frames, "
+		<< worstFrame << " in the worst frame, frame arena " << frameArena.stats.frameBytes << " bytes" << std::endl;
+	if (allocations != 0)
+	{
+		std::cout << "ERROR::FRAME::HEAP_ALLOCATIONS " << allocations << std::endl;
+		return false;
+	}
+	return true;
+}
+
+//issues a trace recorded with --trace as fast as the driver takes it, in a hidden window of the traced size
+bool replayTrace(const std::string& path)
+{
+	GLTraceReplayer replayer;
+	if (!replayer.load(path))
+	{
+		return false;
+	}
+
+	if (SDL_Init(SDL_INIT_VIDEO) < 0)
+	{
+		printf("SDL could not initialize! SDL Error: %s\n", SDL_GetError());
+		return false;
+	}
+
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 5);
+
+	bool success = false;
+	gWindow = SDL_CreateWindow("3D room trace replay", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, replayer.getWidth(), replayer.getHeight(), SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+	gContext = gWindow != NULL ? SDL_GL_CreateContext(gWindow) : NULL;
+	if (gContext == NULL)
+	{
+		printf("OpenGL context could not be created! SDL Error: %s\n", SDL_GetError());
+	}
+	else
+	{
+		glewInit();
+		SDL_GL_SetSwapInterval(0);
+
+		success = replayer.replay();
+		replayer.printStats();
+		SDL_GL_DeleteContext(gContext);
+	}
 
+	if (gWindow != NULL)
+	{
+		SDL_DestroyWindow(gWindow);
+		gWindow = NULL;
+	}
 	SDL_Quit();
+	return success;
 }
 
-void render()
+//builds the BVH over the recorded scene when it is out of date
+void updateSceneBvh()
 {
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	if (!sceneRecorded)
+	{
+		recordScene();
+	}
+	if (!sceneBvhDirty)
+	{
+		return;
+	}
+
+	MemoryScope scope(MEMORY_TAG_SCENE);
+	sceneBvh.build(sceneObjects);
+	sceneBvhDirty = false;
+}
+
+//moves the camera like ProcessKeyboard, sliding along whatever it runs into
+void moveCamera(Camera_Movement direction)
+{
+	glm::vec3 position = camera.Position;
+	camera.ProcessKeyboard(direction, deltaTime);
+	if (!cameraCollision)
+	{
+		return;
+	}
+
+	updateSceneBvh();
+	glm::vec3 motion = camera.Position - position;
+
+	//every contact stops the camera just short of it and takes the motion into the blocking side away
+	for (int i = 0; i < 3; i++)
+	{
+		float length = glm::length(motion);
+		RayHit hit;
+		if (length < 1e-6f || !sceneBvh.sweepSphere(position, cameraRadius, motion, hit))
+		{
+			position += motion;
+			break;
+		}
+
+		float travelled = std::max(0.0f, hit.t - cameraSkin / length);
+		position += motion * travelled;
+		motion *= 1.0f - travelled;
+		motion -= hit.normal * glm::dot(motion, hit.normal);
+	}
+
+	camera.Position = position;
+}
+
+//selects the object under the cursor with a ray from the eye through the pixel
+void pickObject(int x, int y)
+{
+	updateSceneBvh();
+
+	FrameData frame = getFrameData();
+	glm::mat4 inverseViewProjection = glm::inverse(frame.projection * frame.view);
+	float ndcX = 2.0f * (x + 0.5f) / windowWidth - 1.0f;
+	float ndcY = 1.0f - 2.0f * (y + 0.5f) / windowHeight;
+	glm::vec4 farPoint = inverseViewProjection * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+	glm::vec3 direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - camera.Position);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	RayHit hit;
+	bool found = sceneBvh.intersect(Ray(camera.Position, direction), 1e30f, hit);
+	double microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+	selectedObject = found ? hit.object : -1;
+	if (!found)
+	{
+		std::cout << "Nothing picked (" << microseconds << " us)" << std::endl;
+		return;
+	}
+
+	const ObjectBounds& bounds = sceneBounds[hit.object];
+	std::cout << "Picked object " << hit.object << " at distance " << hit.t << ", side " << hit.face << ", center "
+		<< glm::to_string(glm::vec3(bounds.center)) << ", size " << glm::to_string(2.0f * glm::vec3(bounds.extents))
+		<< " (" << microseconds << " us)" << std::endl;
+}
+
+//times picking rays, batches of rays and camera sweeps from random points of the scene
+void runRayQueryBenchmark()
+{
+	const int queryCount = 100000;
+
+	updateSceneBvh();
+
+	glm::vec3 sceneMin(1e30f), sceneMax(-1e30f);
+	for (size_t i = 0; i < sceneBounds.size(); i++)
+	{
+		sceneMin = glm::min(sceneMin, glm::vec3(sceneBounds[i].center - sceneBounds[i].extents));
+		sceneMax = glm::max(sceneMax, glm::vec3(sceneBounds[i].center + sceneBounds[i].extents));
+	}
+
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::vector<Ray> rays(queryCount);
+	for (int i = 0; i < queryCount; i++)
+	{
+		glm::vec3 origin = sceneMin + glm::vec3(unit(random), unit(random), unit(random)) * (sceneMax - sceneMin);
+		glm::vec3 direction = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) * 2.0f - 1.0f);
+		rays[i] = Ray(origin, direction);
+	}
+
+	std::vector<double> rayTimes(queryCount);
+	double rayTotal = 0.0;
+	int rayHits = 0;
+	for (int i = 0; i < queryCount; i++)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		RayHit hit;
+		rayHits += sceneBvh.intersect(rays[i], 1e30f, hit) ? 1 : 0;
+		rayTimes[i] = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+		rayTotal += rayTimes[i];
+	}
+
+	std::vector<RayHit> hits(queryCount);
+	std::chrono::steady_clock::time_point batchStart = std::chrono::steady_clock::now();
+	sceneBvh.intersect(rays.data(), queryCount, 1e30f, hits.data(), threadPool);
+	double batchTotal = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - batchStart).count();
 
-	glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), 16.0f/9.0f, 2.0f, 1000.0f);
-	glm::mat4 view = camera.GetViewMatrix();
-	glm::mat4 model = glm::mat4(1);
+	//a frame of walking is about a third of a unit
+	std::vector<double> sweepTimes(queryCount);
+	double sweepTotal = 0.0;
+	int sweepHits = 0;
+	for (int i = 0; i < queryCount; i++)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		RayHit hit;
+		sweepHits += sceneBvh.sweepSphere(rays[i].origin, cameraRadius, rays[i].direction * 0.33f, hit) ? 1 : 0;
+		sweepTimes[i] = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+		sweepTotal += sweepTimes[i];
+	}
 
-	glm::mat3 normalMat = glm::transpose(glm::inverse(model));
+	//the worst single query is mostly the scheduler, the 99th percentile shows the slow queries
+	std::sort(rayTimes.begin(), rayTimes.end());
+	std::sort(sweepTimes.begin(), sweepTimes.end());
+	int percentile = queryCount * 99 / 100;
 
-	shader.setMat4("projection", projection);
-	shader.setMat4("view", view);
-	shader.setMat3("normalMat", normalMat);
+	std::cout << "Ray queries over " << sceneBvh.getBoxCount() << " objects: closest hit " << rayTotal / queryCount << " us average, "
+		<< rayTimes[percentile] << " us 99th percentile, " << rayTimes.back() << " us worst (" << rayHits << " of " << queryCount << " hit); batched "
+		<< batchTotal / queryCount << " us per ray on " << threadPool.getThreadCount() << " threads; sphere sweep " << sweepTotal / queryCount
+		<< " us average, " << sweepTimes[percentile] << " us 99th percentile, " << sweepTimes.back() << " us worst (" << sweepHits << " hit)" << std::endl;
+}
 
+void drawScene()
+{
 	drawRoom();
 
 	drawCeilingLight();
@@ -351,23 +2132,246 @@ void render()
 
 	drawMirrorTable();
 
-	//std::cout << glm::to_string(camera.Position) << std::endl;
+	drawImportedMeshes();
+}
+
+//collects the object records and bounds of the whole scene instead of drawing it
+void recordScene()
+{
+	MemoryScope scope(MEMORY_TAG_SCENE);
+
+	sceneObjects.clear();
+	sceneBounds.clear();
+
+	if (sceneReplicator.enabled)
+	{
+		replicateScene();
+	}
+	else
+	{
+		recordingScene = true;
+		drawScene();
+		recordingScene = false;
+	}
+
+	sceneAnimation.bind(sceneObjects);
+
+	lampRecords.clear();
+	for (size_t i = 0; i < sceneObjects.size(); i++)
+	{
+		if (sceneObjects[i].lamp != NO_LAMP)
+		{
+			lampRecords.push_back((unsigned int)i);
+		}
+	}
+	lampRanges.clear();
+	lampRanges.reserve(lampRecords.size());
+
+	sceneRecorded = true;
+	sceneBvhDirty = true;
+	planarReflection.invalidate();
+}
+
+//records the furniture groups of drawScene() as prefabs and instantiates them over the grid of rooms
+void replicateScene()
+{
+	sceneReplicator.clearPrefabs();
+	addScenePrefab("Room", false, { drawRoom, drawCeilingLight });
+	addScenePrefab("Bed", true, { drawBed });
+	addScenePrefab("Wardrobe", true, { drawWardrobe });
+	addScenePrefab("NightStand", true, { drawNightStand, drawNightStandLamp });
+	addScenePrefab("Shelfs", true, { drawShelfs });
+	addScenePrefab("MirrorTable", true, { drawMirrorTable });
+	if (meshRegistry.getMeshCount() > 1)
+	{
+		addScenePrefab("Imported", true, { drawImportedMeshes });
+	}
+
+	sceneReplicator.build(threadPool, sceneObjects, sceneBounds);
+}
+
+void addScenePrefab(const std::string& name, bool optional, std::initializer_list<void(*)()> draws)
+{
+	sceneObjects.clear();
+	sceneBounds.clear();
+
+	recordingScene = true;
+	for (void (*draw)() : draws)
+	{
+		draw();
+	}
+	recordingScene = false;
+
+	sceneReplicator.addPrefab(name, sceneObjects, optional);
+}
+
+//classic path of a replicated scene, one draw per recorded object like drawScene() does
+void drawRecordedScene()
+{
+	for (size_t i = 0; i < sceneObjects.size() && frameObjectCount < frameObjectCapacity; i++)
+	{
+		setModelTransform(sceneObjects[i].transform);
+		currentMaterial = sceneObjects[i].material;
+		drawMesh(sceneObjects[i].mesh);
+	}
+}
+
+//the doors swing out about their outer edge, the drawers slide out of the wardrobe and the table
+void initAnimation()
+{
+	MemoryScope scope(MEMORY_TAG_SCENE);
+
+	//the pivots are in the frame of the door, its center, and at its back edge
+	AnimationTrack doorTrack;
+	doorTrack.type = ANIMATION_SWING;
+	doorTrack.axis = glm::vec3(0.0f, 1.0f, 0.0f);
+	doorTrack.duration = 1.2f;
+
+	doorTrack.amount = glm::radians(-100.0f);
+	wardrobeLeftDoorNode = sceneAnimation.addNode("WardrobeLeftDoor", doorTrack, glm::vec3(-0.375f, 0.0f, -0.004f));
+
+	doorTrack.amount = glm::radians(100.0f);
+	wardrobeRightDoorNode = sceneAnimation.addNode("WardrobeRightDoor", doorTrack, glm::vec3(0.375f, 0.0f, -0.004f));
+
+	//the drawers follow the doors one after the other and slow down before they stop
+	glm::quat noRotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+	AnimationTrack drawerTrack;
+	drawerTrack.type = ANIMATION_KEYFRAMES;
+	drawerTrack.keys = {
+		{ 0.0f, glm::vec3(0.0f), noRotation },
+		{ 0.3f, glm::vec3(0.0f), noRotation },
+		{ 0.8f, glm::vec3(0.0f, 0.0f, 0.3f), noRotation },
+		{ 1.0f, glm::vec3(0.0f, 0.0f, 0.35f), noRotation }
+	};
+	wardrobeTopDrawerNode = sceneAnimation.addNode("WardrobeTopDrawer", drawerTrack, glm::vec3(0.0f));
+
+	for (size_t i = 1; i < drawerTrack.keys.size(); i++)
+	{
+		drawerTrack.keys[i].time += 0.2f;
+	}
+	wardrobeBottomDrawerNode = sceneAnimation.addNode("WardrobeBottomDrawer", drawerTrack, glm::vec3(0.0f));
+
+	AnimationTrack tableDrawerTrack;
+	tableDrawerTrack.type = ANIMATION_SLIDE;
+	tableDrawerTrack.axis = glm::vec3(0.0f, 0.0f, 1.0f);
+	tableDrawerTrack.amount = 0.3f;
+	tableDrawerTrack.duration = 0.9f;
+	mirrorTableDrawerNode = sceneAnimation.addNode("MirrorTableDrawer", tableDrawerTrack, glm::vec3(0.0f));
+}
+
+//moves the doors and drawers, the recorded scene is updated where they moved
+void updateAnimation()
+{
+	sceneAnimation.advance(deltaTime);
+	if (!sceneRecorded)
+	{
+		return;
+	}
+
+	//what moves out of the mirror has to leave its reflection too, so the bounds are tested before the motion as well
+	if (planarReflection.isVisible())
+	{
+		const std::vector<ObjectRange>& movingRanges = sceneAnimation.findRanges();
+		for (size_t i = 0; i < movingRanges.size(); i++)
+		{
+			for (unsigned int j = 0; j < movingRanges[i].count; j++)
+			{
+				planarReflection.objectMoved(sceneBounds[movingRanges[i].first + j]);
+			}
+		}
+	}
+
+	sceneAnimation.apply(threadPool, sceneObjects, sceneBounds);
+	const std::vector<ObjectRange>& ranges = sceneAnimation.getRanges();
+	if (!ranges.empty())
+	{
+		//a tree that is rebuilt anyway takes the new bounds then
+		if (!sceneBvhDirty)
+		{
+			sceneBvh.refit(sceneObjects, ranges);
+		}
+
+		//the mirror is rendered again only when it shows one of the objects that moved
+		for (size_t i = 0; i < ranges.size() && planarReflection.isVisible(); i++)
+		{
+			for (unsigned int j = 0; j < ranges[i].count; j++)
+			{
+				planarReflection.objectMoved(sceneBounds[ranges[i].first + j]);
+			}
+		}
+
+		//the GPU-driven path takes the moved ranges every frame, or the whole scene once it is switched on
+		if (!gpuDrivenMode)
+		{
+			sceneDirty = true;
+		}
+	}
+}
+
+//a lamp switch only changes the emission of the lamp records, they are patched and taken by the GPU copy
+//of the scene like the ranges the animation moved
+void switchLampRecords()
+{
+	if (!sceneRecorded)
+	{
+		sceneDirty = true;
+		return;
+	}
+
+	lampRanges.clear();
+	for (size_t i = 0; i < lampRecords.size(); i++)
+	{
+		unsigned int record = lampRecords[i];
+		sceneObjects[record].material.emission = getLampEmission(sceneObjects[record].lamp);
+		if (!lampRanges.empty() && lampRanges.back().first + lampRanges.back().count == record)
+		{
+			lampRanges.back().count++;
+		}
+		else
+		{
+			ObjectRange range;
+			range.first = record;
+			range.count = 1;
+			lampRanges.push_back(range);
+		}
+	}
+
+	if (gpuDrivenMode && !sceneDirty)
+	{
+		gpuDrivenRenderer.updateRanges(sceneObjects, sceneBounds, lampRanges, objectTransforms);
+	}
+	else
+	{
+		sceneDirty = true;
+	}
+}
+
+//the objects drawn until endAnimationNode() move with node, the first of them anchors the motion
+void beginAnimationNode(unsigned int node)
+{
+	currentAnimationNode = node;
+	animationAnchorPending = true;
+}
 
+void endAnimationNode()
+{
+	currentAnimationNode = NO_ANIMATION_NODE;
+	animationAnchorPending = false;
 }
 
 void drawRoom()
 {
-	glm::mat4 model;
+	ObjectTransform model;
 	glm::vec3 ambient;
 	glm::vec3 diffuse;
 
 	//floor
-	model = glm::mat4(1.0f);
-	model = glm::scale(model, glm::vec3(5.0f, 0.1f, 7.0f));
-	model = glm::translate(model, glm::vec3(-1.0f, -5.0f, 0.0f));
-	model = generateDefaultModelMatrixCube(model);
+	model = ObjectTransform();
+	model = scale(model, glm::vec3(5.0f, 0.1f, 7.0f));
+	model = translate(model, glm::vec3(-1.0f, -5.0f, 0.0f));
+	model = generateDefaultTransformCube(model);
 
-	shader.setMat4("model", model);
+	setModelTransform(model);
 
 	ambient = glm::vec3(0.25f, 0.05f, 0.0f);
 	diffuse = glm::vec3(0.5f, 0.1f, 0.0f);
@@ -376,12 +2380,12 @@ void drawRoom()
 	drawCube();
 
 	//front wall
-	model = glm::mat4(1.0f);
-	model = glm::translate(model, glm::vec3(-1.5f, -1.0f, 2.2f));
-	model = glm::scale(model, glm::vec3(5.0f, 2.0f, 0.1f));
-	model = generateDefaultModelMatrixCube(model);
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(-1.5f, -1.0f, 2.2f));
+	model = scale(model, glm::vec3(5.0f, 2.0f, 0.1f));
+	model = generateDefaultTransformCube(model);
 
-	shader.setMat4("model", model);
+	setModelTransform(model);
 	ambient = glm::vec3(0.5f, 0.4f, 0.35f);
 	diffuse = glm::vec3(1.0f, 0.8f, 0.7f);
 	setMaterialValues(ambient, diffuse);
@@ -391,77 +2395,253 @@ void drawRoom()
 	//Same material values for the next couple elements of the room
 
 	//right wall
-	model = glm::mat4(1.0f);
-	model = glm::translate(model, glm::vec3(9.0f, -1.0f, 0.0f));
-	model = glm::scale(model, glm::vec3(0.2f, 2.0f, 5.5f));
-	model = generateDefaultModelMatrixCube(model);
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(9.0f, -1.0f, 0.0f));
+	model = scale(model, glm::vec3(0.2f, 2.0f, 5.5f));
+	model = generateDefaultTransformCube(model);
 
-	shader.setMat4("model", model);
+	setModelTransform(model);
 	drawCube();
 
 	//left wall
-	model = glm::mat4(1.0f);
-	model = glm::translate(model, glm::vec3(-4.5f, -1.0f, 0.0f));
-	model = glm::scale(model, glm::vec3(1.0f, 2.0f, 5.5f));
-	model = generateDefaultModelMatrixCube(model);
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(-4.5f, -1.0f, 0.0f));
+	model = scale(model, glm::vec3(1.0f, 2.0f, 5.5f));
+	model = generateDefaultTransformCube(model);
 
-	shader.setMat4("model", model);
+	setModelTransform(model);
 	drawCube();
 
 	//back wall
-	model = glm::mat4(1.0f);
-	model = glm::translate(model, glm::vec3(-1.5f, -1.0f, 16.0f));
-	model = glm::scale(model, glm::vec3(5.0f, 2.0f, 0.1f));
-	model = generateDefaultModelMatrixCube(model);
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(-1.5f, -1.0f, 16.0f));
+	model = scale(model, glm::vec3(5.0f, 2.0f, 0.1f));
+	model = generateDefaultTransformCube(model);
 
-	shader.setMat4("model", model);
+	setModelTransform(model);
 	drawCube();
 
 
 	//ceiling
-	model = glm::mat4(1.0f);
-	model = glm::translate(model, glm::vec3(-2.0f, 5.1f, 0.0f));
-	model = glm::scale(model, glm::vec3(5.0f, 0.1f, 7.0f));
-	model = generateDefaultModelMatrixCube(model);
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(-2.0f, 5.1f, 0.0f));
+	model = scale(model, glm::vec3(5.0f, 0.1f, 7.0f));
+	model = generateDefaultTransformCube(model);
+
+	setModelTransform(model);
+
+	ambient = glm::vec3(0.5f, 0.45f, 0.4f);
+	diffuse = glm::vec3(1.0f, 0.9f, 0.8f);
+
+	setMaterialValues(ambient, diffuse);
+
+	drawCube();
+
+	//carpet
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(3.5f, -0.2f, 7.0f));
+	model = scale(model, glm::vec3(1.3f, 0.01f, 1.7f));
+	model = generateDefaultTransformCube(model);
+
+	setModelTransform(model);
+
+	ambient = glm::vec3(0.20f, 0.05f, 0.0f);
+	diffuse = glm::vec3(0.4f, 0.1f, 0.0f);
+
+	setMaterialValues(ambient, diffuse);
+
+	drawCube();
+}
+
+void drawBed()
+{
+	ObjectTransform model;
+	glm::vec3 ambient;
+	glm::vec3 diffuse;
+
+	//headboard
+	model = ObjectTransform();
+	model = scale(model, glm::vec3(0.1f, 0.5f, 0.9f));
+	model = translate(model, glm::vec3(-2.0f, -0.5f, 6.2f));
+	model = generateDefaultTransformCube(model);
+
+	setModelTransform(model);
+
+	ambient = glm::vec3(0.25f, 0.1f, 0.1f);
+	diffuse = glm::vec3(0.5f, 0.2f, 0.2f);
+
+	setMaterialValues(ambient, diffuse);
+
+	drawCube();
+
+	//body
+	model = ObjectTransform();
+	model = scale(model, glm::vec3(1.0f, 0.2f, 0.9f));
+	model = translate(model, glm::vec3(0.0f, -0.5f, 6.2f));
+	model = generateDefaultTransformCube(model);
+
+	setModelTransform(model);
+
+	ambient = glm::vec3(0.412f, 0.353f, 0.2745f);
+	diffuse = glm::vec3(0.824f, 0.706f, 0.549f);
+
+	setMaterialValues(ambient, diffuse);
+
+	drawCube();
+
+	//right pillow
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(0.5f, 0.5f, 6.0f));
+	model = rotate(model, glm::radians(20.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+	model = scale(model, glm::vec3(0.1f, 0.15f, 0.28f));
+	model = generateDefaultTransformCube(model);
+
+	setModelTransform(model);
+
+	ambient = glm::vec3(0.3135f, 0.161f, 0.088f);
+	diffuse = glm::vec3(0.627f, 0.322f, 0.176f);
+
+	setMaterialValues(ambient, diffuse);
+
+	drawCube();
+
+	//left pillow
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(0.5f, 0.5f, 7.2f));
+	model = rotate(model, glm::radians(22.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+	model = scale(model, glm::vec3(0.1f, 0.15f, 0.28f));
+	model = generateDefaultTransformCube(model);
+
+	setModelTransform(model);
+	drawCube();
+
+	//blanket
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(1.4f, 0.45f, 5.5f));
+	model = scale(model, glm::vec3(0.5f, 0.05f, 0.95f));
+	model = generateDefaultTransformCube(model);
+
+	setModelTransform(model);
+
+	drawCube();
+
+	//blanket left side
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(1.4f, -0.3f, 8.2f));
+	model = scale(model, glm::vec3(0.5f, 0.25f, 0.05f));
+	model = generateDefaultTransformCube(model);
+
+	setModelTransform(model);
+
+	drawCube();
+
+	//blanket right side
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(1.4f, -0.3f, 5.5f));
+	model = scale(model, glm::vec3(0.5f, 0.25f, 0.05f));
+	model = generateDefaultTransformCube(model);
+
+	setModelTransform(model);
+
+	drawCube();
+}
+
+void drawWardrobe() {
+	ObjectTransform model;
+	glm::vec3 ambient;
+	glm::vec3 diffuse;
+
+	//wardrobe body
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(6.5f, 0.0f, 3.6f));
+	model = scale(model, glm::vec3(0.5f, 1.0f, 0.5f));
+	model = generateDefaultTransformCube(model);
+
+	setModelTransform(model);
+
+	ambient = glm::vec3(0.25f, 0.1f, 0.1f);
+	diffuse = glm::vec3(0.5f, 0.2f, 0.2f);
+
+	setMaterialValues(ambient, diffuse);
+
+	drawCube();
+
+	//inside, seen behind open doors and drawers
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(6.53f, 0.03f, 5.1f));
+	model = scale(model, glm::vec3(1.44f, 2.94f, 0.0005f) / 3.0f);
+	model = generateDefaultTransformCube(model);
+
+	setModelTransform(model);
+
+	ambient = glm::vec3(0.05f, 0.02f, 0.02f);
+	diffuse = glm::vec3(0.1f, 0.04f, 0.04f);
+
+	setMaterialValues(ambient, diffuse);
+
+	drawCube();
+
+	// top vertical stripline
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(6.5f, 1.0f, 5.11f));
+	model = scale(model, glm::vec3(0.5f, 0.01f, 0.0001f));
+	model = generateDefaultTransformCube(model);
+
+	setModelTransform(model);
+
+	ambient = glm::vec3(0.1f, 0.05f, 0.05f);
+	diffuse = glm::vec3(0.2f, 0.1f, 0.1f);
+
+	setMaterialValues(ambient, diffuse);
+	//Same material values for the next couple elements of the wardrobe
+
+	drawCube();
 
-	shader.setMat4("model", model);
+	//middle vertical stripline
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(6.5f, 0.5f, 5.11f));
+	model = scale(model, glm::vec3(0.5f, 0.01f, 0.0001f));
+	model = generateDefaultTransformCube(model);
 
-	ambient = glm::vec3(0.5f, 0.45f, 0.4f);
-	diffuse = glm::vec3(1.0f, 0.9f, 0.8f);
+	setModelTransform(model);
+	drawCube();
 
-	setMaterialValues(ambient, diffuse);
+	//bottom vertical stripline
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(6.5f, 0.0f, 5.11f));
+	model = scale(model, glm::vec3(0.5f, 0.01f, 0.0001f));
+	model = generateDefaultTransformCube(model);
 
+	setModelTransform(model);
 	drawCube();
 
-	//carpet
-	model = glm::mat4(1.0f);
-	model = glm::translate(model, glm::vec3(3.5f, -0.2f, 7.0f));
-	model = glm::scale(model, glm::vec3(1.3f, 0.01f, 1.7f));
-	model = generateDefaultModelMatrixCube(model);
-
-	shader.setMat4("model", model);
+	//right side horizontal stripline
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(8.0f, 0.0f, 5.1f));
+	model = scale(model, glm::vec3(0.01f, 1.0f, 0.0001f));
+	model = generateDefaultTransformCube(model);
 
-	ambient = glm::vec3(0.20f, 0.05f, 0.0f);
-	diffuse = glm::vec3(0.4f, 0.1f, 0.0f);
+	setModelTransform(model);
+	drawCube();
 
-	setMaterialValues(ambient, diffuse);
+	//left side horizontal stripline
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(6.5f, 0.0f, 5.11f));
+	model = scale(model, glm::vec3(0.01f, 1.0f, 0.0001f));
+	model = generateDefaultTransformCube(model);
 
+	setModelTransform(model);
 	drawCube();
-}
 
-void drawBed()
-{
-	glm::mat4 model;
-	glm::vec3 ambient;
-	glm::vec3 diffuse;
+	//left door, hinged at its outer edge
+	beginAnimationNode(wardrobeLeftDoorNode);
 
-	//headboard
-	model = glm::mat4(1.0f);
-	model = glm::scale(model, glm::vec3(0.1f, 0.5f, 0.9f));
-	model = glm::translate(model, glm::vec3(-2.0f, -0.5f, 6.2f));
-	model = generateDefaultModelMatrixCube(model);
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(6.5f, 1.03f, 5.1f));
+	model = scale(model, glm::vec3(0.75f, 1.97f, 0.008f) / 3.0f);
+	model = generateDefaultTransformCube(model);
 
-	shader.setMat4("model", model);
+	setModelTransform(model);
 
 	ambient = glm::vec3(0.25f, 0.1f, 0.1f);
 	diffuse = glm::vec3(0.5f, 0.2f, 0.2f);
@@ -470,90 +2650,75 @@ void drawBed()
 
 	drawCube();
 
-	//body
-	model = glm::mat4(1.0f);
-	model = glm::scale(model, glm::vec3(1.0f, 0.2f, 0.9f));
-	model = glm::translate(model, glm::vec3(0.0f, -0.5f, 6.2f));
-	model = generateDefaultModelMatrixCube(model);
+	//left handle
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(7.0f, 1.4f, 5.11f));
+	model = scale(model, glm::vec3(0.02f, 0.18f, 0.01f));
+	model = generateDefaultTransformCube(model);
 
-	shader.setMat4("model", model);
+	setModelTransform(model);
 
-	ambient = glm::vec3(0.412f, 0.353f, 0.2745f);
-	diffuse = glm::vec3(0.824f, 0.706f, 0.549f);
+	ambient = glm::vec3(0.1f, 0.05f, 0.05f);
+	diffuse = glm::vec3(0.2f, 0.1f, 0.1f);
 
 	setMaterialValues(ambient, diffuse);
 
 	drawCube();
 
-	//right pillow
-	model = glm::mat4(1.0f);
-	model = glm::translate(model, glm::vec3(0.5f, 0.5f, 6.0f));
-	model = glm::rotate(model, glm::radians(20.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-	model = glm::scale(model, glm::vec3(0.1f, 0.15f, 0.28f));
-	model = generateDefaultModelMatrixCube(model);
+	endAnimationNode();
 
-	shader.setMat4("model", model);
+	//right door, the stripline between the doors is on it
+	beginAnimationNode(wardrobeRightDoorNode);
 
-	ambient = glm::vec3(0.3135f, 0.161f, 0.088f);
-	diffuse = glm::vec3(0.627f, 0.322f, 0.176f);
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(7.25f, 1.03f, 5.1f));
+	model = scale(model, glm::vec3(0.75f, 1.97f, 0.008f) / 3.0f);
+	model = generateDefaultTransformCube(model);
 
-	setMaterialValues(ambient, diffuse);
+	setModelTransform(model);
 
-	drawCube();
+	ambient = glm::vec3(0.25f, 0.1f, 0.1f);
+	diffuse = glm::vec3(0.5f, 0.2f, 0.2f);
 
-	//left pillow
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(0.5f, 0.5f, 7.2f));
-	model = glm::rotate(model, glm::radians(22.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-	model = glm::scale(model, glm::vec3(0.1f, 0.15f, 0.28f));
-	model = generateDefaultModelMatrixCube(model);
+	setMaterialValues(ambient, diffuse);
 
-	shader.setMat4("model", model);
 	drawCube();
 
-	//blanket
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(1.4f, 0.45f, 5.5f));
-	model = glm::scale(model, glm::vec3(0.5f, 0.05f, 0.95f));
-	model = generateDefaultModelMatrixCube(model);
-
-	shader.setMat4("model", model);
+	//middle horizontal stripline
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(7.25f, 1.0f, 5.11f));
+	model = scale(model, glm::vec3(0.01f, 0.67f, 0.0001f));
+	model = generateDefaultTransformCube(model);
 
-	drawCube();
+	setModelTransform(model);
 
-	//blanket left side
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(1.4f, -0.3f, 8.2f));
-	model = glm::scale(model, glm::vec3(0.5f, 0.25f, 0.05f));
-	model = generateDefaultModelMatrixCube(model);
+	ambient = glm::vec3(0.1f, 0.05f, 0.05f);
+	diffuse = glm::vec3(0.2f, 0.1f, 0.1f);
 
-	shader.setMat4("model", model);
+	setMaterialValues(ambient, diffuse);
 
 	drawCube();
 
-	//blanket right side
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(1.4f, -0.3f, 5.5f));
-	model = glm::scale(model, glm::vec3(0.5f, 0.25f, 0.05f));
-	model = generateDefaultModelMatrixCube(model);
-
-	shader.setMat4("model", model);
+	//right handle
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(7.5f, 1.4f, 5.11f));
+	model = scale(model, glm::vec3(0.02f, 0.18f, 0.01f));
+	model = generateDefaultTransformCube(model);
 
+	setModelTransform(model);
 	drawCube();
-}
 
-void drawWardrobe() {
-	glm::mat4 model;
-	glm::vec3 ambient;
-	glm::vec3 diffuse;
+	endAnimationNode();
 
-	//wardrobe body
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(6.5f, 0.0f, 3.6f));
-	model = glm::scale(model, glm::vec3(0.5f, 1.0f, 0.5f));
-	model = generateDefaultModelMatrixCube(model);
+	//top drawer
+	beginAnimationNode(wardrobeTopDrawerNode);
 
-	shader.setMat4("model", model);
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(6.53f, 0.53f, 5.1f));
+	model = scale(model, glm::vec3(1.44f, 0.47f, 0.008f) / 3.0f);
+	model = generateDefaultTransformCube(model);
+
+	setModelTransform(model);
 
 	ambient = glm::vec3(0.25f, 0.1f, 0.1f);
 	diffuse = glm::vec3(0.5f, 0.2f, 0.2f);
@@ -562,117 +2727,116 @@ void drawWardrobe() {
 
 	drawCube();
 
-	// top vertical stripline
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(6.5f, 1.0f, 5.11f));
-	model = glm::scale(model, glm::vec3(0.5f, 0.01f, 0.0001f));
-	model = generateDefaultModelMatrixCube(model);
+	drawDrawerBox(glm::vec3(6.56f, 0.55f, 4.7f), glm::vec3(7.94f, 0.9f, 5.1f));
 
-	shader.setMat4("model", model);
+	//drawer handle 1
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(7.0f, 0.7f, 5.11f));
+	model = scale(model, glm::vec3(0.16f, 0.02f, 0.01f));
+	model = generateDefaultTransformCube(model);
+	setModelTransform(model);
 
 	ambient = glm::vec3(0.1f, 0.05f, 0.05f);
 	diffuse = glm::vec3(0.2f, 0.1f, 0.1f);
 
 	setMaterialValues(ambient, diffuse);
-	//Same material values for the next couple elements of the wardrobe
 
 	drawCube();
 
-	//middle vertical stripline
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(6.5f, 0.5f, 5.11f));
-	model = glm::scale(model, glm::vec3(0.5f, 0.01f, 0.0001f));
-	model = generateDefaultModelMatrixCube(model);
+	endAnimationNode();
 
-	shader.setVec4("color", glm::vec4(0.2f, 0.1f, 0.1f, 1.0f));
-	shader.setMat4("model", model);
-	drawCube();
+	//bottom drawer
+	beginAnimationNode(wardrobeBottomDrawerNode);
 
-	//bottom vertical stripline
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(6.5f, 0.0f, 5.11f));
-	model = glm::scale(model, glm::vec3(0.5f, 0.01f, 0.0001f));
-	model = generateDefaultModelMatrixCube(model);
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(6.53f, 0.03f, 5.1f));
+	model = scale(model, glm::vec3(1.44f, 0.47f, 0.008f) / 3.0f);
+	model = generateDefaultTransformCube(model);
 
-	shader.setMat4("model", model);
-	drawCube();
+	setModelTransform(model);
 
-	//right side horizontal stripline
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(8.0f, 0.0f, 5.1f));
-	model = glm::scale(model, glm::vec3(0.01f, 1.0f, 0.0001f));
-	model = generateDefaultModelMatrixCube(model);
+	ambient = glm::vec3(0.25f, 0.1f, 0.1f);
+	diffuse = glm::vec3(0.5f, 0.2f, 0.2f);
+
+	setMaterialValues(ambient, diffuse);
 
-	shader.setMat4("model", model);
 	drawCube();
 
-	//left side horizontal stripline
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(7.25f, 1.0f, 5.11f));
-	model = glm::scale(model, glm::vec3(0.01f, 0.67f, 0.0001f));
-	model = generateDefaultModelMatrixCube(model);
+	drawDrawerBox(glm::vec3(6.56f, 0.05f, 4.7f), glm::vec3(7.94f, 0.4f, 5.1f));
 
-	shader.setMat4("model", model);
-	drawCube();
+	//drawer handle 2
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(7.0f, 0.25f, 5.11f));
+	model = scale(model, glm::vec3(0.16f, 0.02f, 0.01f));
+	model = generateDefaultTransformCube(model);
 
-	//left side horizontal stripline
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(6.5f, 0.0f, 5.11f));
-	model = glm::scale(model, glm::vec3(0.01f, 1.0f, 0.0001f));
-	model = generateDefaultModelMatrixCube(model);
+	setModelTransform(model);
 
-	shader.setMat4("model", model);
-	drawCube();
+	ambient = glm::vec3(0.1f, 0.05f, 0.05f);
+	diffuse = glm::vec3(0.2f, 0.1f, 0.1f);
 
-	//right handle
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(7.5f, 1.4f, 5.11f));
-	model = glm::scale(model, glm::vec3(0.02f, 0.18f, 0.01f));
-	model = generateDefaultModelMatrixCube(model);
+	setMaterialValues(ambient, diffuse);
 
-	shader.setMat4("model", model);
 	drawCube();
 
-	//left handle
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(7.0f, 1.4f, 5.11f));
-	model = glm::scale(model, glm::vec3(0.02f, 0.18f, 0.01f));
-	model = generateDefaultModelMatrixCube(model);
+	endAnimationNode();
+}
+
+//bottom, sides and back of a drawer between min and max, open at the top and at the front, in the current material
+void drawDrawerBox(glm::vec3 min, glm::vec3 max)
+{
+	const float thickness = 0.02f;
+	ObjectTransform model;
 
-	shader.setMat4("model", model);
+	//bottom
+	model = ObjectTransform();
+	model = translate(model, min);
+	model = scale(model, glm::vec3(max.x - min.x, thickness, max.z - min.z) / 3.0f);
+	model = generateDefaultTransformCube(model);
+
+	setModelTransform(model);
 	drawCube();
 
-	//drawer handle 1
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(7.0f, 0.7f, 5.11f));
-	model = glm::scale(model, glm::vec3(0.16f, 0.02f, 0.01f));
-	model = generateDefaultModelMatrixCube(model);
-	shader.setMat4("model", model);
+	//left side
+	model = ObjectTransform();
+	model = translate(model, min);
+	model = scale(model, glm::vec3(thickness, max.y - min.y, max.z - min.z) / 3.0f);
+	model = generateDefaultTransformCube(model);
+
+	setModelTransform(model);
 	drawCube();
 
+	//right side
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(max.x - thickness, min.y, min.z));
+	model = scale(model, glm::vec3(thickness, max.y - min.y, max.z - min.z) / 3.0f);
+	model = generateDefaultTransformCube(model);
 
-	//drawer handle 2
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(7.0f, 0.25f, 5.11f));
-	model = glm::scale(model, glm::vec3(0.16f, 0.02f, 0.01f));
-	model = generateDefaultModelMatrixCube(model);
+	setModelTransform(model);
+	drawCube();
+
+	//back
+	model = ObjectTransform();
+	model = translate(model, min);
+	model = scale(model, glm::vec3(max.x - min.x, max.y - min.y, thickness) / 3.0f);
+	model = generateDefaultTransformCube(model);
 
-	shader.setMat4("model", model);
+	setModelTransform(model);
 	drawCube();
 }
 
 void drawNightStand() {
-	glm::mat4 model;
+	ObjectTransform model;
 	glm::vec3 ambient;
 	glm::vec3 diffuse;
 
 	//nightStand main body
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(0.5f, -0.1f, 8.7f));
-	model = glm::scale(model, glm::vec3(0.12f, 0.2f, 0.23f));
-	model = generateDefaultModelMatrixCube(model);
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(0.5f, -0.1f, 8.7f));
+	model = scale(model, glm::vec3(0.12f, 0.2f, 0.23f));
+	model = generateDefaultTransformCube(model);
 
-	shader.setMat4("model", model);
+	setModelTransform(model);
 
 	ambient = glm::vec3(0.1f, 0.05f, 0.05f);
 	diffuse = glm::vec3(0.2f, 0.1f, 0.1f);
@@ -682,12 +2846,12 @@ void drawNightStand() {
 	drawCube();
 
 	// drawer
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(0.88f, 0.0f, 8.8f));
-	model = glm::scale(model, glm::vec3(0.0001f, 0.11f, 0.18f));
-	model = generateDefaultModelMatrixCube(model);
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(0.88f, 0.0f, 8.8f));
+	model = scale(model, glm::vec3(0.0001f, 0.11f, 0.18f));
+	model = generateDefaultTransformCube(model);
 
-	shader.setMat4("model", model);
+	setModelTransform(model);
 
 	ambient = glm::vec3(0.15f, 0.1f, 0.1f);
 	diffuse = glm::vec3(0.3f, 0.2f, 0.2f);
@@ -697,12 +2861,12 @@ void drawNightStand() {
 	drawCube();
 
 	//drawer's knob
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(0.9f, 0.15f, 9.05f));
-	model = glm::scale(model, glm::vec3(0.01f, 0.02f, 0.02f));
-	model = generateDefaultModelMatrixCube(model);
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(0.9f, 0.15f, 9.05f));
+	model = scale(model, glm::vec3(0.01f, 0.02f, 0.02f));
+	model = generateDefaultTransformCube(model);
 
-	shader.setMat4("model", model);
+	setModelTransform(model);
 
 	ambient = glm::vec3(0.15f, 0.05f, 0.0f);
 	diffuse = glm::vec3(0.3f, 0.1f, 0.0f);
@@ -714,17 +2878,17 @@ void drawNightStand() {
 }
 
 void drawShelfs() {
-	glm::mat4 model;
+	ObjectTransform model;
 	glm::vec3 ambient;
 	glm::vec3 diffuse;
 
 	//middle shelf
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(0.5f, 1.9f, 3.0f));
-	model = glm::scale(model, glm::vec3(0.4f, 0.03f, 0.2f));
-	model = generateDefaultModelMatrixCube(model);
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(0.5f, 1.9f, 3.0f));
+	model = scale(model, glm::vec3(0.4f, 0.03f, 0.2f));
+	model = generateDefaultTransformCube(model);
 
-	shader.setMat4("model", model);
+	setModelTransform(model);
 
 	ambient = glm::vec3(0.1f, 0.05f, 0.05f);
 	diffuse = glm::vec3(0.2f, 0.1f, 0.1f);
@@ -735,33 +2899,33 @@ void drawShelfs() {
 	drawCube();
 
 	//top shelf
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(1.0f, 2.3f, 3.0f));
-	model = glm::scale(model, glm::vec3(0.4f, 0.03f, 0.2f));
-	model = generateDefaultModelMatrixCube(model);
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(1.0f, 2.3f, 3.0f));
+	model = scale(model, glm::vec3(0.4f, 0.03f, 0.2f));
+	model = generateDefaultTransformCube(model);
 
-	shader.setMat4("model", model);
+	setModelTransform(model);
 
 	drawCube();
 
 	//bottom shelf
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(1.0f, 1.5f, 3.0f));
-	model = glm::scale(model, glm::vec3(0.4f, 0.03f, 0.2f));
-	model = generateDefaultModelMatrixCube(model);
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(1.0f, 1.5f, 3.0f));
+	model = scale(model, glm::vec3(0.4f, 0.03f, 0.2f));
+	model = generateDefaultTransformCube(model);
 
-	shader.setMat4("model", model);
+	setModelTransform(model);
 
 	drawCube();
 
 
 	//item 1 on middle shelf
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(0.5f, 1.9f, 3.0f));
-	model = glm::scale(model, glm::vec3(0.05f, 0.16f, 0.01f));
-	model = generateDefaultModelMatrixCube(model);
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(0.5f, 1.9f, 3.0f));
+	model = scale(model, glm::vec3(0.05f, 0.16f, 0.01f));
+	model = generateDefaultTransformCube(model);
 
-	shader.setMat4("model", model);
+	setModelTransform(model);
 
 	ambient = glm::vec3(0.4315f, 0.039f, 0.1175f);
 	diffuse = glm::vec3(0.863f, 0.078f, 0.235f);
@@ -771,12 +2935,12 @@ void drawShelfs() {
 	drawCube();
 
 	//item 2 on middle shelf
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(0.8f, 1.9f, 3.0f));
-	model = glm::scale(model, glm::vec3(0.05f, 0.12f, 0.01f));
-	model = generateDefaultModelMatrixCube(model);
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(0.8f, 1.9f, 3.0f));
+	model = scale(model, glm::vec3(0.05f, 0.12f, 0.01f));
+	model = generateDefaultTransformCube(model);
 
-	shader.setMat4("model", model);
+	setModelTransform(model);
 
 	ambient = glm::vec3(0.39f, 0.041f, 0.261f);
 	diffuse = glm::vec3(0.780f, 0.082f, 0.522f);
@@ -786,12 +2950,12 @@ void drawShelfs() {
 	drawCube();
 
 	//item 1 on top shelf
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(1.11f, 2.3f, 3.1f));
-	model = glm::scale(model, glm::vec3(0.16f, 0.1f, 0.1f));
-	model = generateDefaultModelMatrixCube(model);
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(1.11f, 2.3f, 3.1f));
+	model = scale(model, glm::vec3(0.16f, 0.1f, 0.1f));
+	model = generateDefaultTransformCube(model);
 
-	shader.setMat4("model", model);
+	setModelTransform(model);
 
 	ambient = glm::vec3(0.502f, 0.502f, 0.0f);
 	diffuse = glm::vec3(0.416f, 0.353f, 0.804f);
@@ -801,12 +2965,12 @@ void drawShelfs() {
 	drawCube();
 
 	//item 2 on top shelf lower part
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(2.0f, 2.31f, 3.0f));
-	model = glm::scale(model, glm::vec3(0.04f, 0.06f, 0.2f));
-	model = generateDefaultModelMatrixCube(model);
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(2.0f, 2.31f, 3.0f));
+	model = scale(model, glm::vec3(0.04f, 0.06f, 0.2f));
+	model = generateDefaultTransformCube(model);
 
-	shader.setMat4("model", model);
+	setModelTransform(model);
 
 	ambient = glm::vec3(0.39f, 0.041f, 0.261f);
 	diffuse = glm::vec3(0.780f, 0.082f, 0.522f);
@@ -816,12 +2980,12 @@ void drawShelfs() {
 	drawCube();
 
 	//item 2 on top shelf upper part
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(2.01f, 2.46f, 3.0f));
-	model = glm::scale(model, glm::vec3(0.01f, 0.05f, 0.2f));
-	model = generateDefaultModelMatrixCube(model);
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(2.01f, 2.46f, 3.0f));
+	model = scale(model, glm::vec3(0.01f, 0.05f, 0.2f));
+	model = generateDefaultTransformCube(model);
 
-	shader.setMat4("model", model);
+	setModelTransform(model);
 
 	ambient = glm::vec3(0.2645f, 0.404f, 0.49f);
 	diffuse = glm::vec3(0.529f, 0.808f, 0.98f);
@@ -831,12 +2995,12 @@ void drawShelfs() {
 	drawCube();
 
 	//item 1 on the bottom shelf
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(1.8f, 1.5f, 3.0f));
-	model = glm::scale(model, glm::vec3(0.09f, 0.1f, 0.2f));
-	model = generateDefaultModelMatrixCube(model);
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(1.8f, 1.5f, 3.0f));
+	model = scale(model, glm::vec3(0.09f, 0.1f, 0.2f));
+	model = generateDefaultTransformCube(model);
 
-	shader.setMat4("model", model);
+	setModelTransform(model);
 
 	ambient = glm::vec3(0.349f, 0.65f, 0.065f);
 	diffuse = glm::vec3(0.698f, 0.133f, 0.133f);
@@ -847,17 +3011,17 @@ void drawShelfs() {
 }
 
 void drawMirrorTable() {
-	glm::mat4 model;
+	ObjectTransform model;
 	glm::vec3 ambient;
 	glm::vec3 diffuse;
 
 	//left drawer
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(4.5f, 0.0f, 4.6f));
-	model = glm::scale(model, glm::vec3(0.2f, 0.2f, 0.2f));
-	model = generateDefaultModelMatrixCube(model);
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(4.5f, 0.0f, 4.6f));
+	model = scale(model, glm::vec3(0.2f, 0.2f, 0.2f));
+	model = generateDefaultTransformCube(model);
 
-	shader.setMat4("model", model);
+	setModelTransform(model);
 
 	ambient = glm::vec3(0.2725f, 0.1355f, 0.0375f);
 	diffuse = glm::vec3(0.545f, 0.271f, 0.075f);
@@ -868,32 +3032,32 @@ void drawMirrorTable() {
 	drawCube();
 
 	//right drawer
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(5.6f, 0.0f, 4.6f));
-	model = glm::scale(model, glm::vec3(0.2f, 0.2f, 0.2f));
-	model = generateDefaultModelMatrixCube(model);
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(5.6f, 0.0f, 4.6f));
+	model = scale(model, glm::vec3(0.2f, 0.2f, 0.2f));
+	model = generateDefaultTransformCube(model);
 
-	shader.setMat4("model", model);
+	setModelTransform(model);
 
 	drawCube();
 
 	//middle drawer
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(4.5f, 0.6f, 4.6f));
-	model = glm::scale(model, glm::vec3(0.57f, 0.1f, 0.2f));
-	model = generateDefaultModelMatrixCube(model);
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(4.5f, 0.6f, 4.6f));
+	model = scale(model, glm::vec3(0.57f, 0.1f, 0.2f));
+	model = generateDefaultTransformCube(model);
 
-	shader.setMat4("model", model);
+	setModelTransform(model);
 
 	drawCube();
 
 	//middle drawer bottom stripe
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(4.5f, 0.6f, 5.2f));
-	model = glm::scale(model, glm::vec3(0.57f, 0.01f, 0.0001f));
-	model = generateDefaultModelMatrixCube(model);
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(4.5f, 0.6f, 5.2f));
+	model = scale(model, glm::vec3(0.57f, 0.01f, 0.0001f));
+	model = generateDefaultTransformCube(model);
 
-	shader.setMat4("model", model);
+	setModelTransform(model);
 
 	ambient = glm::vec3(0.1f, 0.05f, 0.05f);
 	diffuse = glm::vec3(0.2f, 0.1f, 0.1f);
@@ -903,93 +3067,119 @@ void drawMirrorTable() {
 	drawCube();
 
 	//middle drawer top stripe
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(4.5f, 0.9f, 5.2f));
-	model = glm::scale(model, glm::vec3(0.57f, 0.01f, 0.0001f));
-	model = generateDefaultModelMatrixCube(model);
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(4.5f, 0.9f, 5.2f));
+	model = scale(model, glm::vec3(0.57f, 0.01f, 0.0001f));
+	model = generateDefaultTransformCube(model);
+
+	setModelTransform(model);
+
+	drawCube();
+
+	//middle drawer, its front just in front of the table
+	beginAnimationNode(mirrorTableDrawerNode);
+
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(4.52f, 0.635f, 5.2f));
+	model = scale(model, glm::vec3(1.67f, 0.26f, 0.0001f) / 3.0f);
+	model = generateDefaultTransformCube(model);
+
+	setModelTransform(model);
 
-	shader.setMat4("model", model);
+	ambient = glm::vec3(0.2725f, 0.1355f, 0.0375f);
+	diffuse = glm::vec3(0.545f, 0.271f, 0.075f);
+
+	setMaterialValues(ambient, diffuse);
 
 	drawCube();
 
+	drawDrawerBox(glm::vec3(4.6f, 0.65f, 4.8f), glm::vec3(6.1f, 0.88f, 5.2f));
+
 	//middle drawer handle
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(5.1f, 0.75f, 5.2f));
-	model = glm::scale(model, glm::vec3(0.16f, 0.02f, 0.0001f));
-	model = generateDefaultModelMatrixCube(model);
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(5.1f, 0.75f, 5.2f));
+	model = scale(model, glm::vec3(0.16f, 0.02f, 0.0001f));
+	model = generateDefaultTransformCube(model);
+
+	setModelTransform(model);
+
+	ambient = glm::vec3(0.1f, 0.05f, 0.05f);
+	diffuse = glm::vec3(0.2f, 0.1f, 0.1f);
 
-	shader.setMat4("model", model);
+	setMaterialValues(ambient, diffuse);
 
 	drawCube();
 
+	endAnimationNode();
+
 	//left body handle
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(5.0f, 0.1f, 5.2f));
-	model = glm::scale(model, glm::vec3(0.02f, 0.13f, 0.0001f));
-	model = generateDefaultModelMatrixCube(model);
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(5.0f, 0.1f, 5.2f));
+	model = scale(model, glm::vec3(0.02f, 0.13f, 0.0001f));
+	model = generateDefaultTransformCube(model);
 
-	shader.setMat4("model", model);
+	setModelTransform(model);
 
 	drawCube();
 
 	//right body handle
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(5.7f, 0.1f, 5.2f));
-	model = glm::scale(model, glm::vec3(0.02f, 0.13f, 0.0001f));
-	model = generateDefaultModelMatrixCube(model);
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(5.7f, 0.1f, 5.2f));
+	model = scale(model, glm::vec3(0.02f, 0.13f, 0.0001f));
+	model = generateDefaultTransformCube(model);
 
-	shader.setMat4("model", model);
+	setModelTransform(model);
 
 	drawCube();
 
 	//mirror left stripe
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(4.77f, 0.9f, 4.71f));
-	model = glm::scale(model, glm::vec3(0.019f, 0.49f, 0.0001f));
-	model = generateDefaultModelMatrixCube(model);
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(4.77f, 0.9f, 4.71f));
+	model = scale(model, glm::vec3(0.019f, 0.49f, 0.0001f));
+	model = generateDefaultTransformCube(model);
 
-	shader.setMat4("model", model);
+	setModelTransform(model);
 
 	drawCube();
 
 
 	//mirror right stripe
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(5.85f, 0.9f, 4.71f));
-	model = glm::scale(model, glm::vec3(0.019f, 0.49f, 0.0001f));
-	model = generateDefaultModelMatrixCube(model);
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(5.85f, 0.9f, 4.71f));
+	model = scale(model, glm::vec3(0.019f, 0.49f, 0.0001f));
+	model = generateDefaultTransformCube(model);
 
-	shader.setMat4("model", model);
+	setModelTransform(model);
 	
 	drawCube();
 
 	//mirror bottom stripe 
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(4.77f, 0.9f, 4.71f));
-	model = glm::scale(model, glm::vec3(0.36f, 0.019f, 0.0001f));
-	model = generateDefaultModelMatrixCube(model);
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(4.77f, 0.9f, 4.71f));
+	model = scale(model, glm::vec3(0.36f, 0.019f, 0.0001f));
+	model = generateDefaultTransformCube(model);
 
-	shader.setMat4("model", model);
+	setModelTransform(model);
 
 	drawCube();
 
 	//mirror top stripe
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(4.77f, 2.35f, 4.71f));
-	model = glm::scale(model, glm::vec3(0.379f, 0.019f, 0.0001f));
-	model = generateDefaultModelMatrixCube(model);
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(4.77f, 2.35f, 4.71f));
+	model = scale(model, glm::vec3(0.379f, 0.019f, 0.0001f));
+	model = generateDefaultTransformCube(model);
 
-	shader.setMat4("model", model);
+	setModelTransform(model);
 
 	drawCube();
 
-	// mirror
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(4.8f, 0.9f, 4.7f));
-	model = glm::scale(model, glm::vec3(0.36f, 0.5f, 0.0001f));
-	model = generateDefaultModelMatrixCube(model);
+	// mirror, the planar reflection is drawn over its front face
+	model = ObjectTransform();
+	model = translate(model, mirrorPosition);
+	model = scale(model, mirrorScale);
+	model = generateDefaultTransformCube(model);
 
-	shader.setMat4("model", model);
+	setModelTransform(model);
 
 	ambient = glm::vec3(0.345f, 0.439f, 0.451f);
 	diffuse = glm::vec3(0.690f, 0.878f, 0.902f);
@@ -998,20 +3188,36 @@ void drawMirrorTable() {
 	setMaterialValues(ambient, diffuse,glm::vec3(0,0,0), shinines);
 
 	drawCube();
+
+	//glass vase on the table, in front of the mirror
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(5.45f, 0.9f, 4.85f));
+	model = scale(model, glm::vec3(0.05f, 0.1f, 0.05f));
+	model = generateDefaultTransformCube(model);
+
+	setModelTransform(model);
+
+	ambient = glm::vec3(0.05f, 0.08f, 0.09f);
+	diffuse = glm::vec3(0.6f, 0.85f, 0.9f);
+
+	setMaterialValues(ambient, diffuse, glm::vec3(0.0f, 0.0f, 0.0f), 96.0f);
+	setMaterialOpacity(0.3f);
+
+	drawCube();
 }
 
 void drawNightStandLamp() {
-	glm::mat4 model;
+	ObjectTransform model;
 	glm::vec3 ambient;
 	glm::vec3 diffuse;
 
 	//lamp base
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(0.6f, 0.5f, 8.95f));
-	model = glm::scale(model, glm::vec3(0.07f, 0.02f, 0.07f));
-	model = generateDefaultModelMatrixCube(model);
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(0.6f, 0.5f, 8.95f));
+	model = scale(model, glm::vec3(0.07f, 0.02f, 0.07f));
+	model = generateDefaultTransformCube(model);
 
-	shader.setMat4("model", model);
+	setModelTransform(model);
 
 	ambient = glm::vec3(0.0f, 0.0f, 0.5f);
 	diffuse = glm::vec3(0.0f, 0.0f, 1.0f);
@@ -1021,12 +3227,12 @@ void drawNightStandLamp() {
 	drawCube();
 
 	//stand
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(0.7f, 0.35f, 9.050f));
-	model = glm::scale(model, glm::vec3(0.01f, 0.2f, 0.01f));
-	model = generateDefaultModelMatrixCube(model);
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(0.7f, 0.35f, 9.050f));
+	model = scale(model, glm::vec3(0.01f, 0.2f, 0.01f));
+	model = generateDefaultTransformCube(model);
 
-	shader.setMat4("model", model);
+	setModelTransform(model);
 
 	ambient = glm::vec3(0.8f, 0.8f, 0.8f);
 	diffuse = glm::vec3(1.0f, 1.0f, 1.0f);
@@ -1036,151 +3242,417 @@ void drawNightStandLamp() {
 	drawCube();
 
 	//shade
-	model = glm::mat4(1);
-	model = glm::translate(model, glm::vec3(0.6f, 0.9f, 8.9f));
-	model = glm::scale(model, glm::vec3(0.08f, 0.09f, 0.08f));
-	model = generateDefaultModelMatrixCube(model);
+	model = ObjectTransform();
+	model = translate(model, glm::vec3(0.6f, 0.9f, 8.9f));
+	model = scale(model, glm::vec3(0.08f, 0.09f, 0.08f));
+	model = generateDefaultTransformCube(model);
 
-	shader.setMat4("model", model);
+	setModelTransform(model);
 
 	ambient = glm::vec3(0.0f, 0.0f, 0.2725f);
 	diffuse = glm::vec3(0.0f, 0.0f, 0.545f);
-	glm::vec3 emission = glm::vec3(0.0f, 0.0f, 0.0f);
-
-	if (nightLampStatus) {
-		emission = glm::vec3(0.0f, 0.0f, 0.5f);
-	}
 
-	setMaterialValues(ambient, diffuse, emission);
+	setMaterialValues(ambient, diffuse, getLampEmission(NIGHT_LAMP));
+	setMaterialOpacity(0.75f);
 
+	currentLamp = NIGHT_LAMP;
 	drawCube();
+	currentLamp = NO_LAMP;
 
 }
 
 void drawCeilingLight() {
-	glm::mat4 model = glm::mat4(1);
+	ObjectTransform model;
 
-	model = glm::translate(model, glm::vec3(5.0f, 5.0f, 7.5f));
-	model = glm::scale(model, glm::vec3(0.3f, 0.03f, 0.3f));
-	model = generateDefaultModelMatrixCube(model);
+	model = translate(model, glm::vec3(5.0f, 5.0f, 7.5f));
+	model = scale(model, glm::vec3(0.3f, 0.03f, 0.3f));
+	model = generateDefaultTransformCube(model);
 
 	glm::vec3 ambient = glm::vec3(0.7f, 0.7f, 0.7f);
 	glm::vec3 diffuse = glm::vec3(1.0f, 0.843f, 0.0f);
-	glm::vec3 emission = glm::vec3(0.0f, 0.0f, 0.0f);
-
-	if (ceilingLampStatus) {
-		emission = glm::vec3(1.0f, 1.0f, 1.0f);
-	}
-
-	setMaterialValues(ambient, diffuse, emission);
-
-	shader.setMat4("model", model);
-
-	drawCube();
-}
-
-GLuint createCube()
-{
-	//each side of the cube with its own vertices to use different normals
-	float vertices[] = {
-		//front side
-		-0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-		0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-		0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-		0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-		-0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-		-0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-
-		//back side
-		-0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
-		0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
-		0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
-		0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
-		-0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
-		-0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
-
-		//left side
-		-0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
-		-0.5f,  0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
-		-0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
-		-0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
-		-0.5f, -0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
-		-0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
-
-		//right side
-		0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
-		0.5f,  0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
-		0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
-		0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
-		0.5f, -0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
-		0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
-
-		//bottom side
-		-0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,
-		0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,
-		0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
-		0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
-		-0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
-		-0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,
-
-		//top side
-		-0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,
-		0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,
-		0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
-		0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
-		-0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
-		-0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f
-	};
 
-	GLuint vertexArrayObject;
-	GLuint vertexBufferObject;
+	setMaterialValues(ambient, diffuse, getLampEmission(CEILING_LAMP));
+
+	setModelTransform(model);
+
+	currentLamp = CEILING_LAMP;
+	drawCube();
+	currentLamp = NO_LAMP;
+}
+
+//HDR, a lamp that is switched on is bright enough to bloom
+glm::vec3 getLampEmission(unsigned int lamp)
+{
+	if (lamp == CEILING_LAMP && ceilingLampStatus)
+	{
+		return glm::vec3(4.0f, 4.0f, 4.0f);
+	}
+	if (lamp == NIGHT_LAMP && nightLampStatus)
+	{
+		return glm::vec3(0.0f, 0.0f, 2.0f);
+	}
+	return glm::vec3(0.0f, 0.0f, 0.0f);
+}
+
+//imported meshes stand in a row on the carpet in front of the bed, scaled so their longest side is 1
+void drawImportedMeshes() {
+	const float floorHeight = -0.2f;
+
+	glm::vec3 ambient = glm::vec3(0.35f, 0.35f, 0.35f);
+	glm::vec3 diffuse = glm::vec3(0.7f, 0.7f, 0.7f);
+	setMaterialValues(ambient, diffuse);
+
+	for (unsigned int mesh = CUBE_MESH + 1; mesh < meshRegistry.getMeshCount(); mesh++)
+	{
+		glm::vec3 size = meshRegistry.getSize(mesh);
+		size /= std::max(size.x, std::max(size.y, size.z));
+
+		ObjectTransform model;
+		model = translate(model, glm::vec3(4.0f + (mesh - 1) * 1.2f, floorHeight + 0.5f * size.y, 8.0f));
+		model = scale(model, size);
+
+		setModelTransform(model);
+		drawMesh(mesh);
+	}
+}
+
+//two triangles per side
+void getCubeIndices(GLuint indices[36])
+{
+	for (int side = 0; side < 6; side++)
+	{
+		GLuint first = side * 4;
+		GLuint sideIndices[] = { first, first + 1, first + 2, first + 2, first + 3, first };
+		for (int i = 0; i < 6; i++)
+		{
+			indices[side * 6 + i] = sideIndices[i];
+		}
+	}
+}
+
+//the cube is mesh 0, imported meshes are fitted into the unit cube and keep their size for drawImportedMeshes()
+void registerMeshes(const std::vector<std::string>& importPaths)
+{
+	GLuint indices[36];
+	getCubeIndices(indices);
+	meshRegistry.add("Cube", cubeVertices, cubeVertexCount, indices, 36);
+
+	for (size_t i = 0; i < importPaths.size(); i++)
+	{
+		ImportedMesh mesh;
+		MeshImportStats stats;
+		if (!meshImporter.import(importPaths[i], threadPool, mesh, stats))
+		{
+			continue;
+		}
+
+		glm::vec3 size = MeshImporter::fitToUnitCube(mesh);
+		meshRegistry.add(importPaths[i], mesh.vertices.data(), stats.vertexCount, mesh.indices.data(), (unsigned int)mesh.indices.size(), size);
 
-	glGenBuffers(1, &vertexBufferObject);
-	glGenVertexArrays(1, &vertexArrayObject);
+		std::cout << "Imported " << importPaths[i] << ": " << stats.fileBytes / 1000000.0 << " MB at " << stats.getThroughput() << " MB/s on "
+			<< stats.threads << " threads (read " << stats.readMilliseconds << " ms, parse " << stats.parseMilliseconds << " ms, index "
+			<< stats.indexMilliseconds << " ms), " << stats.corners << " corners merged into " << stats.vertexCount << " vertices, "
+			<< stats.triangleCount << " triangles, ACMR " << stats.acmrBefore << " -> " << stats.acmrAfter << " with " << stats.clusterCount
+			<< " overdraw runs, optimized in " << stats.optimizeMilliseconds << " ms" << std::endl;
+	}
+}
 
-	glBindVertexArray(vertexArrayObject);
-	glBindBuffer(GL_ARRAY_BUFFER, vertexBufferObject);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+//uploads every registered mesh and adds the per-instance object index to their vertex array
+GLuint createGeometry()
+{
+	GLuint vertexArrayObject = meshRegistry.upload();
 
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
+	MemoryScope scope(MEMORY_TAG_GEOMETRY);
 
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-	glEnableVertexAttribArray(1);
+	//object index per instance, the draw's base instance selects the object record
+	glState.bindVertexArray(vertexArrayObject);
+	glGenBuffers(1, &gObjectIndexBuffer);
+	glState.bindBuffer(GL_ARRAY_BUFFER, gObjectIndexBuffer);
+	glVertexAttribIPointer(2, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)0);
+	glVertexAttribDivisor(2, 1);
+	glEnableVertexAttribArray(2);
 
+	glState.bindBuffer(GL_ARRAY_BUFFER, 0);
 
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glState.bindVertexArray(0);
 
-	glBindVertexArray(0);
+	gObjectIndexCapacity = 0;
+	resizeObjectIndexBuffer(frameObjectLimit);
 
 	return vertexArrayObject;
 }
 
+//the object index attribute must cover every base instance used by a draw
+void resizeObjectIndexBuffer(unsigned int objectCount)
+{
+	if (objectCount <= gObjectIndexCapacity)
+	{
+		return;
+	}
+
+	MemoryScope scope(MEMORY_TAG_GEOMETRY);
+
+	std::vector<GLuint> objectIndices(objectCount);
+	for (unsigned int i = 0; i < objectCount; i++)
+	{
+		objectIndices[i] = i;
+	}
+
+	gpuMemory.bufferData(gObjectIndexBuffer, objectIndices.size() * sizeof(GLuint), objectIndices.data(), GL_STATIC_DRAW);
+
+	gObjectIndexCapacity = objectCount;
+}
+
 void drawCube() {
-	glBindVertexArray(gVertexArrayObjectCube);
-	glDrawArrays(GL_TRIANGLES, 0, 36);
-	//glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, (void*)0);
-	glBindVertexArray(0);
+	drawMesh(CUBE_MESH);
+}
+
+void drawMesh(unsigned int mesh)
+{
+	//the recorded scene keeps the rest transform, the animation moves its records in place
+	if (recordingScene)
+	{
+		ObjectData object;
+		object.transform = currentTransform;
+		object.material = currentMaterial;
+		object.mesh = mesh;
+		object.animationNode = currentAnimationNode;
+		object.lamp = currentLamp;
+		sceneObjects.push_back(object);
+		sceneBounds.push_back(computeCubeBounds(currentTransform));
+		return;
+	}
+
+	if (frameObjectCount >= frameObjectCapacity)
+	{
+		return;
+	}
+
+	ObjectTransform transform = currentTransform;
+	if (currentAnimationNode != NO_ANIMATION_NODE)
+	{
+		if (animationAnchorPending)
+		{
+			currentAnimationMotion = sceneAnimation.getMotion(currentAnimationNode, currentTransform);
+			animationAnchorPending = false;
+		}
+		transform = combine(currentAnimationMotion, currentTransform);
+	}
+
+	ObjectData& object = frameObjects[frameObjectCount];
+	object.transform = transform;
+	object.material = currentMaterial;
+	object.mesh = mesh;
+	object.animationNode = currentAnimationNode;
+	streamBuffer.written(&object, sizeof(ObjectData));
+
+	frameObjectMeshes[frameObjectCount] = mesh;
+	if (planarReflection.isVisible())
+	{
+		//the slot still holds the bounds of the same object in the last frame
+		ObjectBounds& bounds = frameObjectBounds[frameObjectCount];
+		bool moved = currentAnimationNode != NO_ANIMATION_NODE && sceneAnimation.hasMoved(currentAnimationNode);
+		if (moved)
+		{
+			planarReflection.objectMoved(bounds);
+		}
+		bounds = computeCubeBounds(transform);
+		if (moved)
+		{
+			planarReflection.objectMoved(bounds);
+		}
+	}
+	if (currentMaterial.opacity < 1.0f)
+	{
+		frameTranslucentObjects[frameTranslucentCount++] = frameObjectCount;
+	}
+	frameObjectCount++;
+}
+
+//one draw per recorded opaque object, their matrices are computed by then
+void drawFrameObjects()
+{
+	glState.bindVertexArray(gSceneVertexArray);
+	unsigned int nextTranslucent = 0;
+	for (unsigned int i = 0; i < frameObjectCount; i++)
+	{
+		if (nextTranslucent < frameTranslucentCount && frameTranslucentObjects[nextTranslucent] == i)
+		{
+			nextTranslucent++;
+			continue;
+		}
+		meshRegistry.draw(frameObjectMeshes[i], 1, i);
+	}
+}
+
+//one draw per recorded opaque object the mirror can show, tested against the mirrored frustum
+void drawFrameReflectedObjects()
+{
+	glState.bindVertexArray(gSceneVertexArray);
+	unsigned int nextTranslucent = 0;
+	unsigned int drawn = 0;
+	for (unsigned int i = 0; i < frameObjectCount; i++)
+	{
+		if (nextTranslucent < frameTranslucentCount && frameTranslucentObjects[nextTranslucent] == i)
+		{
+			nextTranslucent++;
+			continue;
+		}
+		if (planarReflection.intersects(frameObjectBounds[i]))
+		{
+			meshRegistry.draw(frameObjectMeshes[i], 1, i);
+			drawn++;
+		}
+	}
+	planarReflection.stats.drawnObjects = drawn;
+	planarReflection.stats.culledObjects = frameObjectCount - frameTranslucentCount - drawn;
+}
+
+//one draw per recorded translucent object, in any order
+void drawFrameTranslucentObjects()
+{
+	glState.bindVertexArray(gSceneVertexArray);
+	for (unsigned int i = 0; i < frameTranslucentCount; i++)
+	{
+		unsigned int object = frameTranslucentObjects[i];
+		meshRegistry.draw(frameObjectMeshes[object], 1, object);
+	}
+}
+
+//per-frame values shared by the GL and the software renderer
+FrameData getFrameData()
+{
+	FrameData frame;
+	frame.projection = glm::perspective(glm::radians(camera.Zoom), (float)windowWidth / windowHeight, 2.0f, 1000.0f);
+	frame.view = camera.GetViewMatrix();
+	frame.viewPos = glm::vec4(camera.Position, 1.0f);
+	return frame;
+}
+
+//only the lamps that are switched on are compiled into the scene shader
+unsigned int getShaderFeatures()
+{
+	unsigned int features = 0;
+
+	if (ceilingLampStatus)
+	{
+		features |= FEATURE_CEILING_LAMP;
+	}
+
+	if (nightLampStatus)
+	{
+		features |= FEATURE_NIGHT_LAMP | FEATURE_NIGHT_LAMP_SPOT;
+	}
+
+	if (lightmapMode)
+	{
+		features |= FEATURE_LIGHTMAP;
+	}
+
+	if (gpuDrivenMode && gpuDrivenRenderer.packedInstances)
+	{
+		features |= FEATURE_PACKED_INSTANCES;
+	}
+
+	return features;
+}
+
+//light uniforms that stay the same for the whole run, uniforms a variant does not declare are ignored
+void initSceneShader(Shader& variant)
+{
+	variant.setVec3("ceilingLampLight.diffuse", glm::vec3(1.0f, 1.0f, 1.0f));
+	variant.setVec3("ceilingLampLight.position", ceilingLightPosition);
+
+	variant.setVec3("nightLampLight.diffuse", glm::vec3(1.0f, 1.0f, 1.0f));
+	variant.setVec3("nightLampLight.position", nightLampLightPosition);
+	variant.setVec3("nightLampLightDirection", nightLampLightDirection);
+
+	variant.setFloat("nightLampLightCutOff", glm::cos(glm::radians(35.0f)));
+
+	variant.setFloat("nightLampLightOuterCutOff", glm::cos(glm::radians(40.0f)));
 }
 
-glm::mat4 generateDefaultModelMatrixCube(glm::mat4 model)
+ObjectTransform generateDefaultTransformCube(ObjectTransform model)
 {
-	model = glm::translate(model, glm::vec3(1.5f, 1.5f, 1.5f));
-	model = glm::scale(model, glm::vec3(3.0f, 3.0f, 3.0f));
+	model = translate(model, glm::vec3(1.5f, 1.5f, 1.5f));
+	model = scale(model, glm::vec3(3.0f, 3.0f, 3.0f));
 
 	return model;
 }
 
+void setModelTransform(const ObjectTransform& model)
+{
+	currentTransform = model;
+}
+
 void setMaterialValues(glm::vec3 ambient, glm::vec3 diffuse, glm::vec3 emission, float shininess) {
 
-	shader.setVec3("fragMaterial.ambient", ambient);
-	shader.setVec3("fragMaterial.diffuse", diffuse);
-	shader.setVec3("fragMaterial.emission", emission);
-	shader.setVec3("fragMaterial.specular", 1.0f, 1.0f, 1.0f);
-	shader.setFloat("fragMaterial.shininess", shininess);
+	currentMaterial.ambient = ambient;
+	currentMaterial.diffuse = diffuse;
+	currentMaterial.emission = emission;
+	currentMaterial.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+	currentMaterial.shininess = shininess;
+
+	currentMaterial.ka = 1.0f;
+	currentMaterial.kd = 1.0f;
+	currentMaterial.ks = 1.0f;
+
+	currentMaterial.opacity = 1.0f;
+}
+
+//for the objects drawn next, call it after setMaterialValues()
+void setMaterialOpacity(float opacity) {
+	currentMaterial.opacity = opacity;
+}
+
+//heap tracking, every block carries its size and tag in front so delete can charge it back
+struct alignas(16) HeapBlockHeader {
+	size_t size;
+	MemoryTag tag;
+};
+
+void* operator new(size_t size)
+{
+	HeapBlockHeader* header = (HeapBlockHeader*)malloc(sizeof(HeapBlockHeader) + size);
+	if (header == NULL)
+	{
+		throw std::bad_alloc();
+	}
+
+	header->size = size;
+	header->tag = MemoryScope::current();
+	cpuMemory.add(header->tag, (long long)size);
+	return header + 1;
+}
+
+void operator delete(void* pointer) noexcept
+{
+	if (pointer == NULL)
+	{
+		return;
+	}
+
+	HeapBlockHeader* header = (HeapBlockHeader*)pointer - 1;
+	cpuMemory.remove(header->tag, (long long)header->size);
+	free(header);
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+	operator delete(pointer);
+}
 
-	shader.setFloat("fragMaterial.ka", 1.0f);
-	shader.setFloat("fragMaterial.kd", 1.0f);
-	shader.setFloat("fragMaterial.ks", 1.0f);
+void operator delete(void* pointer, size_t) noexcept
+{
+	operator delete(pointer);
+}
 
-}
\ No newline at end of file
+void operator delete[](void* pointer, size_t) noexcept
+{
+	operator delete(pointer);
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+/*
+ Dynamic resolution controller.
+ Chooses the size of the render targets as a fraction of the window from the measured GPU time of
+ the frame, so that the frame stays within a GPU budget. The GPU time is roughly proportional to the
+ number of pixels: when the frame is too slow the scale drops at once to where the budget should be
+ met, when there is headroom it goes back up one step at a time. Scales are quantized to steps so the
+ frame graph pool only ever sees a few different target sizes.
+*/
+
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+
+class DynamicResolution
+{
+public:
+	bool enabled = true;
+	float targetMilliseconds = 14.0f;	// GPU budget, below the 16.7 ms of 60 Hz to leave room for the CPU
+	float minScale = 0.5f;
+	float maxScale = 1.0f;
+	float step = 0.0625f;
+
+	DynamicResolution() {}
+
+	// feeds the GPU time of the last measured frame, 0 when no timing is available yet
+	// ------------------------------------------------------------------------
+	void update(double gpuMilliseconds)
+	{
+		frames++;
+		scaleSum += scale;
+
+		if (!enabled || gpuMilliseconds <= 0.0)
+		{
+			return;
+		}
+
+		//the timings arrive a few frames late, the first ones after a change are from the old size
+		framesSinceChange++;
+		if (framesSinceChange <= MEASURE_DELAY)
+		{
+			return;
+		}
+
+		filteredMilliseconds = filteredMilliseconds > 0.0 ? filteredMilliseconds + (gpuMilliseconds - filteredMilliseconds) * 0.2 : gpuMilliseconds;
+		if (framesSinceChange < MEASURE_DELAY + SETTLE_FRAMES)
+		{
+			return;
+		}
+
+		float newScale = scale;
+		if (filteredMilliseconds > targetMilliseconds)
+		{
+			newScale = scale * (float)std::sqrt(targetMilliseconds / filteredMilliseconds);
+			newScale = std::min(std::floor(newScale / step) * step, scale - step);
+		}
+		else if (filteredMilliseconds < targetMilliseconds * HEADROOM)
+		{
+			newScale = scale + step;
+		}
+
+		newScale = std::max(minScale, std::min(maxScale, newScale));
+		if (newScale != scale)
+		{
+			scale = newScale;
+			lowestScale = std::min(lowestScale, scale);
+			framesSinceChange = 0;
+			filteredMilliseconds = 0.0;
+			changes++;
+		}
+	}
+
+	// turns the controller off and renders at the given scale
+	void setFixedScale(float fixedScale)
+	{
+		enabled = false;
+		scale = std::max(0.1f, std::min(1.0f, fixedScale));
+		lowestScale = std::min(lowestScale, scale);
+	}
+
+	// back to full resolution, for when the controller is switched off
+	void reset()
+	{
+		scale = maxScale;
+		framesSinceChange = 0;
+		filteredMilliseconds = 0.0;
+	}
+
+	float getScale() const
+	{
+		return scale;
+	}
+
+	// ------------------------------------------------------------------------
+	void getRenderSize(int windowWidth, int windowHeight, int& width, int& height) const
+	{
+		width = std::max(1, (int)(windowWidth * scale + 0.5f));
+		height = std::max(1, (int)(windowHeight * scale + 0.5f));
+	}
+
+	void printStats() const
+	{
+		std::cout << "Dynamic resolution: " << (enabled ? "on" : "off") << ", scale " << scale << " now, "
+			<< (frames > 0 ? scaleSum / frames : scale) << " on average, " << lowestScale << " lowest, " << changes << " changes, GPU "
+			<< filteredMilliseconds << " ms (target " << targetMilliseconds << " ms)" << std::endl;
+	}
+
+private:
+	static const int MEASURE_DELAY = 5;		// frames until the timings show a new size
+	static const int SETTLE_FRAMES = 8;		// frames averaged before the next decision
+	static constexpr float HEADROOM = 0.8f;	// only scale up when the frame is this far under budget
+
+	float scale = 1.0f;
+	float lowestScale = 1.0f;
+	double filteredMilliseconds = 0.0;
+	int framesSinceChange = 0;
+	unsigned int changes = 0;
+	unsigned long long frames = 0;
+	double scaleSum = 0.0;
+};
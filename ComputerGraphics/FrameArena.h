@@ -0,0 +1,163 @@
+#pragma once
+
+/*
+ Linear allocator for data that only lives during one frame.
+ Allocations bump a pointer through one block that is reset at the end of every frame, nothing is
+ freed on its own. When a frame needs more than the block holds the rest comes from overflow blocks
+ on the heap, and the next reset replaces the block by one large enough for that frame, so after the
+ first frames the arena stops touching the heap. Objects that need their destructor run can be
+ created with create(), the destructors are called in reverse order on reset.
+*/
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include <utility>
+#include <type_traits>
+#include <iostream>
+
+#include "MemoryTracker.h"
+
+struct FrameArenaStats {
+	size_t capacity = 0;			// size of the block
+	size_t frameBytes = 0;			// used by the last completed frame
+	size_t peakBytes = 0;			// most any frame used
+	unsigned int overflows = 0;		// allocations that did not fit the block
+	unsigned int grows = 0;			// times the block was replaced by a larger one
+};
+
+class FrameArena
+{
+public:
+	FrameArenaStats stats;
+
+	FrameArena() {}
+
+	~FrameArena()
+	{
+		release();
+	}
+
+	void init(size_t capacity)
+	{
+		release();
+
+		MemoryScope scope(MEMORY_TAG_FRAME_ARENA);
+		block = (char*)::operator new(capacity);
+		stats.capacity = capacity;
+		head = 0;
+	}
+
+	// uninitialized memory, valid until the next reset()
+	// ------------------------------------------------------------------------
+	void* allocate(size_t size, size_t alignment = alignof(std::max_align_t))
+	{
+		size_t alignedHead = (head + alignment - 1) / alignment * alignment;
+		if (block != NULL && alignedHead + size <= stats.capacity)
+		{
+			head = alignedHead + size;
+			return block + alignedHead;
+		}
+
+		//keeps counting as if the block were large enough, that is the size it grows to on reset
+		head = alignedHead + size;
+		stats.overflows++;
+
+		MemoryScope scope(MEMORY_TAG_FRAME_ARENA);
+		overflowBlocks.push_back(::operator new(size + alignment));
+		size_t address = (size_t)overflowBlocks.back();
+		return (void*)((address + alignment - 1) / alignment * alignment);
+	}
+
+	template<typename T>
+	T* allocateArray(size_t count)
+	{
+		return (T*)allocate(count * sizeof(T), alignof(T));
+	}
+
+	// constructs an object in the arena, its destructor runs on reset() unless it has none
+	// ------------------------------------------------------------------------
+	template<typename T, typename... Args>
+	T* create(Args&&... args)
+	{
+		T* object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+		if (!std::is_trivially_destructible<T>::value)
+		{
+			Destructor* destructor = new (allocate(sizeof(Destructor), alignof(Destructor))) Destructor;
+			destructor->object = object;
+			destructor->destroy = [](void* pointer) { ((T*)pointer)->~T(); };
+			destructor->next = destructors;
+			destructors = destructor;
+		}
+		return object;
+	}
+
+	// ends the frame, everything allocated since the last reset is gone
+	// ------------------------------------------------------------------------
+	void reset()
+	{
+		for (Destructor* destructor = destructors; destructor != NULL; destructor = destructor->next)
+		{
+			destructor->destroy(destructor->object);
+		}
+		destructors = NULL;
+
+		stats.frameBytes = head;
+		stats.peakBytes = head > stats.peakBytes ? head : stats.peakBytes;
+
+		if (!overflowBlocks.empty())
+		{
+			for (size_t i = 0; i < overflowBlocks.size(); i++)
+			{
+				::operator delete(overflowBlocks[i]);
+			}
+			overflowBlocks.clear();
+
+			size_t capacity = stats.capacity;
+			while (capacity < head)
+			{
+				capacity = capacity > 0 ? capacity * 2 : 4096;
+			}
+			FrameArenaStats kept = stats;
+			init(capacity);
+			kept.capacity = capacity;
+			kept.grows++;
+			stats = kept;
+		}
+
+		head = 0;
+	}
+
+	void release()
+	{
+		if (block != NULL)
+		{
+			::operator delete(block);
+			block = NULL;
+		}
+		stats.capacity = 0;
+		head = 0;
+	}
+
+	void printStats() const
+	{
+		std::cout << "Frame arena: " << stats.frameBytes << " bytes last frame, " << stats.peakBytes << " bytes peak, "
+			<< stats.capacity / 1024 << " KB block, " << stats.overflows << " overflow allocations, " << stats.grows << " grows" << std::endl;
+	}
+
+private:
+	struct Destructor {
+		void* object;
+		void (*destroy)(void*);
+		Destructor* next;
+	};
+
+	char* block = NULL;
+	size_t head = 0;
+	Destructor* destructors = NULL;
+	std::vector<void*> overflowBlocks;
+};
+
+// The arena of the frame in progress, defined in ComputerGraphics.cpp and reset at the end of render()
+extern FrameArena frameArena;
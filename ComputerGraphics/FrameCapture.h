@@ -0,0 +1,469 @@
+#pragma once
+
+/*
+ Stall-free frame capture.
+ Every captured frame is read back with glReadPixels into one of RING_SIZE pixel pack buffers
+ and fenced. The buffer is only mapped RING_SIZE frames later, when the GPU is long done with it,
+ so the render thread never waits on the readback. Encoding and disk I/O run on a writer thread.
+*/
+
+#include <GL/glew.h>
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+
+#include "GLState.h"
+
+enum CaptureFormat {
+	CAPTURE_PNG,	// one png file per frame
+	CAPTURE_Y4M		// single raw YUV 4:2:0 stream
+};
+
+class FrameCapture
+{
+public:
+	// Number of frames between issuing a readback and mapping it
+	static const int RING_SIZE = 3;
+	// Upper bound of frames waiting for the writer thread before the render thread has to wait
+	static const int MAX_QUEUED_FRAMES = 8;
+
+	// Capture statistics
+	unsigned int framesCaptured = 0;
+	unsigned int framesWritten = 0;
+	unsigned int fenceStalls = 0;	// mapped a buffer whose fence was not yet signalled
+	unsigned int writerStalls = 0;	// writer queue full, render thread had to wait
+
+	FrameCapture() {}
+	~FrameCapture()
+	{
+		stop();
+	}
+
+	// Starts capturing the default framebuffer. For png, outputPath is a file prefix ("capture/frame"),
+	// for y4m it is the stream file name.
+	bool start(const std::string& outputPath, int frameWidth, int frameHeight, CaptureFormat captureFormat, int framesPerSecond = 60)
+	{
+		if (active)
+		{
+			return true;
+		}
+
+		if (captureFormat == CAPTURE_Y4M && (frameWidth % 2 != 0 || frameHeight % 2 != 0))
+		{
+			std::cout << "ERROR::CAPTURE::Y4M_NEEDS_EVEN_DIMENSIONS" << std::endl;
+			return false;
+		}
+
+		path = outputPath;
+		width = frameWidth;
+		height = frameHeight;
+		format = captureFormat;
+		fps = framesPerSecond;
+		frameSize = (size_t)width * height * 4;
+
+		if (format == CAPTURE_Y4M)
+		{
+			stream.open(path, std::ios::binary);
+			if (!stream.is_open())
+			{
+				std::cout << "ERROR::CAPTURE::FILE_NOT_SUCCESFULLY_OPENED " << path << std::endl;
+				return false;
+			}
+			stream << "YUV4MPEG2 W" << width << " H" << height << " F" << fps << ":1 Ip A1:1 C420jpeg\n";
+		}
+
+		MemoryScope scope(MEMORY_TAG_CAPTURE);
+
+		glCreateBuffers(RING_SIZE, pbos);
+		for (int i = 0; i < RING_SIZE; i++)
+		{
+			gpuMemory.bufferData(pbos[i], frameSize, NULL, GL_STREAM_READ);
+			fences[i] = 0;
+		}
+
+		//the frame buffers are allocated up front so a capture does not allocate per frame
+		freeFrames.clear();
+		for (int i = 0; i < MAX_QUEUED_FRAMES; i++)
+		{
+			freeFrames.push_back(std::vector<unsigned char>(frameSize));
+		}
+
+		nextSlot = 0;
+		frameNumber = 0;
+		framesCaptured = 0;
+		framesWritten = 0;
+		fenceStalls = 0;
+		writerStalls = 0;
+		stopWriter = false;
+		writer = std::thread(&FrameCapture::writerLoop, this);
+		active = true;
+
+		return true;
+	}
+
+	// Queues a readback of the current back buffer. Call after rendering and before swapping.
+	void captureFrame()
+	{
+		if (!active)
+		{
+			return;
+		}
+
+		//the slot we are about to reuse holds the frame issued RING_SIZE frames ago
+		if (fences[nextSlot] != 0)
+		{
+			retireSlot(nextSlot);
+		}
+
+		GLint previousPackBuffer;
+		glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &previousPackBuffer);
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[nextSlot]);
+		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+		glReadBuffer(GL_BACK);
+		glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, previousPackBuffer);
+
+		fences[nextSlot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		slotFrameNumbers[nextSlot] = frameNumber++;
+
+		nextSlot = (nextSlot + 1) % RING_SIZE;
+	}
+
+	// Flushes all outstanding readbacks, waits for the writer and releases the buffers
+	void stop()
+	{
+		if (!active)
+		{
+			return;
+		}
+
+		//retire in issue order
+		for (int i = 0; i < RING_SIZE; i++)
+		{
+			int slot = (nextSlot + i) % RING_SIZE;
+			if (fences[slot] != 0)
+			{
+				retireSlot(slot);
+			}
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			stopWriter = true;
+		}
+		queueCondition.notify_all();
+		writer.join();
+
+		glState.deleteBuffers(RING_SIZE, pbos);
+
+		if (stream.is_open())
+		{
+			stream.close();
+		}
+
+		freeFrames.clear();
+		active = false;
+
+		std::cout << "Capture finished: " << framesWritten << " frames written, "
+			<< fenceStalls << " fence stalls, " << writerStalls << " writer stalls" << std::endl;
+	}
+
+	bool isActive() const
+	{
+		return active;
+	}
+
+	// Writes a bottom-up RGBA image as an RGB png using stored (uncompressed) deflate blocks, which keeps the writer thread cheap
+	// ------------------------------------------------------------------------
+	static void encodePNG(const std::vector<unsigned char>& rgba, int width, int height, std::vector<unsigned char>& out)
+	{
+		size_t rowSize = (size_t)width * 3 + 1;
+		size_t rawSize = rowSize * height;
+
+		out.clear();
+		const unsigned char signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		out.insert(out.end(), signature, signature + sizeof(signature));
+
+		unsigned char ihdr[13];
+		putBigEndian(ihdr, width);
+		putBigEndian(ihdr + 4, height);
+		ihdr[8] = 8;	//bit depth
+		ihdr[9] = 2;	//truecolor
+		ihdr[10] = 0;
+		ihdr[11] = 0;
+		ihdr[12] = 0;
+		writeChunk(out, "IHDR", ihdr, sizeof(ihdr));
+
+		//zlib stream: header, stored blocks of at most 65535 bytes, adler32
+		size_t blockCount = (rawSize + 65534) / 65535;
+		std::vector<unsigned char> idat;
+		idat.reserve(2 + rawSize + blockCount * 5 + 4);
+		idat.push_back(0x78);
+		idat.push_back(0x01);
+
+		unsigned int adlerA = 1, adlerB = 0;
+		size_t blockRemaining = 0;
+		size_t written = 0;
+		for (int y = 0; y < height; y++)
+		{
+			const unsigned char* row = &rgba[(size_t)(height - 1 - y) * width * 4];
+			for (size_t i = 0; i < rowSize; i++)
+			{
+				if (blockRemaining == 0)
+				{
+					size_t blockSize = rawSize - written < 65535 ? rawSize - written : 65535;
+					idat.push_back(written + blockSize == rawSize ? 1 : 0);
+					idat.push_back((unsigned char)(blockSize & 0xFF));
+					idat.push_back((unsigned char)(blockSize >> 8));
+					idat.push_back((unsigned char)(~blockSize & 0xFF));
+					idat.push_back((unsigned char)((~blockSize >> 8) & 0xFF));
+					blockRemaining = blockSize;
+				}
+
+				//filter byte 0 at the start of each row, then RGB
+				unsigned char value = i == 0 ? 0 : row[((i - 1) / 3) * 4 + (i - 1) % 3];
+				idat.push_back(value);
+				adlerA = (adlerA + value) % 65521;
+				adlerB = (adlerB + adlerA) % 65521;
+				blockRemaining--;
+				written++;
+			}
+		}
+
+		unsigned char adler[4];
+		putBigEndian(adler, (adlerB << 16) | adlerA);
+		idat.insert(idat.end(), adler, adler + 4);
+
+		writeChunk(out, "IDAT", idat.data(), idat.size());
+		writeChunk(out, "IEND", NULL, 0);
+	}
+
+private:
+	struct PendingFrame {
+		unsigned int number;
+		std::vector<unsigned char> pixels;
+	};
+
+	bool active = false;
+	std::string path;
+	int width = 0;
+	int height = 0;
+	int fps = 60;
+	size_t frameSize = 0;
+	CaptureFormat format = CAPTURE_PNG;
+	std::ofstream stream;
+
+	GLuint pbos[RING_SIZE];
+	GLsync fences[RING_SIZE];
+	unsigned int slotFrameNumbers[RING_SIZE];
+	int nextSlot = 0;
+	unsigned int frameNumber = 0;
+
+	std::thread writer;
+	std::mutex queueMutex;
+	std::condition_variable queueCondition;
+	std::deque<PendingFrame> queue;
+	std::vector<std::vector<unsigned char>> freeFrames;
+	bool stopWriter = false;
+
+	// Maps a finished pixel buffer and hands its contents to the writer thread
+	void retireSlot(int slot)
+	{
+		GLenum waitResult = glClientWaitSync(fences[slot], 0, 0);
+		if (waitResult == GL_TIMEOUT_EXPIRED)
+		{
+			fenceStalls++;
+			glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		}
+		glDeleteSync(fences[slot]);
+		fences[slot] = 0;
+
+		std::vector<unsigned char> pixels;
+		{
+			std::unique_lock<std::mutex> lock(queueMutex);
+			if (freeFrames.empty())
+			{
+				writerStalls++;
+				queueCondition.wait(lock, [this] { return !freeFrames.empty(); });
+			}
+			pixels = std::move(freeFrames.back());
+			freeFrames.pop_back();
+		}
+
+		GLint previousPackBuffer;
+		glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &previousPackBuffer);
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[slot]);
+		void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frameSize, GL_MAP_READ_BIT);
+		if (mapped != NULL)
+		{
+			memcpy(pixels.data(), mapped, frameSize);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, previousPackBuffer);
+
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			PendingFrame frame;
+			frame.number = slotFrameNumbers[slot];
+			frame.pixels = std::move(pixels);
+			queue.push_back(std::move(frame));
+		}
+		queueCondition.notify_all();
+		framesCaptured++;
+	}
+
+	void writerLoop()
+	{
+		MemoryScope scope(MEMORY_TAG_CAPTURE);
+		std::vector<unsigned char> encoded;
+
+		while (true)
+		{
+			PendingFrame frame;
+			{
+				std::unique_lock<std::mutex> lock(queueMutex);
+				queueCondition.wait(lock, [this] { return stopWriter || !queue.empty(); });
+				if (queue.empty())
+				{
+					return;
+				}
+				frame = std::move(queue.front());
+				queue.pop_front();
+			}
+
+			if (format == CAPTURE_Y4M)
+			{
+				encodeY4MFrame(frame.pixels, encoded);
+				stream.write((const char*)encoded.data(), encoded.size());
+			}
+			else
+			{
+				char fileName[32];
+				snprintf(fileName, sizeof(fileName), "_%06u.png", frame.number);
+				encodePNG(frame.pixels, width, height, encoded);
+				std::ofstream file(path + fileName, std::ios::binary);
+				file.write((const char*)encoded.data(), encoded.size());
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(queueMutex);
+				freeFrames.push_back(std::move(frame.pixels));
+				framesWritten++;
+			}
+			queueCondition.notify_all();
+		}
+	}
+
+	// utility encoding functions, the readback is bottom-up RGBA
+	// ------------------------------------------------------------------------
+	void encodeY4MFrame(const std::vector<unsigned char>& rgba, std::vector<unsigned char>& out) const
+	{
+		const char header[] = "FRAME\n";
+		size_t lumaSize = (size_t)width * height;
+		size_t chromaSize = lumaSize / 4;
+		out.resize(sizeof(header) - 1 + lumaSize + 2 * chromaSize);
+		memcpy(out.data(), header, sizeof(header) - 1);
+
+		unsigned char* yPlane = out.data() + sizeof(header) - 1;
+		unsigned char* uPlane = yPlane + lumaSize;
+		unsigned char* vPlane = uPlane + chromaSize;
+
+		//full range BT.601, chroma averaged over 2x2 blocks
+		for (int y = 0; y < height; y += 2)
+		{
+			for (int x = 0; x < width; x += 2)
+			{
+				int sumR = 0, sumG = 0, sumB = 0;
+				for (int dy = 0; dy < 2; dy++)
+				{
+					for (int dx = 0; dx < 2; dx++)
+					{
+						const unsigned char* p = &rgba[((size_t)(height - 1 - (y + dy)) * width + x + dx) * 4];
+						int luma = (77 * p[0] + 150 * p[1] + 29 * p[2]) >> 8;
+						yPlane[(size_t)(y + dy) * width + x + dx] = (unsigned char)luma;
+						sumR += p[0];
+						sumG += p[1];
+						sumB += p[2];
+					}
+				}
+				int r = sumR / 4, g = sumG / 4, b = sumB / 4;
+				size_t chromaIndex = (size_t)(y / 2) * (width / 2) + x / 2;
+				uPlane[chromaIndex] = (unsigned char)clampByte(128 + ((-43 * r - 85 * g + 128 * b) >> 8));
+				vPlane[chromaIndex] = (unsigned char)clampByte(128 + ((128 * r - 107 * g - 21 * b) >> 8));
+			}
+		}
+	}
+
+	static void writeChunk(std::vector<unsigned char>& out, const char* type, const unsigned char* data, size_t size)
+	{
+		unsigned char length[4];
+		putBigEndian(length, (unsigned int)size);
+		out.insert(out.end(), length, length + 4);
+
+		size_t crcStart = out.size();
+		out.insert(out.end(), type, type + 4);
+		if (size > 0)
+		{
+			out.insert(out.end(), data, data + size);
+		}
+
+		unsigned char crc[4];
+		putBigEndian(crc, crc32(&out[crcStart], size + 4));
+		out.insert(out.end(), crc, crc + 4);
+	}
+
+	// CRC-32 of the chunks, one entry per byte value
+	struct CrcTable {
+		unsigned int values[256];
+
+		CrcTable()
+		{
+			for (unsigned int n = 0; n < 256; n++)
+			{
+				unsigned int c = n;
+				for (int k = 0; k < 8; k++)
+				{
+					c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+				}
+				values[n] = c;
+			}
+		}
+	};
+
+	static unsigned int crc32(const unsigned char* data, size_t size)
+	{
+		//encodePNG() runs on the main thread and on the writer thread, a function-local static is built once
+		//by whichever comes first while the other waits for it
+		static const CrcTable table;
+
+		unsigned int crc = 0xFFFFFFFFu;
+		for (size_t i = 0; i < size; i++)
+		{
+			crc = table.values[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+		}
+		return crc ^ 0xFFFFFFFFu;
+	}
+
+	static void putBigEndian(unsigned char* out, unsigned int value)
+	{
+		out[0] = (unsigned char)(value >> 24);
+		out[1] = (unsigned char)(value >> 16);
+		out[2] = (unsigned char)(value >> 8);
+		out[3] = (unsigned char)value;
+	}
+
+	static int clampByte(int value)
+	{
+		return value < 0 ? 0 : (value > 255 ? 255 : value);
+	}
+};
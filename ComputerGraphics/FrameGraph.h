@@ -0,0 +1,824 @@
+#pragma once
+
+/*
+ Frame graph for the render passes of one frame.
+ Every frame the passes are declared again together with the textures they read and write. compile()
+ culls the passes whose results nobody uses, orders the rest by their dependencies and assigns the
+ transient textures to physical ones from a pool. A texture can be updated by several passes in turn,
+ every pass sees it as the passes declared before it left it. A physical texture is shared by all transient
+ textures of the same size and format whose lifetimes (first to last pass using them) do not overlap.
+ The pool lives across frames, so in the steady state a frame creates no GL objects at all.
+ Nor does it touch the heap: the pass and resource records are reused from frame to frame, the pass
+ callbacks and the scratch data of compile() live in the frame arena.
+ Every executed pass is enclosed in a pair of timestamp queries, the GPU times arrive a few frames later.
+*/
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstring>
+#include <utility>
+#include <type_traits>
+
+#include "GLState.h"
+#include "FrameArena.h"
+
+// Index of a texture declared in the current frame
+typedef int FrameGraphResource;
+
+struct FrameGraphTextureDesc {
+	int width;
+	int height;
+	GLenum format;	// sized internal format
+	int levels;
+
+	FrameGraphTextureDesc(int width = 0, int height = 0, GLenum format = GL_RGBA8, int levels = 1)
+		: width(width), height(height), format(format), levels(levels)
+	{
+	}
+
+	bool operator==(const FrameGraphTextureDesc& other) const
+	{
+		return width == other.width && height == other.height && format == other.format && levels == other.levels;
+	}
+};
+
+struct FrameGraphStats {
+	unsigned int passes = 0;				// passes declared
+	unsigned int culledPasses = 0;			// passes dropped because nothing used their output
+	unsigned int transientTextures = 0;		// transient textures used by the executed passes
+	unsigned int physicalTextures = 0;		// pool textures they were mapped to
+	size_t transientBytes = 0;				// render target memory if every transient texture had its own storage
+	size_t aliasedBytes = 0;				// render target memory of the pool textures actually used
+};
+
+// GPU time of a pass, averaged since the last resetTimings()
+struct FrameGraphPassTiming {
+	double lastMilliseconds = 0.0;
+	double totalMilliseconds = 0.0;
+	unsigned int samples = 0;
+
+	double getAverage() const
+	{
+		return samples > 0 ? totalMilliseconds / samples : 0.0;
+	}
+};
+
+class FrameGraph
+{
+public:
+	// most color targets of one pass
+	static const int MAX_COLOR_TARGETS = 4;
+
+	FrameGraphStats frameStats;		// last compiled frame
+	FrameGraphStats peakStats;		// largest values of any frame so far
+	bool timing = true;				// measure every pass with timestamp queries
+
+	FrameGraph() {}
+
+	// forgets the passes and textures of the previous frame, the texture pool is kept
+	// ------------------------------------------------------------------------
+	void reset()
+	{
+		passCount = 0;
+		resourceCount = 0;
+		order.clear();
+	}
+
+	// texture that only lives during this frame and is allocated by the graph
+	// ------------------------------------------------------------------------
+	FrameGraphResource createTexture(const char* name, const FrameGraphTextureDesc& desc)
+	{
+		if (resourceCount == (int)resources.size())
+		{
+			resources.push_back(Resource());
+		}
+
+		Resource& resource = resources[resourceCount];
+		resource = Resource();
+		resource.name = name;
+		resource.desc = desc;
+		return resourceCount++;
+	}
+
+	// texture owned outside the graph, writing to it keeps the writing pass alive
+	// ------------------------------------------------------------------------
+	FrameGraphResource importTexture(const char* name, GLuint texture, const FrameGraphTextureDesc& desc)
+	{
+		FrameGraphResource handle = createTexture(name, desc);
+		resources[handle].imported = true;
+		resources[handle].texture = texture;
+		return handle;
+	}
+
+	// the default framebuffer, it can only be written as a color target
+	// ------------------------------------------------------------------------
+	FrameGraphResource importBackbuffer(const char* name, int width, int height)
+	{
+		FrameGraphResource handle = importTexture(name, 0, FrameGraphTextureDesc(width, height));
+		resources[handle].backbuffer = true;
+		return handle;
+	}
+
+	// execute is called with the graph so the pass can look up the GL names of its textures, it is kept
+	// in the frame arena and the name has to outlive the graph (a string literal)
+	// ------------------------------------------------------------------------
+	template<typename Callback>
+	int addPass(const char* name, Callback&& execute)
+	{
+		typedef typename std::decay<Callback>::type CallbackType;
+
+		if (passCount == (int)passes.size())
+		{
+			passes.push_back(Pass());
+		}
+
+		//the read and write lists keep their storage from earlier frames
+		Pass& pass = passes[passCount];
+		pass.name = name;
+		pass.callback = frameArena.create<CallbackType>(std::forward<Callback>(execute));
+		pass.invoke = [](void* callback, const FrameGraph& graph) { (*(CallbackType*)callback)(graph); };
+		pass.reads.clear();
+		pass.writes.clear();
+		pass.colorTargets.clear();
+		pass.depthTarget = -1;
+		pass.framebuffer = 0;
+		pass.culled = false;
+		return passCount++;
+	}
+
+	// sampled or loaded from image units by the pass
+	void read(int pass, FrameGraphResource resource)
+	{
+		passes[pass].reads.push_back(resource);
+	}
+
+	// written through image stores or any other way that needs no framebuffer
+	void write(int pass, FrameGraphResource resource)
+	{
+		passes[pass].writes.push_back(resource);
+	}
+
+	// rendered to as color attachment, in the order of the calls
+	void writeColor(int pass, FrameGraphResource resource)
+	{
+		if ((int)passes[pass].colorTargets.size() == MAX_COLOR_TARGETS)
+		{
+			std::cout << "ERROR::FRAME_GRAPH::TOO_MANY_COLOR_TARGETS " << passes[pass].name << std::endl;
+			return;
+		}
+		passes[pass].writes.push_back(resource);
+		passes[pass].colorTargets.push_back(resource);
+	}
+
+	// rendered to as depth attachment
+	void writeDepth(int pass, FrameGraphResource resource)
+	{
+		passes[pass].writes.push_back(resource);
+		passes[pass].depthTarget = resource;
+	}
+
+	// culls and orders the passes and assigns pool textures to the transient textures
+	// ------------------------------------------------------------------------
+	void compile()
+	{
+		sortPasses();
+		cullPasses();
+		allocateTextures();
+	}
+
+	// runs the surviving passes in order, passes with render targets start with their framebuffer bound
+	// ------------------------------------------------------------------------
+	void execute()
+	{
+		for (size_t i = 0; i < order.size(); i++)
+		{
+			Pass& pass = passes[order[i]];
+			if (pass.culled)
+			{
+				continue;
+			}
+
+			if (!pass.colorTargets.empty() || pass.depthTarget >= 0)
+			{
+				const Resource& target = resources[!pass.colorTargets.empty() ? pass.colorTargets[0] : pass.depthTarget];
+				glState.bindFramebuffer(GL_FRAMEBUFFER, getFramebuffer(order[i]));
+				glState.setViewport(0, 0, target.desc.width, target.desc.height);
+			}
+
+			PassTimer* timer = timing ? beginTimer(pass.name) : NULL;
+			pass.invoke(pass.callback, *this);
+			if (timer != NULL)
+			{
+				glQueryCounter(timer->queries[timerFrame % TIMER_FRAMES][1], GL_TIMESTAMP);
+			}
+		}
+
+		timerFrame++;
+	}
+
+	// GL name of a texture, only valid while the passes are executed
+	// ------------------------------------------------------------------------
+	GLuint getTexture(FrameGraphResource resource) const
+	{
+		return resources[resource].texture;
+	}
+
+	const FrameGraphTextureDesc& getDesc(FrameGraphResource resource) const
+	{
+		return resources[resource].desc;
+	}
+
+	// framebuffer with the render targets of a pass, e.g. to blit from what an earlier pass rendered
+	// ------------------------------------------------------------------------
+	GLuint getFramebuffer(int pass) const
+	{
+		return passes[pass].framebuffer;
+	}
+
+	bool isCulled(int pass) const
+	{
+		return passes[pass].culled;
+	}
+
+	// NULL until a result for the pass has arrived
+	// ------------------------------------------------------------------------
+	const FrameGraphPassTiming* getTiming(const char* pass) const
+	{
+		TimerMap::const_iterator it = timers.find(pass);
+		if (it == timers.end() || it->second.timing.samples == 0)
+		{
+			return NULL;
+		}
+		return &it->second.timing;
+	}
+
+	// GPU time of all passes of the last frame that has timings, 0 before the first results arrive
+	// ------------------------------------------------------------------------
+	double getFrameMilliseconds() const
+	{
+		double total = 0.0;
+		for (size_t i = 0; i < order.size(); i++)
+		{
+			const FrameGraphPassTiming* passTiming = passes[order[i]].culled ? NULL : getTiming(passes[order[i]].name);
+			if (passTiming != NULL)
+			{
+				total += passTiming->lastMilliseconds;
+			}
+		}
+		return total;
+	}
+
+	// ------------------------------------------------------------------------
+	void resetTimings()
+	{
+		for (TimerMap::iterator it = timers.begin(); it != timers.end(); ++it)
+		{
+			it->second.timing = FrameGraphPassTiming();
+		}
+	}
+
+	// average GPU time of the passes of the last frame, in execution order
+	// ------------------------------------------------------------------------
+	void printTimings() const
+	{
+		double total = 0.0;
+		std::cout << "Frame graph GPU times:";
+		for (size_t i = 0; i < order.size(); i++)
+		{
+			const Pass& pass = passes[order[i]];
+			const FrameGraphPassTiming* passTiming = getTiming(pass.name);
+			if (pass.culled || passTiming == NULL)
+			{
+				continue;
+			}
+			std::cout << " " << pass.name << " " << passTiming->getAverage() << " ms";
+			total += passTiming->getAverage();
+		}
+		std::cout << ", total " << total << " ms" << std::endl;
+	}
+
+	// pass names in execution order, culled ones in brackets
+	// ------------------------------------------------------------------------
+	std::string describe() const
+	{
+		std::string text;
+		for (size_t i = 0; i < order.size(); i++)
+		{
+			const Pass& pass = passes[order[i]];
+			if (i > 0)
+			{
+				text += " -> ";
+			}
+			text += pass.culled ? "[" + std::string(pass.name) + "]" : pass.name;
+		}
+		return text;
+	}
+
+	void printStats() const
+	{
+		std::cout << "Frame graph: " << describe() << ", " << frameStats.culledPasses << " of " << frameStats.passes << " passes culled" << std::endl;
+		std::cout << "Frame graph: " << frameStats.transientTextures << " transient textures on " << frameStats.physicalTextures << " pool textures, peak render target memory "
+			<< peakStats.transientBytes / 1024 << " KB without aliasing, " << peakStats.aliasedBytes / 1024 << " KB with aliasing" << std::endl;
+	}
+
+	// an imported texture that passes rendered to is deleted, the cached framebuffers may point at it and
+	// are created again when they are needed
+	// ------------------------------------------------------------------------
+	void forgetFramebuffers()
+	{
+		releaseFramebuffers();
+	}
+
+	// deletes the pool textures and cached framebuffers
+	// ------------------------------------------------------------------------
+	void release()
+	{
+		releaseFramebuffers();
+		for (size_t i = 0; i < pool.size(); i++)
+		{
+			glState.deleteTextures(1, &pool[i].texture);
+		}
+		pool.clear();
+
+		for (TimerMap::iterator it = timers.begin(); it != timers.end(); ++it)
+		{
+			glDeleteQueries(TIMER_FRAMES * 2, &it->second.queries[0][0]);
+		}
+		timers.clear();
+
+		reset();
+	}
+
+	// storage of a texture with all its mip levels
+	static size_t getTextureSize(const FrameGraphTextureDesc& desc)
+	{
+		return (size_t)GpuMemoryTracker::getTextureBytes(desc.format, desc.width, desc.height, desc.levels);
+	}
+
+private:
+	// pool textures that were not used for this many frames are deleted
+	static const int MAX_IDLE_FRAMES = 120;
+	// query pairs per pass, a result is read back this many frames after it was issued
+	static const int TIMER_FRAMES = 4;
+
+	struct Resource {
+		const char* name = NULL;
+		FrameGraphTextureDesc desc;
+		bool imported = false;
+		bool backbuffer = false;
+		GLuint texture = 0;
+		int firstUse = -1;		// positions in the execution order
+		int lastUse = -1;
+		bool needed = false;	// read by a pass that is not culled
+	};
+
+	struct Pass {
+		const char* name = NULL;
+		void* callback = NULL;								// the callable passed to addPass, in the frame arena
+		void (*invoke)(void*, const FrameGraph&) = NULL;	// calls it with its real type
+		std::vector<FrameGraphResource> reads;
+		std::vector<FrameGraphResource> writes;
+		std::vector<FrameGraphResource> colorTargets;
+		FrameGraphResource depthTarget = -1;
+		GLuint framebuffer = 0;
+		bool culled = false;
+	};
+
+	struct PoolTexture {
+		FrameGraphTextureDesc desc;
+		GLuint texture = 0;
+		bool busy = false;		// holds a transient texture that is still alive
+		bool used = false;		// handed out this frame
+		int idleFrames = 0;
+	};
+
+	// records of earlier frames stay allocated, only the first passCount and resourceCount are current
+	std::vector<Pass> passes;
+	std::vector<Resource> resources;
+	int passCount = 0;
+	int resourceCount = 0;
+	std::vector<int> order;
+	std::vector<PoolTexture> pool;
+
+	// timers by pass name, passes are declared anew every frame but keep their names
+	struct PassTimer {
+		GLuint queries[TIMER_FRAMES][2];	// timestamps before and after the pass
+		bool pending[TIMER_FRAMES];
+		FrameGraphPassTiming timing;
+	};
+	// looked up with the pass name as it is, without building a std::string
+	struct NameLess {
+		typedef void is_transparent;
+		bool operator()(const std::string& a, const std::string& b) const { return a < b; }
+		bool operator()(const std::string& a, const char* b) const { return a.compare(b) < 0; }
+		bool operator()(const char* a, const std::string& b) const { return b.compare(a) > 0; }
+	};
+	typedef std::map<std::string, PassTimer, NameLess> TimerMap;
+	TimerMap timers;
+	unsigned int timerFrame = 0;
+
+	// depth texture followed by the color textures, unused slots are 0
+	struct FramebufferKey {
+		GLuint attachments[MAX_COLOR_TARGETS + 1];
+
+		bool operator<(const FramebufferKey& other) const
+		{
+			return memcmp(attachments, other.attachments, sizeof(attachments)) < 0;
+		}
+	};
+
+	// framebuffers by their attachments, the pool textures and so the attachments stay the same every frame
+	std::map<FramebufferKey, GLuint> framebuffers;
+
+	// in the order of declaration a pass runs after the last earlier writer of what it reads or writes,
+	// and a writer after the earlier readers of the contents it replaces. A texture can so be read and
+	// written by several passes in turn, otherwise the order of declaration is kept
+	void sortPasses()
+	{
+		//a read adds at most two edges (from its writer, to the next writer), a write at most one,
+		//they are kept as (from, to) pairs
+		int maxEdges = 0;
+		for (int i = 0; i < passCount; i++)
+		{
+			maxEdges += (int)(2 * passes[i].reads.size() + passes[i].writes.size());
+		}
+
+		std::pair<int, int>* edges = frameArena.allocateArray<std::pair<int, int> >(maxEdges);
+		int edgeCount = 0;
+		int* incoming = frameArena.allocateArray<int>(passCount);
+		int* lastWriter = frameArena.allocateArray<int>(resourceCount);
+		bool* done = frameArena.allocateArray<bool>(passCount);
+		std::fill(incoming, incoming + passCount, 0);
+		std::fill(lastWriter, lastWriter + resourceCount, -1);
+		std::fill(done, done + passCount, false);
+
+		for (int i = 0; i < passCount; i++)
+		{
+			for (size_t j = 0; j < passes[i].reads.size(); j++)
+			{
+				FrameGraphResource resource = passes[i].reads[j];
+				if (lastWriter[resource] >= 0 && lastWriter[resource] != i)
+				{
+					edges[edgeCount++] = std::make_pair(lastWriter[resource], i);
+					incoming[i]++;
+				}
+			}
+
+			for (size_t j = 0; j < passes[i].writes.size(); j++)
+			{
+				FrameGraphResource resource = passes[i].writes[j];
+				if (lastWriter[resource] == i)
+				{
+					continue;
+				}
+				if (lastWriter[resource] >= 0)
+				{
+					edges[edgeCount++] = std::make_pair(lastWriter[resource], i);
+					incoming[i]++;
+				}
+
+				//the passes reading the previous contents go first
+				for (int k = lastWriter[resource] + 1; k < i; k++)
+				{
+					if (std::find(passes[k].reads.begin(), passes[k].reads.end(), resource) != passes[k].reads.end())
+					{
+						edges[edgeCount++] = std::make_pair(k, i);
+						incoming[i]++;
+					}
+				}
+				lastWriter[resource] = i;
+			}
+		}
+
+		order.clear();
+		while ((int)order.size() < passCount)
+		{
+			int next = -1;
+			for (int i = 0; i < passCount; i++)
+			{
+				if (!done[i] && incoming[i] == 0)
+				{
+					next = i;
+					break;
+				}
+			}
+
+			if (next < 0)
+			{
+				std::cout << "ERROR::FRAME_GRAPH::DEPENDENCY_CYCLE" << std::endl;
+				for (int i = 0; i < passCount; i++)
+				{
+					if (!done[i])
+					{
+						order.push_back(i);
+					}
+				}
+				break;
+			}
+
+			done[next] = true;
+			order.push_back(next);
+			for (int j = 0; j < edgeCount; j++)
+			{
+				if (edges[j].first == next)
+				{
+					incoming[edges[j].second]--;
+				}
+			}
+		}
+	}
+
+	// walks the passes backwards from the ones with side effects (writes to imported textures)
+	void cullPasses()
+	{
+		frameStats = FrameGraphStats();
+		frameStats.passes = (unsigned int)passCount;
+
+		for (int i = (int)order.size() - 1; i >= 0; i--)
+		{
+			Pass& pass = passes[order[i]];
+
+			bool keep = false;
+			for (size_t j = 0; j < pass.writes.size() && !keep; j++)
+			{
+				const Resource& resource = resources[pass.writes[j]];
+				keep = resource.imported || resource.needed;
+			}
+
+			pass.culled = !keep;
+			if (pass.culled)
+			{
+				frameStats.culledPasses++;
+				continue;
+			}
+
+			for (size_t j = 0; j < pass.reads.size(); j++)
+			{
+				resources[pass.reads[j]].needed = true;
+			}
+		}
+	}
+
+	void allocateTextures()
+	{
+		MemoryScope scope(MEMORY_TAG_RENDER_TARGETS);
+
+		//done before any framebuffer of this frame is looked up, deleting textures drops the cached ones
+		removeIdleTextures();
+
+		//lifetimes in execution order
+		for (int i = 0; i < (int)order.size(); i++)
+		{
+			const Pass& pass = passes[order[i]];
+			if (pass.culled)
+			{
+				continue;
+			}
+			markUse(pass.reads, i);
+			markUse(pass.writes, i);
+		}
+
+		for (size_t i = 0; i < pool.size(); i++)
+		{
+			pool[i].busy = false;
+			pool[i].used = false;
+		}
+
+		for (int i = 0; i < (int)order.size(); i++)
+		{
+			for (int j = 0; j < resourceCount; j++)
+			{
+				if (!resources[j].imported && resources[j].firstUse == i)
+				{
+					acquire(resources[j]);
+				}
+			}
+
+			Pass& pass = passes[order[i]];
+			if (!pass.culled)
+			{
+				pass.framebuffer = findFramebuffer(pass.colorTargets, pass.depthTarget, pass.name);
+			}
+
+			//textures whose last user has run can be taken by the textures of later passes
+			for (int j = 0; j < resourceCount; j++)
+			{
+				if (!resources[j].imported && resources[j].lastUse == i)
+				{
+					releaseToPool(resources[j]);
+				}
+			}
+		}
+
+		for (size_t i = 0; i < pool.size(); i++)
+		{
+			if (pool[i].used)
+			{
+				pool[i].idleFrames = 0;
+				frameStats.physicalTextures++;
+				frameStats.aliasedBytes += getTextureSize(pool[i].desc);
+			}
+			else
+			{
+				pool[i].idleFrames++;
+			}
+		}
+
+		peakStats.passes = std::max(peakStats.passes, frameStats.passes);
+		peakStats.culledPasses = std::max(peakStats.culledPasses, frameStats.culledPasses);
+		peakStats.transientTextures = std::max(peakStats.transientTextures, frameStats.transientTextures);
+		peakStats.physicalTextures = std::max(peakStats.physicalTextures, frameStats.physicalTextures);
+		peakStats.transientBytes = std::max(peakStats.transientBytes, frameStats.transientBytes);
+		peakStats.aliasedBytes = std::max(peakStats.aliasedBytes, frameStats.aliasedBytes);
+	}
+
+	void markUse(const std::vector<FrameGraphResource>& used, int position)
+	{
+		for (size_t i = 0; i < used.size(); i++)
+		{
+			Resource& resource = resources[used[i]];
+			if (resource.firstUse < 0)
+			{
+				resource.firstUse = position;
+			}
+			resource.lastUse = position;
+		}
+	}
+
+	void acquire(Resource& resource)
+	{
+		frameStats.transientTextures++;
+		frameStats.transientBytes += getTextureSize(resource.desc);
+
+		for (size_t i = 0; i < pool.size(); i++)
+		{
+			if (!pool[i].busy && pool[i].desc == resource.desc)
+			{
+				pool[i].busy = true;
+				pool[i].used = true;
+				resource.texture = pool[i].texture;
+				return;
+			}
+		}
+
+		PoolTexture texture;
+		texture.desc = resource.desc;
+		texture.busy = true;
+		texture.used = true;
+
+		bool depth = resource.desc.format == GL_DEPTH_COMPONENT32F || resource.desc.format == GL_DEPTH_COMPONENT24
+			|| resource.desc.format == GL_DEPTH24_STENCIL8 || resource.desc.format == GL_DEPTH32F_STENCIL8;
+
+		MemoryScope scope(MEMORY_TAG_RENDER_TARGETS);
+		texture.texture = gpuMemory.createTexture2D(resource.desc.levels, resource.desc.format, resource.desc.width, resource.desc.height);
+		glTextureParameteri(texture.texture, GL_TEXTURE_MIN_FILTER, depth ? GL_NEAREST : (resource.desc.levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR));
+		glTextureParameteri(texture.texture, GL_TEXTURE_MAG_FILTER, depth ? GL_NEAREST : GL_LINEAR);
+		glTextureParameteri(texture.texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTextureParameteri(texture.texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+		pool.push_back(texture);
+		resource.texture = texture.texture;
+	}
+
+	void releaseToPool(const Resource& resource)
+	{
+		for (size_t i = 0; i < pool.size(); i++)
+		{
+			if (pool[i].texture == resource.texture)
+			{
+				pool[i].busy = false;
+				return;
+			}
+		}
+	}
+
+	GLuint findFramebuffer(const std::vector<FrameGraphResource>& colorTargets, FrameGraphResource depthTarget, const char* name)
+	{
+		if (colorTargets.empty() && depthTarget < 0)
+		{
+			return 0;
+		}
+
+		if (colorTargets.size() == 1 && resources[colorTargets[0]].backbuffer)
+		{
+			return 0;
+		}
+
+		//depth first so that a color-only and a depth-only framebuffer never get the same key
+		FramebufferKey key;
+		memset(key.attachments, 0, sizeof(key.attachments));
+		key.attachments[0] = depthTarget >= 0 ? resources[depthTarget].texture : 0;
+		for (size_t i = 0; i < colorTargets.size(); i++)
+		{
+			key.attachments[i + 1] = resources[colorTargets[i]].texture;
+		}
+
+		std::map<FramebufferKey, GLuint>::iterator it = framebuffers.find(key);
+		if (it != framebuffers.end())
+		{
+			return it->second;
+		}
+
+		GLuint framebuffer;
+		glCreateFramebuffers(1, &framebuffer);
+
+		GLenum drawBuffers[MAX_COLOR_TARGETS];
+		for (size_t i = 0; i < colorTargets.size(); i++)
+		{
+			glNamedFramebufferTexture(framebuffer, GL_COLOR_ATTACHMENT0 + (GLenum)i, key.attachments[i + 1], 0);
+			drawBuffers[i] = GL_COLOR_ATTACHMENT0 + (GLenum)i;
+		}
+		if (colorTargets.empty())
+		{
+			glNamedFramebufferDrawBuffer(framebuffer, GL_NONE);
+		}
+		else
+		{
+			glNamedFramebufferDrawBuffers(framebuffer, (GLsizei)colorTargets.size(), drawBuffers);
+		}
+		if (depthTarget >= 0)
+		{
+			glNamedFramebufferTexture(framebuffer, GL_DEPTH_ATTACHMENT, key.attachments[0], 0);
+		}
+
+		if (glCheckNamedFramebufferStatus(framebuffer, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		{
+			std::cout << "ERROR::FRAME_GRAPH::FRAMEBUFFER_INCOMPLETE " << name << std::endl;
+		}
+
+		framebuffers[key] = framebuffer;
+		return framebuffer;
+	}
+
+	// collects the result this slot held TIMER_FRAMES frames ago and takes the timestamp before the pass
+	// (timestamps instead of GL_TIME_ELAPSED, those cannot nest and passes may time their own work)
+	PassTimer* beginTimer(const char* name)
+	{
+		TimerMap::iterator it = timers.find(name);
+		if (it == timers.end())
+		{
+			PassTimer timer;
+			glGenQueries(TIMER_FRAMES * 2, &timer.queries[0][0]);
+			for (int i = 0; i < TIMER_FRAMES; i++)
+			{
+				timer.pending[i] = false;
+			}
+			it = timers.insert(std::make_pair(std::string(name), timer)).first;
+		}
+
+		PassTimer& timer = it->second;
+		int slot = timerFrame % TIMER_FRAMES;
+		if (timer.pending[slot])
+		{
+			GLuint64 begin = 0;
+			GLuint64 end = 0;
+			glGetQueryObjectui64v(timer.queries[slot][0], GL_QUERY_RESULT, &begin);
+			glGetQueryObjectui64v(timer.queries[slot][1], GL_QUERY_RESULT, &end);
+			timer.timing.lastMilliseconds = (end - begin) / 1000000.0;
+			timer.timing.totalMilliseconds += timer.timing.lastMilliseconds;
+			timer.timing.samples++;
+		}
+
+		glQueryCounter(timer.queries[slot][0], GL_TIMESTAMP);
+		timer.pending[slot] = true;
+		return &timer;
+	}
+
+	void removeIdleTextures()
+	{
+		bool removed = false;
+		for (size_t i = 0; i < pool.size();)
+		{
+			if (pool[i].idleFrames > MAX_IDLE_FRAMES)
+			{
+				glState.deleteTextures(1, &pool[i].texture);
+				pool.erase(pool.begin() + i);
+				removed = true;
+			}
+			else
+			{
+				i++;
+			}
+		}
+
+		//a framebuffer may point at a deleted texture, they are cheap to recreate
+		if (removed)
+		{
+			releaseFramebuffers();
+		}
+	}
+
+	void releaseFramebuffers()
+	{
+		for (std::map<FramebufferKey, GLuint>::iterator it = framebuffers.begin(); it != framebuffers.end(); ++it)
+		{
+			glState.deleteFramebuffers(1, &it->second);
+		}
+		framebuffers.clear();
+	}
+};
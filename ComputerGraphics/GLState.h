@@ -0,0 +1,496 @@
+#pragma once
+
+/*
+ Shadow copy of the GL state the renderer touches.
+ Every bind and state change goes through glState, calls that would set a value which is already
+ current are skipped. Issued and elided calls are counted per frame to see what the cache saves, the
+ draw calls the subsystems report are counted alongside.
+ Code that changes the same state with raw GL calls has to restore it or call invalidate().
+ GL objects are deleted through glState as well, which also hands their memory back to gpuMemory.
+ The GL 1.1 calls below go through the wrappers of GLTrace.h, which record them while a trace runs.
+*/
+
+#include <GL/glew.h>
+
+#include <iostream>
+
+#include "MemoryTracker.h"
+#include "GLTrace.h"
+
+struct GLStateStats {
+	unsigned int issued = 0;	// calls forwarded to GL
+	unsigned int elided = 0;	// calls skipped because the value was already current
+	unsigned int uniforms = 0;	// uniform updates among the issued calls
+	unsigned int draws = 0;		// draw calls, a multi-draw counts once
+};
+
+class GLState
+{
+public:
+	static const int MAX_TEXTURE_UNITS = 16;
+	static const int MAX_BUFFER_BINDINGS = 16;
+
+	GLStateStats frameStats;		// counters of the frame in progress
+	GLStateStats lastFrameStats;	// counters of the last completed frame
+	GLStateStats totalStats;
+
+	GLState()
+	{
+		invalidate();
+	}
+
+	// forgets everything that is cached, the next call for every state is issued
+	// ------------------------------------------------------------------------
+	void invalidate()
+	{
+		program = UNKNOWN;
+		vertexArray = UNKNOWN;
+		drawFramebuffer = UNKNOWN;
+		readFramebuffer = UNKNOWN;
+
+		for (int i = 0; i < BUFFER_TARGET_COUNT; i++)
+		{
+			buffers[i] = UNKNOWN;
+		}
+
+		for (int i = 0; i < MAX_BUFFER_BINDINGS; i++)
+		{
+			uniformBuffers[i].buffer = UNKNOWN;
+			storageBuffers[i].buffer = UNKNOWN;
+		}
+
+		for (int i = 0; i < MAX_TEXTURE_UNITS; i++)
+		{
+			textures[i] = UNKNOWN;
+		}
+
+		for (int i = 0; i < CAPABILITY_COUNT; i++)
+		{
+			capabilities[i] = -1;
+		}
+
+		blendSource = UNKNOWN;
+		blendDestination = UNKNOWN;
+		depthFunction = UNKNOWN;
+		depthMask = -1;
+		viewport[0] = viewport[1] = viewport[2] = viewport[3] = -1;
+	}
+
+	// starts a new counting period
+	// ------------------------------------------------------------------------
+	void beginFrame()
+	{
+		frameStats = GLStateStats();
+	}
+
+	// ------------------------------------------------------------------------
+	void endFrame()
+	{
+		lastFrameStats = frameStats;
+		totalStats.issued += frameStats.issued;
+		totalStats.elided += frameStats.elided;
+		totalStats.uniforms += frameStats.uniforms;
+		totalStats.draws += frameStats.draws;
+	}
+
+	// ------------------------------------------------------------------------
+	void useProgram(GLuint id)
+	{
+		if (check(program, id))
+		{
+			glUseProgram(id);
+		}
+	}
+
+	// ------------------------------------------------------------------------
+	void bindVertexArray(GLuint id)
+	{
+		if (check(vertexArray, id))
+		{
+			glBindVertexArray(id);
+		}
+	}
+
+	// ------------------------------------------------------------------------
+	void bindFramebuffer(GLenum target, GLuint id)
+	{
+		bool changeDraw = target != GL_READ_FRAMEBUFFER && drawFramebuffer != id;
+		bool changeRead = target != GL_DRAW_FRAMEBUFFER && readFramebuffer != id;
+		if (!changeDraw && !changeRead)
+		{
+			frameStats.elided++;
+			return;
+		}
+
+		frameStats.issued++;
+		glBindFramebuffer(target, id);
+		if (target != GL_READ_FRAMEBUFFER)
+		{
+			drawFramebuffer = id;
+		}
+		if (target != GL_DRAW_FRAMEBUFFER)
+		{
+			readFramebuffer = id;
+		}
+	}
+
+	// non-indexed buffer targets, the element array buffer is part of the vertex array and is not tracked
+	// ------------------------------------------------------------------------
+	void bindBuffer(GLenum target, GLuint id)
+	{
+		int slot = bufferSlot(target);
+		if (slot < 0)
+		{
+			frameStats.issued++;
+			glBindBuffer(target, id);
+			return;
+		}
+
+		if (check(buffers[slot], id))
+		{
+			glBindBuffer(target, id);
+		}
+	}
+
+	// uniform and shader storage binding points
+	// ------------------------------------------------------------------------
+	void bindBufferRange(GLenum target, GLuint index, GLuint id, GLintptr offset, GLsizeiptr size)
+	{
+		IndexedBinding* binding = indexedBinding(target, index);
+		if (binding != NULL && binding->buffer == id && binding->offset == offset && binding->size == size)
+		{
+			frameStats.elided++;
+			return;
+		}
+
+		frameStats.issued++;
+		glBindBufferRange(target, index, id, offset, size);
+		if (binding != NULL)
+		{
+			binding->buffer = id;
+			binding->offset = offset;
+			binding->size = size;
+		}
+	}
+
+	// ------------------------------------------------------------------------
+	void bindBufferBase(GLenum target, GLuint index, GLuint id)
+	{
+		IndexedBinding* binding = indexedBinding(target, index);
+		if (binding != NULL && binding->buffer == id && binding->size == WHOLE_BUFFER)
+		{
+			frameStats.elided++;
+			return;
+		}
+
+		frameStats.issued++;
+		glBindBufferBase(target, index, id);
+		if (binding != NULL)
+		{
+			binding->buffer = id;
+			binding->offset = 0;
+			binding->size = WHOLE_BUFFER;
+		}
+	}
+
+	// ------------------------------------------------------------------------
+	void bindTextureUnit(GLuint unit, GLuint id)
+	{
+		if (unit >= MAX_TEXTURE_UNITS)
+		{
+			frameStats.issued++;
+			glBindTextureUnit(unit, id);
+			return;
+		}
+
+		if (check(textures[unit], id))
+		{
+			glBindTextureUnit(unit, id);
+		}
+	}
+
+	// GL_BLEND, GL_DEPTH_TEST and GL_CULL_FACE are cached, other capabilities are passed through
+	// ------------------------------------------------------------------------
+	void setEnabled(GLenum capability, bool enabled)
+	{
+		int slot = capabilitySlot(capability);
+		if (slot >= 0 && capabilities[slot] == (enabled ? 1 : 0))
+		{
+			frameStats.elided++;
+			return;
+		}
+
+		frameStats.issued++;
+		if (enabled)
+		{
+			glEnable(capability);
+		}
+		else
+		{
+			glDisable(capability);
+		}
+		if (slot >= 0)
+		{
+			capabilities[slot] = enabled ? 1 : 0;
+		}
+	}
+
+	// ------------------------------------------------------------------------
+	void blendFunc(GLenum source, GLenum destination)
+	{
+		if (blendSource == source && blendDestination == destination)
+		{
+			frameStats.elided++;
+			return;
+		}
+
+		frameStats.issued++;
+		glBlendFunc(source, destination);
+		blendSource = source;
+		blendDestination = destination;
+	}
+
+	// blend function of one draw buffer, afterwards the cached function of all of them is unknown
+	// ------------------------------------------------------------------------
+	void blendFunci(GLuint buffer, GLenum source, GLenum destination)
+	{
+		frameStats.issued++;
+		glBlendFunci(buffer, source, destination);
+		blendSource = UNKNOWN;
+		blendDestination = UNKNOWN;
+	}
+
+	// ------------------------------------------------------------------------
+	void depthFunc(GLenum function)
+	{
+		if (check(depthFunction, function))
+		{
+			glDepthFunc(function);
+		}
+	}
+
+	// ------------------------------------------------------------------------
+	void setDepthMask(bool write)
+	{
+		if (depthMask == (write ? 1 : 0))
+		{
+			frameStats.elided++;
+			return;
+		}
+
+		frameStats.issued++;
+		glDepthMask(write ? GL_TRUE : GL_FALSE);
+		depthMask = write ? 1 : 0;
+	}
+
+	// ------------------------------------------------------------------------
+	void setViewport(GLint x, GLint y, GLsizei width, GLsizei height)
+	{
+		if (viewport[0] == x && viewport[1] == y && viewport[2] == width && viewport[3] == height)
+		{
+			frameStats.elided++;
+			return;
+		}
+
+		frameStats.issued++;
+		glViewport(x, y, width, height);
+		viewport[0] = x;
+		viewport[1] = y;
+		viewport[2] = width;
+		viewport[3] = height;
+	}
+
+	// deleting a bound object resets the binding in GL, the cache has to follow or a recycled name would be skipped
+	// ------------------------------------------------------------------------
+	void deleteBuffers(GLsizei count, GLuint* ids)
+	{
+		for (GLsizei i = 0; i < count; i++)
+		{
+			if (ids[i] == 0)
+			{
+				continue;
+			}
+			gpuMemory.release(GPU_OBJECT_BUFFER, ids[i]);
+			for (int j = 0; j < BUFFER_TARGET_COUNT; j++)
+			{
+				forget(buffers[j], ids[i]);
+			}
+			for (int j = 0; j < MAX_BUFFER_BINDINGS; j++)
+			{
+				forget(uniformBuffers[j].buffer, ids[i]);
+				forget(storageBuffers[j].buffer, ids[i]);
+			}
+		}
+		glDeleteBuffers(count, ids);
+	}
+
+	// ------------------------------------------------------------------------
+	void deleteTextures(GLsizei count, GLuint* ids)
+	{
+		for (GLsizei i = 0; i < count; i++)
+		{
+			gpuMemory.release(GPU_OBJECT_TEXTURE, ids[i]);
+			for (int j = 0; j < MAX_TEXTURE_UNITS; j++)
+			{
+				forget(textures[j], ids[i]);
+			}
+		}
+		glDeleteTextures(count, ids);
+	}
+
+	// ------------------------------------------------------------------------
+	void deleteVertexArrays(GLsizei count, GLuint* ids)
+	{
+		for (GLsizei i = 0; i < count; i++)
+		{
+			forget(vertexArray, ids[i]);
+		}
+		glDeleteVertexArrays(count, ids);
+	}
+
+	// ------------------------------------------------------------------------
+	void deleteFramebuffers(GLsizei count, GLuint* ids)
+	{
+		for (GLsizei i = 0; i < count; i++)
+		{
+			forget(drawFramebuffer, ids[i]);
+			forget(readFramebuffer, ids[i]);
+		}
+		glDeleteFramebuffers(count, ids);
+	}
+
+	// ------------------------------------------------------------------------
+	void deleteProgram(GLuint id)
+	{
+		forget(program, id);
+		gpuMemory.release(GPU_OBJECT_PROGRAM, id);
+		glDeleteProgram(id);
+	}
+
+	// counts a uniform update done by the shader's own value cache
+	void countUniform(bool issued)
+	{
+		if (issued)
+		{
+			frameStats.issued++;
+			frameStats.uniforms++;
+		}
+		else
+		{
+			frameStats.elided++;
+		}
+	}
+
+	// draws are issued by the subsystems directly, they only report them here
+	void countDraw()
+	{
+		frameStats.draws++;
+	}
+
+	void printStats() const
+	{
+		unsigned int total = totalStats.issued + totalStats.elided;
+		std::cout << "GL state cache: " << lastFrameStats.issued << " calls issued, " << lastFrameStats.elided << " elided last frame, "
+			<< (total > 0 ? 100.0 * totalStats.elided / total : 0.0) << "% elided overall" << std::endl;
+	}
+
+private:
+	static const GLuint UNKNOWN = 0xFFFFFFFFu;
+	static const GLsizeiptr WHOLE_BUFFER = -1;
+	static const int BUFFER_TARGET_COUNT = 4;
+	static const int CAPABILITY_COUNT = 3;
+
+	struct IndexedBinding {
+		GLuint buffer;
+		GLintptr offset;
+		GLsizeiptr size;
+	};
+
+	GLuint program;
+	GLuint vertexArray;
+	GLuint drawFramebuffer;
+	GLuint readFramebuffer;
+	GLuint buffers[BUFFER_TARGET_COUNT];
+	IndexedBinding uniformBuffers[MAX_BUFFER_BINDINGS];
+	IndexedBinding storageBuffers[MAX_BUFFER_BINDINGS];
+	GLuint textures[MAX_TEXTURE_UNITS];
+	int capabilities[CAPABILITY_COUNT];
+	GLenum blendSource;
+	GLenum blendDestination;
+	GLenum depthFunction;
+	int depthMask;
+	GLint viewport[4];
+
+	// true when the value changes and the call has to be issued
+	bool check(GLuint& cached, GLuint value)
+	{
+		if (cached == value)
+		{
+			frameStats.elided++;
+			return false;
+		}
+
+		frameStats.issued++;
+		cached = value;
+		return true;
+	}
+
+	void forget(GLuint& cached, GLuint id)
+	{
+		if (cached == id)
+		{
+			cached = UNKNOWN;
+		}
+	}
+
+	int bufferSlot(GLenum target) const
+	{
+		switch (target)
+		{
+		case GL_ARRAY_BUFFER:
+			return 0;
+		case GL_DRAW_INDIRECT_BUFFER:
+			return 1;
+		case GL_PARAMETER_BUFFER_ARB:
+			return 2;
+		case GL_DISPATCH_INDIRECT_BUFFER:
+			return 3;
+		}
+		return -1;
+	}
+
+	int capabilitySlot(GLenum capability) const
+	{
+		switch (capability)
+		{
+		case GL_BLEND:
+			return 0;
+		case GL_DEPTH_TEST:
+			return 1;
+		case GL_CULL_FACE:
+			return 2;
+		}
+		return -1;
+	}
+
+	// binding a range also replaces the generic binding of the target, that one is not tracked for indexed targets
+	IndexedBinding* indexedBinding(GLenum target, GLuint index)
+	{
+		if (index >= MAX_BUFFER_BINDINGS)
+		{
+			return NULL;
+		}
+		if (target == GL_UNIFORM_BUFFER)
+		{
+			return &uniformBuffers[index];
+		}
+		if (target == GL_SHADER_STORAGE_BUFFER)
+		{
+			return &storageBuffers[index];
+		}
+		return NULL;
+	}
+};
+
+// The one context of the application, defined in ComputerGraphics.cpp
+extern GLState glState;
@@ -0,0 +1,1267 @@
+#pragma once
+
+/*
+ GL command-stream capture.
+ While a trace is recorded every GL function the renderer uses goes through a wrapper that calls the
+ driver and appends the call with its arguments to a compact binary trace: a 16 bit call id followed by
+ the raw argument values. Data passed by pointer is stored with the call (buffer and texture uploads,
+ shader sources, uniform values, name arrays), names and locations returned by GL are stored as the
+ capture saw them and remapped on replay. GLEW reaches every function after GL 1.1 through a function
+ pointer, those pointers are swapped for the wrappers while recording. The GL 1.1 functions are
+ exported by the GL library itself, this header replaces them by wrappers with macros, so it has to be
+ included before any code that calls them (GLState.h includes it).
+ Persistently mapped memory is written without any GL call, the stream buffer reports what it wrote
+ with recordMappedWrite(). Frames are separated by markers. Recording is only done on the thread
+ that owns the context, threads with a shared context call the driver's functions directly.
+ GLTraceReplay.h plays a trace back.
+*/
+
+#include <GL/glew.h>
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+
+#include "MemoryTracker.h"
+
+// Every call a trace can hold, the values are stored in the file so new calls only go at the end
+enum TraceCall {
+	TRACE_FRAME_END,
+	TRACE_MAPPED_WRITE,
+	TRACE_CREATE_BUFFERS,
+	TRACE_GEN_BUFFERS,
+	TRACE_DELETE_BUFFERS,
+	TRACE_NAMED_BUFFER_STORAGE,
+	TRACE_NAMED_BUFFER_DATA,
+	TRACE_BUFFER_DATA,
+	TRACE_NAMED_BUFFER_SUB_DATA,
+	TRACE_CLEAR_NAMED_BUFFER_DATA,
+	TRACE_CLEAR_NAMED_BUFFER_SUB_DATA,
+	TRACE_MAP_NAMED_BUFFER_RANGE,
+	TRACE_MAP_BUFFER_RANGE,
+	TRACE_UNMAP_NAMED_BUFFER,
+	TRACE_UNMAP_BUFFER,
+	TRACE_BIND_BUFFER,
+	TRACE_BIND_BUFFER_RANGE,
+	TRACE_BIND_BUFFER_BASE,
+	TRACE_GEN_VERTEX_ARRAYS,
+	TRACE_CREATE_VERTEX_ARRAYS,
+	TRACE_BIND_VERTEX_ARRAY,
+	TRACE_DELETE_VERTEX_ARRAYS,
+	TRACE_VERTEX_ATTRIB_POINTER,
+	TRACE_VERTEX_ATTRIB_I_POINTER,
+	TRACE_VERTEX_ATTRIB_DIVISOR,
+	TRACE_ENABLE_VERTEX_ATTRIB_ARRAY,
+	TRACE_CREATE_TEXTURES,
+	TRACE_DELETE_TEXTURES,
+	TRACE_TEXTURE_STORAGE_2D,
+	TRACE_TEXTURE_SUB_IMAGE_2D,
+	TRACE_TEXTURE_PARAMETER_I,
+	TRACE_BIND_TEXTURE_UNIT,
+	TRACE_BIND_IMAGE_TEXTURE,
+	TRACE_CREATE_FRAMEBUFFERS,
+	TRACE_DELETE_FRAMEBUFFERS,
+	TRACE_BIND_FRAMEBUFFER,
+	TRACE_NAMED_FRAMEBUFFER_TEXTURE,
+	TRACE_NAMED_FRAMEBUFFER_DRAW_BUFFERS,
+	TRACE_NAMED_FRAMEBUFFER_DRAW_BUFFER,
+	TRACE_CHECK_NAMED_FRAMEBUFFER_STATUS,
+	TRACE_GEN_QUERIES,
+	TRACE_DELETE_QUERIES,
+	TRACE_QUERY_COUNTER,
+	TRACE_GET_QUERY_OBJECT_UI64V,
+	TRACE_FENCE_SYNC,
+	TRACE_CLIENT_WAIT_SYNC,
+	TRACE_DELETE_SYNC,
+	TRACE_CREATE_SHADER,
+	TRACE_SHADER_SOURCE,
+	TRACE_COMPILE_SHADER,
+	TRACE_GET_SHADER_IV,
+	TRACE_GET_SHADER_INFO_LOG,
+	TRACE_DELETE_SHADER,
+	TRACE_CREATE_PROGRAM,
+	TRACE_ATTACH_SHADER,
+	TRACE_LINK_PROGRAM,
+	TRACE_GET_PROGRAM_IV,
+	TRACE_GET_PROGRAM_INFO_LOG,
+	TRACE_DELETE_PROGRAM,
+	TRACE_USE_PROGRAM,
+	TRACE_GET_UNIFORM_LOCATION,
+	TRACE_PROGRAM_UNIFORM_1I,
+	TRACE_PROGRAM_UNIFORM_1UI,
+	TRACE_PROGRAM_UNIFORM_1F,
+	TRACE_PROGRAM_UNIFORM_FV,			// 2fv, 3fv and 4fv, the component count is stored
+	TRACE_PROGRAM_UNIFORM_MATRIX_FV,	// 2fv, 3fv and 4fv, the column count is stored
+	TRACE_MAX_SHADER_COMPILER_THREADS,
+	TRACE_DISPATCH_COMPUTE,
+	TRACE_MEMORY_BARRIER,
+	TRACE_DRAW_ARRAYS,
+	TRACE_DRAW_ELEMENTS_INSTANCED_BASE_INSTANCE,
+	TRACE_MULTI_DRAW_ELEMENTS_INDIRECT,
+	TRACE_MULTI_DRAW_ELEMENTS_INDIRECT_COUNT,
+	TRACE_ENABLE,
+	TRACE_DISABLE,
+	TRACE_BLEND_FUNC,
+	TRACE_DEPTH_FUNC,
+	TRACE_DEPTH_MASK,
+	TRACE_VIEWPORT,
+	TRACE_CLEAR,
+	TRACE_CLEAR_COLOR,
+	TRACE_POLYGON_MODE,
+	TRACE_PIXEL_STORE_I,
+	TRACE_READ_BUFFER,
+	TRACE_READ_PIXELS,
+	TRACE_GET_INTEGER_V,
+	TRACE_GET_ERROR,
+	TRACE_DRAW_ELEMENTS_INSTANCED_BASE_VERTEX_BASE_INSTANCE,
+	TRACE_COPY_NAMED_BUFFER_SUB_DATA,
+	TRACE_BEGIN_QUERY,
+	TRACE_END_QUERY,
+	TRACE_GET_QUERY_OBJECT_UIV,
+	TRACE_BLEND_FUNCI,
+	TRACE_CLEAR_BUFFER_FV,
+	TRACE_SCISSOR,
+	TRACE_END
+};
+
+// Start of every trace file
+struct GLTraceHeader {
+	char magic[4];
+	unsigned int version;
+	int width;		// of the window the trace was recorded in
+	int height;
+};
+
+const unsigned int GL_TRACE_VERSION = 2;
+
+// bytes of one pixel of an unpacked format/type pair, packed types are not used by the renderer
+inline GLsizeiptr getTracePixelSize(GLenum format, GLenum type)
+{
+	int components = 4;
+	switch (format)
+	{
+	case GL_RED:
+	case GL_RED_INTEGER:
+	case GL_DEPTH_COMPONENT:
+		components = 1;
+		break;
+	case GL_RG:
+	case GL_RG_INTEGER:
+		components = 2;
+		break;
+	case GL_RGB:
+	case GL_BGR:
+	case GL_RGB_INTEGER:
+		components = 3;
+		break;
+	}
+
+	switch (type)
+	{
+	case GL_UNSIGNED_BYTE:
+	case GL_BYTE:
+		return components;
+	case GL_UNSIGNED_SHORT:
+	case GL_SHORT:
+	case GL_HALF_FLOAT:
+		return components * 2;
+	}
+	return components * 4;
+}
+
+// client memory read or written by a pixel transfer, rows are padded to the pack/unpack alignment
+inline GLsizeiptr getTraceImageSize(GLsizei width, GLsizei height, GLenum format, GLenum type, GLint alignment)
+{
+	if (width <= 0 || height <= 0)
+	{
+		return 0;
+	}
+	GLsizeiptr row = width * getTracePixelSize(format, type);
+	GLsizeiptr paddedRow = (row + alignment - 1) / alignment * alignment;
+	return paddedRow * (height - 1) + row;
+}
+
+// The functions GLEW reaches through pointers that the recorder replaces, name and PFNGL...PROC stem
+#define GL_TRACE_FUNCTIONS(X) \
+	X(CreateBuffers, CREATEBUFFERS) \
+	X(GenBuffers, GENBUFFERS) \
+	X(DeleteBuffers, DELETEBUFFERS) \
+	X(NamedBufferStorage, NAMEDBUFFERSTORAGE) \
+	X(NamedBufferData, NAMEDBUFFERDATA) \
+	X(BufferData, BUFFERDATA) \
+	X(NamedBufferSubData, NAMEDBUFFERSUBDATA) \
+	X(ClearNamedBufferData, CLEARNAMEDBUFFERDATA) \
+	X(ClearNamedBufferSubData, CLEARNAMEDBUFFERSUBDATA) \
+	X(CopyNamedBufferSubData, COPYNAMEDBUFFERSUBDATA) \
+	X(MapNamedBufferRange, MAPNAMEDBUFFERRANGE) \
+	X(MapBufferRange, MAPBUFFERRANGE) \
+	X(UnmapNamedBuffer, UNMAPNAMEDBUFFER) \
+	X(UnmapBuffer, UNMAPBUFFER) \
+	X(BindBuffer, BINDBUFFER) \
+	X(BindBufferRange, BINDBUFFERRANGE) \
+	X(BindBufferBase, BINDBUFFERBASE) \
+	X(GenVertexArrays, GENVERTEXARRAYS) \
+	X(CreateVertexArrays, CREATEVERTEXARRAYS) \
+	X(BindVertexArray, BINDVERTEXARRAY) \
+	X(DeleteVertexArrays, DELETEVERTEXARRAYS) \
+	X(VertexAttribPointer, VERTEXATTRIBPOINTER) \
+	X(VertexAttribIPointer, VERTEXATTRIBIPOINTER) \
+	X(VertexAttribDivisor, VERTEXATTRIBDIVISOR) \
+	X(EnableVertexAttribArray, ENABLEVERTEXATTRIBARRAY) \
+	X(CreateTextures, CREATETEXTURES) \
+	X(TextureStorage2D, TEXTURESTORAGE2D) \
+	X(TextureSubImage2D, TEXTURESUBIMAGE2D) \
+	X(TextureParameteri, TEXTUREPARAMETERI) \
+	X(BindTextureUnit, BINDTEXTUREUNIT) \
+	X(BindImageTexture, BINDIMAGETEXTURE) \
+	X(CreateFramebuffers, CREATEFRAMEBUFFERS) \
+	X(DeleteFramebuffers, DELETEFRAMEBUFFERS) \
+	X(BindFramebuffer, BINDFRAMEBUFFER) \
+	X(NamedFramebufferTexture, NAMEDFRAMEBUFFERTEXTURE) \
+	X(NamedFramebufferDrawBuffers, NAMEDFRAMEBUFFERDRAWBUFFERS) \
+	X(NamedFramebufferDrawBuffer, NAMEDFRAMEBUFFERDRAWBUFFER) \
+	X(CheckNamedFramebufferStatus, CHECKNAMEDFRAMEBUFFERSTATUS) \
+	X(ClearBufferfv, CLEARBUFFERFV) \
+	X(BlendFunci, BLENDFUNCI) \
+	X(GenQueries, GENQUERIES) \
+	X(DeleteQueries, DELETEQUERIES) \
+	X(QueryCounter, QUERYCOUNTER) \
+	X(GetQueryObjectui64v, GETQUERYOBJECTUI64V) \
+	X(BeginQuery, BEGINQUERY) \
+	X(EndQuery, ENDQUERY) \
+	X(GetQueryObjectuiv, GETQUERYOBJECTUIV) \
+	X(FenceSync, FENCESYNC) \
+	X(ClientWaitSync, CLIENTWAITSYNC) \
+	X(DeleteSync, DELETESYNC) \
+	X(CreateShader, CREATESHADER) \
+	X(ShaderSource, SHADERSOURCE) \
+	X(CompileShader, COMPILESHADER) \
+	X(GetShaderiv, GETSHADERIV) \
+	X(GetShaderInfoLog, GETSHADERINFOLOG) \
+	X(DeleteShader, DELETESHADER) \
+	X(CreateProgram, CREATEPROGRAM) \
+	X(AttachShader, ATTACHSHADER) \
+	X(LinkProgram, LINKPROGRAM) \
+	X(GetProgramiv, GETPROGRAMIV) \
+	X(GetProgramInfoLog, GETPROGRAMINFOLOG) \
+	X(DeleteProgram, DELETEPROGRAM) \
+	X(UseProgram, USEPROGRAM) \
+	X(GetUniformLocation, GETUNIFORMLOCATION) \
+	X(ProgramUniform1i, PROGRAMUNIFORM1I) \
+	X(ProgramUniform1ui, PROGRAMUNIFORM1UI) \
+	X(ProgramUniform1f, PROGRAMUNIFORM1F) \
+	X(ProgramUniform2fv, PROGRAMUNIFORM2FV) \
+	X(ProgramUniform3fv, PROGRAMUNIFORM3FV) \
+	X(ProgramUniform4fv, PROGRAMUNIFORM4FV) \
+	X(ProgramUniformMatrix2fv, PROGRAMUNIFORMMATRIX2FV) \
+	X(ProgramUniformMatrix3fv, PROGRAMUNIFORMMATRIX3FV) \
+	X(ProgramUniformMatrix4fv, PROGRAMUNIFORMMATRIX4FV) \
+	X(MaxShaderCompilerThreadsKHR, MAXSHADERCOMPILERTHREADSKHR) \
+	X(MaxShaderCompilerThreadsARB, MAXSHADERCOMPILERTHREADSARB) \
+	X(DispatchCompute, DISPATCHCOMPUTE) \
+	X(MemoryBarrier, MEMORYBARRIER) \
+	X(DrawElementsInstancedBaseInstance, DRAWELEMENTSINSTANCEDBASEINSTANCE) \
+	X(MultiDrawElementsIndirect, MULTIDRAWELEMENTSINDIRECT) \
+	X(MultiDrawElementsIndirectCountARB, MULTIDRAWELEMENTSINDIRECTCOUNTARB) \
+	X(DrawElementsInstancedBaseVertexBaseInstance, DRAWELEMENTSINSTANCEDBASEVERTEXBASEINSTANCE)
+
+// The driver's functions while the wrappers are installed
+struct GLTraceFunctions {
+#define GL_TRACE_FUNCTION_POINTER(name, stem) PFNGL##stem##PROC name;
+	GL_TRACE_FUNCTIONS(GL_TRACE_FUNCTION_POINTER)
+#undef GL_TRACE_FUNCTION_POINTER
+};
+
+struct GLTraceStats {
+	unsigned int frames = 0;
+	unsigned long long calls = 0;
+	unsigned long long bytes = 0;		// written to the file, header included
+	unsigned long long mappedBytes = 0;	// of persistently mapped memory reported by recordMappedWrite
+};
+
+class GLTraceRecorder
+{
+public:
+	GLTraceFunctions real;
+	GLTraceStats stats;
+
+	// state the wrappers need to size pixel transfers
+	GLuint packBuffer = 0;
+	GLint packAlignment = 4;
+	GLint unpackAlignment = 4;
+
+	GLTraceRecorder() {}
+
+	~GLTraceRecorder()
+	{
+		stop();
+	}
+
+	bool isRecording() const
+	{
+		return recording;
+	}
+
+	// installs the wrappers, needs a context and glewInit(), frameLimit frames are recorded (0 for no limit)
+	// ------------------------------------------------------------------------
+	bool start(const std::string& path, int width, int height, unsigned int frameLimit);
+
+	// marks the end of a frame and stops once the frame limit is reached
+	// ------------------------------------------------------------------------
+	void endFrame()
+	{
+		if (!recording)
+		{
+			return;
+		}
+
+		record(TRACE_FRAME_END);
+		stats.frames++;
+		if (frames > 0 && stats.frames >= frames)
+		{
+			stop();
+		}
+	}
+
+	// puts the driver's functions back and writes the rest of the trace
+	void stop();
+
+	// the driver's functions, whether the wrappers are installed or not. Other threads with a context of
+	// their own call these, their work is not part of the trace
+	// ------------------------------------------------------------------------
+	void getDriverFunctions(GLTraceFunctions& functions) const;
+
+	// bytes the application wrote into memory it got from glMapNamedBufferRange
+	// ------------------------------------------------------------------------
+	void recordMappedWrite(GLuint buffer, GLintptr offset, GLsizeiptr size)
+	{
+		std::unordered_map<GLuint, MappedRange>::const_iterator it = mappedRanges.find(buffer);
+		if (it == mappedRanges.end())
+		{
+			return;
+		}
+
+		record(TRACE_MAPPED_WRITE, buffer, offset);
+		writeBytes(it->second.data + (offset - it->second.offset), size);
+		stats.mappedBytes += size;
+	}
+
+	// appends a call and its arguments, every argument is stored as its raw bytes
+	// ------------------------------------------------------------------------
+	template<typename... Args>
+	void record(TraceCall call, const Args&... args)
+	{
+		writeValue((unsigned short)call);
+		int expand[] = { 0, (writeValue(args), 0)... };
+		(void)expand;
+		stats.calls++;
+	}
+
+	template<typename T>
+	void writeValue(const T& value)
+	{
+		write(&value, sizeof(T));
+	}
+
+	// a size followed by the data, NULL is stored as size -1
+	// ------------------------------------------------------------------------
+	void writeBytes(const void* data, GLsizeiptr size)
+	{
+		long long storedSize = data != NULL ? size : -1;
+		writeValue(storedSize);
+		if (data != NULL)
+		{
+			write(data, (size_t)size);
+		}
+	}
+
+	template<typename T>
+	void writeArray(const T* values, GLsizei count)
+	{
+		writeBytes(values, count * (GLsizeiptr)sizeof(T));
+	}
+
+	void writeString(const char* text)
+	{
+		writeBytes(text, text != NULL ? (GLsizeiptr)strlen(text) : 0);
+	}
+
+	// memory of a buffer mapped for writing, recordMappedWrite() reads from it
+	// ------------------------------------------------------------------------
+	void mapped(GLuint buffer, GLintptr offset, void* data)
+	{
+		MappedRange range;
+		range.data = (char*)data;
+		range.offset = offset;
+		mappedRanges[buffer] = range;
+	}
+
+	void unmapped(GLuint buffer)
+	{
+		mappedRanges.erase(buffer);
+	}
+
+	void printStats() const
+	{
+		std::cout << "GL trace: " << stats.frames << " frames, " << stats.calls << " calls, " << stats.bytes / 1024 << " KB written to "
+			<< path << " (" << stats.mappedBytes / 1024 << " KB of mapped memory)" << std::endl;
+	}
+
+private:
+	static const size_t CHUNK_SIZE = 1 << 20;
+
+	struct MappedRange {
+		char* data;
+		GLintptr offset;
+	};
+
+	bool recording = false;
+	unsigned int frames = 0;
+	std::string path;
+	std::ofstream file;
+	std::vector<char> chunk;
+	std::unordered_map<GLuint, MappedRange> mappedRanges;
+
+	void write(const void* data, size_t size)
+	{
+		const char* bytes = (const char*)data;
+		chunk.insert(chunk.end(), bytes, bytes + size);
+		stats.bytes += size;
+		if (chunk.size() >= CHUNK_SIZE)
+		{
+			flush();
+		}
+	}
+
+	void flush()
+	{
+		file.write(chunk.data(), chunk.size());
+		chunk.clear();
+	}
+
+	void install();
+	void uninstall();
+};
+
+// Defined in ComputerGraphics.cpp
+extern GLTraceRecorder glTrace;
+
+/*
+ Wrappers of the functions GLEW reaches through pointers, installed while recording
+*/
+
+inline void GLAPIENTRY traceCreateBuffers(GLsizei n, GLuint* buffers)
+{
+	glTrace.real.CreateBuffers(n, buffers);
+	glTrace.record(TRACE_CREATE_BUFFERS, n);
+	glTrace.writeArray(buffers, n);
+}
+
+inline void GLAPIENTRY traceGenBuffers(GLsizei n, GLuint* buffers)
+{
+	glTrace.real.GenBuffers(n, buffers);
+	glTrace.record(TRACE_GEN_BUFFERS, n);
+	glTrace.writeArray(buffers, n);
+}
+
+inline void GLAPIENTRY traceDeleteBuffers(GLsizei n, const GLuint* buffers)
+{
+	glTrace.real.DeleteBuffers(n, buffers);
+	glTrace.record(TRACE_DELETE_BUFFERS, n);
+	glTrace.writeArray(buffers, n);
+}
+
+inline void GLAPIENTRY traceNamedBufferStorage(GLuint buffer, GLsizeiptr size, const void* data, GLbitfield flags)
+{
+	glTrace.real.NamedBufferStorage(buffer, size, data, flags);
+	glTrace.record(TRACE_NAMED_BUFFER_STORAGE, buffer, size, flags);
+	glTrace.writeBytes(data, size);
+}
+
+inline void GLAPIENTRY traceNamedBufferData(GLuint buffer, GLsizeiptr size, const void* data, GLenum usage)
+{
+	glTrace.real.NamedBufferData(buffer, size, data, usage);
+	glTrace.record(TRACE_NAMED_BUFFER_DATA, buffer, size, usage);
+	glTrace.writeBytes(data, size);
+}
+
+inline void GLAPIENTRY traceBufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage)
+{
+	glTrace.real.BufferData(target, size, data, usage);
+	glTrace.record(TRACE_BUFFER_DATA, target, size, usage);
+	glTrace.writeBytes(data, size);
+}
+
+inline void GLAPIENTRY traceNamedBufferSubData(GLuint buffer, GLintptr offset, GLsizeiptr size, const void* data)
+{
+	glTrace.real.NamedBufferSubData(buffer, offset, size, data);
+	glTrace.record(TRACE_NAMED_BUFFER_SUB_DATA, buffer, offset, size);
+	glTrace.writeBytes(data, size);
+}
+
+inline void GLAPIENTRY traceClearNamedBufferData(GLuint buffer, GLenum internalformat, GLenum format, GLenum type, const void* data)
+{
+	glTrace.real.ClearNamedBufferData(buffer, internalformat, format, type, data);
+	glTrace.record(TRACE_CLEAR_NAMED_BUFFER_DATA, buffer, internalformat, format, type);
+	glTrace.writeBytes(data, getTracePixelSize(format, type));
+}
+
+inline void GLAPIENTRY traceClearNamedBufferSubData(GLuint buffer, GLenum internalformat, GLintptr offset, GLsizeiptr size, GLenum format, GLenum type, const void* data)
+{
+	glTrace.real.ClearNamedBufferSubData(buffer, internalformat, offset, size, format, type, data);
+	glTrace.record(TRACE_CLEAR_NAMED_BUFFER_SUB_DATA, buffer, internalformat, offset, size, format, type);
+	glTrace.writeBytes(data, getTracePixelSize(format, type));
+}
+
+inline void GLAPIENTRY traceCopyNamedBufferSubData(GLuint readBuffer, GLuint writeBuffer, GLintptr readOffset, GLintptr writeOffset, GLsizeiptr size)
+{
+	glTrace.real.CopyNamedBufferSubData(readBuffer, writeBuffer, readOffset, writeOffset, size);
+	glTrace.record(TRACE_COPY_NAMED_BUFFER_SUB_DATA, readBuffer, writeBuffer, readOffset, writeOffset, size);
+}
+
+inline void* GLAPIENTRY traceMapNamedBufferRange(GLuint buffer, GLintptr offset, GLsizeiptr length, GLbitfield access)
+{
+	void* data = glTrace.real.MapNamedBufferRange(buffer, offset, length, access);
+	glTrace.record(TRACE_MAP_NAMED_BUFFER_RANGE, buffer, offset, length, access);
+	if (data != NULL && (access & GL_MAP_WRITE_BIT) != 0)
+	{
+		glTrace.mapped(buffer, offset, data);
+	}
+	return data;
+}
+
+inline void* GLAPIENTRY traceMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access)
+{
+	void* data = glTrace.real.MapBufferRange(target, offset, length, access);
+	glTrace.record(TRACE_MAP_BUFFER_RANGE, target, offset, length, access);
+	return data;
+}
+
+inline GLboolean GLAPIENTRY traceUnmapNamedBuffer(GLuint buffer)
+{
+	GLboolean result = glTrace.real.UnmapNamedBuffer(buffer);
+	glTrace.record(TRACE_UNMAP_NAMED_BUFFER, buffer);
+	glTrace.unmapped(buffer);
+	return result;
+}
+
+inline GLboolean GLAPIENTRY traceUnmapBuffer(GLenum target)
+{
+	GLboolean result = glTrace.real.UnmapBuffer(target);
+	glTrace.record(TRACE_UNMAP_BUFFER, target);
+	return result;
+}
+
+inline void GLAPIENTRY traceBindBuffer(GLenum target, GLuint buffer)
+{
+	glTrace.real.BindBuffer(target, buffer);
+	glTrace.record(TRACE_BIND_BUFFER, target, buffer);
+	if (target == GL_PIXEL_PACK_BUFFER)
+	{
+		glTrace.packBuffer = buffer;
+	}
+}
+
+inline void GLAPIENTRY traceBindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+	glTrace.real.BindBufferRange(target, index, buffer, offset, size);
+	glTrace.record(TRACE_BIND_BUFFER_RANGE, target, index, buffer, offset, size);
+}
+
+inline void GLAPIENTRY traceBindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+	glTrace.real.BindBufferBase(target, index, buffer);
+	glTrace.record(TRACE_BIND_BUFFER_BASE, target, index, buffer);
+}
+
+inline void GLAPIENTRY traceGenVertexArrays(GLsizei n, GLuint* arrays)
+{
+	glTrace.real.GenVertexArrays(n, arrays);
+	glTrace.record(TRACE_GEN_VERTEX_ARRAYS, n);
+	glTrace.writeArray(arrays, n);
+}
+
+inline void GLAPIENTRY traceCreateVertexArrays(GLsizei n, GLuint* arrays)
+{
+	glTrace.real.CreateVertexArrays(n, arrays);
+	glTrace.record(TRACE_CREATE_VERTEX_ARRAYS, n);
+	glTrace.writeArray(arrays, n);
+}
+
+inline void GLAPIENTRY traceBindVertexArray(GLuint array)
+{
+	glTrace.real.BindVertexArray(array);
+	glTrace.record(TRACE_BIND_VERTEX_ARRAY, array);
+}
+
+inline void GLAPIENTRY traceDeleteVertexArrays(GLsizei n, const GLuint* arrays)
+{
+	glTrace.real.DeleteVertexArrays(n, arrays);
+	glTrace.record(TRACE_DELETE_VERTEX_ARRAYS, n);
+	glTrace.writeArray(arrays, n);
+}
+
+// the pointers of vertex attributes and draws are offsets into the bound buffers
+inline void GLAPIENTRY traceVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void* pointer)
+{
+	glTrace.real.VertexAttribPointer(index, size, type, normalized, stride, pointer);
+	glTrace.record(TRACE_VERTEX_ATTRIB_POINTER, index, size, type, normalized, stride, (GLintptr)pointer);
+}
+
+inline void GLAPIENTRY traceVertexAttribIPointer(GLuint index, GLint size, GLenum type, GLsizei stride, const void* pointer)
+{
+	glTrace.real.VertexAttribIPointer(index, size, type, stride, pointer);
+	glTrace.record(TRACE_VERTEX_ATTRIB_I_POINTER, index, size, type, stride, (GLintptr)pointer);
+}
+
+inline void GLAPIENTRY traceVertexAttribDivisor(GLuint index, GLuint divisor)
+{
+	glTrace.real.VertexAttribDivisor(index, divisor);
+	glTrace.record(TRACE_VERTEX_ATTRIB_DIVISOR, index, divisor);
+}
+
+inline void GLAPIENTRY traceEnableVertexAttribArray(GLuint index)
+{
+	glTrace.real.EnableVertexAttribArray(index);
+	glTrace.record(TRACE_ENABLE_VERTEX_ATTRIB_ARRAY, index);
+}
+
+inline void GLAPIENTRY traceCreateTextures(GLenum target, GLsizei n, GLuint* textures)
+{
+	glTrace.real.CreateTextures(target, n, textures);
+	glTrace.record(TRACE_CREATE_TEXTURES, target, n);
+	glTrace.writeArray(textures, n);
+}
+
+inline void GLAPIENTRY traceTextureStorage2D(GLuint texture, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height)
+{
+	glTrace.real.TextureStorage2D(texture, levels, internalformat, width, height);
+	glTrace.record(TRACE_TEXTURE_STORAGE_2D, texture, levels, internalformat, width, height);
+}
+
+inline void GLAPIENTRY traceTextureSubImage2D(GLuint texture, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const void* pixels)
+{
+	glTrace.real.TextureSubImage2D(texture, level, xoffset, yoffset, width, height, format, type, pixels);
+	glTrace.record(TRACE_TEXTURE_SUB_IMAGE_2D, texture, level, xoffset, yoffset, width, height, format, type);
+	glTrace.writeBytes(pixels, getTraceImageSize(width, height, format, type, glTrace.unpackAlignment));
+}
+
+inline void GLAPIENTRY traceTextureParameteri(GLuint texture, GLenum pname, GLint param)
+{
+	glTrace.real.TextureParameteri(texture, pname, param);
+	glTrace.record(TRACE_TEXTURE_PARAMETER_I, texture, pname, param);
+}
+
+inline void GLAPIENTRY traceBindTextureUnit(GLuint unit, GLuint texture)
+{
+	glTrace.real.BindTextureUnit(unit, texture);
+	glTrace.record(TRACE_BIND_TEXTURE_UNIT, unit, texture);
+}
+
+inline void GLAPIENTRY traceBindImageTexture(GLuint unit, GLuint texture, GLint level, GLboolean layered, GLint layer, GLenum access, GLenum format)
+{
+	glTrace.real.BindImageTexture(unit, texture, level, layered, layer, access, format);
+	glTrace.record(TRACE_BIND_IMAGE_TEXTURE, unit, texture, level, layered, layer, access, format);
+}
+
+inline void GLAPIENTRY traceCreateFramebuffers(GLsizei n, GLuint* framebuffers)
+{
+	glTrace.real.CreateFramebuffers(n, framebuffers);
+	glTrace.record(TRACE_CREATE_FRAMEBUFFERS, n);
+	glTrace.writeArray(framebuffers, n);
+}
+
+inline void GLAPIENTRY traceDeleteFramebuffers(GLsizei n, const GLuint* framebuffers)
+{
+	glTrace.real.DeleteFramebuffers(n, framebuffers);
+	glTrace.record(TRACE_DELETE_FRAMEBUFFERS, n);
+	glTrace.writeArray(framebuffers, n);
+}
+
+inline void GLAPIENTRY traceBindFramebuffer(GLenum target, GLuint framebuffer)
+{
+	glTrace.real.BindFramebuffer(target, framebuffer);
+	glTrace.record(TRACE_BIND_FRAMEBUFFER, target, framebuffer);
+}
+
+inline void GLAPIENTRY traceNamedFramebufferTexture(GLuint framebuffer, GLenum attachment, GLuint texture, GLint level)
+{
+	glTrace.real.NamedFramebufferTexture(framebuffer, attachment, texture, level);
+	glTrace.record(TRACE_NAMED_FRAMEBUFFER_TEXTURE, framebuffer, attachment, texture, level);
+}
+
+inline void GLAPIENTRY traceNamedFramebufferDrawBuffers(GLuint framebuffer, GLsizei n, const GLenum* buffers)
+{
+	glTrace.real.NamedFramebufferDrawBuffers(framebuffer, n, buffers);
+	glTrace.record(TRACE_NAMED_FRAMEBUFFER_DRAW_BUFFERS, framebuffer, n);
+	glTrace.writeArray(buffers, n);
+}
+
+inline void GLAPIENTRY traceNamedFramebufferDrawBuffer(GLuint framebuffer, GLenum buffer)
+{
+	glTrace.real.NamedFramebufferDrawBuffer(framebuffer, buffer);
+	glTrace.record(TRACE_NAMED_FRAMEBUFFER_DRAW_BUFFER, framebuffer, buffer);
+}
+
+inline GLenum GLAPIENTRY traceCheckNamedFramebufferStatus(GLuint framebuffer, GLenum target)
+{
+	GLenum status = glTrace.real.CheckNamedFramebufferStatus(framebuffer, target);
+	glTrace.record(TRACE_CHECK_NAMED_FRAMEBUFFER_STATUS, framebuffer, target);
+	return status;
+}
+
+// one value for depth, four for a color buffer
+inline void GLAPIENTRY traceClearBufferfv(GLenum buffer, GLint drawBuffer, const GLfloat* value)
+{
+	glTrace.real.ClearBufferfv(buffer, drawBuffer, value);
+	glTrace.record(TRACE_CLEAR_BUFFER_FV, buffer, drawBuffer);
+	glTrace.writeArray(value, buffer == GL_COLOR ? 4 : 1);
+}
+
+inline void GLAPIENTRY traceBlendFunci(GLuint buffer, GLenum source, GLenum destination)
+{
+	glTrace.real.BlendFunci(buffer, source, destination);
+	glTrace.record(TRACE_BLEND_FUNCI, buffer, source, destination);
+}
+
+inline void GLAPIENTRY traceGenQueries(GLsizei n, GLuint* ids)
+{
+	glTrace.real.GenQueries(n, ids);
+	glTrace.record(TRACE_GEN_QUERIES, n);
+	glTrace.writeArray(ids, n);
+}
+
+inline void GLAPIENTRY traceDeleteQueries(GLsizei n, const GLuint* ids)
+{
+	glTrace.real.DeleteQueries(n, ids);
+	glTrace.record(TRACE_DELETE_QUERIES, n);
+	glTrace.writeArray(ids, n);
+}
+
+inline void GLAPIENTRY traceQueryCounter(GLuint id, GLenum target)
+{
+	glTrace.real.QueryCounter(id, target);
+	glTrace.record(TRACE_QUERY_COUNTER, id, target);
+}
+
+inline void GLAPIENTRY traceGetQueryObjectui64v(GLuint id, GLenum pname, GLuint64* params)
+{
+	glTrace.real.GetQueryObjectui64v(id, pname, params);
+	glTrace.record(TRACE_GET_QUERY_OBJECT_UI64V, id, pname);
+}
+
+inline void GLAPIENTRY traceBeginQuery(GLenum target, GLuint id)
+{
+	glTrace.real.BeginQuery(target, id);
+	glTrace.record(TRACE_BEGIN_QUERY, target, id);
+}
+
+inline void GLAPIENTRY traceEndQuery(GLenum target)
+{
+	glTrace.real.EndQuery(target);
+	glTrace.record(TRACE_END_QUERY, target);
+}
+
+inline void GLAPIENTRY traceGetQueryObjectuiv(GLuint id, GLenum pname, GLuint* params)
+{
+	glTrace.real.GetQueryObjectuiv(id, pname, params);
+	glTrace.record(TRACE_GET_QUERY_OBJECT_UIV, id, pname);
+}
+
+// syncs are stored by the pointer value the capture got
+inline GLsync GLAPIENTRY traceFenceSync(GLenum condition, GLbitfield flags)
+{
+	GLsync sync = glTrace.real.FenceSync(condition, flags);
+	glTrace.record(TRACE_FENCE_SYNC, condition, flags, (unsigned long long)(size_t)sync);
+	return sync;
+}
+
+inline GLenum GLAPIENTRY traceClientWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout)
+{
+	GLenum result = glTrace.real.ClientWaitSync(sync, flags, timeout);
+	glTrace.record(TRACE_CLIENT_WAIT_SYNC, (unsigned long long)(size_t)sync, flags, timeout);
+	return result;
+}
+
+inline void GLAPIENTRY traceDeleteSync(GLsync sync)
+{
+	glTrace.real.DeleteSync(sync);
+	glTrace.record(TRACE_DELETE_SYNC, (unsigned long long)(size_t)sync);
+}
+
+inline GLuint GLAPIENTRY traceCreateShader(GLenum type)
+{
+	GLuint shader = glTrace.real.CreateShader(type);
+	glTrace.record(TRACE_CREATE_SHADER, type, shader);
+	return shader;
+}
+
+// the strings are joined into one source
+inline void GLAPIENTRY traceShaderSource(GLuint shader, GLsizei count, const GLchar* const* strings, const GLint* lengths)
+{
+	glTrace.real.ShaderSource(shader, count, strings, lengths);
+
+	std::string source;
+	for (GLsizei i = 0; i < count; i++)
+	{
+		if (lengths != NULL && lengths[i] >= 0)
+		{
+			source.append(strings[i], lengths[i]);
+		}
+		else
+		{
+			source.append(strings[i]);
+		}
+	}
+	glTrace.record(TRACE_SHADER_SOURCE, shader);
+	glTrace.writeString(source.c_str());
+}
+
+inline void GLAPIENTRY traceCompileShader(GLuint shader)
+{
+	glTrace.real.CompileShader(shader);
+	glTrace.record(TRACE_COMPILE_SHADER, shader);
+}
+
+inline void GLAPIENTRY traceGetShaderiv(GLuint shader, GLenum pname, GLint* params)
+{
+	glTrace.real.GetShaderiv(shader, pname, params);
+	glTrace.record(TRACE_GET_SHADER_IV, shader, pname);
+}
+
+inline void GLAPIENTRY traceGetShaderInfoLog(GLuint shader, GLsizei bufSize, GLsizei* length, GLchar* infoLog)
+{
+	glTrace.real.GetShaderInfoLog(shader, bufSize, length, infoLog);
+	glTrace.record(TRACE_GET_SHADER_INFO_LOG, shader, bufSize);
+}
+
+inline void GLAPIENTRY traceDeleteShader(GLuint shader)
+{
+	glTrace.real.DeleteShader(shader);
+	glTrace.record(TRACE_DELETE_SHADER, shader);
+}
+
+inline GLuint GLAPIENTRY traceCreateProgram()
+{
+	GLuint program = glTrace.real.CreateProgram();
+	glTrace.record(TRACE_CREATE_PROGRAM, program);
+	return program;
+}
+
+inline void GLAPIENTRY traceAttachShader(GLuint program, GLuint shader)
+{
+	glTrace.real.AttachShader(program, shader);
+	glTrace.record(TRACE_ATTACH_SHADER, program, shader);
+}
+
+inline void GLAPIENTRY traceLinkProgram(GLuint program)
+{
+	glTrace.real.LinkProgram(program);
+	glTrace.record(TRACE_LINK_PROGRAM, program);
+}
+
+inline void GLAPIENTRY traceGetProgramiv(GLuint program, GLenum pname, GLint* params)
+{
+	glTrace.real.GetProgramiv(program, pname, params);
+	glTrace.record(TRACE_GET_PROGRAM_IV, program, pname);
+}
+
+inline void GLAPIENTRY traceGetProgramInfoLog(GLuint program, GLsizei bufSize, GLsizei* length, GLchar* infoLog)
+{
+	glTrace.real.GetProgramInfoLog(program, bufSize, length, infoLog);
+	glTrace.record(TRACE_GET_PROGRAM_INFO_LOG, program, bufSize);
+}
+
+inline void GLAPIENTRY traceDeleteProgram(GLuint program)
+{
+	glTrace.real.DeleteProgram(program);
+	glTrace.record(TRACE_DELETE_PROGRAM, program);
+}
+
+inline void GLAPIENTRY traceUseProgram(GLuint program)
+{
+	glTrace.real.UseProgram(program);
+	glTrace.record(TRACE_USE_PROGRAM, program);
+}
+
+// the location the capture got is stored so the replay can map it to its own
+inline GLint GLAPIENTRY traceGetUniformLocation(GLuint program, const GLchar* name)
+{
+	GLint location = glTrace.real.GetUniformLocation(program, name);
+	glTrace.record(TRACE_GET_UNIFORM_LOCATION, program, location);
+	glTrace.writeString(name);
+	return location;
+}
+
+inline void GLAPIENTRY traceProgramUniform1i(GLuint program, GLint location, GLint v0)
+{
+	glTrace.real.ProgramUniform1i(program, location, v0);
+	glTrace.record(TRACE_PROGRAM_UNIFORM_1I, program, location, v0);
+}
+
+inline void GLAPIENTRY traceProgramUniform1ui(GLuint program, GLint location, GLuint v0)
+{
+	glTrace.real.ProgramUniform1ui(program, location, v0);
+	glTrace.record(TRACE_PROGRAM_UNIFORM_1UI, program, location, v0);
+}
+
+inline void GLAPIENTRY traceProgramUniform1f(GLuint program, GLint location, GLfloat v0)
+{
+	glTrace.real.ProgramUniform1f(program, location, v0);
+	glTrace.record(TRACE_PROGRAM_UNIFORM_1F, program, location, v0);
+}
+
+inline void GLAPIENTRY traceProgramUniform2fv(GLuint program, GLint location, GLsizei count, const GLfloat* value)
+{
+	glTrace.real.ProgramUniform2fv(program, location, count, value);
+	glTrace.record(TRACE_PROGRAM_UNIFORM_FV, program, location, (GLint)2, count);
+	glTrace.writeArray(value, count * 2);
+}
+
+inline void GLAPIENTRY traceProgramUniform3fv(GLuint program, GLint location, GLsizei count, const GLfloat* value)
+{
+	glTrace.real.ProgramUniform3fv(program, location, count, value);
+	glTrace.record(TRACE_PROGRAM_UNIFORM_FV, program, location, (GLint)3, count);
+	glTrace.writeArray(value, count * 3);
+}
+
+inline void GLAPIENTRY traceProgramUniform4fv(GLuint program, GLint location, GLsizei count, const GLfloat* value)
+{
+	glTrace.real.ProgramUniform4fv(program, location, count, value);
+	glTrace.record(TRACE_PROGRAM_UNIFORM_FV, program, location, (GLint)4, count);
+	glTrace.writeArray(value, count * 4);
+}
+
+inline void GLAPIENTRY traceProgramUniformMatrix2fv(GLuint program, GLint location, GLsizei count, GLboolean transpose, const GLfloat* value)
+{
+	glTrace.real.ProgramUniformMatrix2fv(program, location, count, transpose, value);
+	glTrace.record(TRACE_PROGRAM_UNIFORM_MATRIX_FV, program, location, (GLint)2, count, transpose);
+	glTrace.writeArray(value, count * 4);
+}
+
+inline void GLAPIENTRY traceProgramUniformMatrix3fv(GLuint program, GLint location, GLsizei count, GLboolean transpose, const GLfloat* value)
+{
+	glTrace.real.ProgramUniformMatrix3fv(program, location, count, transpose, value);
+	glTrace.record(TRACE_PROGRAM_UNIFORM_MATRIX_FV, program, location, (GLint)3, count, transpose);
+	glTrace.writeArray(value, count * 9);
+}
+
+inline void GLAPIENTRY traceProgramUniformMatrix4fv(GLuint program, GLint location, GLsizei count, GLboolean transpose, const GLfloat* value)
+{
+	glTrace.real.ProgramUniformMatrix4fv(program, location, count, transpose, value);
+	glTrace.record(TRACE_PROGRAM_UNIFORM_MATRIX_FV, program, location, (GLint)4, count, transpose);
+	glTrace.writeArray(value, count * 16);
+}
+
+inline void GLAPIENTRY traceMaxShaderCompilerThreadsKHR(GLuint count)
+{
+	glTrace.real.MaxShaderCompilerThreadsKHR(count);
+	glTrace.record(TRACE_MAX_SHADER_COMPILER_THREADS, count);
+}
+
+inline void GLAPIENTRY traceMaxShaderCompilerThreadsARB(GLuint count)
+{
+	glTrace.real.MaxShaderCompilerThreadsARB(count);
+	glTrace.record(TRACE_MAX_SHADER_COMPILER_THREADS, count);
+}
+
+inline void GLAPIENTRY traceDispatchCompute(GLuint x, GLuint y, GLuint z)
+{
+	glTrace.real.DispatchCompute(x, y, z);
+	glTrace.record(TRACE_DISPATCH_COMPUTE, x, y, z);
+}
+
+inline void GLAPIENTRY traceMemoryBarrier(GLbitfield barriers)
+{
+	glTrace.real.MemoryBarrier(barriers);
+	glTrace.record(TRACE_MEMORY_BARRIER, barriers);
+}
+
+inline void GLAPIENTRY traceDrawElementsInstancedBaseInstance(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instancecount, GLuint baseinstance)
+{
+	glTrace.real.DrawElementsInstancedBaseInstance(mode, count, type, indices, instancecount, baseinstance);
+	glTrace.record(TRACE_DRAW_ELEMENTS_INSTANCED_BASE_INSTANCE, mode, count, type, (GLintptr)indices, instancecount, baseinstance);
+}
+
+inline void GLAPIENTRY traceMultiDrawElementsIndirect(GLenum mode, GLenum type, const void* indirect, GLsizei drawcount, GLsizei stride)
+{
+	glTrace.real.MultiDrawElementsIndirect(mode, type, indirect, drawcount, stride);
+	glTrace.record(TRACE_MULTI_DRAW_ELEMENTS_INDIRECT, mode, type, (GLintptr)indirect, drawcount, stride);
+}
+
+inline void GLAPIENTRY traceMultiDrawElementsIndirectCountARB(GLenum mode, GLenum type, const void* indirect, GLintptr drawcount, GLsizei maxdrawcount, GLsizei stride)
+{
+	glTrace.real.MultiDrawElementsIndirectCountARB(mode, type, indirect, drawcount, maxdrawcount, stride);
+	glTrace.record(TRACE_MULTI_DRAW_ELEMENTS_INDIRECT_COUNT, mode, type, (GLintptr)indirect, drawcount, maxdrawcount, stride);
+}
+
+inline void GLAPIENTRY traceDrawElementsInstancedBaseVertexBaseInstance(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instancecount, GLint basevertex, GLuint baseinstance)
+{
+	glTrace.real.DrawElementsInstancedBaseVertexBaseInstance(mode, count, type, indices, instancecount, basevertex, baseinstance);
+	glTrace.record(TRACE_DRAW_ELEMENTS_INSTANCED_BASE_VERTEX_BASE_INSTANCE, mode, count, type, (GLintptr)indices, instancecount, basevertex, baseinstance);
+}
+
+/*
+ Wrappers of the GL 1.1 functions, the macros below route every later call through them
+*/
+
+inline void GLAPIENTRY traceEnable(GLenum capability)
+{
+	glEnable(capability);
+	if (glTrace.isRecording())
+	{
+		glTrace.record(TRACE_ENABLE, capability);
+	}
+}
+
+inline void GLAPIENTRY traceDisable(GLenum capability)
+{
+	glDisable(capability);
+	if (glTrace.isRecording())
+	{
+		glTrace.record(TRACE_DISABLE, capability);
+	}
+}
+
+inline void GLAPIENTRY traceBlendFunc(GLenum source, GLenum destination)
+{
+	glBlendFunc(source, destination);
+	if (glTrace.isRecording())
+	{
+		glTrace.record(TRACE_BLEND_FUNC, source, destination);
+	}
+}
+
+inline void GLAPIENTRY traceDepthFunc(GLenum function)
+{
+	glDepthFunc(function);
+	if (glTrace.isRecording())
+	{
+		glTrace.record(TRACE_DEPTH_FUNC, function);
+	}
+}
+
+inline void GLAPIENTRY traceDepthMask(GLboolean flag)
+{
+	glDepthMask(flag);
+	if (glTrace.isRecording())
+	{
+		glTrace.record(TRACE_DEPTH_MASK, flag);
+	}
+}
+
+inline void GLAPIENTRY traceViewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	glViewport(x, y, width, height);
+	if (glTrace.isRecording())
+	{
+		glTrace.record(TRACE_VIEWPORT, x, y, width, height);
+	}
+}
+
+inline void GLAPIENTRY traceScissor(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	glScissor(x, y, width, height);
+	if (glTrace.isRecording())
+	{
+		glTrace.record(TRACE_SCISSOR, x, y, width, height);
+	}
+}
+
+inline void GLAPIENTRY traceClear(GLbitfield mask)
+{
+	glClear(mask);
+	if (glTrace.isRecording())
+	{
+		glTrace.record(TRACE_CLEAR, mask);
+	}
+}
+
+inline void GLAPIENTRY traceClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha)
+{
+	glClearColor(red, green, blue, alpha);
+	if (glTrace.isRecording())
+	{
+		glTrace.record(TRACE_CLEAR_COLOR, red, green, blue, alpha);
+	}
+}
+
+inline void GLAPIENTRY tracePolygonMode(GLenum face, GLenum mode)
+{
+	glPolygonMode(face, mode);
+	if (glTrace.isRecording())
+	{
+		glTrace.record(TRACE_POLYGON_MODE, face, mode);
+	}
+}
+
+inline void GLAPIENTRY tracePixelStorei(GLenum pname, GLint param)
+{
+	glPixelStorei(pname, param);
+	if (pname == GL_PACK_ALIGNMENT)
+	{
+		glTrace.packAlignment = param;
+	}
+	else if (pname == GL_UNPACK_ALIGNMENT)
+	{
+		glTrace.unpackAlignment = param;
+	}
+	if (glTrace.isRecording())
+	{
+		glTrace.record(TRACE_PIXEL_STORE_I, pname, param);
+	}
+}
+
+inline void GLAPIENTRY traceReadBuffer(GLenum source)
+{
+	glReadBuffer(source);
+	if (glTrace.isRecording())
+	{
+		glTrace.record(TRACE_READ_BUFFER, source);
+	}
+}
+
+// into a pixel pack buffer the pointer is an offset, client memory is not stored since nothing reads it on replay
+inline void GLAPIENTRY traceReadPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, void* pixels)
+{
+	glReadPixels(x, y, width, height, format, type, pixels);
+	if (glTrace.isRecording())
+	{
+		GLintptr offset = glTrace.packBuffer != 0 ? (GLintptr)pixels : -1;
+		glTrace.record(TRACE_READ_PIXELS, x, y, width, height, format, type, offset);
+	}
+}
+
+inline void GLAPIENTRY traceGetIntegerv(GLenum pname, GLint* data)
+{
+	glGetIntegerv(pname, data);
+	if (glTrace.isRecording())
+	{
+		glTrace.record(TRACE_GET_INTEGER_V, pname);
+	}
+}
+
+inline GLenum GLAPIENTRY traceGetError()
+{
+	GLenum error = glGetError();
+	if (glTrace.isRecording())
+	{
+		glTrace.record(TRACE_GET_ERROR);
+	}
+	return error;
+}
+
+inline void GLAPIENTRY traceDeleteTextures(GLsizei n, const GLuint* textures)
+{
+	glDeleteTextures(n, textures);
+	if (glTrace.isRecording())
+	{
+		glTrace.record(TRACE_DELETE_TEXTURES, n);
+		glTrace.writeArray(textures, n);
+	}
+}
+
+inline void GLAPIENTRY traceDrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+	glDrawArrays(mode, first, count);
+	if (glTrace.isRecording())
+	{
+		glTrace.record(TRACE_DRAW_ARRAYS, mode, first, count);
+	}
+}
+
+#define glEnable traceEnable
+#define glDisable traceDisable
+#define glBlendFunc traceBlendFunc
+#define glDepthFunc traceDepthFunc
+#define glDepthMask traceDepthMask
+#define glViewport traceViewport
+#define glScissor traceScissor
+#define glClear traceClear
+#define glClearColor traceClearColor
+#define glPolygonMode tracePolygonMode
+#define glPixelStorei tracePixelStorei
+#define glReadBuffer traceReadBuffer
+#define glReadPixels traceReadPixels
+#define glGetIntegerv traceGetIntegerv
+#define glGetError traceGetError
+#define glDeleteTextures traceDeleteTextures
+#define glDrawArrays traceDrawArrays
+
+// ------------------------------------------------------------------------
+inline bool GLTraceRecorder::start(const std::string& tracePath, int width, int height, unsigned int frameLimit)
+{
+	stop();
+
+	file.open(tracePath.c_str(), std::ios::binary);
+	if (!file)
+	{
+		std::cout << "ERROR::GL_TRACE::FILE_NOT_OPENED " << tracePath << std::endl;
+		return false;
+	}
+
+	MemoryScope scope(MEMORY_TAG_CAPTURE);
+	chunk.reserve(CHUNK_SIZE + 4096);
+	path = tracePath;
+	frames = frameLimit;
+	stats = GLTraceStats();
+
+	GLTraceHeader header;
+	memcpy(header.magic, "GLTR", 4);
+	header.version = GL_TRACE_VERSION;
+	header.width = width;
+	header.height = height;
+	writeValue(header);
+
+	install();
+	recording = true;
+	return true;
+}
+
+// ------------------------------------------------------------------------
+inline void GLTraceRecorder::stop()
+{
+	if (!recording)
+	{
+		return;
+	}
+
+	recording = false;
+	uninstall();
+	mappedRanges.clear();
+
+	writeValue((unsigned short)TRACE_END);
+	flush();
+	file.close();
+	std::vector<char>().swap(chunk);
+	printStats();
+}
+
+inline void GLTraceRecorder::install()
+{
+#define GL_TRACE_INSTALL(name, stem) real.name = __glew##name; __glew##name = trace##name;
+	GL_TRACE_FUNCTIONS(GL_TRACE_INSTALL)
+#undef GL_TRACE_INSTALL
+}
+
+inline void GLTraceRecorder::getDriverFunctions(GLTraceFunctions& functions) const
+{
+	if (recording)
+	{
+		functions = real;
+		return;
+	}
+#define GL_TRACE_DRIVER_FUNCTION(name, stem) functions.name = __glew##name;
+	GL_TRACE_FUNCTIONS(GL_TRACE_DRIVER_FUNCTION)
+#undef GL_TRACE_DRIVER_FUNCTION
+}
+
+inline void GLTraceRecorder::uninstall()
+{
+#define GL_TRACE_UNINSTALL(name, stem) __glew##name = real.name;
+	GL_TRACE_FUNCTIONS(GL_TRACE_UNINSTALL)
+#undef GL_TRACE_UNINSTALL
+}
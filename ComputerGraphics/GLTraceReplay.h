@@ -0,0 +1,1050 @@
+#pragma once
+
+/*
+ Plays back a trace written by GLTraceRecorder.
+ The whole file is read into memory first so only GL is timed, then every call is issued again as
+ fast as the driver takes it, with no window updates in between. Object names, syncs and uniform
+ locations the driver hands out on replay are mapped to the ones of the capture. Queries and other
+ reads are issued into scratch memory so the driver does the same synchronization work as in the
+ capture. The time of every frame is measured on the CPU, from one frame marker to the next, which
+ is the submission and driver overhead of the frame. A glFinish() at the end adds the GPU time.
+*/
+
+#include <GL/glew.h>
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <unordered_map>
+#include <iostream>
+
+#include "GLTrace.h"
+#include "MemoryTracker.h"
+
+struct GLTraceReplayStats {
+	unsigned int frames = 0;
+	unsigned long long calls = 0;
+	unsigned long long frameCalls = 0;		// calls after the first frame marker
+	double setupMilliseconds = 0.0;			// from the start to the first frame marker
+	double frameMilliseconds = 0.0;			// all frames after the first one
+	double fastestFrameMilliseconds = 0.0;
+	double slowestFrameMilliseconds = 0.0;
+	double finishMilliseconds = 0.0;		// waiting for the GPU after the last call
+	unsigned int unknownNames = 0;			// names used before the trace created them
+};
+
+class GLTraceReplayer
+{
+public:
+	GLTraceReplayStats stats;
+
+	GLTraceReplayer() {}
+
+	// reads the whole trace, the window for the replay needs the size from the header
+	// ------------------------------------------------------------------------
+	bool load(const std::string& path)
+	{
+		std::ifstream file(path.c_str(), std::ios::binary | std::ios::ate);
+		if (!file)
+		{
+			std::cout << "ERROR::GL_TRACE::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
+			return false;
+		}
+
+		MemoryScope scope(MEMORY_TAG_CAPTURE);
+		data.resize((size_t)file.tellg());
+		file.seekg(0);
+		file.read(data.data(), data.size());
+
+		if (data.size() < sizeof(GLTraceHeader))
+		{
+			std::cout << "ERROR::GL_TRACE::FILE_TOO_SHORT " << path << std::endl;
+			return false;
+		}
+
+		memcpy(&header, data.data(), sizeof(GLTraceHeader));
+		if (memcmp(header.magic, "GLTR", 4) != 0 || header.version != GL_TRACE_VERSION)
+		{
+			std::cout << "ERROR::GL_TRACE::UNSUPPORTED_FILE " << path << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	int getWidth() const
+	{
+		return header.width;
+	}
+
+	int getHeight() const
+	{
+		return header.height;
+	}
+
+	// issues the trace on the current context, false when it is cut off or holds an unknown call
+	// ------------------------------------------------------------------------
+	bool replay()
+	{
+		MemoryScope scope(MEMORY_TAG_CAPTURE);
+		position = sizeof(GLTraceHeader);
+		stats = GLTraceReplayStats();
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		std::chrono::steady_clock::time_point frameStart = start;
+		while (true)
+		{
+			if (position + sizeof(unsigned short) > data.size())
+			{
+				std::cout << "ERROR::GL_TRACE::TRACE_CUT_OFF" << std::endl;
+				return false;
+			}
+
+			TraceCall call = (TraceCall)read<unsigned short>();
+			if (call == TRACE_END)
+			{
+				break;
+			}
+
+			if (call == TRACE_FRAME_END)
+			{
+				std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+				double milliseconds = std::chrono::duration<double, std::milli>(now - frameStart).count();
+				frameStart = now;
+				endFrame(milliseconds);
+				continue;
+			}
+
+			if (!replayCall(call) || position > data.size())
+			{
+				std::cout << "ERROR::GL_TRACE::UNKNOWN_CALL " << (int)call << std::endl;
+				return false;
+			}
+			stats.calls++;
+			stats.frameCalls += stats.frames > 0 ? 1 : 0;
+		}
+
+		std::chrono::steady_clock::time_point finishStart = std::chrono::steady_clock::now();
+		glFinish();
+		stats.finishMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - finishStart).count();
+		return true;
+	}
+
+	// ------------------------------------------------------------------------
+	void printStats() const
+	{
+		unsigned int timedFrames = stats.frames > 1 ? stats.frames - 1 : 0;
+		double frameAverage = timedFrames > 0 ? stats.frameMilliseconds / timedFrames : 0.0;
+		double callNanoseconds = stats.frameCalls > 0 ? stats.frameMilliseconds * 1e6 / stats.frameCalls : 0.0;
+
+		std::cout << "Trace replay: " << stats.frames << " frames, " << stats.calls << " calls, setup and first frame " << stats.setupMilliseconds
+			<< " ms; " << frameAverage << " ms per frame on the CPU (" << stats.fastestFrameMilliseconds << " fastest, " << stats.slowestFrameMilliseconds
+			<< " slowest), " << (timedFrames > 0 ? stats.frameCalls / timedFrames : 0) << " calls per frame, " << callNanoseconds << " ns per call; GPU done "
+			<< stats.finishMilliseconds << " ms after the last call" << std::endl;
+		if (stats.unknownNames > 0)
+		{
+			std::cout << "ERROR::GL_TRACE::UNKNOWN_NAMES " << stats.unknownNames << std::endl;
+		}
+	}
+
+private:
+	// captured name to replayed name, names are small integers so plain arrays are enough
+	typedef std::vector<GLuint> NameMap;
+
+	struct MappedRange {
+		char* data;
+		GLintptr offset;
+	};
+
+	std::vector<char> data;
+	size_t position = 0;
+	GLTraceHeader header;
+
+	NameMap buffers;
+	NameMap vertexArrays;
+	NameMap textures;
+	NameMap framebuffers;
+	NameMap queries;
+	NameMap shaders;
+	NameMap programs;
+	std::unordered_map<unsigned long long, GLsync> syncs;
+	std::unordered_map<unsigned long long, GLint> locations;	// replayed program and captured location
+	std::unordered_map<GLuint, MappedRange> mappedRanges;		// by replayed buffer
+	GLuint packBuffer = 0;
+	GLint packAlignment = 4;
+	std::vector<char> scratch;
+
+	template<typename T>
+	T read()
+	{
+		T value;
+		memcpy(&value, data.data() + position, sizeof(T));
+		position += sizeof(T);
+		return value;
+	}
+
+	// data stored with writeBytes(), NULL when the capture passed NULL
+	const void* readBytes(GLsizeiptr& size)
+	{
+		long long storedSize = read<long long>();
+		if (storedSize < 0)
+		{
+			size = 0;
+			return NULL;
+		}
+
+		const void* bytes = data.data() + position;
+		size = (GLsizeiptr)storedSize;
+		position += (size_t)storedSize;
+		return bytes;
+	}
+
+	const void* readBytes()
+	{
+		GLsizeiptr size;
+		return readBytes(size);
+	}
+
+	std::string readString()
+	{
+		GLsizeiptr size;
+		const char* text = (const char*)readBytes(size);
+		return text != NULL ? std::string(text, (size_t)size) : std::string();
+	}
+
+	// ------------------------------------------------------------------------
+	GLuint mapName(const NameMap& names, GLuint captured)
+	{
+		if (captured == 0)
+		{
+			return 0;
+		}
+		if (captured < names.size() && names[captured] != 0)
+		{
+			return names[captured];
+		}
+		stats.unknownNames++;
+		return captured;
+	}
+
+	GLuint readName(const NameMap& names)
+	{
+		return mapName(names, read<GLuint>());
+	}
+
+	void addName(NameMap& names, GLuint captured, GLuint replayed)
+	{
+		if (captured >= names.size())
+		{
+			names.resize(captured + 1, 0);
+		}
+		names[captured] = replayed;
+	}
+
+	// the names a glCreate*/glGen* call returned in the capture, paired with the ones it returned now
+	void addNames(NameMap& names, const GLuint* replayed)
+	{
+		GLsizeiptr size;
+		const GLuint* captured = (const GLuint*)readBytes(size);
+		for (size_t i = 0; i < size / sizeof(GLuint); i++)
+		{
+			addName(names, captured[i], replayed[i]);
+		}
+	}
+
+	// the names of a glDelete* call, forgotten once they are mapped
+	const GLuint* readDeletedNames(NameMap& names, GLsizei count)
+	{
+		const GLuint* captured = (const GLuint*)readBytes();
+		GLuint* replayed = scratchArray<GLuint>(count);
+		for (GLsizei i = 0; i < count; i++)
+		{
+			replayed[i] = mapName(names, captured[i]);
+			if (captured[i] < names.size())
+			{
+				names[captured[i]] = 0;
+			}
+		}
+		return replayed;
+	}
+
+	template<typename T>
+	T* scratchArray(size_t count)
+	{
+		if (scratch.size() < count * sizeof(T))
+		{
+			scratch.resize(count * sizeof(T));
+		}
+		return (T*)scratch.data();
+	}
+
+	GLsync readSync()
+	{
+		std::unordered_map<unsigned long long, GLsync>::const_iterator it = syncs.find(read<unsigned long long>());
+		if (it == syncs.end())
+		{
+			stats.unknownNames++;
+			return 0;
+		}
+		return it->second;
+	}
+
+	GLint readLocation(GLuint program)
+	{
+		GLint captured = read<GLint>();
+		std::unordered_map<unsigned long long, GLint>::const_iterator it = locations.find(getLocationKey(program, captured));
+		return it != locations.end() ? it->second : captured;
+	}
+
+	static unsigned long long getLocationKey(GLuint program, GLint location)
+	{
+		return ((unsigned long long)program << 32) | (GLuint)location;
+	}
+
+	void endFrame(double milliseconds)
+	{
+		if (stats.frames == 0)
+		{
+			stats.setupMilliseconds = milliseconds;
+		}
+		else
+		{
+			bool first = stats.frames == 1;
+			stats.frameMilliseconds += milliseconds;
+			stats.fastestFrameMilliseconds = first ? milliseconds : std::min(stats.fastestFrameMilliseconds, milliseconds);
+			stats.slowestFrameMilliseconds = first ? milliseconds : std::max(stats.slowestFrameMilliseconds, milliseconds);
+		}
+		stats.frames++;
+
+		//the capture presented here, the replay only makes sure the driver keeps working on the frame
+		glFlush();
+	}
+
+	// reads the arguments of one call and issues it, false for a call this version does not know
+	// ------------------------------------------------------------------------
+	bool replayCall(TraceCall call)
+	{
+		switch (call)
+		{
+		case TRACE_MAPPED_WRITE:
+		{
+			GLuint buffer = readName(buffers);
+			GLintptr offset = read<GLintptr>();
+			GLsizeiptr size;
+			const void* bytes = readBytes(size);
+			std::unordered_map<GLuint, MappedRange>::const_iterator it = mappedRanges.find(buffer);
+			if (it != mappedRanges.end())
+			{
+				memcpy(it->second.data + (offset - it->second.offset), bytes, (size_t)size);
+			}
+			return true;
+		}
+		case TRACE_CREATE_BUFFERS:
+		case TRACE_GEN_BUFFERS:
+		{
+			GLsizei count = read<GLsizei>();
+			GLuint* replayed = scratchArray<GLuint>(count);
+			if (call == TRACE_CREATE_BUFFERS)
+			{
+				glCreateBuffers(count, replayed);
+			}
+			else
+			{
+				glGenBuffers(count, replayed);
+			}
+			addNames(buffers, replayed);
+			return true;
+		}
+		case TRACE_DELETE_BUFFERS:
+		{
+			GLsizei count = read<GLsizei>();
+			const GLuint* replayed = readDeletedNames(buffers, count);
+			for (GLsizei i = 0; i < count; i++)
+			{
+				mappedRanges.erase(replayed[i]);
+			}
+			glDeleteBuffers(count, replayed);
+			return true;
+		}
+		case TRACE_NAMED_BUFFER_STORAGE:
+		{
+			GLuint buffer = readName(buffers);
+			GLsizeiptr size = read<GLsizeiptr>();
+			GLbitfield flags = read<GLbitfield>();
+			glNamedBufferStorage(buffer, size, readBytes(), flags);
+			return true;
+		}
+		case TRACE_NAMED_BUFFER_DATA:
+		{
+			GLuint buffer = readName(buffers);
+			GLsizeiptr size = read<GLsizeiptr>();
+			GLenum usage = read<GLenum>();
+			glNamedBufferData(buffer, size, readBytes(), usage);
+			return true;
+		}
+		case TRACE_BUFFER_DATA:
+		{
+			GLenum target = read<GLenum>();
+			GLsizeiptr size = read<GLsizeiptr>();
+			GLenum usage = read<GLenum>();
+			glBufferData(target, size, readBytes(), usage);
+			return true;
+		}
+		case TRACE_NAMED_BUFFER_SUB_DATA:
+		{
+			GLuint buffer = readName(buffers);
+			GLintptr offset = read<GLintptr>();
+			GLsizeiptr size = read<GLsizeiptr>();
+			glNamedBufferSubData(buffer, offset, size, readBytes());
+			return true;
+		}
+		case TRACE_CLEAR_NAMED_BUFFER_DATA:
+		{
+			GLuint buffer = readName(buffers);
+			GLenum internalFormat = read<GLenum>();
+			GLenum format = read<GLenum>();
+			GLenum type = read<GLenum>();
+			glClearNamedBufferData(buffer, internalFormat, format, type, readBytes());
+			return true;
+		}
+		case TRACE_CLEAR_NAMED_BUFFER_SUB_DATA:
+		{
+			GLuint buffer = readName(buffers);
+			GLenum internalFormat = read<GLenum>();
+			GLintptr offset = read<GLintptr>();
+			GLsizeiptr size = read<GLsizeiptr>();
+			GLenum format = read<GLenum>();
+			GLenum type = read<GLenum>();
+			glClearNamedBufferSubData(buffer, internalFormat, offset, size, format, type, readBytes());
+			return true;
+		}
+		case TRACE_COPY_NAMED_BUFFER_SUB_DATA:
+		{
+			GLuint readBuffer = readName(buffers);
+			GLuint writeBuffer = readName(buffers);
+			GLintptr readOffset = read<GLintptr>();
+			GLintptr writeOffset = read<GLintptr>();
+			glCopyNamedBufferSubData(readBuffer, writeBuffer, readOffset, writeOffset, read<GLsizeiptr>());
+			return true;
+		}
+		case TRACE_MAP_NAMED_BUFFER_RANGE:
+		{
+			GLuint buffer = readName(buffers);
+			GLintptr offset = read<GLintptr>();
+			GLsizeiptr length = read<GLsizeiptr>();
+			GLbitfield access = read<GLbitfield>();
+			void* mapped = glMapNamedBufferRange(buffer, offset, length, access);
+			if (mapped != NULL && (access & GL_MAP_WRITE_BIT) != 0)
+			{
+				MappedRange range;
+				range.data = (char*)mapped;
+				range.offset = offset;
+				mappedRanges[buffer] = range;
+			}
+			return true;
+		}
+		case TRACE_MAP_BUFFER_RANGE:
+		{
+			GLenum target = read<GLenum>();
+			GLintptr offset = read<GLintptr>();
+			GLsizeiptr length = read<GLsizeiptr>();
+			GLbitfield access = read<GLbitfield>();
+			glMapBufferRange(target, offset, length, access);
+			return true;
+		}
+		case TRACE_UNMAP_NAMED_BUFFER:
+		{
+			GLuint buffer = readName(buffers);
+			mappedRanges.erase(buffer);
+			glUnmapNamedBuffer(buffer);
+			return true;
+		}
+		case TRACE_UNMAP_BUFFER:
+			glUnmapBuffer(read<GLenum>());
+			return true;
+		case TRACE_BIND_BUFFER:
+		{
+			GLenum target = read<GLenum>();
+			GLuint buffer = readName(buffers);
+			if (target == GL_PIXEL_PACK_BUFFER)
+			{
+				packBuffer = buffer;
+			}
+			glBindBuffer(target, buffer);
+			return true;
+		}
+		case TRACE_BIND_BUFFER_RANGE:
+		{
+			GLenum target = read<GLenum>();
+			GLuint index = read<GLuint>();
+			GLuint buffer = readName(buffers);
+			GLintptr offset = read<GLintptr>();
+			GLsizeiptr size = read<GLsizeiptr>();
+			glBindBufferRange(target, index, buffer, offset, size);
+			return true;
+		}
+		case TRACE_BIND_BUFFER_BASE:
+		{
+			GLenum target = read<GLenum>();
+			GLuint index = read<GLuint>();
+			glBindBufferBase(target, index, readName(buffers));
+			return true;
+		}
+		case TRACE_GEN_VERTEX_ARRAYS:
+		case TRACE_CREATE_VERTEX_ARRAYS:
+		{
+			GLsizei count = read<GLsizei>();
+			GLuint* replayed = scratchArray<GLuint>(count);
+			if (call == TRACE_CREATE_VERTEX_ARRAYS)
+			{
+				glCreateVertexArrays(count, replayed);
+			}
+			else
+			{
+				glGenVertexArrays(count, replayed);
+			}
+			addNames(vertexArrays, replayed);
+			return true;
+		}
+		case TRACE_BIND_VERTEX_ARRAY:
+			glBindVertexArray(readName(vertexArrays));
+			return true;
+		case TRACE_DELETE_VERTEX_ARRAYS:
+		{
+			GLsizei count = read<GLsizei>();
+			glDeleteVertexArrays(count, readDeletedNames(vertexArrays, count));
+			return true;
+		}
+		case TRACE_VERTEX_ATTRIB_POINTER:
+		{
+			GLuint index = read<GLuint>();
+			GLint size = read<GLint>();
+			GLenum type = read<GLenum>();
+			GLboolean normalized = read<GLboolean>();
+			GLsizei stride = read<GLsizei>();
+			glVertexAttribPointer(index, size, type, normalized, stride, (const void*)read<GLintptr>());
+			return true;
+		}
+		case TRACE_VERTEX_ATTRIB_I_POINTER:
+		{
+			GLuint index = read<GLuint>();
+			GLint size = read<GLint>();
+			GLenum type = read<GLenum>();
+			GLsizei stride = read<GLsizei>();
+			glVertexAttribIPointer(index, size, type, stride, (const void*)read<GLintptr>());
+			return true;
+		}
+		case TRACE_VERTEX_ATTRIB_DIVISOR:
+		{
+			GLuint index = read<GLuint>();
+			glVertexAttribDivisor(index, read<GLuint>());
+			return true;
+		}
+		case TRACE_ENABLE_VERTEX_ATTRIB_ARRAY:
+			glEnableVertexAttribArray(read<GLuint>());
+			return true;
+		case TRACE_CREATE_TEXTURES:
+		{
+			GLenum target = read<GLenum>();
+			GLsizei count = read<GLsizei>();
+			GLuint* replayed = scratchArray<GLuint>(count);
+			glCreateTextures(target, count, replayed);
+			addNames(textures, replayed);
+			return true;
+		}
+		case TRACE_DELETE_TEXTURES:
+		{
+			GLsizei count = read<GLsizei>();
+			glDeleteTextures(count, readDeletedNames(textures, count));
+			return true;
+		}
+		case TRACE_TEXTURE_STORAGE_2D:
+		{
+			GLuint texture = readName(textures);
+			GLsizei levels = read<GLsizei>();
+			GLenum internalFormat = read<GLenum>();
+			GLsizei width = read<GLsizei>();
+			GLsizei height = read<GLsizei>();
+			glTextureStorage2D(texture, levels, internalFormat, width, height);
+			return true;
+		}
+		case TRACE_TEXTURE_SUB_IMAGE_2D:
+		{
+			GLuint texture = readName(textures);
+			GLint level = read<GLint>();
+			GLint x = read<GLint>();
+			GLint y = read<GLint>();
+			GLsizei width = read<GLsizei>();
+			GLsizei height = read<GLsizei>();
+			GLenum format = read<GLenum>();
+			GLenum type = read<GLenum>();
+			glTextureSubImage2D(texture, level, x, y, width, height, format, type, readBytes());
+			return true;
+		}
+		case TRACE_TEXTURE_PARAMETER_I:
+		{
+			GLuint texture = readName(textures);
+			GLenum name = read<GLenum>();
+			glTextureParameteri(texture, name, read<GLint>());
+			return true;
+		}
+		case TRACE_BIND_TEXTURE_UNIT:
+		{
+			GLuint unit = read<GLuint>();
+			glBindTextureUnit(unit, readName(textures));
+			return true;
+		}
+		case TRACE_BIND_IMAGE_TEXTURE:
+		{
+			GLuint unit = read<GLuint>();
+			GLuint texture = readName(textures);
+			GLint level = read<GLint>();
+			GLboolean layered = read<GLboolean>();
+			GLint layer = read<GLint>();
+			GLenum access = read<GLenum>();
+			glBindImageTexture(unit, texture, level, layered, layer, access, read<GLenum>());
+			return true;
+		}
+		case TRACE_CREATE_FRAMEBUFFERS:
+		{
+			GLsizei count = read<GLsizei>();
+			GLuint* replayed = scratchArray<GLuint>(count);
+			glCreateFramebuffers(count, replayed);
+			addNames(framebuffers, replayed);
+			return true;
+		}
+		case TRACE_DELETE_FRAMEBUFFERS:
+		{
+			GLsizei count = read<GLsizei>();
+			glDeleteFramebuffers(count, readDeletedNames(framebuffers, count));
+			return true;
+		}
+		case TRACE_BIND_FRAMEBUFFER:
+		{
+			GLenum target = read<GLenum>();
+			glBindFramebuffer(target, readName(framebuffers));
+			return true;
+		}
+		case TRACE_NAMED_FRAMEBUFFER_TEXTURE:
+		{
+			GLuint framebuffer = readName(framebuffers);
+			GLenum attachment = read<GLenum>();
+			GLuint texture = readName(textures);
+			glNamedFramebufferTexture(framebuffer, attachment, texture, read<GLint>());
+			return true;
+		}
+		case TRACE_NAMED_FRAMEBUFFER_DRAW_BUFFERS:
+		{
+			GLuint framebuffer = readName(framebuffers);
+			GLsizei count = read<GLsizei>();
+			glNamedFramebufferDrawBuffers(framebuffer, count, (const GLenum*)readBytes());
+			return true;
+		}
+		case TRACE_NAMED_FRAMEBUFFER_DRAW_BUFFER:
+		{
+			GLuint framebuffer = readName(framebuffers);
+			glNamedFramebufferDrawBuffer(framebuffer, read<GLenum>());
+			return true;
+		}
+		case TRACE_CHECK_NAMED_FRAMEBUFFER_STATUS:
+		{
+			GLuint framebuffer = readName(framebuffers);
+			glCheckNamedFramebufferStatus(framebuffer, read<GLenum>());
+			return true;
+		}
+		case TRACE_GEN_QUERIES:
+		{
+			GLsizei count = read<GLsizei>();
+			GLuint* replayed = scratchArray<GLuint>(count);
+			glGenQueries(count, replayed);
+			addNames(queries, replayed);
+			return true;
+		}
+		case TRACE_DELETE_QUERIES:
+		{
+			GLsizei count = read<GLsizei>();
+			glDeleteQueries(count, readDeletedNames(queries, count));
+			return true;
+		}
+		case TRACE_QUERY_COUNTER:
+		{
+			GLuint query = readName(queries);
+			glQueryCounter(query, read<GLenum>());
+			return true;
+		}
+		case TRACE_GET_QUERY_OBJECT_UI64V:
+		{
+			GLuint query = readName(queries);
+			GLuint64 result;
+			glGetQueryObjectui64v(query, read<GLenum>(), &result);
+			return true;
+		}
+		case TRACE_BEGIN_QUERY:
+		{
+			GLenum target = read<GLenum>();
+			glBeginQuery(target, readName(queries));
+			return true;
+		}
+		case TRACE_END_QUERY:
+			glEndQuery(read<GLenum>());
+			return true;
+		case TRACE_GET_QUERY_OBJECT_UIV:
+		{
+			GLuint query = readName(queries);
+			GLuint result;
+			glGetQueryObjectuiv(query, read<GLenum>(), &result);
+			return true;
+		}
+		case TRACE_FENCE_SYNC:
+		{
+			GLenum condition = read<GLenum>();
+			GLbitfield flags = read<GLbitfield>();
+			syncs[read<unsigned long long>()] = glFenceSync(condition, flags);
+			return true;
+		}
+		case TRACE_CLIENT_WAIT_SYNC:
+		{
+			GLsync sync = readSync();
+			GLbitfield flags = read<GLbitfield>();
+			GLuint64 timeout = read<GLuint64>();
+			if (sync != 0)
+			{
+				glClientWaitSync(sync, flags, timeout);
+			}
+			return true;
+		}
+		case TRACE_DELETE_SYNC:
+		{
+			unsigned long long captured = read<unsigned long long>();
+			std::unordered_map<unsigned long long, GLsync>::iterator it = syncs.find(captured);
+			if (it != syncs.end())
+			{
+				glDeleteSync(it->second);
+				syncs.erase(it);
+			}
+			return true;
+		}
+		case TRACE_CREATE_SHADER:
+		{
+			GLenum type = read<GLenum>();
+			addName(shaders, read<GLuint>(), glCreateShader(type));
+			return true;
+		}
+		case TRACE_SHADER_SOURCE:
+		{
+			GLuint shader = readName(shaders);
+			GLsizeiptr size;
+			const GLchar* source = (const GLchar*)readBytes(size);
+			GLint length = (GLint)size;
+			glShaderSource(shader, 1, &source, &length);
+			return true;
+		}
+		case TRACE_COMPILE_SHADER:
+			glCompileShader(readName(shaders));
+			return true;
+		case TRACE_GET_SHADER_IV:
+		{
+			GLuint shader = readName(shaders);
+			GLint value;
+			glGetShaderiv(shader, read<GLenum>(), &value);
+			return true;
+		}
+		case TRACE_GET_SHADER_INFO_LOG:
+		{
+			GLuint shader = readName(shaders);
+			GLsizei size = read<GLsizei>();
+			glGetShaderInfoLog(shader, size, NULL, scratchArray<GLchar>(size));
+			return true;
+		}
+		case TRACE_DELETE_SHADER:
+		{
+			GLuint captured = read<GLuint>();
+			glDeleteShader(mapName(shaders, captured));
+			addName(shaders, captured, 0);
+			return true;
+		}
+		case TRACE_CREATE_PROGRAM:
+			addName(programs, read<GLuint>(), glCreateProgram());
+			return true;
+		case TRACE_ATTACH_SHADER:
+		{
+			GLuint program = readName(programs);
+			glAttachShader(program, readName(shaders));
+			return true;
+		}
+		case TRACE_LINK_PROGRAM:
+			glLinkProgram(readName(programs));
+			return true;
+		case TRACE_GET_PROGRAM_IV:
+		{
+			GLuint program = readName(programs);
+			GLint value;
+			glGetProgramiv(program, read<GLenum>(), &value);
+			return true;
+		}
+		case TRACE_GET_PROGRAM_INFO_LOG:
+		{
+			GLuint program = readName(programs);
+			GLsizei size = read<GLsizei>();
+			glGetProgramInfoLog(program, size, NULL, scratchArray<GLchar>(size));
+			return true;
+		}
+		case TRACE_DELETE_PROGRAM:
+		{
+			GLuint captured = read<GLuint>();
+			glDeleteProgram(mapName(programs, captured));
+			addName(programs, captured, 0);
+			return true;
+		}
+		case TRACE_USE_PROGRAM:
+			glUseProgram(readName(programs));
+			return true;
+		case TRACE_GET_UNIFORM_LOCATION:
+		{
+			GLuint program = readName(programs);
+			GLint captured = read<GLint>();
+			locations[getLocationKey(program, captured)] = glGetUniformLocation(program, readString().c_str());
+			return true;
+		}
+		case TRACE_PROGRAM_UNIFORM_1I:
+		{
+			GLuint program = readName(programs);
+			GLint location = readLocation(program);
+			glProgramUniform1i(program, location, read<GLint>());
+			return true;
+		}
+		case TRACE_PROGRAM_UNIFORM_1UI:
+		{
+			GLuint program = readName(programs);
+			GLint location = readLocation(program);
+			glProgramUniform1ui(program, location, read<GLuint>());
+			return true;
+		}
+		case TRACE_PROGRAM_UNIFORM_1F:
+		{
+			GLuint program = readName(programs);
+			GLint location = readLocation(program);
+			glProgramUniform1f(program, location, read<GLfloat>());
+			return true;
+		}
+		case TRACE_PROGRAM_UNIFORM_FV:
+		{
+			GLuint program = readName(programs);
+			GLint location = readLocation(program);
+			GLint components = read<GLint>();
+			GLsizei count = read<GLsizei>();
+			const GLfloat* values = (const GLfloat*)readBytes();
+			if (components == 2)
+			{
+				glProgramUniform2fv(program, location, count, values);
+			}
+			else if (components == 3)
+			{
+				glProgramUniform3fv(program, location, count, values);
+			}
+			else
+			{
+				glProgramUniform4fv(program, location, count, values);
+			}
+			return true;
+		}
+		case TRACE_PROGRAM_UNIFORM_MATRIX_FV:
+		{
+			GLuint program = readName(programs);
+			GLint location = readLocation(program);
+			GLint columns = read<GLint>();
+			GLsizei count = read<GLsizei>();
+			GLboolean transpose = read<GLboolean>();
+			const GLfloat* values = (const GLfloat*)readBytes();
+			if (columns == 2)
+			{
+				glProgramUniformMatrix2fv(program, location, count, transpose, values);
+			}
+			else if (columns == 3)
+			{
+				glProgramUniformMatrix3fv(program, location, count, transpose, values);
+			}
+			else
+			{
+				glProgramUniformMatrix4fv(program, location, count, transpose, values);
+			}
+			return true;
+		}
+		case TRACE_MAX_SHADER_COMPILER_THREADS:
+		{
+			GLuint count = read<GLuint>();
+			if (GLEW_KHR_parallel_shader_compile)
+			{
+				glMaxShaderCompilerThreadsKHR(count);
+			}
+			else if (GLEW_ARB_parallel_shader_compile)
+			{
+				glMaxShaderCompilerThreadsARB(count);
+			}
+			return true;
+		}
+		case TRACE_DISPATCH_COMPUTE:
+		{
+			GLuint x = read<GLuint>();
+			GLuint y = read<GLuint>();
+			glDispatchCompute(x, y, read<GLuint>());
+			return true;
+		}
+		case TRACE_MEMORY_BARRIER:
+			glMemoryBarrier(read<GLbitfield>());
+			return true;
+		case TRACE_DRAW_ARRAYS:
+		{
+			GLenum mode = read<GLenum>();
+			GLint first = read<GLint>();
+			glDrawArrays(mode, first, read<GLsizei>());
+			return true;
+		}
+		case TRACE_DRAW_ELEMENTS_INSTANCED_BASE_INSTANCE:
+		{
+			GLenum mode = read<GLenum>();
+			GLsizei count = read<GLsizei>();
+			GLenum type = read<GLenum>();
+			const void* indices = (const void*)read<GLintptr>();
+			GLsizei instanceCount = read<GLsizei>();
+			glDrawElementsInstancedBaseInstance(mode, count, type, indices, instanceCount, read<GLuint>());
+			return true;
+		}
+		case TRACE_MULTI_DRAW_ELEMENTS_INDIRECT:
+		{
+			GLenum mode = read<GLenum>();
+			GLenum type = read<GLenum>();
+			const void* indirect = (const void*)read<GLintptr>();
+			GLsizei drawCount = read<GLsizei>();
+			glMultiDrawElementsIndirect(mode, type, indirect, drawCount, read<GLsizei>());
+			return true;
+		}
+		case TRACE_MULTI_DRAW_ELEMENTS_INDIRECT_COUNT:
+		{
+			GLenum mode = read<GLenum>();
+			GLenum type = read<GLenum>();
+			const void* indirect = (const void*)read<GLintptr>();
+			GLintptr drawCount = read<GLintptr>();
+			GLsizei maxDrawCount = read<GLsizei>();
+			glMultiDrawElementsIndirectCountARB(mode, type, indirect, drawCount, maxDrawCount, read<GLsizei>());
+			return true;
+		}
+		case TRACE_ENABLE:
+			glEnable(read<GLenum>());
+			return true;
+		case TRACE_DISABLE:
+			glDisable(read<GLenum>());
+			return true;
+		case TRACE_BLEND_FUNC:
+		{
+			GLenum source = read<GLenum>();
+			glBlendFunc(source, read<GLenum>());
+			return true;
+		}
+		case TRACE_BLEND_FUNCI:
+		{
+			GLuint buffer = read<GLuint>();
+			GLenum source = read<GLenum>();
+			glBlendFunci(buffer, source, read<GLenum>());
+			return true;
+		}
+		case TRACE_CLEAR_BUFFER_FV:
+		{
+			GLenum buffer = read<GLenum>();
+			GLint drawBuffer = read<GLint>();
+			glClearBufferfv(buffer, drawBuffer, (const GLfloat*)readBytes());
+			return true;
+		}
+		case TRACE_DEPTH_FUNC:
+			glDepthFunc(read<GLenum>());
+			return true;
+		case TRACE_DEPTH_MASK:
+			glDepthMask(read<GLboolean>());
+			return true;
+		case TRACE_VIEWPORT:
+		{
+			GLint x = read<GLint>();
+			GLint y = read<GLint>();
+			GLsizei width = read<GLsizei>();
+			glViewport(x, y, width, read<GLsizei>());
+			return true;
+		}
+		case TRACE_SCISSOR:
+		{
+			GLint x = read<GLint>();
+			GLint y = read<GLint>();
+			GLsizei width = read<GLsizei>();
+			glScissor(x, y, width, read<GLsizei>());
+			return true;
+		}
+		case TRACE_CLEAR:
+			glClear(read<GLbitfield>());
+			return true;
+		case TRACE_CLEAR_COLOR:
+		{
+			GLfloat red = read<GLfloat>();
+			GLfloat green = read<GLfloat>();
+			GLfloat blue = read<GLfloat>();
+			glClearColor(red, green, blue, read<GLfloat>());
+			return true;
+		}
+		case TRACE_POLYGON_MODE:
+		{
+			GLenum face = read<GLenum>();
+			glPolygonMode(face, read<GLenum>());
+			return true;
+		}
+		case TRACE_PIXEL_STORE_I:
+		{
+			GLenum name = read<GLenum>();
+			GLint value = read<GLint>();
+			if (name == GL_PACK_ALIGNMENT)
+			{
+				packAlignment = value;
+			}
+			glPixelStorei(name, value);
+			return true;
+		}
+		case TRACE_READ_BUFFER:
+			glReadBuffer(read<GLenum>());
+			return true;
+		case TRACE_READ_PIXELS:
+		{
+			GLint x = read<GLint>();
+			GLint y = read<GLint>();
+			GLsizei width = read<GLsizei>();
+			GLsizei height = read<GLsizei>();
+			GLenum format = read<GLenum>();
+			GLenum type = read<GLenum>();
+			GLintptr offset = read<GLintptr>();
+			void* pixels = packBuffer != 0 && offset >= 0 ? (void*)offset : scratchArray<char>(getTraceImageSize(width, height, format, type, packAlignment));
+			glReadPixels(x, y, width, height, format, type, pixels);
+			return true;
+		}
+		case TRACE_GET_INTEGER_V:
+		{
+			GLint values[16];
+			glGetIntegerv(read<GLenum>(), values);
+			return true;
+		}
+		case TRACE_GET_ERROR:
+			glGetError();
+			return true;
+		case TRACE_DRAW_ELEMENTS_INSTANCED_BASE_VERTEX_BASE_INSTANCE:
+		{
+			GLenum mode = read<GLenum>();
+			GLsizei count = read<GLsizei>();
+			GLenum type = read<GLenum>();
+			const void* indices = (const void*)read<GLintptr>();
+			GLsizei instanceCount = read<GLsizei>();
+			GLint baseVertex = read<GLint>();
+			glDrawElementsInstancedBaseVertexBaseInstance(mode, count, type, indices, instanceCount, baseVertex, read<GLuint>());
+			return true;
+		}
+		default:
+			return false;
+		}
+	}
+};
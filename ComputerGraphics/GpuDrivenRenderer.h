@@ -0,0 +1,524 @@
+#pragma once
+
+/*
+ GPU-driven rendering path.
+ Object records and world-space bounds of the whole scene live in shader storage buffers and are
+ only uploaded when the scene changes, objects that move are updated by ranges of records. Every
+ frame a compute shader culls all objects against the view frustum (and optionally against a hi-z
+ pyramid of the previous frame's depth), writes compacted DrawElementsIndirectCommand records with
+ the index range of each object's mesh and the frame is submitted with one multi-draw-indirect call.
+ The model and normal matrices are computed from the object records on upload, also by a dispatch.
+ Translucent objects get their commands from the end of the command buffer and a count of their own,
+ draw() submits the opaque ones and drawTranslucent() the rest for the translucent pass.
+ The CPU work per frame does not depend on the number of objects. The scene targets belong to the
+ frame graph, the renderer only keeps the depth pyramid that has to survive until the next frame.
+ The number of visible objects is copied to a mapped buffer after culling and read a few frames
+ later without waiting for the GPU, for the overlay.
+ With packedInstances the scene is kept as PackedInstance records instead, which the draw shader
+ decodes itself with the PACKED_INSTANCES variant, so neither the object records nor the matrices
+ are stored on the GPU.
+*/
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <iostream>
+
+#include "Shader.h"
+#include "GLState.h"
+#include "Scene.h"
+#include "StartupLoader.h"
+#include "ObjectTransforms.h"
+#include "PackedInstances.h"
+
+// Layout defined by GL for glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand {
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+class GpuDrivenRenderer
+{
+public:
+	// Test objects against the previous frame's depth pyramid as well
+	bool occlusionCulling = false;
+
+	// Upload the scene as packed records, read by the PACKED_INSTANCES variant. Switched off again when
+	// a scene does not fit the encoding
+	bool packedInstances = false;
+
+	GpuDrivenRenderer() {}
+
+	// only required for the first frame when it is rendered GPU-driven
+	void requestShaders(StartupLoader& loader, bool required)
+	{
+		loader.addComputeProgram(cullShader, "./Shaders/cull.comp", required);
+		loader.addComputeProgram(hiZShader, "./Shaders/hiz.comp", required);
+	}
+
+	// waits for the programs of requestShaders(), before the first GPU-driven frame
+	void finishShaders()
+	{
+		cullShader.finishLoad();
+		hiZShader.finishLoad();
+	}
+
+	bool init(int width, int height)
+	{
+		if (!GLEW_VERSION_4_3)
+		{
+			std::cout << "ERROR::GPU_DRIVEN::COMPUTE_SHADERS_NOT_SUPPORTED" << std::endl;
+			return false;
+		}
+
+		MemoryScope scope(MEMORY_TAG_GPU_DRIVEN);
+
+		//opaque and translucent draw count
+		drawCountBuffer = gpuMemory.createBuffer(2 * sizeof(GLuint), NULL, GL_DYNAMIC_STORAGE_BIT);
+
+		GLbitfield readbackFlags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		readbackBuffer = gpuMemory.createBuffer(READBACK_FRAMES * 2 * sizeof(GLuint), NULL, readbackFlags);
+		readbackData = (const GLuint*)glMapNamedBufferRange(readbackBuffer, 0, READBACK_FRAMES * 2 * sizeof(GLuint), readbackFlags);
+		for (int i = 0; i < READBACK_FRAMES; i++)
+		{
+			readbackFences[i] = 0;
+		}
+
+		useDrawCount = GLEW_ARB_indirect_parameters ? true : false;
+
+		resize(width, height);
+
+		return true;
+	}
+
+	// (re)creates the depth pyramid for a scene depth buffer of the given size
+	// ------------------------------------------------------------------------
+	void resize(int width, int height)
+	{
+		releaseTargets();
+
+		targetWidth = width;
+		targetHeight = height;
+
+		hiZLevels = 1;
+		int size = width > height ? width : height;
+		while (size > 1)
+		{
+			size /= 2;
+			hiZLevels++;
+		}
+
+		MemoryScope scope(MEMORY_TAG_GPU_DRIVEN);
+		hiZTexture = gpuMemory.createTexture2D(hiZLevels, GL_R32F, width, height);
+		glTextureParameteri(hiZTexture, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+		glTextureParameteri(hiZTexture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+		hiZValid = false;
+	}
+
+	// uploads object records and bounds and computes the matrices, or packs the records, only needed
+	// when the scene changes
+	// ------------------------------------------------------------------------
+	void uploadScene(const std::vector<ObjectData>& objects, const std::vector<ObjectBounds>& bounds, ObjectTransforms& transforms)
+	{
+		objectCount = (GLuint)objects.size();
+		translucentCount = 0;
+		if (objectCount == 0)
+		{
+			return;
+		}
+
+		if (packedInstances && !packed.pack(objects))
+		{
+			std::cout << "ERROR::GPU_DRIVEN::SCENE_NOT_PACKED" << std::endl;
+			packedInstances = false;
+		}
+		if (!packedInstances)
+		{
+			packed.release();
+		}
+
+		for (size_t i = 0; i < objects.size(); i++)
+		{
+			if (objects[i].material.opacity < 1.0f)
+			{
+				translucentCount++;
+			}
+		}
+
+		if (objectCount > capacity || packedInstances != scenePacked)
+		{
+			releaseSceneBuffers();
+			capacity = objectCount;
+			scenePacked = packedInstances;
+
+			MemoryScope scope(MEMORY_TAG_GPU_DRIVEN);
+			boundsBuffer = gpuMemory.createBuffer(capacity * sizeof(ObjectBounds), NULL, GL_DYNAMIC_STORAGE_BIT);
+			commandBuffer = gpuMemory.createBuffer(capacity * sizeof(DrawElementsIndirectCommand), NULL, GL_DYNAMIC_STORAGE_BIT);
+			if (!scenePacked)
+			{
+				objectBuffer = gpuMemory.createBuffer(capacity * sizeof(ObjectData), NULL, GL_DYNAMIC_STORAGE_BIT);
+				matrixBuffer = gpuMemory.createBuffer(capacity * sizeof(ObjectMatrices), NULL, 0);
+			}
+		}
+
+		glNamedBufferSubData(boundsBuffer, 0, objectCount * sizeof(ObjectBounds), bounds.data());
+		if (!scenePacked)
+		{
+			glNamedBufferSubData(objectBuffer, 0, objectCount * sizeof(ObjectData), objects.data());
+			transforms.compute(objectBuffer, 0, 0, objectCount, matrixBuffer);
+		}
+
+		hiZValid = false;
+	}
+
+	// writes the records and bounds of the given ranges and recomputes their matrices, for the objects
+	// that moved since uploadScene() while the rest of the scene stays as it was uploaded
+	// ------------------------------------------------------------------------
+	void updateRanges(const std::vector<ObjectData>& objects, const std::vector<ObjectBounds>& bounds, const std::vector<ObjectRange>& ranges, ObjectTransforms& transforms)
+	{
+		for (size_t i = 0; i < ranges.size(); i++)
+		{
+			const ObjectRange& range = ranges[i];
+			if (range.first + range.count > objectCount)
+			{
+				std::cout << "ERROR::GPU_DRIVEN::RANGE_OUT_OF_SCENE" << std::endl;
+				continue;
+			}
+
+			glNamedBufferSubData(boundsBuffer, range.first * sizeof(ObjectBounds), range.count * sizeof(ObjectBounds), &bounds[range.first]);
+			if (!scenePacked)
+			{
+				glNamedBufferSubData(objectBuffer, range.first * sizeof(ObjectData), range.count * sizeof(ObjectData), &objects[range.first]);
+				transforms.compute(objectBuffer, 0, range.first, range.count, matrixBuffer);
+			}
+		}
+		if (scenePacked)
+		{
+			packed.updateRanges(objects, ranges);
+		}
+	}
+
+	// culls all objects on the GPU and fills the indirect command buffer with the index range of their
+	// mesh, meshRangeBuffer holds the MeshRange of every mesh the objects use. Any other view than the
+	// main one, a reflection, is culled by its frustum only and does not touch the visible count or the
+	// view the depth pyramid belongs to
+	// ------------------------------------------------------------------------
+	void cull(const glm::mat4& viewProjection, GLuint meshRangeBuffer, bool mainView = true)
+	{
+		if (objectCount == 0)
+		{
+			return;
+		}
+
+		glm::vec4 planes[6];
+		extractFrustumPlanes(viewProjection, planes);
+
+		GLuint zero = 0;
+		glClearNamedBufferData(drawCountBuffer, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+		if (!useDrawCount)
+		{
+			//without ARB_indirect_parameters every slot is submitted, the ones past the visible count draw nothing
+			glClearNamedBufferSubData(commandBuffer, GL_R32UI, 0, objectCount * sizeof(DrawElementsIndirectCommand), GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+		}
+
+		bindObjects();
+		glState.bindBufferBase(GL_SHADER_STORAGE_BUFFER, BOUNDS_BUFFER_BINDING, boundsBuffer);
+		glState.bindBufferBase(GL_SHADER_STORAGE_BUFFER, COMMAND_BUFFER_BINDING, commandBuffer);
+		glState.bindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_COUNT_BINDING, drawCountBuffer);
+		glState.bindBufferBase(GL_SHADER_STORAGE_BUFFER, MESH_RANGE_BINDING, meshRangeBuffer);
+
+		if (!occlusionCulling)
+		{
+			hiZValid = false;
+		}
+		bool testOcclusion = mainView && occlusionCulling && hiZValid;
+
+		cullShader.use();
+		cullShader.setUint("objectCount", objectCount);
+		cullShader.setUint("translucentFirst", objectCount - translucentCount);
+		cullShader.setVec4Array("frustumPlanes", planes, 6);
+		cullShader.setBool("packedInstances", scenePacked);
+		cullShader.setBool("occlusionCulling", testOcclusion);
+		if (testOcclusion)
+		{
+			cullShader.setMat4("previousViewProjection", previousViewProjection);
+			cullShader.setInt("hiZLevels", hiZLevels);
+			glState.bindTextureUnit(0, hiZTexture);
+		}
+
+		glDispatchCompute((objectCount + 63) / 64, 1, 1);
+		glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+		if (!mainView)
+		{
+			return;
+		}
+
+		readBackVisibleCount();
+
+		currentViewProjection = viewProjection;
+	}
+
+	// submits every visible opaque object with a single indirect draw, the draw shader has to be bound
+	// and vertexArray has to hold every mesh
+	// ------------------------------------------------------------------------
+	void draw(GLuint vertexArray)
+	{
+		submit(vertexArray, 0, objectCount - translucentCount, 0);
+	}
+
+	// the same for the visible translucent objects, with the TRANSLUCENT variant bound
+	// ------------------------------------------------------------------------
+	void drawTranslucent(GLuint vertexArray)
+	{
+		submit(vertexArray, objectCount - translucentCount, translucentCount, sizeof(GLuint));
+	}
+
+	// reduces the depth the culled frame was rendered with for the next frame's occlusion test
+	// ------------------------------------------------------------------------
+	void buildHiZ(GLuint depthTexture)
+	{
+		hiZShader.use();
+
+		int width = targetWidth;
+		int height = targetHeight;
+		for (int level = 0; level < hiZLevels; level++)
+		{
+			hiZShader.setBool("copyDepth", level == 0);
+			if (level == 0)
+			{
+				glState.bindTextureUnit(0, depthTexture);
+			}
+			else
+			{
+				glBindImageTexture(0, hiZTexture, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+				width = width / 2 > 1 ? width / 2 : 1;
+				height = height / 2 > 1 ? height / 2 : 1;
+			}
+			glBindImageTexture(1, hiZTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+			glDispatchCompute((width + 7) / 8, (height + 7) / 8, 1);
+			glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+		}
+
+		previousViewProjection = currentViewProjection;
+		hiZValid = true;
+	}
+
+	void release()
+	{
+		releaseSceneBuffers();
+		packed.release();
+		releaseTargets();
+		glState.deleteBuffers(1, &drawCountBuffer);
+		for (int i = 0; i < READBACK_FRAMES; i++)
+		{
+			if (readbackFences[i] != 0)
+			{
+				glDeleteSync(readbackFences[i]);
+				readbackFences[i] = 0;
+			}
+		}
+		if (readbackBuffer != 0)
+		{
+			glUnmapNamedBuffer(readbackBuffer);
+			glState.deleteBuffers(1, &readbackBuffer);
+			readbackBuffer = 0;
+		}
+		readbackData = NULL;
+		glState.deleteProgram(cullShader.ID);
+		glState.deleteProgram(hiZShader.ID);
+	}
+
+	GLuint getObjectCount() const
+	{
+		return objectCount;
+	}
+
+	// the uploaded scene is in packed records, the draws need the PACKED_INSTANCES variant
+	bool isScenePacked() const
+	{
+		return scenePacked;
+	}
+
+	const PackedInstances& getPackedInstances() const
+	{
+		return packed;
+	}
+
+	// objects of the uploaded scene with an opacity below 1
+	GLuint getTranslucentCount() const
+	{
+		return translucentCount;
+	}
+
+	// objects that passed the culling of a recent frame, translucent ones included, it lags a few frames behind
+	GLuint getVisibleCount() const
+	{
+		return visibleCount;
+	}
+
+	// size of the depth buffer the pyramid was created for
+	int getTargetWidth() const
+	{
+		return targetWidth;
+	}
+
+	int getTargetHeight() const
+	{
+		return targetHeight;
+	}
+
+	GLuint getHiZTexture() const
+	{
+		return hiZTexture;
+	}
+
+	int getHiZLevels() const
+	{
+		return hiZLevels;
+	}
+
+	// Gribb/Hartmann plane extraction, planes point inwards
+	static void extractFrustumPlanes(const glm::mat4& m, glm::vec4 planes[6])
+	{
+		glm::vec4 row0 = glm::vec4(m[0][0], m[1][0], m[2][0], m[3][0]);
+		glm::vec4 row1 = glm::vec4(m[0][1], m[1][1], m[2][1], m[3][1]);
+		glm::vec4 row2 = glm::vec4(m[0][2], m[1][2], m[2][2], m[3][2]);
+		glm::vec4 row3 = glm::vec4(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+		planes[0] = row3 + row0;	//left
+		planes[1] = row3 - row0;	//right
+		planes[2] = row3 + row1;	//bottom
+		planes[3] = row3 - row1;	//top
+		planes[4] = row3 + row2;	//near
+		planes[5] = row3 - row2;	//far
+
+		for (int i = 0; i < 6; i++)
+		{
+			planes[i] /= glm::length(glm::vec3(planes[i]));
+		}
+	}
+
+private:
+	static const int READBACK_FRAMES = 4;
+
+	Shader cullShader;
+	Shader hiZShader;
+
+	GLuint objectBuffer = 0;
+	GLuint boundsBuffer = 0;
+	GLuint commandBuffer = 0;
+	GLuint matrixBuffer = 0;
+	GLuint drawCountBuffer = 0;
+	GLuint capacity = 0;
+	GLuint objectCount = 0;
+	GLuint translucentCount = 0;	// their commands are the last slots of the command buffer
+	bool useDrawCount = false;
+
+	PackedInstances packed;
+	bool scenePacked = false;		// the scene buffers were created for packed records
+
+	GLuint readbackBuffer = 0;
+	const GLuint* readbackData = NULL;
+	GLsync readbackFences[READBACK_FRAMES];
+	int readbackSlot = 0;
+	GLuint visibleCount = 0;
+
+	GLuint hiZTexture = 0;
+	int hiZLevels = 1;
+	int targetWidth = 0;
+	int targetHeight = 0;
+	bool hiZValid = false;
+
+	glm::mat4 currentViewProjection = glm::mat4(1.0f);
+	glm::mat4 previousViewProjection = glm::mat4(1.0f);
+
+	// slotCount commands from firstSlot, the draw count is read at countOffset of the count buffer
+	void submit(GLuint vertexArray, GLuint firstSlot, GLuint slotCount, GLintptr countOffset)
+	{
+		if (slotCount == 0)
+		{
+			return;
+		}
+
+		bindObjects();
+		glState.bindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+		glState.bindVertexArray(vertexArray);
+
+		void* firstCommand = (void*)(firstSlot * sizeof(DrawElementsIndirectCommand));
+		if (useDrawCount)
+		{
+			glState.bindBuffer(GL_PARAMETER_BUFFER_ARB, drawCountBuffer);
+			glMultiDrawElementsIndirectCountARB(GL_TRIANGLES, GL_UNSIGNED_INT, firstCommand, countOffset, slotCount, 0);
+		}
+		else
+		{
+			glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, firstCommand, slotCount, 0);
+		}
+		glState.countDraw();
+	}
+
+	// the object records and matrices, or the packed records with their cells and palette
+	void bindObjects()
+	{
+		if (scenePacked)
+		{
+			packed.bind();
+		}
+		else
+		{
+			glState.bindBufferBase(GL_SHADER_STORAGE_BUFFER, OBJECT_BUFFER_BINDING, objectBuffer);
+			glState.bindBufferBase(GL_SHADER_STORAGE_BUFFER, OBJECT_MATRIX_BINDING, matrixBuffer);
+		}
+	}
+
+	void releaseSceneBuffers()
+	{
+		glState.deleteBuffers(1, &objectBuffer);
+		glState.deleteBuffers(1, &boundsBuffer);
+		glState.deleteBuffers(1, &commandBuffer);
+		glState.deleteBuffers(1, &matrixBuffer);
+		objectBuffer = 0;
+		boundsBuffer = 0;
+		commandBuffer = 0;
+		matrixBuffer = 0;
+		capacity = 0;
+	}
+
+	// takes the count copied READBACK_FRAMES culls ago if the GPU is done with it, a copy that is still
+	// pending is dropped rather than waited for, then copies this frame's count into the freed slot
+	void readBackVisibleCount()
+	{
+		if (readbackData == NULL)
+		{
+			return;
+		}
+
+		GLsync fence = readbackFences[readbackSlot];
+		if (fence != 0)
+		{
+			GLenum status = glClientWaitSync(fence, 0, 0);
+			if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+			{
+				visibleCount = readbackData[2 * readbackSlot] + readbackData[2 * readbackSlot + 1];
+			}
+			glDeleteSync(fence);
+		}
+
+		glCopyNamedBufferSubData(drawCountBuffer, readbackBuffer, 0, readbackSlot * 2 * sizeof(GLuint), 2 * sizeof(GLuint));
+		readbackFences[readbackSlot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		readbackSlot = (readbackSlot + 1) % READBACK_FRAMES;
+	}
+
+	void releaseTargets()
+	{
+		glState.deleteTextures(1, &hiZTexture);
+		hiZTexture = 0;
+	}
+};
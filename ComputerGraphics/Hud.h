@@ -0,0 +1,458 @@
+#pragma once
+
+/*
+ Performance overlay drawn over the presented frame.
+ Text and graph bars are quads in pixels, written into the stream buffer every frame and expanded
+ from gl_VertexID by hud.vert, so the whole overlay is one draw with no vertex buffer. Glyphs come
+ from a small atlas built at init from a 5x7 font of the printable ASCII range up to '_', lowercase
+ is drawn in uppercase; the bars sample a solid cell of the same atlas.
+ The graph shows the CPU and GPU times of the last HISTORY frames, the counters are those of the last
+ completed frame and the visible object count of the GPU-driven path lags a few frames behind. The
+ triangles are counted by a primitives query around the scene pass that is only issued while the
+ overlay is shown and read without waiting, like the frame graph's timestamps.
+*/
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <cstdio>
+#include <vector>
+
+#include "Shader.h"
+#include "GLState.h"
+#include "Scene.h"
+#include "StartupLoader.h"
+#include "StreamBuffer.h"
+#include "FrameGraph.h"
+#include "MemoryTracker.h"
+
+// Layout shared with hud.vert (std430), rect and uv are x, y, width, height in pixels and atlas texels
+struct HudQuad {
+	glm::vec4 rect;
+	glm::vec4 uv;
+	glm::vec4 color;
+};
+
+static_assert(sizeof(HudQuad) == 48, "HudQuad must match the std430 layout");
+
+// What the renderer knew about its last frame when the overlay was declared
+struct HudCounters {
+	int renderWidth = 0;
+	int renderHeight = 0;
+	int windowWidth = 0;
+	int windowHeight = 0;
+	GLStateStats state;
+	unsigned int objects = 0;	// in the scene the frame was drawn from
+	unsigned int submitted = 0;	// drawn after culling
+	long long cpuBytes = 0;
+	long long gpuBytes = 0;
+};
+
+// Rows of the glyphs from ' ' to '_', the highest of the 5 bits is the leftmost pixel
+static const unsigned char hudFont[64][7] = {
+		{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },	// space
+		{ 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04 },	// !
+		{ 0x0A, 0x0A, 0x00, 0x00, 0x00, 0x00, 0x00 },	// "
+		{ 0x0A, 0x0A, 0x1F, 0x0A, 0x1F, 0x0A, 0x0A },	// #
+		{ 0x04, 0x0F, 0x14, 0x0E, 0x05, 0x1E, 0x04 },	// $
+		{ 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 },	// %
+		{ 0x0C, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0D },	// &
+		{ 0x04, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00 },	// '
+		{ 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 },	// (
+		{ 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 },	// )
+		{ 0x00, 0x04, 0x15, 0x0E, 0x15, 0x04, 0x00 },	// *
+		{ 0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00 },	// +
+		{ 0x00, 0x00, 0x00, 0x00, 0x0C, 0x04, 0x08 },	// ,
+		{ 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00 },	// -
+		{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C },	// .
+		{ 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 },	// /
+		{ 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E },	// 0
+		{ 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E },	// 1
+		{ 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F },	// 2
+		{ 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E },	// 3
+		{ 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 },	// 4
+		{ 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E },	// 5
+		{ 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E },	// 6
+		{ 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 },	// 7
+		{ 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E },	// 8
+		{ 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C },	// 9
+		{ 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 },	// :
+		{ 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x04, 0x08 },	// ;
+		{ 0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02 },	// <
+		{ 0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00 },	// =
+		{ 0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08 },	// >
+		{ 0x0E, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 },	// ?
+		{ 0x0E, 0x11, 0x01, 0x0D, 0x15, 0x15, 0x0E },	// @
+		{ 0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 },	// A
+		{ 0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E },	// B
+		{ 0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E },	// C
+		{ 0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C },	// D
+		{ 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F },	// E
+		{ 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10 },	// F
+		{ 0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F },	// G
+		{ 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 },	// H
+		{ 0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E },	// I
+		{ 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C },	// J
+		{ 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 },	// K
+		{ 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F },	// L
+		{ 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11 },	// M
+		{ 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 },	// N
+		{ 0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E },	// O
+		{ 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10 },	// P
+		{ 0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D },	// Q
+		{ 0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11 },	// R
+		{ 0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E },	// S
+		{ 0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 },	// T
+		{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E },	// U
+		{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04 },	// V
+		{ 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A },	// W
+		{ 0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11 },	// X
+		{ 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04, 0x04 },	// Y
+		{ 0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F },	// Z
+		{ 0x0E, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0E },	// [
+		{ 0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00 },	// backslash
+		{ 0x0E, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0E },	// ]
+		{ 0x04, 0x0A, 0x11, 0x00, 0x00, 0x00, 0x00 },	// ^
+		{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F },	// _
+};
+
+class Hud
+{
+public:
+	static const int HISTORY = 240;
+	static const int MAX_QUADS = 1024;
+
+	bool visible = false;
+
+	Hud() {}
+
+	void requestShaders(StartupLoader& loader)
+	{
+		loader.addProgram(hudShader, "./Shaders/hud.vert", "./Shaders/hud.frag", "", true);
+	}
+
+	// builds the atlas, quads are allocated from stream with the storage buffer alignment
+	// ------------------------------------------------------------------------
+	void init(StreamBuffer& stream, GLint storageAlignment)
+	{
+		streamBuffer = &stream;
+		storageBufferAlignment = storageAlignment;
+
+		MemoryScope scope(MEMORY_TAG_HUD);
+
+		std::vector<unsigned char> pixels(ATLAS_WIDTH * ATLAS_HEIGHT, 0);
+		for (int glyph = 0; glyph < GLYPH_COUNT; glyph++)
+		{
+			int cellX = glyph % ATLAS_COLUMNS * CELL_SIZE;
+			int cellY = glyph / ATLAS_COLUMNS * CELL_SIZE;
+			for (int row = 0; row < GLYPH_HEIGHT; row++)
+			{
+				for (int column = 0; column < GLYPH_WIDTH; column++)
+				{
+					if (hudFont[glyph][row] & (1 << (GLYPH_WIDTH - 1 - column)))
+					{
+						pixels[(cellY + row) * ATLAS_WIDTH + cellX + column] = 255;
+					}
+				}
+			}
+		}
+		for (int row = 0; row < CELL_SIZE; row++)
+		{
+			for (int column = 0; column < CELL_SIZE; column++)
+			{
+				pixels[(SOLID_CELL / ATLAS_COLUMNS * CELL_SIZE + row) * ATLAS_WIDTH + SOLID_CELL % ATLAS_COLUMNS * CELL_SIZE + column] = 255;
+			}
+		}
+
+		atlasTexture = gpuMemory.createTexture2D(1, GL_R8, ATLAS_WIDTH, ATLAS_HEIGHT);
+		glTextureSubImage2D(atlasTexture, 0, 0, 0, ATLAS_WIDTH, ATLAS_HEIGHT, GL_RED, GL_UNSIGNED_BYTE, pixels.data());
+		glTextureParameteri(atlasTexture, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTextureParameteri(atlasTexture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+		//the quads are expanded from gl_VertexID, core profile still needs a vertex array
+		glCreateVertexArrays(1, &emptyVertexArray);
+		glGenQueries(QUERY_FRAMES, primitiveQueries);
+	}
+
+	// ------------------------------------------------------------------------
+	void toggle()
+	{
+		visible = !visible;
+	}
+
+	// times of one frame, frameMilliseconds is the time since the one before
+	// ------------------------------------------------------------------------
+	void addSample(float frameMilliseconds, float cpuMilliseconds, float gpuMilliseconds)
+	{
+		frameHistory[historyHead] = frameMilliseconds;
+		cpuHistory[historyHead] = cpuMilliseconds;
+		gpuHistory[historyHead] = gpuMilliseconds;
+		historyHead = (historyHead + 1) % HISTORY;
+		historyCount = historyCount < HISTORY ? historyCount + 1 : HISTORY;
+	}
+
+	// counts the primitives of the draws up to endPrimitiveQuery(), nothing is issued while hidden
+	// ------------------------------------------------------------------------
+	void beginPrimitiveQuery()
+	{
+		if (!visible)
+		{
+			return;
+		}
+
+		//a result that is not there after QUERY_FRAMES frames is dropped, the query is reused
+		if (queryPending[querySlot])
+		{
+			GLuint available = 0;
+			glGetQueryObjectuiv(primitiveQueries[querySlot], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (available)
+			{
+				glGetQueryObjectui64v(primitiveQueries[querySlot], GL_QUERY_RESULT, &triangles);
+			}
+			queryPending[querySlot] = false;
+		}
+
+		glBeginQuery(GL_PRIMITIVES_GENERATED, primitiveQueries[querySlot]);
+		queryActive = true;
+	}
+
+	// ------------------------------------------------------------------------
+	void endPrimitiveQuery()
+	{
+		if (!queryActive)
+		{
+			return;
+		}
+
+		glEndQuery(GL_PRIMITIVES_GENERATED);
+		queryPending[querySlot] = true;
+		querySlot = (querySlot + 1) % QUERY_FRAMES;
+		queryActive = false;
+	}
+
+	// draws the overlay over the backbuffer after the passes declared before it
+	// ------------------------------------------------------------------------
+	void addPass(FrameGraph& graph, FrameGraphResource backbuffer, const HudCounters& counters)
+	{
+		int hudPass = graph.addPass("Hud", [this, counters](const FrameGraph&) {
+			draw(counters);
+		});
+		graph.writeColor(hudPass, backbuffer);
+	}
+
+	void release()
+	{
+		glState.deleteTextures(1, &atlasTexture);
+		glState.deleteVertexArrays(1, &emptyVertexArray);
+		glDeleteQueries(QUERY_FRAMES, primitiveQueries);
+		glState.deleteProgram(hudShader.ID);
+		atlasTexture = 0;
+		emptyVertexArray = 0;
+	}
+
+private:
+	static const int GLYPH_WIDTH = 5;
+	static const int GLYPH_HEIGHT = 7;
+	static const int GLYPH_COUNT = 64;
+	static const int CELL_SIZE = 8;
+	static const int ATLAS_COLUMNS = 16;
+	static const int SOLID_CELL = GLYPH_COUNT;	// the cell after the glyphs, fully set
+	static const int ATLAS_WIDTH = ATLAS_COLUMNS * CELL_SIZE;
+	static const int ATLAS_HEIGHT = (GLYPH_COUNT / ATLAS_COLUMNS + 1) * CELL_SIZE;
+	static const int QUERY_FRAMES = 4;
+
+	// layout in pixels, glyphs are drawn at twice their size
+	static const int SCALE = 2;
+	static const int ADVANCE = (GLYPH_WIDTH + 1) * SCALE;
+	static const int LINE_HEIGHT = (GLYPH_HEIGHT + 3) * SCALE;
+	static const int MARGIN = 8;
+	static const int PADDING = 8;
+	static const int GRAPH_HEIGHT = 96;
+	static const int COLUMN_WIDTH = 2;
+	static const int GRAPH_WIDTH = HISTORY * COLUMN_WIDTH;
+
+	Shader hudShader;
+	GLuint atlasTexture = 0;
+	GLuint emptyVertexArray = 0;
+
+	StreamBuffer* streamBuffer = NULL;
+	GLint storageBufferAlignment = 256;
+
+	float frameHistory[HISTORY] = {};
+	float cpuHistory[HISTORY] = {};
+	float gpuHistory[HISTORY] = {};
+	int historyHead = 0;
+	int historyCount = 0;
+
+	GLuint primitiveQueries[QUERY_FRAMES] = {};
+	bool queryPending[QUERY_FRAMES] = {};
+	bool queryActive = false;
+	int querySlot = 0;
+	GLuint64 triangles = 0;
+
+	// the quads of the overlay in progress, in mapped memory
+	HudQuad* quads = NULL;
+	unsigned int quadCount = 0;
+
+	// the history and counters as quads in the stream buffer, then one draw of all of them
+	void draw(const HudCounters& counters)
+	{
+		StreamAllocation block = streamBuffer->allocate(MAX_QUADS * sizeof(HudQuad), storageBufferAlignment);
+		if (block.data == NULL)
+		{
+			return;
+		}
+		quads = (HudQuad*)block.data;
+		quadCount = 0;
+
+		build(counters);
+
+		streamBuffer->written(block.data, quadCount * sizeof(HudQuad));
+		streamBuffer->trim(block, quadCount * sizeof(HudQuad));
+		quads = NULL;
+		if (quadCount == 0)
+		{
+			return;
+		}
+
+		glState.bindBufferRange(GL_SHADER_STORAGE_BUFFER, HUD_QUAD_BINDING, streamBuffer->ID, block.offset, quadCount * sizeof(HudQuad));
+
+		hudShader.use();
+		hudShader.setVec2("screenSize", (float)counters.windowWidth, (float)counters.windowHeight);
+		glState.bindTextureUnit(0, atlasTexture);
+		glState.bindVertexArray(emptyVertexArray);
+
+		glState.setEnabled(GL_DEPTH_TEST, false);
+		glState.setEnabled(GL_BLEND, true);
+		glState.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		glDrawArrays(GL_TRIANGLES, 0, quadCount * 6);
+		glState.countDraw();
+		glState.setEnabled(GL_DEPTH_TEST, true);
+	}
+
+	void build(const HudCounters& counters)
+	{
+		const glm::vec4 white = glm::vec4(1.0f);
+		const glm::vec4 cpuColor = glm::vec4(1.0f, 0.6f, 0.2f, 1.0f);
+		const glm::vec4 gpuColor = glm::vec4(0.3f, 0.9f, 0.4f, 1.0f);
+		const glm::vec4 gridColor = glm::vec4(1.0f, 1.0f, 1.0f, 0.25f);
+
+		float left = (float)(MARGIN + PADDING);
+		float y = (float)(MARGIN + PADDING);
+		int lines = 7;
+		addRect((float)MARGIN, (float)MARGIN, (float)(GRAPH_WIDTH + 2 * PADDING),
+			(float)(lines * LINE_HEIGHT + GRAPH_HEIGHT + PADDING + 2 * PADDING), glm::vec4(0.0f, 0.0f, 0.0f, 0.6f));
+
+		int newest = (historyHead + HISTORY - 1) % HISTORY;
+		float frame = historyCount > 0 ? frameHistory[newest] : 0.0f;
+		float cpu = historyCount > 0 ? cpuHistory[newest] : 0.0f;
+		float gpu = historyCount > 0 ? gpuHistory[newest] : 0.0f;
+
+		char line[128];
+		snprintf(line, sizeof(line), "FRAME %.1f MS  %.0f FPS", frame, frame > 0.0f ? 1000.0f / frame : 0.0f);
+		addText(left, y, line, white);
+		y += LINE_HEIGHT;
+
+		snprintf(line, sizeof(line), "CPU %.1f MS", cpu);
+		float x = addText(left, y, line, cpuColor);
+		snprintf(line, sizeof(line), "  GPU %.1f MS", gpu);
+		addText(x, y, line, gpuColor);
+		y += LINE_HEIGHT;
+
+		//the scale grows in steps of a 60 Hz frame so the bars do not jump with every sample
+		float highest = 0.0f;
+		for (int i = 0; i < historyCount; i++)
+		{
+			highest = glm::max(highest, glm::max(cpuHistory[i], gpuHistory[i]));
+		}
+		const float step = 1000.0f / 60.0f;
+		float scale = glm::max(2.0f, glm::ceil(highest / step)) * step;
+
+		float graphTop = y;
+		float graphBottom = y + GRAPH_HEIGHT;
+		addRect(left, graphTop, (float)GRAPH_WIDTH, (float)GRAPH_HEIGHT, glm::vec4(0.0f, 0.0f, 0.0f, 0.5f));
+		for (float mark = step; mark < scale && scale / step <= 8.0f; mark += step)
+		{
+			addRect(left, graphBottom - mark / scale * GRAPH_HEIGHT, (float)GRAPH_WIDTH, 1.0f, gridColor);
+		}
+
+		//oldest sample on the left, the graph fills up from the right; GPU times are bars, CPU times a line over them
+		for (int i = 0; i < historyCount; i++)
+		{
+			int sample = (historyHead + HISTORY - historyCount + i) % HISTORY;
+			float columnX = left + (float)(HISTORY - historyCount + i) * COLUMN_WIDTH;
+			float cpuHeight = glm::min(cpuHistory[sample] / scale, 1.0f) * GRAPH_HEIGHT;
+			float gpuHeight = glm::min(gpuHistory[sample] / scale, 1.0f) * GRAPH_HEIGHT;
+			addRect(columnX, graphBottom - gpuHeight, (float)COLUMN_WIDTH, gpuHeight, gpuColor * glm::vec4(1.0f, 1.0f, 1.0f, 0.7f));
+			addRect(columnX, graphBottom - glm::max(cpuHeight, 2.0f), (float)COLUMN_WIDTH, 2.0f, cpuColor);
+		}
+
+		snprintf(line, sizeof(line), "%.0f MS", scale);
+		addText(left + 4.0f, graphTop + 4.0f, line, white);
+		y = graphBottom + PADDING;
+
+		snprintf(line, sizeof(line), "RENDER %dX%d  WINDOW %dX%d", counters.renderWidth, counters.renderHeight, counters.windowWidth, counters.windowHeight);
+		addText(left, y, line, white);
+		y += LINE_HEIGHT;
+
+		snprintf(line, sizeof(line), "DRAWS %u  TRIANGLES %llu", counters.state.draws, (unsigned long long)triangles);
+		addText(left, y, line, white);
+		y += LINE_HEIGHT;
+
+		snprintf(line, sizeof(line), "STATE %u SET  %u ELIDED  UNIFORMS %u", counters.state.issued - counters.state.uniforms,
+			counters.state.elided, counters.state.uniforms);
+		addText(left, y, line, white);
+		y += LINE_HEIGHT;
+
+		snprintf(line, sizeof(line), "OBJECTS %u  SUBMITTED %u  CULLED %u", counters.objects, counters.submitted,
+			counters.objects > counters.submitted ? counters.objects - counters.submitted : 0);
+		addText(left, y, line, white);
+		y += LINE_HEIGHT;
+
+		const double megabyte = 1024.0 * 1024.0;
+		snprintf(line, sizeof(line), "MEMORY CPU %.1f MB  GPU %.1f MB", counters.cpuBytes / megabyte, counters.gpuBytes / megabyte);
+		addText(left, y, line, white);
+	}
+
+	void addQuad(float x, float y, float width, float height, float u, float v, float uvWidth, float uvHeight, const glm::vec4& color)
+	{
+		if (quadCount >= MAX_QUADS)
+		{
+			return;
+		}
+
+		HudQuad& quad = quads[quadCount++];
+		quad.rect = glm::vec4(x, y, width, height);
+		quad.uv = glm::vec4(u, v, uvWidth, uvHeight);
+		quad.color = color;
+	}
+
+	void addRect(float x, float y, float width, float height, const glm::vec4& color)
+	{
+		if (width <= 0.0f || height <= 0.0f)
+		{
+			return;
+		}
+
+		float cellX = (float)(SOLID_CELL % ATLAS_COLUMNS * CELL_SIZE);
+		float cellY = (float)(SOLID_CELL / ATLAS_COLUMNS * CELL_SIZE);
+		addQuad(x, y, width, height, cellX + 1.0f, cellY + 1.0f, CELL_SIZE - 2.0f, CELL_SIZE - 2.0f, color);
+	}
+
+	// returns the x after the text
+	float addText(float x, float y, const char* text, const glm::vec4& color)
+	{
+		for (const char* c = text; *c != '\0'; c++)
+		{
+			int code = *c >= 'a' && *c <= 'z' ? *c - 'a' + 'A' : *c;
+			if (code > ' ' && code < ' ' + GLYPH_COUNT)
+			{
+				int glyph = code - ' ';
+				addQuad(x, y, (float)(GLYPH_WIDTH * SCALE), (float)(GLYPH_HEIGHT * SCALE), (float)(glyph % ATLAS_COLUMNS * CELL_SIZE),
+					(float)(glyph / ATLAS_COLUMNS * CELL_SIZE), (float)GLYPH_WIDTH, (float)GLYPH_HEIGHT, color);
+			}
+			x += ADVANCE;
+		}
+		return x;
+	}
+};
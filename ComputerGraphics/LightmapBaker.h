@@ -0,0 +1,373 @@
+#pragma once
+
+/*
+ CPU lightmap baker for the static room.
+ Every side of every cube gets its own rectangle in a lightmap atlas, sized by its world-space area.
+ For each texel the baker traces direct light with a shadow ray and one bounce of indirect light with
+ cosine-weighted hemisphere rays against a BVH of the scene, spread over all cores with a ThreadPool.
+ Each lamp is baked into its own irradiance map so the runtime can add up the lamps that are on.
+ Irradiance uses the same units as the Phong diffuse term of fragment.frag (no attenuation), the
+ surface albedo is applied at runtime.
+*/
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <atomic>
+
+#include "Scene.h"
+#include "Bvh.h"
+#include "ThreadPool.h"
+
+struct LightmapLight {
+	glm::vec3 position;
+	glm::vec3 color;
+	bool spot = false;		// limit the light to a cone around direction
+	glm::vec3 direction;
+	float cutOff = 1.0f;	// cosine of the inner cone angle
+	float outerCutOff = 1.0f;
+};
+
+struct LightmapBakeStats {
+	unsigned long long rays = 0;
+	unsigned int texels = 0;
+	unsigned int threads = 0;
+	double seconds = 0.0;
+
+	double raysPerSecond() const
+	{
+		return seconds > 0.0 ? rays / seconds : 0.0;
+	}
+};
+
+class LightmapBaker
+{
+public:
+	// Atlas resolution, texels per world unit along each side
+	float texelsPerUnit = 4.0f;
+	// Hemisphere rays per texel for the indirect bounce, rounded down to a square for stratification
+	int indirectSamples = 64;
+
+	LightmapBaker() {}
+
+	// lays out the atlas and builds the ray tracing scene, objects that enclose a light are left out
+	// of the BVH so lamp shades and fixtures do not swallow their own light
+	// ------------------------------------------------------------------------
+	void init(const std::vector<ObjectData>& objects, const std::vector<LightmapLight>& lights)
+	{
+		this->objects = objects;
+
+		std::vector<bool> occluders(objects.size(), true);
+		for (size_t i = 0; i < objects.size(); i++)
+		{
+			ObjectBounds bounds = computeCubeBounds(objects[i].transform);
+			for (size_t j = 0; j < lights.size(); j++)
+			{
+				glm::vec3 distance = glm::abs(lights[j].position - glm::vec3(bounds.center));
+				if (glm::all(glm::lessThanEqual(distance, glm::vec3(bounds.extents) + 0.05f)))
+				{
+					occluders[i] = false;
+				}
+			}
+		}
+		bvh.build(objects, &occluders);
+
+		layoutAtlas();
+	}
+
+	// bakes the irradiance of one light into irradiance (width * height texels)
+	// ------------------------------------------------------------------------
+	LightmapBakeStats bake(const LightmapLight& light, ThreadPool& pool, std::vector<glm::vec3>& irradiance) const
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		irradiance.assign((size_t)width * height, glm::vec3(0.0f));
+		std::atomic<unsigned long long> rays(0);
+
+		pool.parallelFor((int)texels.size(), 64, [&](int begin, int end)
+		{
+			unsigned long long localRays = 0;
+			for (int i = begin; i < end; i++)
+			{
+				const Texel& texel = texels[i];
+				irradiance[(size_t)texel.y * width + texel.x] = bakeTexel(texel, light, (unsigned int)i, localRays);
+			}
+			rays += localRays;
+		});
+
+		fillGutters(irradiance);
+
+		LightmapBakeStats stats;
+		stats.rays = rays;
+		stats.texels = (unsigned int)texels.size();
+		stats.threads = pool.getThreadCount();
+		stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		return stats;
+	}
+
+	const std::vector<LightmapRects>& getRects() const
+	{
+		return rects;
+	}
+
+	int getWidth() const
+	{
+		return width;
+	}
+
+	int getHeight() const
+	{
+		return height;
+	}
+
+private:
+	static const int ATLAS_WIDTH = 1024;
+
+	// sample point of one texel inside a face
+	struct Texel {
+		int x;
+		int y;
+		glm::vec3 position;
+		glm::vec3 normal;
+	};
+
+	// texel rectangle of one face, interior texels are surrounded by a one texel gutter
+	struct FaceRect {
+		int object;
+		int face;
+		int x;
+		int y;
+		int width;		// interior size
+		int height;
+	};
+
+	std::vector<ObjectData> objects;
+	Bvh bvh;
+	std::vector<FaceRect> faces;
+	std::vector<Texel> texels;
+	std::vector<LightmapRects> rects;
+	int width = 0;
+	int height = 0;
+
+	// axes of a cube side in the order of cubeVertices: normal axis, u axis, v axis and normal sign
+	static void getFaceAxes(int face, int& normalAxis, int& uAxis, int& vAxis, float& sign)
+	{
+		static const int axes[6][3] = { { 2, 0, 1 }, { 2, 0, 1 }, { 0, 2, 1 }, { 0, 2, 1 }, { 1, 0, 2 }, { 1, 0, 2 } };
+		normalAxis = axes[face][0];
+		uAxis = axes[face][1];
+		vAxis = axes[face][2];
+		sign = (face % 2 == 0) ? -1.0f : 1.0f;
+	}
+
+	// shelf packing of all face rectangles, tallest first
+	void layoutAtlas()
+	{
+		faces.clear();
+		texels.clear();
+
+		for (size_t i = 0; i < objects.size(); i++)
+		{
+			for (int face = 0; face < 6; face++)
+			{
+				int normalAxis, uAxis, vAxis;
+				float sign;
+				getFaceAxes(face, normalAxis, uAxis, vAxis, sign);
+
+				float uLength = glm::abs(objects[i].transform.scale[uAxis]);
+				float vLength = glm::abs(objects[i].transform.scale[vAxis]);
+
+				FaceRect rect;
+				rect.object = (int)i;
+				rect.face = face;
+				rect.width = glm::clamp((int)std::ceil(uLength * texelsPerUnit), 2, ATLAS_WIDTH / 4);
+				rect.height = glm::clamp((int)std::ceil(vLength * texelsPerUnit), 2, ATLAS_WIDTH / 4);
+				faces.push_back(rect);
+			}
+		}
+
+		std::vector<int> order(faces.size());
+		for (size_t i = 0; i < order.size(); i++)
+		{
+			order[i] = (int)i;
+		}
+		std::sort(order.begin(), order.end(), [this](int a, int b) { return faces[a].height > faces[b].height; });
+
+		int shelfX = 0;
+		int shelfY = 0;
+		int shelfHeight = 0;
+		for (size_t i = 0; i < order.size(); i++)
+		{
+			FaceRect& rect = faces[order[i]];
+			if (shelfX + rect.width + 2 > ATLAS_WIDTH)
+			{
+				shelfX = 0;
+				shelfY += shelfHeight;
+				shelfHeight = 0;
+			}
+			rect.x = shelfX;
+			rect.y = shelfY;
+			shelfX += rect.width + 2;
+			shelfHeight = std::max(shelfHeight, rect.height + 2);
+		}
+
+		width = ATLAS_WIDTH;
+		height = (shelfY + shelfHeight + 3) / 4 * 4;
+
+		rects.assign(objects.size(), LightmapRects());
+		for (size_t i = 0; i < faces.size(); i++)
+		{
+			const FaceRect& rect = faces[i];
+			glm::mat4 model = getModelMatrix(objects[rect.object].transform);
+
+			rects[rect.object].faces[rect.face] = glm::vec4((rect.x + 1.0f) / width, (rect.y + 1.0f) / height,
+				(float)rect.width / width, (float)rect.height / height);
+
+			int normalAxis, uAxis, vAxis;
+			float sign;
+			getFaceAxes(rect.face, normalAxis, uAxis, vAxis, sign);
+
+			glm::vec3 localNormal = glm::vec3(0.0f);
+			localNormal[normalAxis] = sign;
+			glm::vec3 normal = glm::normalize(getNormalMatrix(objects[rect.object].transform) * localNormal);
+
+			for (int y = 0; y < rect.height; y++)
+			{
+				for (int x = 0; x < rect.width; x++)
+				{
+					glm::vec3 local = 0.5f * localNormal;
+					local[uAxis] = (x + 0.5f) / rect.width - 0.5f;
+					local[vAxis] = (y + 0.5f) / rect.height - 0.5f;
+
+					Texel texel;
+					texel.x = rect.x + 1 + x;
+					texel.y = rect.y + 1 + y;
+					texel.position = glm::vec3(model * glm::vec4(local, 1.0f));
+					texel.normal = normal;
+					texels.push_back(texel);
+				}
+			}
+		}
+	}
+
+	// xorshift generator seeded per texel so the result does not depend on the thread count
+	struct Random {
+		unsigned int state;
+
+		Random(unsigned int seed) : state(seed * 747796405u + 2891336453u)
+		{
+			if (state == 0)
+			{
+				state = 1;
+			}
+		}
+
+		float next()
+		{
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			return (state >> 8) * (1.0f / 16777216.0f);
+		}
+	};
+
+	glm::vec3 getDirectIrradiance(const glm::vec3& position, const glm::vec3& normal, const LightmapLight& light, unsigned long long& rays) const
+	{
+		glm::vec3 toLight = light.position - position;
+		float distance = glm::length(toLight);
+		glm::vec3 direction = toLight / distance;
+
+		float cosine = glm::dot(normal, direction);
+		if (cosine <= 0.0f)
+		{
+			return glm::vec3(0.0f);
+		}
+
+		float intensity = 1.0f;
+		if (light.spot)
+		{
+			float theta = glm::dot(direction, glm::normalize(-light.direction));
+			intensity = glm::clamp((theta - light.outerCutOff) / (light.cutOff - light.outerCutOff), 0.0f, 1.0f);
+			if (intensity <= 0.0f)
+			{
+				return glm::vec3(0.0f);
+			}
+		}
+
+		rays++;
+		if (bvh.occluded(Ray(position + normal * 1e-3f, direction), distance - 2e-3f))
+		{
+			return glm::vec3(0.0f);
+		}
+
+		return light.color * cosine * intensity;
+	}
+
+	glm::vec3 bakeTexel(const Texel& texel, const LightmapLight& light, unsigned int seed, unsigned long long& rays) const
+	{
+		glm::vec3 direct = getDirectIrradiance(texel.position, texel.normal, light, rays);
+
+		//tangent frame around the normal (Duff et al.)
+		glm::vec3 n = texel.normal;
+		float s = n.z >= 0.0f ? 1.0f : -1.0f;
+		float a = -1.0f / (s + n.z);
+		float b = n.x * n.y * a;
+		glm::vec3 tangent = glm::vec3(1.0f + s * n.x * n.x * a, s * b, -s * n.x);
+		glm::vec3 bitangent = glm::vec3(b, s + n.y * n.y * a, -n.y);
+
+		Random random(seed);
+		int strata = std::max(1, (int)std::sqrt((float)indirectSamples));
+		glm::vec3 indirect = glm::vec3(0.0f);
+		glm::vec3 origin = texel.position + n * 1e-3f;
+
+		//cosine-weighted samples, the pdf cancels the cosine so the estimate is the mean of albedo * irradiance
+		for (int i = 0; i < strata; i++)
+		{
+			for (int j = 0; j < strata; j++)
+			{
+				float u1 = (i + random.next()) / strata;
+				float u2 = (j + random.next()) / strata;
+				float radius = std::sqrt(u1);
+				float phi = 6.2831853f * u2;
+				glm::vec3 direction = tangent * (radius * std::cos(phi)) + bitangent * (radius * std::sin(phi)) + n * std::sqrt(std::max(0.0f, 1.0f - u1));
+
+				RayHit hit;
+				rays++;
+				if (!bvh.intersect(Ray(origin, direction), 1e30f, hit) || glm::dot(hit.normal, direction) >= 0.0f)
+				{
+					continue;
+				}
+
+				const Material& material = objects[hit.object].material;
+				glm::vec3 albedo = material.kd * material.diffuse;
+				indirect += albedo * getDirectIrradiance(origin + direction * hit.t, hit.normal, light, rays);
+			}
+		}
+		indirect /= (float)(strata * strata);
+
+		return direct + indirect;
+	}
+
+	// copies the outermost interior texels into the gutter so bilinear filtering never reads a neighbour
+	void fillGutters(std::vector<glm::vec3>& irradiance) const
+	{
+		for (size_t i = 0; i < faces.size(); i++)
+		{
+			const FaceRect& rect = faces[i];
+			for (int y = 0; y < rect.height + 2; y++)
+			{
+				for (int x = 0; x < rect.width + 2; x++)
+				{
+					if (x > 0 && y > 0 && x <= rect.width && y <= rect.height)
+					{
+						continue;
+					}
+					int sourceX = glm::clamp(x, 1, rect.width);
+					int sourceY = glm::clamp(y, 1, rect.height);
+					irradiance[(size_t)(rect.y + y) * width + rect.x + x] = irradiance[(size_t)(rect.y + sourceY) * width + rect.x + sourceX];
+				}
+			}
+		}
+	}
+};
@@ -0,0 +1,300 @@
+#pragma once
+
+/*
+ Memory accounting per subsystem.
+ Every allocation is charged to the tag of the MemoryScope that is open on the allocating thread,
+ subsystems open one in the functions that allocate. CPU heap memory is counted by the global
+ operator new/delete in ComputerGraphics.cpp, which keep the size and tag in a small header in front
+ of every block. GL buffers, textures and programs are created through gpuMemory, which estimates
+ their size from the storage that was requested, and forgotten again by the glState delete calls.
+ Live and peak bytes are kept per tag, GL objects still alive after close() are reported as leaks.
+*/
+
+#include <GL/glew.h>
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+
+// Subsystems memory is charged to, keep getMemoryTagName() in sync
+enum MemoryTag {
+	MEMORY_TAG_GENERAL,
+	MEMORY_TAG_GEOMETRY,		// cube and imported meshes, the per-instance object index buffer
+	MEMORY_TAG_SCENE,			// recorded and replicated object records
+	MEMORY_TAG_GPU_DRIVEN,		// GPU copy of the scene, indirect commands and the depth pyramid
+	MEMORY_TAG_STREAMING,		// per-frame stream buffer
+	MEMORY_TAG_RENDER_TARGETS,	// frame graph texture pool
+	MEMORY_TAG_POST_PROCESS,
+	MEMORY_TAG_SHADERS,			// scene shader variants
+	MEMORY_TAG_LIGHTMAPS,
+	MEMORY_TAG_SOFTWARE,		// software renderer
+	MEMORY_TAG_CAPTURE,
+	MEMORY_TAG_FRAME_ARENA,		// block of the per-frame linear allocator
+	MEMORY_TAG_HUD,				// glyph atlas of the performance overlay
+	MEMORY_TAG_UPLOADS,			// staging buffer of the upload worker and the assets it streams
+	MEMORY_TAG_COUNT
+};
+
+inline const char* getMemoryTagName(MemoryTag tag)
+{
+	static const char* names[MEMORY_TAG_COUNT] = { "General", "Geometry", "Scene", "GpuDriven", "Streaming",
+		"RenderTargets", "PostProcess", "Shaders", "Lightmaps", "Software", "Capture", "FrameArena", "Hud", "Uploads" };
+	return tag < MEMORY_TAG_COUNT ? names[tag] : "Unknown";
+}
+
+// Charges allocations on this thread to a tag until it goes out of scope, scopes nest
+class MemoryScope
+{
+public:
+	explicit MemoryScope(MemoryTag tag)
+	{
+		previous = current();
+		current() = tag;
+	}
+
+	~MemoryScope()
+	{
+		current() = previous;
+	}
+
+	static MemoryTag& current()
+	{
+		static thread_local MemoryTag tag = MEMORY_TAG_GENERAL;
+		return tag;
+	}
+
+private:
+	MemoryTag previous;
+};
+
+// Live bytes, peak bytes, live allocation counts and the number of allocations ever made per tag,
+// the last slot holds the totals.
+// It has no constructor so a global instance is zero before any static constructor allocates.
+struct MemoryCounters {
+	std::atomic<long long> live[MEMORY_TAG_COUNT + 1];
+	std::atomic<long long> peak[MEMORY_TAG_COUNT + 1];
+	std::atomic<long long> allocations[MEMORY_TAG_COUNT + 1];
+	std::atomic<long long> allocationsMade[MEMORY_TAG_COUNT + 1];
+
+	void add(MemoryTag tag, long long bytes)
+	{
+		addTo(tag, bytes);
+		addTo(MEMORY_TAG_COUNT, bytes);
+	}
+
+	void remove(MemoryTag tag, long long bytes)
+	{
+		live[tag].fetch_sub(bytes, std::memory_order_relaxed);
+		allocations[tag].fetch_sub(1, std::memory_order_relaxed);
+		live[MEMORY_TAG_COUNT].fetch_sub(bytes, std::memory_order_relaxed);
+		allocations[MEMORY_TAG_COUNT].fetch_sub(1, std::memory_order_relaxed);
+	}
+
+private:
+	void addTo(int slot, long long bytes)
+	{
+		long long now = live[slot].fetch_add(bytes, std::memory_order_relaxed) + bytes;
+		allocations[slot].fetch_add(1, std::memory_order_relaxed);
+		allocationsMade[slot].fetch_add(1, std::memory_order_relaxed);
+
+		long long highest = peak[slot].load(std::memory_order_relaxed);
+		while (now > highest && !peak[slot].compare_exchange_weak(highest, now, std::memory_order_relaxed))
+		{
+		}
+	}
+};
+
+// Kinds of GL objects the tracker knows about, names are only unique within a kind
+enum GpuObjectKind {
+	GPU_OBJECT_BUFFER,
+	GPU_OBJECT_TEXTURE,
+	GPU_OBJECT_PROGRAM
+};
+
+class GpuMemoryTracker
+{
+public:
+	MemoryCounters counters;
+
+	GpuMemoryTracker() {}
+
+	// a buffer with immutable storage
+	// ------------------------------------------------------------------------
+	GLuint createBuffer(GLsizeiptr size, const void* data, GLbitfield flags)
+	{
+		GLuint buffer;
+		glCreateBuffers(1, &buffer);
+		glNamedBufferStorage(buffer, size, data, flags);
+		track(GPU_OBJECT_BUFFER, buffer, size);
+		return buffer;
+	}
+
+	// (re)specifies the mutable storage of an existing buffer
+	// ------------------------------------------------------------------------
+	void bufferData(GLuint buffer, GLsizeiptr size, const void* data, GLenum usage)
+	{
+		glNamedBufferData(buffer, size, data, usage);
+		track(GPU_OBJECT_BUFFER, buffer, size);
+	}
+
+	// a 2D texture with immutable storage
+	// ------------------------------------------------------------------------
+	GLuint createTexture2D(GLsizei levels, GLenum format, GLsizei width, GLsizei height)
+	{
+		GLuint texture;
+		glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+		glTextureStorage2D(texture, levels, format, width, height);
+		track(GPU_OBJECT_TEXTURE, texture, getTextureBytes(format, width, height, levels));
+		return texture;
+	}
+
+	// a linked program, the size of its binary stands in for the driver's memory
+	// ------------------------------------------------------------------------
+	void trackProgram(GLuint program)
+	{
+		GLint binaryLength = 0;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &binaryLength);
+		track(GPU_OBJECT_PROGRAM, program, binaryLength);
+	}
+
+	// called by the glState delete functions, names that are not tracked are ignored
+	// ------------------------------------------------------------------------
+	void release(GpuObjectKind kind, GLuint id)
+	{
+		if (id == 0)
+		{
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		std::unordered_map<unsigned long long, Allocation>::iterator it = objects.find(getKey(kind, id));
+		if (it != objects.end())
+		{
+			counters.remove(it->second.tag, it->second.bytes);
+			objects.erase(it);
+		}
+	}
+
+	// reports every GL object that is still alive, call after all subsystems released theirs
+	// ------------------------------------------------------------------------
+	void printLeaks() const
+	{
+		static const char* kindNames[3] = { "buffer", "texture", "program" };
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (objects.empty())
+		{
+			std::cout << "GPU memory: no leaked objects" << std::endl;
+			return;
+		}
+
+		std::vector<std::pair<unsigned long long, Allocation> > leaks(objects.begin(), objects.end());
+		std::sort(leaks.begin(), leaks.end(), [](const std::pair<unsigned long long, Allocation>& a, const std::pair<unsigned long long, Allocation>& b) {
+			return a.first < b.first;
+		});
+
+		long long bytes = 0;
+		for (size_t i = 0; i < leaks.size(); i++)
+		{
+			const Allocation& allocation = leaks[i].second;
+			std::cout << "GPU memory leak: " << kindNames[leaks[i].first >> 32] << " " << (GLuint)leaks[i].first << " ("
+				<< getMemoryTagName(allocation.tag) << "), " << allocation.bytes << " bytes" << std::endl;
+			bytes += allocation.bytes;
+		}
+		std::cout << "GPU memory: " << leaks.size() << " leaked objects, " << bytes << " bytes" << std::endl;
+	}
+
+	// ------------------------------------------------------------------------
+	static long long getTexelSize(GLenum format)
+	{
+		switch (format)
+		{
+		case GL_R8:
+			return 1;
+		case GL_R16F:
+		case GL_RG8:
+			return 2;
+		case GL_RGB16F:
+			return 6;
+		case GL_RGBA16F:
+		case GL_RG32F:
+			return 8;
+		case GL_RGBA32F:
+			return 16;
+		default:
+			//RGBA8, R11F_G11F_B10F, R32F, RG16F and the 32 bit depth formats
+			return 4;
+		}
+	}
+
+	// storage of a texture with all its mip levels
+	static long long getTextureBytes(GLenum format, int width, int height, int levels)
+	{
+		long long size = 0;
+		for (int level = 0; level < levels; level++)
+		{
+			size += (long long)width * height * getTexelSize(format);
+			width = width / 2 > 1 ? width / 2 : 1;
+			height = height / 2 > 1 ? height / 2 : 1;
+		}
+		return size;
+	}
+
+private:
+	struct Allocation {
+		MemoryTag tag;
+		long long bytes;
+	};
+
+	mutable std::mutex mutex;
+	std::unordered_map<unsigned long long, Allocation> objects;
+
+	static unsigned long long getKey(GpuObjectKind kind, GLuint id)
+	{
+		return ((unsigned long long)kind << 32) | id;
+	}
+
+	// a name that is tracked again had its storage respecified, the old size is given back first
+	void track(GpuObjectKind kind, GLuint id, long long bytes)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		unsigned long long key = getKey(kind, id);
+		std::unordered_map<unsigned long long, Allocation>::iterator it = objects.find(key);
+		if (it != objects.end())
+		{
+			counters.remove(it->second.tag, it->second.bytes);
+			objects.erase(it);
+		}
+
+		Allocation allocation;
+		allocation.tag = MemoryScope::current();
+		allocation.bytes = bytes;
+		objects[key] = allocation;
+		counters.add(allocation.tag, bytes);
+	}
+};
+
+// Defined in ComputerGraphics.cpp together with the operator new/delete that update cpuMemory
+extern MemoryCounters cpuMemory;
+extern GpuMemoryTracker gpuMemory;
+
+// live and peak bytes of every tag that was used, on the CPU heap and in GL objects
+inline void printMemoryStats()
+{
+	const double kilobyte = 1024.0;
+	for (int i = 0; i <= MEMORY_TAG_COUNT; i++)
+	{
+		if (cpuMemory.peak[i] == 0 && gpuMemory.counters.peak[i] == 0)
+		{
+			continue;
+		}
+
+		std::cout << "Memory " << (i < MEMORY_TAG_COUNT ? getMemoryTagName((MemoryTag)i) : "total") << ": GPU "
+			<< gpuMemory.counters.live[i] / kilobyte << " KB live, " << gpuMemory.counters.peak[i] / kilobyte << " KB peak, "
+			<< gpuMemory.counters.allocations[i] << " objects; CPU " << cpuMemory.live[i] / kilobyte << " KB live, "
+			<< cpuMemory.peak[i] / kilobyte << " KB peak, " << cpuMemory.allocations[i] << " blocks" << std::endl;
+	}
+}
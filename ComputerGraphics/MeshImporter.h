@@ -0,0 +1,1603 @@
+#pragma once
+
+/*
+ Mesh import from Wavefront OBJ and binary glTF 2.0 (.glb) files.
+ An OBJ file is cut into chunks at line breaks that the thread pool parses at the same time. Every
+ chunk collects its own positions, normals and triangles, face indices that count back from the end of
+ a list are resolved against the chunk offsets once all chunks are done. A .glb file is decoded from
+ its JSON and binary chunk, the primitives of all nodes are read and moved into the space of the scene
+ in parallel. Both formats end up as one triangle list: identical vertices are merged into an indexed
+ mesh and the normals a file leaves out are generated. The triangles are then ordered for the
+ post-transform vertex cache with Forsyth's linear-speed algorithm, the runs the cache splits them
+ into are sorted so the ones facing away from the center come first (Sander et al., it cuts overdraw
+ without losing much of the cache order), and the vertices are renumbered in the order they are
+ fetched. The average cache miss ratio (ACMR) of a 16 entry FIFO cache is measured before and after.
+ Only triangle lists with float positions and normals are read, texture coordinates and materials are
+ skipped, the scene shades every mesh with a material of its own.
+*/
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+
+#include "ThreadPool.h"
+#include "MemoryTracker.h"
+
+// Indexed triangle list, 6 floats (position, normal) per vertex like the cube
+struct ImportedMesh {
+	std::vector<float> vertices;
+	std::vector<GLuint> indices;
+	glm::vec3 boundsMin = glm::vec3(0.0f);
+	glm::vec3 boundsMax = glm::vec3(0.0f);
+};
+
+struct MeshImportStats {
+	size_t fileBytes = 0;
+	unsigned int threads = 0;
+	double readMilliseconds = 0.0;
+	double parseMilliseconds = 0.0;		// OBJ text or glTF accessors to triangles
+	double indexMilliseconds = 0.0;		// vertex merging and generated normals
+	double optimizeMilliseconds = 0.0;	// vertex cache, overdraw and vertex fetch order
+	unsigned int corners = 0;			// triangle corners before identical vertices were merged
+	unsigned int vertexCount = 0;
+	unsigned int triangleCount = 0;
+	unsigned int clusterCount = 0;		// runs sorted for overdraw
+	float acmrBefore = 0.0f;
+	float acmrAfter = 0.0f;
+
+	// MB/s of the file from reading it to the merged mesh
+	double getThroughput() const
+	{
+		double milliseconds = readMilliseconds + parseMilliseconds + indexMilliseconds;
+		return milliseconds > 0.0 ? fileBytes / (milliseconds * 1000.0) : 0.0;
+	}
+};
+
+class MeshImporter
+{
+public:
+	int cacheSize = 32;				// of the cache Forsyth's scores model
+	int measuredCacheSize = 16;		// of the FIFO cache the ACMR is reported for
+	float overdrawThreshold = 1.05f;	// how much worse than its run's ACMR a split run may get
+
+	MeshImporter() {}
+
+	// reads an .obj or .glb file into mesh, false with an error printed if the file cannot be used
+	// ------------------------------------------------------------------------
+	bool import(const std::string& path, ThreadPool& pool, ImportedMesh& mesh, MeshImportStats& stats)
+	{
+		MemoryScope scope(MEMORY_TAG_GEOMETRY);
+
+		stats = MeshImportStats();
+		stats.threads = pool.getThreadCount();
+		mesh = ImportedMesh();
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		std::vector<char> file;
+		if (!readFile(path, file))
+		{
+			std::cout << "ERROR::MESH_IMPORT::FILE_NOT_READ " << path << std::endl;
+			return false;
+		}
+		stats.fileBytes = file.size();
+		stats.readMilliseconds = getMilliseconds(start);
+
+		std::string extension = path.substr(path.find_last_of('.') + 1);
+		std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+		std::vector<bool> generateNormal;
+		bool parsed = false;
+		if (extension == "obj")
+		{
+			parsed = importObj(file, pool, mesh, generateNormal, stats);
+		}
+		else if (extension == "glb")
+		{
+			parsed = importGlb(file, pool, mesh, generateNormal, stats);
+		}
+		else
+		{
+			std::cout << "ERROR::MESH_IMPORT::UNKNOWN_FORMAT " << path << std::endl;
+			return false;
+		}
+
+		if (!parsed)
+		{
+			std::cout << "ERROR::MESH_IMPORT::FILE_NOT_IMPORTED " << path << std::endl;
+			return false;
+		}
+		if (mesh.indices.empty())
+		{
+			std::cout << "ERROR::MESH_IMPORT::NO_TRIANGLES " << path << std::endl;
+			return false;
+		}
+
+		start = std::chrono::steady_clock::now();
+		generateNormals(mesh, generateNormal);
+		computeBounds(mesh);
+		stats.indexMilliseconds += getMilliseconds(start);
+
+		unsigned int vertexCount = (unsigned int)(mesh.vertices.size() / 6);
+		stats.triangleCount = (unsigned int)(mesh.indices.size() / 3);
+		stats.acmrBefore = computeAcmr(mesh.indices, vertexCount);
+
+		start = std::chrono::steady_clock::now();
+		optimizeVertexCache(mesh.indices, vertexCount);
+		stats.clusterCount = optimizeOverdraw(mesh);
+		optimizeVertexFetch(mesh);
+		stats.optimizeMilliseconds = getMilliseconds(start);
+
+		stats.vertexCount = (unsigned int)(mesh.vertices.size() / 6);
+		stats.acmrAfter = computeAcmr(mesh.indices, stats.vertexCount);
+
+		return true;
+	}
+
+	// moves and scales the mesh so its bounds are the unit cube around the origin, the scene places it
+	// like a cube and the returned size restores its proportions. Normals are scaled with the inverse
+	// so they stay perpendicular to the surface.
+	// ------------------------------------------------------------------------
+	static glm::vec3 fitToUnitCube(ImportedMesh& mesh)
+	{
+		glm::vec3 size = mesh.boundsMax - mesh.boundsMin;
+		glm::vec3 center = 0.5f * (mesh.boundsMin + mesh.boundsMax);
+
+		//a flat mesh keeps a sliver of thickness, the scale must not be 0
+		float largest = std::max(size.x, std::max(size.y, size.z));
+		largest = largest > 0.0f ? largest : 1.0f;
+		size = glm::max(size, glm::vec3(largest * 1e-4f));
+
+		for (size_t i = 0; i < mesh.vertices.size(); i += 6)
+		{
+			glm::vec3 position(mesh.vertices[i], mesh.vertices[i + 1], mesh.vertices[i + 2]);
+			glm::vec3 normal(mesh.vertices[i + 3], mesh.vertices[i + 4], mesh.vertices[i + 5]);
+
+			position = (position - center) / size;
+			normal = glm::normalize(normal * size);
+
+			mesh.vertices[i] = position.x;
+			mesh.vertices[i + 1] = position.y;
+			mesh.vertices[i + 2] = position.z;
+			mesh.vertices[i + 3] = normal.x;
+			mesh.vertices[i + 4] = normal.y;
+			mesh.vertices[i + 5] = normal.z;
+		}
+
+		mesh.boundsMin = glm::vec3(-0.5f);
+		mesh.boundsMax = glm::vec3(0.5f);
+		return size;
+	}
+
+	// misses per triangle of a FIFO cache, 3 is the worst, 0.5 the best a closed mesh can get
+	// ------------------------------------------------------------------------
+	float computeAcmr(const std::vector<GLuint>& indices, unsigned int vertexCount) const
+	{
+		if (indices.empty())
+		{
+			return 0.0f;
+		}
+
+		std::vector<unsigned int> timestamps(vertexCount, 0);
+		unsigned int time = measuredCacheSize + 1;
+		unsigned int misses = 0;
+		for (size_t i = 0; i < indices.size(); i++)
+		{
+			GLuint vertex = indices[i];
+			if (time - timestamps[vertex] > (unsigned int)measuredCacheSize)
+			{
+				timestamps[vertex] = time++;
+				misses++;
+			}
+		}
+
+		return (float)misses / (indices.size() / 3);
+	}
+
+private:
+	// a face corner of an OBJ file, the flags mark indices still relative to the chunk and missing normals
+	struct ObjCorner {
+		int position;
+		int normal;
+		unsigned char flags;
+	};
+
+	static const unsigned char OBJ_RELATIVE_POSITION = 1;
+	static const unsigned char OBJ_RELATIVE_NORMAL = 2;
+	static const unsigned char OBJ_NO_NORMAL = 4;
+
+	struct ObjChunk {
+		const char* begin;
+		const char* end;
+		std::vector<glm::vec3> positions;
+		std::vector<glm::vec3> normals;
+		std::vector<ObjCorner> corners;	// three per triangle
+		int positionBase = 0;			// positions of the chunks before this one
+		int normalBase = 0;
+	};
+
+	// JSON value of a glTF file, members keep their order
+	struct JsonValue {
+		enum Type { JSON_NULL, JSON_BOOL, JSON_NUMBER, JSON_STRING, JSON_ARRAY, JSON_OBJECT };
+
+		Type type = JSON_NULL;
+		double number = 0.0;
+		std::string string;
+		std::vector<JsonValue> items;
+		std::vector<std::pair<std::string, JsonValue>> members;
+
+		const JsonValue* find(const char* key) const
+		{
+			for (size_t i = 0; i < members.size(); i++)
+			{
+				if (members[i].first == key)
+				{
+					return &members[i].second;
+				}
+			}
+			return NULL;
+		}
+
+		const JsonValue* at(size_t index) const
+		{
+			return type == JSON_ARRAY && index < items.size() ? &items[index] : NULL;
+		}
+
+		double getNumber(const char* key, double fallback) const
+		{
+			const JsonValue* value = find(key);
+			return value != NULL && value->type == JSON_NUMBER ? value->number : fallback;
+		}
+	};
+
+	// a primitive of a node, with the node's transform into the space of the scene
+	struct GlbPrimitive {
+		const JsonValue* primitive;
+		glm::mat4 transform;
+		std::vector<float> vertices;
+		std::vector<GLuint> indices;
+		bool hasNormals = false;
+		bool valid = false;
+	};
+
+	static double getMilliseconds(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	static bool readFile(const std::string& path, std::vector<char>& data)
+	{
+		std::ifstream file(path.c_str(), std::ios::binary | std::ios::ate);
+		if (!file)
+		{
+			return false;
+		}
+
+		std::streamsize size = file.tellg();
+		file.seekg(0, std::ios::beg);
+		data.resize((size_t)size);
+		return size == 0 || (bool)file.read(data.data(), size);
+	}
+
+	/*
+	 OBJ
+	*/
+
+	bool importObj(const std::vector<char>& file, ThreadPool& pool, ImportedMesh& mesh, std::vector<bool>& generateNormal, MeshImportStats& stats)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		//enough chunks to balance the threads, but not so many that small files pay for them
+		const size_t minimumChunkBytes = 64 * 1024;
+		size_t chunkCount = std::max((size_t)1, std::min((size_t)pool.getThreadCount() * 4, file.size() / minimumChunkBytes));
+
+		std::vector<ObjChunk> chunks(chunkCount);
+		const char* data = file.data();
+		const char* fileEnd = data + file.size();
+		for (size_t i = 0; i < chunkCount; i++)
+		{
+			chunks[i].begin = i == 0 ? data : chunks[i - 1].end;
+			const char* end = i + 1 == chunkCount ? fileEnd : data + file.size() * (i + 1) / chunkCount;
+			end = std::max(end, chunks[i].begin);
+			while (end < fileEnd && end[-1] != '\n')
+			{
+				end++;
+			}
+			chunks[i].end = end;
+		}
+
+		pool.parallelFor((int)chunkCount, 1, [&chunks](int begin, int end) {
+			for (int i = begin; i < end; i++)
+			{
+				parseObjChunk(chunks[i]);
+			}
+		});
+
+		//relative indices count back from the end of the lists at their line, so every chunk needs
+		//the lengths of the lists before it
+		int positionCount = 0;
+		int normalCount = 0;
+		size_t cornerCount = 0;
+		for (size_t i = 0; i < chunkCount; i++)
+		{
+			chunks[i].positionBase = positionCount;
+			chunks[i].normalBase = normalCount;
+			positionCount += (int)chunks[i].positions.size();
+			normalCount += (int)chunks[i].normals.size();
+			cornerCount += chunks[i].corners.size();
+		}
+
+		std::vector<glm::vec3> positions;
+		std::vector<glm::vec3> normals;
+		std::vector<ObjCorner> corners;
+		positions.reserve(positionCount);
+		normals.reserve(normalCount);
+		corners.reserve(cornerCount);
+		for (size_t i = 0; i < chunkCount; i++)
+		{
+			ObjChunk& chunk = chunks[i];
+			positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+			normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+			for (size_t j = 0; j < chunk.corners.size(); j++)
+			{
+				ObjCorner corner = chunk.corners[j];
+				if (corner.flags & OBJ_RELATIVE_POSITION)
+				{
+					corner.position += chunk.positionBase;
+				}
+				if (corner.flags & OBJ_RELATIVE_NORMAL)
+				{
+					corner.normal += chunk.normalBase;
+				}
+				if (corner.position < 0 || corner.position >= positionCount || (!(corner.flags & OBJ_NO_NORMAL) && (corner.normal < 0 || corner.normal >= normalCount)))
+				{
+					std::cout << "ERROR::MESH_IMPORT::OBJ_INDEX_OUT_OF_RANGE" << std::endl;
+					return false;
+				}
+				corners.push_back(corner);
+			}
+			std::vector<glm::vec3>().swap(chunk.positions);
+			std::vector<glm::vec3>().swap(chunk.normals);
+			std::vector<ObjCorner>().swap(chunk.corners);
+		}
+		stats.corners = (unsigned int)corners.size();
+		stats.parseMilliseconds = getMilliseconds(start);
+
+		//a vertex is a pair of position and normal index, the same pair is the same vertex
+		start = std::chrono::steady_clock::now();
+		std::vector<unsigned int> keys(corners.size() * 2);
+		for (size_t i = 0; i < corners.size(); i++)
+		{
+			keys[i * 2] = (unsigned int)corners[i].position;
+			keys[i * 2 + 1] = (corners[i].flags & OBJ_NO_NORMAL) ? 0xFFFFFFFFu : (unsigned int)corners[i].normal;
+		}
+
+		std::vector<GLuint> firstCorners;
+		mergeEqual(keys, 2, mesh.indices, firstCorners);
+
+		mesh.vertices.resize(firstCorners.size() * 6);
+		generateNormal.resize(firstCorners.size());
+		for (size_t i = 0; i < firstCorners.size(); i++)
+		{
+			const ObjCorner& corner = corners[firstCorners[i]];
+			bool hasNormal = !(corner.flags & OBJ_NO_NORMAL);
+			const glm::vec3& position = positions[corner.position];
+			glm::vec3 normal = hasNormal ? normals[corner.normal] : glm::vec3(0.0f);
+			float vertex[6] = { position.x, position.y, position.z, normal.x, normal.y, normal.z };
+			memcpy(&mesh.vertices[i * 6], vertex, sizeof(vertex));
+			generateNormal[i] = !hasNormal;
+		}
+		stats.indexMilliseconds = getMilliseconds(start);
+
+		return true;
+	}
+
+	static void skipSpaces(const char*& p, const char* end)
+	{
+		while (p < end && (*p == ' ' || *p == '\t'))
+		{
+			p++;
+		}
+	}
+
+	static void skipLine(const char*& p, const char* end)
+	{
+		while (p < end && *p != '\n')
+		{
+			p++;
+		}
+		if (p < end)
+		{
+			p++;
+		}
+	}
+
+	// strtof reads the locale and copies, this only handles what OBJ files contain
+	static float parseFloat(const char*& p, const char* end)
+	{
+		skipSpaces(p, end);
+
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+		{
+			negative = *p == '-';
+			p++;
+		}
+
+		double value = 0.0;
+		while (p < end && *p >= '0' && *p <= '9')
+		{
+			value = value * 10.0 + (*p - '0');
+			p++;
+		}
+
+		if (p < end && *p == '.')
+		{
+			p++;
+			double scale = 0.1;
+			while (p < end && *p >= '0' && *p <= '9')
+			{
+				value += (*p - '0') * scale;
+				scale *= 0.1;
+				p++;
+			}
+		}
+
+		if (p < end && (*p == 'e' || *p == 'E'))
+		{
+			p++;
+			bool negativeExponent = false;
+			if (p < end && (*p == '-' || *p == '+'))
+			{
+				negativeExponent = *p == '-';
+				p++;
+			}
+			int exponent = 0;
+			while (p < end && *p >= '0' && *p <= '9')
+			{
+				exponent = exponent * 10 + (*p - '0');
+				p++;
+			}
+			value *= std::pow(10.0, negativeExponent ? -exponent : exponent);
+		}
+
+		return (float)(negative ? -value : value);
+	}
+
+	// 0 if there is no number
+	static int parseInt(const char*& p, const char* end)
+	{
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+		{
+			negative = *p == '-';
+			p++;
+		}
+
+		int value = 0;
+		while (p < end && *p >= '0' && *p <= '9')
+		{
+			value = value * 10 + (*p - '0');
+			p++;
+		}
+		return negative ? -value : value;
+	}
+
+	// position/texcoord/normal, the texture coordinate and normal are optional
+	static bool parseObjCorner(const char*& p, const char* end, const ObjChunk& chunk, ObjCorner& corner)
+	{
+		int position = parseInt(p, end);
+		int normal = 0;
+		if (p < end && *p == '/')
+		{
+			p++;
+			parseInt(p, end);
+			if (p < end && *p == '/')
+			{
+				p++;
+				normal = parseInt(p, end);
+			}
+		}
+		if (position == 0)
+		{
+			return false;
+		}
+
+		//positive indices count from 1 at the start of the file, negative ones back from the current end
+		corner.flags = 0;
+		if (position > 0)
+		{
+			corner.position = position - 1;
+		}
+		else
+		{
+			corner.position = (int)chunk.positions.size() + position;
+			corner.flags |= OBJ_RELATIVE_POSITION;
+		}
+
+		if (normal == 0)
+		{
+			corner.normal = 0;
+			corner.flags |= OBJ_NO_NORMAL;
+		}
+		else if (normal > 0)
+		{
+			corner.normal = normal - 1;
+		}
+		else
+		{
+			corner.normal = (int)chunk.normals.size() + normal;
+			corner.flags |= OBJ_RELATIVE_NORMAL;
+		}
+		return true;
+	}
+
+	static void parseObjChunk(ObjChunk& chunk)
+	{
+		MemoryScope scope(MEMORY_TAG_GEOMETRY);
+
+		const char* p = chunk.begin;
+		const char* end = chunk.end;
+		ObjCorner face[3];
+
+		while (p < end)
+		{
+			skipSpaces(p, end);
+			if (p + 1 < end && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t'))
+			{
+				p += 1;
+				glm::vec3 position;
+				position.x = parseFloat(p, end);
+				position.y = parseFloat(p, end);
+				position.z = parseFloat(p, end);
+				chunk.positions.push_back(position);
+			}
+			else if (p + 2 < end && p[0] == 'v' && p[1] == 'n' && (p[2] == ' ' || p[2] == '\t'))
+			{
+				p += 2;
+				glm::vec3 normal;
+				normal.x = parseFloat(p, end);
+				normal.y = parseFloat(p, end);
+				normal.z = parseFloat(p, end);
+				chunk.normals.push_back(normal);
+			}
+			else if (p + 1 < end && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+			{
+				//polygons are split into a fan around their first corner
+				p += 1;
+				int count = 0;
+				while (true)
+				{
+					skipSpaces(p, end);
+					if (p >= end || *p == '\n' || *p == '\r' || *p == '#')
+					{
+						break;
+					}
+
+					ObjCorner corner;
+					if (!parseObjCorner(p, end, chunk, corner))
+					{
+						break;
+					}
+
+					if (count < 2)
+					{
+						face[count] = corner;
+					}
+					else
+					{
+						face[2] = corner;
+						chunk.corners.push_back(face[0]);
+						chunk.corners.push_back(face[1]);
+						chunk.corners.push_back(face[2]);
+						face[1] = face[2];
+					}
+					count++;
+				}
+			}
+			skipLine(p, end);
+		}
+	}
+
+	/*
+	 glTF
+	*/
+
+	bool importGlb(const std::vector<char>& file, ThreadPool& pool, ImportedMesh& mesh, std::vector<bool>& generateNormal, MeshImportStats& stats)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		//12 byte header, then the JSON chunk and the binary chunk, each with its length and type
+		const unsigned int glbMagic = 0x46546C67;
+		const unsigned int jsonChunk = 0x4E4F534A;
+		const unsigned int binaryChunk = 0x004E4942;
+
+		if (file.size() < 20 || readUint(file, 0) != glbMagic || readUint(file, 4) != 2)
+		{
+			std::cout << "ERROR::MESH_IMPORT::NOT_A_GLB_2_FILE" << std::endl;
+			return false;
+		}
+
+		size_t jsonLength = readUint(file, 12);
+		if (readUint(file, 16) != jsonChunk || 20 + jsonLength > file.size())
+		{
+			std::cout << "ERROR::MESH_IMPORT::GLB_JSON_CHUNK_MISSING" << std::endl;
+			return false;
+		}
+
+		const char* binary = NULL;
+		size_t binaryLength = 0;
+		size_t binaryHeader = 20 + ((jsonLength + 3) & ~(size_t)3);
+		if (binaryHeader + 8 <= file.size() && readUint(file, binaryHeader + 4) == binaryChunk)
+		{
+			binaryLength = std::min((size_t)readUint(file, binaryHeader), file.size() - binaryHeader - 8);
+			binary = file.data() + binaryHeader + 8;
+		}
+
+		JsonValue json;
+		const char* p = file.data() + 20;
+		if (!parseJson(p, p + jsonLength, json, 0) || json.type != JsonValue::JSON_OBJECT)
+		{
+			std::cout << "ERROR::MESH_IMPORT::GLB_JSON_INVALID" << std::endl;
+			return false;
+		}
+
+		std::vector<GlbPrimitive> primitives;
+		if (!collectGlbPrimitives(json, primitives))
+		{
+			return false;
+		}
+
+		pool.parallelFor((int)primitives.size(), 1, [this, &json, binary, binaryLength, &primitives](int begin, int end) {
+			MemoryScope scope(MEMORY_TAG_GEOMETRY);
+			for (int i = begin; i < end; i++)
+			{
+				primitives[i].valid = readGlbPrimitive(json, binary, binaryLength, primitives[i]);
+			}
+		});
+
+		std::vector<float> vertices;
+		std::vector<GLuint> indices;
+		std::vector<bool> hasNormals;
+		for (size_t i = 0; i < primitives.size(); i++)
+		{
+			GlbPrimitive& primitive = primitives[i];
+			if (!primitive.valid)
+			{
+				return false;
+			}
+
+			GLuint baseVertex = (GLuint)(vertices.size() / 6);
+			for (size_t j = 0; j < primitive.indices.size(); j++)
+			{
+				indices.push_back(baseVertex + primitive.indices[j]);
+			}
+			vertices.insert(vertices.end(), primitive.vertices.begin(), primitive.vertices.end());
+			hasNormals.resize(vertices.size() / 6, primitive.hasNormals);
+
+			std::vector<float>().swap(primitive.vertices);
+			std::vector<GLuint>().swap(primitive.indices);
+		}
+		stats.corners = (unsigned int)indices.size();
+		stats.parseMilliseconds = getMilliseconds(start);
+
+		//exporters often keep a vertex per corner, equal vertices are merged bit for bit
+		start = std::chrono::steady_clock::now();
+		std::vector<unsigned int> keys(vertices.size());
+		memcpy(keys.data(), vertices.data(), vertices.size() * sizeof(float));
+
+		std::vector<GLuint> remap;
+		std::vector<GLuint> firstVertices;
+		mergeEqual(keys, 6, remap, firstVertices);
+
+		mesh.vertices.resize(firstVertices.size() * 6);
+		generateNormal.resize(firstVertices.size());
+		for (size_t i = 0; i < firstVertices.size(); i++)
+		{
+			memcpy(&mesh.vertices[i * 6], &vertices[firstVertices[i] * 6], 6 * sizeof(float));
+			generateNormal[i] = !hasNormals[firstVertices[i]];
+		}
+
+		mesh.indices.resize(indices.size());
+		for (size_t i = 0; i < indices.size(); i++)
+		{
+			mesh.indices[i] = remap[indices[i]];
+		}
+		stats.indexMilliseconds = getMilliseconds(start);
+
+		return true;
+	}
+
+	static unsigned int readUint(const std::vector<char>& data, size_t offset)
+	{
+		unsigned int value;
+		memcpy(&value, data.data() + offset, sizeof(value));
+		return value;
+	}
+
+	static void skipJsonSpaces(const char*& p, const char* end)
+	{
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+		{
+			p++;
+		}
+	}
+
+	// escapes are kept as they are apart from the quote, glTF names are not needed
+	static bool parseJsonString(const char*& p, const char* end, std::string& string)
+	{
+		if (p >= end || *p != '"')
+		{
+			return false;
+		}
+		p++;
+
+		const char* begin = p;
+		while (p < end && *p != '"')
+		{
+			p += *p == '\\' ? 2 : 1;
+		}
+		if (p >= end)
+		{
+			return false;
+		}
+
+		string.assign(begin, p);
+		p++;
+		return true;
+	}
+
+	static bool parseJson(const char*& p, const char* end, JsonValue& value, int depth)
+	{
+		skipJsonSpaces(p, end);
+		if (p >= end || depth > 64)
+		{
+			return false;
+		}
+
+		if (*p == '{')
+		{
+			value.type = JsonValue::JSON_OBJECT;
+			p++;
+			skipJsonSpaces(p, end);
+			if (p < end && *p == '}')
+			{
+				p++;
+				return true;
+			}
+			while (true)
+			{
+				skipJsonSpaces(p, end);
+				std::pair<std::string, JsonValue> member;
+				if (!parseJsonString(p, end, member.first))
+				{
+					return false;
+				}
+				skipJsonSpaces(p, end);
+				if (p >= end || *p != ':')
+				{
+					return false;
+				}
+				p++;
+				if (!parseJson(p, end, member.second, depth + 1))
+				{
+					return false;
+				}
+				value.members.push_back(std::move(member));
+
+				skipJsonSpaces(p, end);
+				if (p < end && *p == ',')
+				{
+					p++;
+				}
+				else if (p < end && *p == '}')
+				{
+					p++;
+					return true;
+				}
+				else
+				{
+					return false;
+				}
+			}
+		}
+
+		if (*p == '[')
+		{
+			value.type = JsonValue::JSON_ARRAY;
+			p++;
+			skipJsonSpaces(p, end);
+			if (p < end && *p == ']')
+			{
+				p++;
+				return true;
+			}
+			while (true)
+			{
+				value.items.push_back(JsonValue());
+				if (!parseJson(p, end, value.items.back(), depth + 1))
+				{
+					return false;
+				}
+
+				skipJsonSpaces(p, end);
+				if (p < end && *p == ',')
+				{
+					p++;
+				}
+				else if (p < end && *p == ']')
+				{
+					p++;
+					return true;
+				}
+				else
+				{
+					return false;
+				}
+			}
+		}
+
+		if (*p == '"')
+		{
+			value.type = JsonValue::JSON_STRING;
+			return parseJsonString(p, end, value.string);
+		}
+
+		if (end - p >= 4 && strncmp(p, "true", 4) == 0)
+		{
+			value.type = JsonValue::JSON_BOOL;
+			value.number = 1.0;
+			p += 4;
+			return true;
+		}
+		if (end - p >= 5 && strncmp(p, "false", 5) == 0)
+		{
+			value.type = JsonValue::JSON_BOOL;
+			p += 5;
+			return true;
+		}
+		if (end - p >= 4 && strncmp(p, "null", 4) == 0)
+		{
+			p += 4;
+			return true;
+		}
+
+		const char* start = p;
+		value.type = JsonValue::JSON_NUMBER;
+		value.number = parseFloat(p, end);
+		return p != start;
+	}
+
+	static glm::mat4 getNodeTransform(const JsonValue& node)
+	{
+		const JsonValue* matrix = node.find("matrix");
+		if (matrix != NULL && matrix->items.size() == 16)
+		{
+			glm::mat4 transform;
+			for (int i = 0; i < 16; i++)
+			{
+				transform[i / 4][i % 4] = (float)matrix->items[i].number;
+			}
+			return transform;
+		}
+
+		glm::mat4 transform(1.0f);
+		const JsonValue* translation = node.find("translation");
+		if (translation != NULL && translation->items.size() == 3)
+		{
+			transform = glm::translate(transform, glm::vec3((float)translation->items[0].number, (float)translation->items[1].number, (float)translation->items[2].number));
+		}
+		const JsonValue* rotation = node.find("rotation");
+		if (rotation != NULL && rotation->items.size() == 4)
+		{
+			glm::quat quaternion((float)rotation->items[3].number, (float)rotation->items[0].number, (float)rotation->items[1].number, (float)rotation->items[2].number);
+			transform = transform * glm::mat4_cast(quaternion);
+		}
+		const JsonValue* scale = node.find("scale");
+		if (scale != NULL && scale->items.size() == 3)
+		{
+			transform = glm::scale(transform, glm::vec3((float)scale->items[0].number, (float)scale->items[1].number, (float)scale->items[2].number));
+		}
+		return transform;
+	}
+
+	static void collectGlbNode(const JsonValue& json, size_t nodeIndex, const glm::mat4& parent, int depth, std::vector<GlbPrimitive>& primitives)
+	{
+		const JsonValue* nodes = json.find("nodes");
+		const JsonValue* node = nodes != NULL ? nodes->at(nodeIndex) : NULL;
+		if (node == NULL || depth > 64)
+		{
+			return;
+		}
+
+		glm::mat4 transform = parent * getNodeTransform(*node);
+
+		const JsonValue* meshes = json.find("meshes");
+		const JsonValue* meshIndex = node->find("mesh");
+		const JsonValue* mesh = meshes != NULL && meshIndex != NULL ? meshes->at((size_t)meshIndex->number) : NULL;
+		const JsonValue* meshPrimitives = mesh != NULL ? mesh->find("primitives") : NULL;
+		if (meshPrimitives != NULL)
+		{
+			for (size_t i = 0; i < meshPrimitives->items.size(); i++)
+			{
+				GlbPrimitive primitive;
+				primitive.primitive = &meshPrimitives->items[i];
+				primitive.transform = transform;
+				primitives.push_back(std::move(primitive));
+			}
+		}
+
+		const JsonValue* children = node->find("children");
+		if (children != NULL)
+		{
+			for (size_t i = 0; i < children->items.size(); i++)
+			{
+				collectGlbNode(json, (size_t)children->items[i].number, transform, depth + 1, primitives);
+			}
+		}
+	}
+
+	// the nodes of the default scene, or every node nothing points at without one
+	static bool collectGlbPrimitives(const JsonValue& json, std::vector<GlbPrimitive>& primitives)
+	{
+		const JsonValue* nodes = json.find("nodes");
+		if (nodes == NULL)
+		{
+			std::cout << "ERROR::MESH_IMPORT::GLB_NO_NODES" << std::endl;
+			return false;
+		}
+
+		std::vector<size_t> roots;
+		const JsonValue* scenes = json.find("scenes");
+		const JsonValue* scene = scenes != NULL ? scenes->at((size_t)json.getNumber("scene", 0.0)) : NULL;
+		const JsonValue* sceneNodes = scene != NULL ? scene->find("nodes") : NULL;
+		if (sceneNodes != NULL)
+		{
+			for (size_t i = 0; i < sceneNodes->items.size(); i++)
+			{
+				roots.push_back((size_t)sceneNodes->items[i].number);
+			}
+		}
+		else
+		{
+			std::vector<bool> isChild(nodes->items.size(), false);
+			for (size_t i = 0; i < nodes->items.size(); i++)
+			{
+				const JsonValue* children = nodes->items[i].find("children");
+				for (size_t j = 0; children != NULL && j < children->items.size(); j++)
+				{
+					size_t child = (size_t)children->items[j].number;
+					if (child < isChild.size())
+					{
+						isChild[child] = true;
+					}
+				}
+			}
+			for (size_t i = 0; i < nodes->items.size(); i++)
+			{
+				if (!isChild[i])
+				{
+					roots.push_back(i);
+				}
+			}
+		}
+
+		for (size_t i = 0; i < roots.size(); i++)
+		{
+			collectGlbNode(json, roots[i], glm::mat4(1.0f), 0, primitives);
+		}
+
+		if (primitives.empty())
+		{
+			std::cout << "ERROR::MESH_IMPORT::GLB_NO_MESHES" << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	// first byte, stride and count of an accessor, false if it is not of the given type or leaves the buffer
+	static bool getGlbAccessor(const JsonValue& json, const char* binary, size_t binaryLength, size_t accessorIndex,
+		const char* type, const char*& data, size_t& stride, size_t& count, int& componentType)
+	{
+		const JsonValue* accessors = json.find("accessors");
+		const JsonValue* accessor = accessors != NULL ? accessors->at(accessorIndex) : NULL;
+		if (accessor == NULL || binary == NULL)
+		{
+			return false;
+		}
+
+		const JsonValue* accessorType = accessor->find("type");
+		const JsonValue* viewIndex = accessor->find("bufferView");
+		if (accessorType == NULL || accessorType->string != type || viewIndex == NULL || accessor->find("sparse") != NULL)
+		{
+			return false;
+		}
+
+		const JsonValue* bufferViews = json.find("bufferViews");
+		const JsonValue* view = bufferViews != NULL ? bufferViews->at((size_t)viewIndex->number) : NULL;
+		if (view == NULL || view->getNumber("buffer", 0.0) != 0.0)
+		{
+			return false;
+		}
+
+		componentType = (int)accessor->getNumber("componentType", 0.0);
+		size_t componentSize = componentType == 5126 || componentType == 5125 ? 4 : (componentType == 5123 ? 2 : 1);
+		size_t components = strcmp(type, "VEC3") == 0 ? 3 : 1;
+		size_t elementSize = componentSize * components;
+
+		count = (size_t)accessor->getNumber("count", 0.0);
+		stride = (size_t)view->getNumber("byteStride", 0.0);
+		stride = stride != 0 ? stride : elementSize;
+		size_t offset = (size_t)view->getNumber("byteOffset", 0.0) + (size_t)accessor->getNumber("byteOffset", 0.0);
+		size_t viewEnd = (size_t)view->getNumber("byteOffset", 0.0) + (size_t)view->getNumber("byteLength", 0.0);
+
+		if (count == 0 || viewEnd > binaryLength || offset + (count - 1) * stride + elementSize > viewEnd)
+		{
+			return false;
+		}
+
+		data = binary + offset;
+		return true;
+	}
+
+	bool readGlbPrimitive(const JsonValue& json, const char* binary, size_t binaryLength, GlbPrimitive& primitive) const
+	{
+		if (primitive.primitive->getNumber("mode", 4.0) != 4.0)
+		{
+			std::cout << "ERROR::MESH_IMPORT::GLB_ONLY_TRIANGLE_LISTS" << std::endl;
+			return false;
+		}
+
+		const JsonValue* attributes = primitive.primitive->find("attributes");
+		const JsonValue* positionAccessor = attributes != NULL ? attributes->find("POSITION") : NULL;
+		if (positionAccessor == NULL)
+		{
+			std::cout << "ERROR::MESH_IMPORT::GLB_NO_POSITIONS" << std::endl;
+			return false;
+		}
+
+		const char* positions;
+		size_t positionStride;
+		size_t vertexCount;
+		int componentType;
+		if (!getGlbAccessor(json, binary, binaryLength, (size_t)positionAccessor->number, "VEC3", positions, positionStride, vertexCount, componentType) || componentType != 5126)
+		{
+			std::cout << "ERROR::MESH_IMPORT::GLB_POSITIONS_NOT_FLOAT_VEC3" << std::endl;
+			return false;
+		}
+
+		const char* normals = NULL;
+		size_t normalStride = 0;
+		size_t normalCount = 0;
+		const JsonValue* normalAccessor = attributes->find("NORMAL");
+		if (normalAccessor != NULL && (!getGlbAccessor(json, binary, binaryLength, (size_t)normalAccessor->number, "VEC3", normals, normalStride, normalCount, componentType)
+			|| componentType != 5126 || normalCount != vertexCount))
+		{
+			std::cout << "ERROR::MESH_IMPORT::GLB_NORMALS_NOT_FLOAT_VEC3" << std::endl;
+			return false;
+		}
+		primitive.hasNormals = normals != NULL;
+
+		//normals go through the inverse transpose, a mirroring transform turns the triangles around
+		glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(primitive.transform)));
+		bool mirrored = glm::determinant(glm::mat3(primitive.transform)) < 0.0f;
+
+		primitive.vertices.resize(vertexCount * 6);
+		for (size_t i = 0; i < vertexCount; i++)
+		{
+			glm::vec3 position;
+			memcpy(&position[0], positions + i * positionStride, sizeof(float) * 3);
+			position = glm::vec3(primitive.transform * glm::vec4(position, 1.0f));
+
+			glm::vec3 normal(0.0f);
+			if (normals != NULL)
+			{
+				memcpy(&normal[0], normals + i * normalStride, sizeof(float) * 3);
+				float length = glm::length(normalMatrix * normal);
+				normal = length > 0.0f ? normalMatrix * normal / length : glm::vec3(0.0f);
+			}
+
+			float* vertex = &primitive.vertices[i * 6];
+			vertex[0] = position.x;
+			vertex[1] = position.y;
+			vertex[2] = position.z;
+			vertex[3] = normal.x;
+			vertex[4] = normal.y;
+			vertex[5] = normal.z;
+		}
+
+		const JsonValue* indexAccessor = primitive.primitive->find("indices");
+		if (indexAccessor == NULL)
+		{
+			primitive.indices.resize(vertexCount - vertexCount % 3);
+			for (size_t i = 0; i < primitive.indices.size(); i++)
+			{
+				primitive.indices[i] = (GLuint)i;
+			}
+		}
+		else
+		{
+			const char* indices;
+			size_t indexStride;
+			size_t indexCount;
+			if (!getGlbAccessor(json, binary, binaryLength, (size_t)indexAccessor->number, "SCALAR", indices, indexStride, indexCount, componentType)
+				|| (componentType != 5121 && componentType != 5123 && componentType != 5125))
+			{
+				std::cout << "ERROR::MESH_IMPORT::GLB_INDICES_INVALID" << std::endl;
+				return false;
+			}
+
+			primitive.indices.resize(indexCount - indexCount % 3);
+			for (size_t i = 0; i < primitive.indices.size(); i++)
+			{
+				const char* index = indices + i * indexStride;
+				GLuint value;
+				if (componentType == 5125)
+				{
+					memcpy(&value, index, sizeof(GLuint));
+				}
+				else if (componentType == 5123)
+				{
+					unsigned short shortValue;
+					memcpy(&shortValue, index, sizeof(shortValue));
+					value = shortValue;
+				}
+				else
+				{
+					value = (unsigned char)*index;
+				}
+
+				if (value >= vertexCount)
+				{
+					std::cout << "ERROR::MESH_IMPORT::GLB_INDEX_OUT_OF_RANGE" << std::endl;
+					return false;
+				}
+				primitive.indices[i] = value;
+			}
+		}
+
+		if (mirrored)
+		{
+			for (size_t i = 0; i < primitive.indices.size(); i += 3)
+			{
+				std::swap(primitive.indices[i + 1], primitive.indices[i + 2]);
+			}
+		}
+		return true;
+	}
+
+	/*
+	 Indexed mesh
+	*/
+
+	// items of keyWords words each, remap gets the index of every item among the distinct ones and
+	// firstItems the first item of each distinct one. An open addressing table keeps the lookups in one
+	// allocation.
+	static void mergeEqual(const std::vector<unsigned int>& keys, size_t keyWords, std::vector<GLuint>& remap, std::vector<GLuint>& firstItems)
+	{
+		const GLuint empty = 0xFFFFFFFFu;
+		size_t count = keys.size() / keyWords;
+		size_t capacity = 16;
+		while (capacity < count * 2)
+		{
+			capacity *= 2;
+		}
+
+		std::vector<GLuint> table(capacity, empty);
+		remap.resize(count);
+		firstItems.clear();
+
+		for (size_t i = 0; i < count; i++)
+		{
+			const unsigned int* key = &keys[i * keyWords];
+
+			//MurmurHash3 mixing of every word
+			unsigned int hash = 0;
+			for (size_t j = 0; j < keyWords; j++)
+			{
+				unsigned int word = key[j] * 0xcc9e2d51u;
+				word = (word << 15) | (word >> 17);
+				hash ^= word * 0x1b873593u;
+				hash = ((hash << 13) | (hash >> 19)) * 5 + 0xe6546b64u;
+			}
+			hash ^= hash >> 16;
+			hash *= 0x85ebca6bu;
+			hash ^= hash >> 13;
+
+			size_t slot = hash & (capacity - 1);
+			while (table[slot] != empty && memcmp(&keys[table[slot] * keyWords], key, keyWords * sizeof(unsigned int)) != 0)
+			{
+				slot = (slot + 1) & (capacity - 1);
+			}
+
+			if (table[slot] == empty)
+			{
+				table[slot] = (GLuint)i;
+				remap[i] = (GLuint)firstItems.size();
+				firstItems.push_back((GLuint)i);
+			}
+			else
+			{
+				remap[i] = remap[table[slot]];
+			}
+		}
+	}
+
+	// area weighted average of the faces around the vertices the file has no normal for
+	static void generateNormals(ImportedMesh& mesh, const std::vector<bool>& generateNormal)
+	{
+		if (std::find(generateNormal.begin(), generateNormal.end(), true) == generateNormal.end())
+		{
+			return;
+		}
+
+		std::vector<float>& vertices = mesh.vertices;
+		for (size_t i = 0; i < mesh.indices.size(); i += 3)
+		{
+			GLuint a = mesh.indices[i];
+			GLuint b = mesh.indices[i + 1];
+			GLuint c = mesh.indices[i + 2];
+			glm::vec3 positionA(vertices[a * 6], vertices[a * 6 + 1], vertices[a * 6 + 2]);
+			glm::vec3 positionB(vertices[b * 6], vertices[b * 6 + 1], vertices[b * 6 + 2]);
+			glm::vec3 positionC(vertices[c * 6], vertices[c * 6 + 1], vertices[c * 6 + 2]);
+			glm::vec3 normal = glm::cross(positionB - positionA, positionC - positionA);
+
+			GLuint corners[3] = { a, b, c };
+			for (int j = 0; j < 3; j++)
+			{
+				if (generateNormal[corners[j]])
+				{
+					vertices[corners[j] * 6 + 3] += normal.x;
+					vertices[corners[j] * 6 + 4] += normal.y;
+					vertices[corners[j] * 6 + 5] += normal.z;
+				}
+			}
+		}
+
+		for (size_t i = 0; i < generateNormal.size(); i++)
+		{
+			if (!generateNormal[i])
+			{
+				continue;
+			}
+
+			glm::vec3 normal(vertices[i * 6 + 3], vertices[i * 6 + 4], vertices[i * 6 + 5]);
+			float length = glm::length(normal);
+			normal = length > 0.0f ? normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+			vertices[i * 6 + 3] = normal.x;
+			vertices[i * 6 + 4] = normal.y;
+			vertices[i * 6 + 5] = normal.z;
+		}
+	}
+
+	static void computeBounds(ImportedMesh& mesh)
+	{
+		mesh.boundsMin = glm::vec3(mesh.vertices[0], mesh.vertices[1], mesh.vertices[2]);
+		mesh.boundsMax = mesh.boundsMin;
+		for (size_t i = 6; i < mesh.vertices.size(); i += 6)
+		{
+			glm::vec3 position(mesh.vertices[i], mesh.vertices[i + 1], mesh.vertices[i + 2]);
+			mesh.boundsMin = glm::min(mesh.boundsMin, position);
+			mesh.boundsMax = glm::max(mesh.boundsMax, position);
+		}
+	}
+
+	/*
+	 Vertex cache, overdraw and vertex fetch order
+	*/
+
+	// recently used vertices score higher, the three of the last triangle a fixed amount so the next
+	// triangle does not simply continue a strip, and vertices with few triangles left get a boost so
+	// no lonely triangles are left behind
+	float getVertexScore(int cachePosition, unsigned int remainingTriangles) const
+	{
+		if (remainingTriangles == 0)
+		{
+			return -1.0f;
+		}
+
+		float score = 0.0f;
+		if (cachePosition >= 0)
+		{
+			if (cachePosition < 3)
+			{
+				score = 0.75f;
+			}
+			else
+			{
+				score = std::pow(1.0f - (float)(cachePosition - 3) / (cacheSize - 3), 1.5f);
+			}
+		}
+
+		return score + 2.0f / std::sqrt((float)remainingTriangles);
+	}
+
+	// Forsyth's greedy ordering, each step emits the best scoring triangle around the vertices in the cache
+	void optimizeVertexCache(std::vector<GLuint>& indices, unsigned int vertexCount) const
+	{
+		size_t triangleCount = indices.size() / 3;
+
+		//triangles of every vertex, the ones still to emit are kept at the front of its list
+		std::vector<unsigned int> remaining(vertexCount, 0);
+		for (size_t i = 0; i < indices.size(); i++)
+		{
+			remaining[indices[i]]++;
+		}
+		std::vector<unsigned int> firstTriangle(vertexCount + 1, 0);
+		for (unsigned int i = 0; i < vertexCount; i++)
+		{
+			firstTriangle[i + 1] = firstTriangle[i] + remaining[i];
+		}
+		std::vector<unsigned int> vertexTriangles(indices.size());
+		std::vector<unsigned int> filled(vertexCount, 0);
+		for (size_t i = 0; i < indices.size(); i++)
+		{
+			GLuint vertex = indices[i];
+			vertexTriangles[firstTriangle[vertex] + filled[vertex]++] = (unsigned int)(i / 3);
+		}
+
+		std::vector<int> cachePosition(vertexCount, -1);
+		std::vector<float> vertexScores(vertexCount);
+		for (unsigned int i = 0; i < vertexCount; i++)
+		{
+			vertexScores[i] = getVertexScore(-1, remaining[i]);
+		}
+
+		std::vector<bool> emitted(triangleCount, false);
+
+		std::vector<GLuint> cache;
+		std::vector<GLuint> newCache;
+		cache.reserve(cacheSize + 3);
+		newCache.reserve(cacheSize + 3);
+
+		std::vector<GLuint> result;
+		result.reserve(indices.size());
+
+		size_t cursor = 0;
+		long long bestTriangle = -1;
+		for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+		{
+			//nothing around the cache is left, continue with the next triangle in the input
+			if (bestTriangle < 0)
+			{
+				while (emitted[cursor])
+				{
+					cursor++;
+				}
+				bestTriangle = (long long)cursor;
+			}
+
+			size_t triangle = (size_t)bestTriangle;
+			emitted[triangle] = true;
+
+			newCache.clear();
+			for (int j = 0; j < 3; j++)
+			{
+				GLuint vertex = indices[triangle * 3 + j];
+				result.push_back(vertex);
+				newCache.push_back(vertex);
+
+				//take the triangle out of the vertex's list of remaining triangles
+				unsigned int* triangles = &vertexTriangles[firstTriangle[vertex]];
+				for (unsigned int k = 0; k < remaining[vertex]; k++)
+				{
+					if (triangles[k] == triangle)
+					{
+						std::swap(triangles[k], triangles[remaining[vertex] - 1]);
+						break;
+					}
+				}
+				remaining[vertex]--;
+			}
+
+			for (size_t j = 0; j < cache.size(); j++)
+			{
+				GLuint vertex = cache[j];
+				if (vertex != newCache[0] && vertex != newCache[1] && vertex != newCache[2])
+				{
+					newCache.push_back(vertex);
+				}
+			}
+
+			//vertices pushed out of the cache lose their cache score
+			for (size_t j = (size_t)cacheSize; j < newCache.size(); j++)
+			{
+				cachePosition[newCache[j]] = -1;
+				vertexScores[newCache[j]] = getVertexScore(-1, remaining[newCache[j]]);
+			}
+			if (newCache.size() > (size_t)cacheSize)
+			{
+				newCache.resize(cacheSize);
+			}
+			for (size_t j = 0; j < newCache.size(); j++)
+			{
+				cachePosition[newCache[j]] = (int)j;
+				vertexScores[newCache[j]] = getVertexScore((int)j, remaining[newCache[j]]);
+			}
+			cache.swap(newCache);
+
+			//only the triangles around the cache changed their score
+			bestTriangle = -1;
+			float bestScore = -1.0f;
+			for (size_t j = 0; j < cache.size(); j++)
+			{
+				GLuint vertex = cache[j];
+				const unsigned int* triangles = &vertexTriangles[firstTriangle[vertex]];
+				for (unsigned int k = 0; k < remaining[vertex]; k++)
+				{
+					unsigned int candidate = triangles[k];
+					float score = vertexScores[indices[candidate * 3]] + vertexScores[indices[candidate * 3 + 1]] + vertexScores[indices[candidate * 3 + 2]];
+					if (score > bestScore)
+					{
+						bestScore = score;
+						bestTriangle = candidate;
+					}
+				}
+			}
+		}
+
+		indices.swap(result);
+	}
+
+	// FIFO cache misses of triangle, time advances with every miss
+	static unsigned int updateFifoCache(const GLuint* triangle, std::vector<unsigned int>& timestamps, unsigned int& time, unsigned int cacheSize)
+	{
+		unsigned int misses = 0;
+		for (int i = 0; i < 3; i++)
+		{
+			if (time - timestamps[triangle[i]] > cacheSize)
+			{
+				timestamps[triangle[i]] = time++;
+				misses++;
+			}
+		}
+		return misses;
+	}
+
+	// Splits the cache ordered triangles into runs where the cache starts over and where a run has
+	// reached an ACMR close to its own average, then draws the runs facing out of the mesh first.
+	// Returns the number of runs.
+	unsigned int optimizeOverdraw(ImportedMesh& mesh) const
+	{
+		std::vector<GLuint>& indices = mesh.indices;
+		size_t triangleCount = indices.size() / 3;
+		unsigned int vertexCount = (unsigned int)(mesh.vertices.size() / 6);
+		unsigned int fifoSize = (unsigned int)measuredCacheSize;
+
+		//hard boundaries, every triangle that misses with all three vertices starts a new run
+		std::vector<unsigned int> hardBoundaries;
+		std::vector<unsigned int> timestamps(vertexCount, 0);
+		unsigned int time = fifoSize + 1;
+		for (size_t i = 0; i < triangleCount; i++)
+		{
+			if (updateFifoCache(&indices[i * 3], timestamps, time, fifoSize) == 3 || i == 0)
+			{
+				hardBoundaries.push_back((unsigned int)i);
+			}
+		}
+		hardBoundaries.push_back((unsigned int)triangleCount);
+
+		//soft boundaries, a run is split once its ACMR so far is within the threshold of the whole run
+		std::vector<unsigned int> boundaries;
+		for (size_t i = 0; i + 1 < hardBoundaries.size(); i++)
+		{
+			unsigned int begin = hardBoundaries[i];
+			unsigned int end = hardBoundaries[i + 1];
+
+			std::fill(timestamps.begin(), timestamps.end(), 0);
+			time = fifoSize + 1;
+			unsigned int runMisses = 0;
+			for (unsigned int j = begin; j < end; j++)
+			{
+				runMisses += updateFifoCache(&indices[j * 3], timestamps, time, fifoSize);
+			}
+			float threshold = overdrawThreshold * runMisses / (end - begin);
+
+			std::fill(timestamps.begin(), timestamps.end(), 0);
+			time = fifoSize + 1;
+			unsigned int start = begin;
+			unsigned int misses = 0;
+			boundaries.push_back(begin);
+			for (unsigned int j = begin; j < end; j++)
+			{
+				misses += updateFifoCache(&indices[j * 3], timestamps, time, fifoSize);
+				if (j + 1 < end && (float)misses / (j + 1 - start) <= threshold)
+				{
+					boundaries.push_back(j + 1);
+					start = j + 1;
+					misses = 0;
+					std::fill(timestamps.begin(), timestamps.end(), 0);
+					time = fifoSize + 1;
+				}
+			}
+		}
+		boundaries.push_back((unsigned int)triangleCount);
+
+		//the runs are sorted by how far their average plane lies outside the mesh center
+		const std::vector<float>& vertices = mesh.vertices;
+		glm::vec3 meshCenter(0.0f);
+		float meshArea = 0.0f;
+		std::vector<glm::vec3> runCenters(boundaries.size() - 1, glm::vec3(0.0f));
+		std::vector<glm::vec3> runNormals(boundaries.size() - 1, glm::vec3(0.0f));
+		for (size_t run = 0; run + 1 < boundaries.size(); run++)
+		{
+			float runArea = 0.0f;
+			for (unsigned int i = boundaries[run]; i < boundaries[run + 1]; i++)
+			{
+				const GLuint* triangle = &indices[i * 3];
+				glm::vec3 a(vertices[triangle[0] * 6], vertices[triangle[0] * 6 + 1], vertices[triangle[0] * 6 + 2]);
+				glm::vec3 b(vertices[triangle[1] * 6], vertices[triangle[1] * 6 + 1], vertices[triangle[1] * 6 + 2]);
+				glm::vec3 c(vertices[triangle[2] * 6], vertices[triangle[2] * 6 + 1], vertices[triangle[2] * 6 + 2]);
+
+				glm::vec3 normal = glm::cross(b - a, c - a);
+				float area = glm::length(normal);
+				glm::vec3 center = (a + b + c) / 3.0f;
+
+				runCenters[run] += center * area;
+				runNormals[run] += normal;
+				runArea += area;
+				meshCenter += center * area;
+				meshArea += area;
+			}
+			runCenters[run] = runArea > 0.0f ? runCenters[run] / runArea : runCenters[run];
+		}
+		meshCenter = meshArea > 0.0f ? meshCenter / meshArea : meshCenter;
+
+		std::vector<float> runScores(runCenters.size());
+		std::vector<unsigned int> runOrder(runCenters.size());
+		for (size_t run = 0; run < runCenters.size(); run++)
+		{
+			float length = glm::length(runNormals[run]);
+			runScores[run] = length > 0.0f ? glm::dot(runCenters[run] - meshCenter, runNormals[run] / length) : 0.0f;
+			runOrder[run] = (unsigned int)run;
+		}
+		std::stable_sort(runOrder.begin(), runOrder.end(), [&runScores](unsigned int a, unsigned int b) {
+			return runScores[a] > runScores[b];
+		});
+
+		std::vector<GLuint> result;
+		result.reserve(indices.size());
+		for (size_t i = 0; i < runOrder.size(); i++)
+		{
+			unsigned int run = runOrder[i];
+			result.insert(result.end(), indices.begin() + boundaries[run] * 3, indices.begin() + boundaries[run + 1] * 3);
+		}
+		indices.swap(result);
+
+		return (unsigned int)runOrder.size();
+	}
+
+	// vertices in the order the indices first use them, so fetching them walks the buffer forward
+	static void optimizeVertexFetch(ImportedMesh& mesh)
+	{
+		unsigned int vertexCount = (unsigned int)(mesh.vertices.size() / 6);
+		std::vector<GLuint> remap(vertexCount, 0xFFFFFFFFu);
+		std::vector<float> vertices(mesh.vertices.size());
+
+		GLuint next = 0;
+		for (size_t i = 0; i < mesh.indices.size(); i++)
+		{
+			GLuint& index = mesh.indices[i];
+			if (remap[index] == 0xFFFFFFFFu)
+			{
+				remap[index] = next;
+				memcpy(&vertices[next * 6], &mesh.vertices[index * 6], 6 * sizeof(float));
+				next++;
+			}
+			index = remap[index];
+		}
+
+		//vertices no triangle uses are dropped
+		vertices.resize(next * 6);
+		mesh.vertices.swap(vertices);
+	}
+};
@@ -0,0 +1,148 @@
+#pragma once
+
+/*
+ Geometry of every mesh the scene draws.
+ All meshes share one vertex buffer (position and normal) and one index buffer, a mesh is a range of
+ indices with a base vertex. The classic path draws any of them from the one vertex array with the
+ range of the object's mesh, the GPU-driven path uploads the ranges to a storage buffer the culling
+ shader builds its indirect commands from. Meshes are added on the CPU, upload() creates the buffers
+ once before the first frame and frees the CPU copy. The cube is added first, so it is CUBE_MESH.
+*/
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include "GLState.h"
+#include "Scene.h"
+#include "MemoryTracker.h"
+
+class MeshRegistry
+{
+public:
+	static const int VERTEX_FLOATS = 6;	// position and normal
+
+	MeshRegistry() {}
+
+	// copies the mesh, size is the extent the mesh had before it was fitted into the unit cube
+	// ------------------------------------------------------------------------
+	unsigned int add(const std::string& name, const float* vertices, unsigned int vertexCount, const GLuint* indices, unsigned int indexCount, const glm::vec3& size = glm::vec3(1.0f))
+	{
+		MemoryScope scope(MEMORY_TAG_GEOMETRY);
+
+		MeshRange range;
+		range.firstIndex = (unsigned int)indexData.size();
+		range.indexCount = indexCount;
+		range.baseVertex = (int)(vertexData.size() / VERTEX_FLOATS);
+		range.padding = 0;
+
+		vertexData.insert(vertexData.end(), vertices, vertices + vertexCount * VERTEX_FLOATS);
+		indexData.insert(indexData.end(), indices, indices + indexCount);
+
+		ranges.push_back(range);
+		names.push_back(name);
+		sizes.push_back(size);
+
+		return (unsigned int)ranges.size() - 1;
+	}
+
+	// creates the buffers and the vertex array with the position and normal attributes 0 and 1
+	// ------------------------------------------------------------------------
+	GLuint upload()
+	{
+		if (vertexArray != 0)
+		{
+			std::cout << "ERROR::MESH_REGISTRY::ALREADY_UPLOADED" << std::endl;
+			return vertexArray;
+		}
+
+		MemoryScope scope(MEMORY_TAG_GEOMETRY);
+
+		vertexBuffer = gpuMemory.createBuffer(vertexData.size() * sizeof(float), vertexData.data(), 0);
+		elementBuffer = gpuMemory.createBuffer(indexData.size() * sizeof(GLuint), indexData.data(), 0);
+		rangeBuffer = gpuMemory.createBuffer(ranges.size() * sizeof(MeshRange), ranges.data(), 0);
+
+		glGenVertexArrays(1, &vertexArray);
+		glState.bindVertexArray(vertexArray);
+		glState.bindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
+
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, VERTEX_FLOATS * sizeof(float), (void*)0);
+		glEnableVertexAttribArray(0);
+
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, VERTEX_FLOATS * sizeof(float), (void*)(3 * sizeof(float)));
+		glEnableVertexAttribArray(1);
+
+		glState.bindBuffer(GL_ARRAY_BUFFER, 0);
+		glState.bindVertexArray(0);
+
+		//the GPU has its copy, only the ranges are needed to draw
+		std::vector<float>().swap(vertexData);
+		std::vector<GLuint>().swap(indexData);
+
+		return vertexArray;
+	}
+
+	// draws instanceCount instances of mesh starting at baseInstance, the vertex array has to be bound
+	// ------------------------------------------------------------------------
+	void draw(unsigned int mesh, GLsizei instanceCount, GLuint baseInstance) const
+	{
+		const MeshRange& range = ranges[mesh];
+		glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT,
+			(void*)(range.firstIndex * sizeof(GLuint)), instanceCount, range.baseVertex, baseInstance);
+		glState.countDraw();
+	}
+
+	void release()
+	{
+		glState.deleteVertexArrays(1, &vertexArray);
+		glState.deleteBuffers(1, &vertexBuffer);
+		glState.deleteBuffers(1, &elementBuffer);
+		glState.deleteBuffers(1, &rangeBuffer);
+		vertexArray = 0;
+		vertexBuffer = 0;
+		elementBuffer = 0;
+		rangeBuffer = 0;
+	}
+
+	unsigned int getMeshCount() const
+	{
+		return (unsigned int)ranges.size();
+	}
+
+	const std::string& getName(unsigned int mesh) const
+	{
+		return names[mesh];
+	}
+
+	const glm::vec3& getSize(unsigned int mesh) const
+	{
+		return sizes[mesh];
+	}
+
+	GLuint getVertexArray() const
+	{
+		return vertexArray;
+	}
+
+	// the MeshRange of every mesh for the culling shader
+	GLuint getRangeBuffer() const
+	{
+		return rangeBuffer;
+	}
+
+private:
+	std::vector<float> vertexData;
+	std::vector<GLuint> indexData;
+	std::vector<MeshRange> ranges;
+	std::vector<std::string> names;
+	std::vector<glm::vec3> sizes;
+
+	GLuint vertexArray = 0;
+	GLuint vertexBuffer = 0;
+	GLuint elementBuffer = 0;
+	GLuint rangeBuffer = 0;
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+/*
+ Model and normal matrices on the GPU.
+ Object records carry a translation, rotation and scale instead of a matrix. One dispatch of
+ object_transforms.comp turns every record of an object buffer into its model matrix and the
+ rotation * inverse(scale) normal matrix, which vertex.vert reads from OBJECT_MATRIX_BINDING. The
+ classic path streams its records every frame and has them transformed into a buffer owned here, the
+ GPU-driven path transforms its scene buffer into a buffer of its own when the scene changes, and only
+ the ranges of records that moved while it animates.
+*/
+
+#include <GL/glew.h>
+
+#include "Shader.h"
+#include "GLState.h"
+#include "Scene.h"
+#include "StartupLoader.h"
+#include "MemoryTracker.h"
+
+class ObjectTransforms
+{
+public:
+	ObjectTransforms() {}
+
+	// both paths need the matrices for every frame
+	void requestShaders(StartupLoader& loader)
+	{
+		loader.addComputeProgram(transformShader, "./Shaders/object_transforms.comp", true);
+	}
+
+	// matrices for up to capacity objects of the classic path
+	// ------------------------------------------------------------------------
+	void init(unsigned int capacity)
+	{
+		if (capacity <= frameCapacity)
+		{
+			return;
+		}
+
+		glState.deleteBuffers(1, &frameMatrixBuffer);
+		frameMatrixBuffer = 0;
+		frameCapacity = capacity;
+
+		MemoryScope scope(MEMORY_TAG_STREAMING);
+		frameMatrixBuffer = gpuMemory.createBuffer(frameCapacity * sizeof(ObjectMatrices), NULL, 0);
+	}
+
+	// writes the matrices of count records, starting with record firstObject of the records at
+	// objectOffset, into the same slots of matrixBuffer, they can be read by the draws issued after it
+	// ------------------------------------------------------------------------
+	void compute(GLuint objectBuffer, GLintptr objectOffset, GLuint firstObject, GLuint count, GLuint matrixBuffer)
+	{
+		if (count == 0)
+		{
+			return;
+		}
+
+		//the whole buffers are bound, an offset of firstObject records would rarely meet the binding alignment
+		glState.bindBufferRange(GL_SHADER_STORAGE_BUFFER, OBJECT_BUFFER_BINDING, objectBuffer, objectOffset, (firstObject + count) * sizeof(ObjectData));
+		glState.bindBufferRange(GL_SHADER_STORAGE_BUFFER, OBJECT_MATRIX_BINDING, matrixBuffer, 0, (firstObject + count) * sizeof(ObjectMatrices));
+
+		transformShader.use();
+		transformShader.setUint("firstObject", firstObject);
+		transformShader.setUint("objectCount", count);
+
+		glDispatchCompute((count + 63) / 64, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	}
+
+	// the classic path's records of this frame, the matrices stay bound for its draws
+	// ------------------------------------------------------------------------
+	void computeFrame(GLuint objectBuffer, GLintptr objectOffset, GLuint count)
+	{
+		compute(objectBuffer, objectOffset, 0, count < frameCapacity ? count : frameCapacity, frameMatrixBuffer);
+	}
+
+	// binds the records and matrices computeFrame() saw again, for draws after passes that bound others
+	// ------------------------------------------------------------------------
+	void bindFrame(GLuint objectBuffer, GLintptr objectOffset, GLuint count)
+	{
+		count = count < frameCapacity ? count : frameCapacity;
+		glState.bindBufferRange(GL_SHADER_STORAGE_BUFFER, OBJECT_BUFFER_BINDING, objectBuffer, objectOffset, count * sizeof(ObjectData));
+		glState.bindBufferRange(GL_SHADER_STORAGE_BUFFER, OBJECT_MATRIX_BINDING, frameMatrixBuffer, 0, count * sizeof(ObjectMatrices));
+	}
+
+	void release()
+	{
+		glState.deleteBuffers(1, &frameMatrixBuffer);
+		frameMatrixBuffer = 0;
+		frameCapacity = 0;
+		glState.deleteProgram(transformShader.ID);
+	}
+
+private:
+	Shader transformShader;
+	GLuint frameMatrixBuffer = 0;
+	unsigned int frameCapacity = 0;
+};
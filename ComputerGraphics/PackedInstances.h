@@ -0,0 +1,586 @@
+#pragma once
+
+/*
+ Compact object records for very large scenes.
+ The objects are placed by a translation, rotation and scale and share a small number of materials,
+ yet an object record with all of it in floats and the matrices computed from it take 256 bytes per
+ object on the GPU-driven path. A PackedInstance holds the same in 24 bytes: the position as 16 bit
+ fixed point inside a cell whose origin is kept in a table, the scale as half floats, the
+ rotation as the three smallest components of the quaternion with 10 bits each next to the index of
+ the one that was left out, and indices into a material palette and the MeshRegistry.
+ The PACKED_INSTANCES variant of vertex.vert decodes a record into the model and normal matrix, the
+ fragment shader reads the material from the palette, so no matrices are stored at all. Materials
+ that only differ below the palette precision share an entry, the colors get a coarser precision when
+ the scene has more materials than a 16 bit index can reach. The cell size is the smallest power of two
+ from MIN_CELL_SIZE on at which the cells of the scene fit the table, a small scene gets a finer step.
+ Every record is decoded on the CPU again and its model matrix compared to the one of the original
+ transform. An object whose matrix is off by more than MAX_ERROR, or by more than MAX_THIN_ERROR of its
+ thinnest side, keeps its exact transform in a separate table and its record points there, like one
+ that does not find room in the cells. Thin parts lying on others, the mirror on its table, would
+ z-fight with them otherwise.
+*/
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <vector>
+#include <map>
+#include <set>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#include "GLState.h"
+#include "Scene.h"
+#include "MemoryTracker.h"
+
+struct PackedInstanceStats {
+	unsigned int objects = 0;
+	unsigned int cells = 0;
+	float cellSize = 0.0f;
+	unsigned int materials = 0;		// entries of the palette
+	float colorStep = 0.0f;			// of the palette colors, 0 when they are exact
+	unsigned int exactObjects = 0;	// kept with their exact transform
+	float positionError = 0.0f;		// largest distance to the original translation
+	float scaleError = 0.0f;		// largest relative one
+	float rotationError = 0.0f;		// largest angle in degrees
+	float matrixError = 0.0f;		// largest distance a corner of the unit cube moved
+	float colorError = 0.0f;		// largest of a color channel of a material
+	double milliseconds = 0.0;		// of the last pack()
+};
+
+class PackedInstances
+{
+public:
+	static constexpr float MIN_CELL_SIZE = 1.0f;	// the position step is the cell size / 65535
+	static constexpr float MAX_CELL_SIZE = 1024.0f;
+	static const unsigned int MAX_CELLS = 65535;
+	static const unsigned int EXACT_CELL = 65535;	// the rotation of the record is the index of an exact transform
+	static const unsigned int MAX_MATERIALS = 65536;
+	static constexpr float MAX_ERROR = 0.0002f;		// of a corner of the unit cube, in meters
+	static constexpr float MAX_THIN_ERROR = 0.1f;	// of the thinnest side of the object
+
+	PackedInstanceStats stats;
+
+	PackedInstances() {}
+
+	// builds the palette and the cells of objects and uploads their records, false when the scene does
+	// not fit the encoding
+	// ------------------------------------------------------------------------
+	bool pack(const std::vector<ObjectData>& objects)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		stats = PackedInstanceStats();
+
+		if (!buildPalette(objects))
+		{
+			std::cout << "ERROR::PACKED_INSTANCES::TOO_MANY_MATERIALS" << std::endl;
+			return false;
+		}
+
+		cellOrigins.clear();
+		cellIndices.clear();
+		exactTransforms.clear();
+		cellSize = chooseCellSize(objects);
+		stats.cellSize = cellSize;
+		{
+			MemoryScope scope(MEMORY_TAG_GPU_DRIVEN);
+			records.assign(objects.size(), PackedInstance());
+		}
+		for (size_t i = 0; i < objects.size(); i++)
+		{
+			encode(objects[i], records[i]);
+		}
+
+		reserve(instanceBuffer, instanceBytes, records.size() * sizeof(PackedInstance));
+		glNamedBufferSubData(instanceBuffer, 0, records.size() * sizeof(PackedInstance), records.data());
+		uploadPalette();
+		uploadCells();
+		uploadExactTransforms(0, (unsigned int)exactTransforms.size());
+
+		stats.objects = (unsigned int)objects.size();
+		stats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		return true;
+	}
+
+	// packs and uploads the records of the ranges again, for the objects that moved or changed their
+	// material. An object that moved out of the cells of the scene adds its cell, or keeps its exact
+	// transform when the cells are full. A material that was not packed is added to the palette
+	// ------------------------------------------------------------------------
+	void updateRanges(const std::vector<ObjectData>& objects, const std::vector<ObjectRange>& ranges)
+	{
+		size_t cellCount = cellOrigins.size();
+		size_t materialCount = palette.size();
+		unsigned int firstExact = (unsigned int)exactTransforms.size();
+		unsigned int endExact = 0;
+		for (size_t i = 0; i < ranges.size(); i++)
+		{
+			const ObjectRange& range = ranges[i];
+			for (unsigned int j = range.first; j < range.first + range.count; j++)
+			{
+				encode(objects[j], records[j]);
+				if (records[j].cell == EXACT_CELL)
+				{
+					firstExact = records[j].rotation < firstExact ? records[j].rotation : firstExact;
+					endExact = records[j].rotation + 1 > endExact ? records[j].rotation + 1 : endExact;
+				}
+			}
+			glNamedBufferSubData(instanceBuffer, range.first * sizeof(PackedInstance), range.count * sizeof(PackedInstance), &records[range.first]);
+		}
+
+		if (cellOrigins.size() != cellCount)
+		{
+			uploadCells();
+		}
+		if (palette.size() != materialCount)
+		{
+			uploadPalette();
+		}
+		uploadExactTransforms(firstExact, endExact);
+	}
+
+	// the records, the cell origins and the palette, for the culling shader and the PACKED_INSTANCES variant
+	// ------------------------------------------------------------------------
+	void bind() const
+	{
+		glState.bindBufferBase(GL_SHADER_STORAGE_BUFFER, PACKED_INSTANCE_BINDING, instanceBuffer);
+		glState.bindBufferBase(GL_SHADER_STORAGE_BUFFER, CELL_ORIGIN_BINDING, cellBuffer);
+		glState.bindBufferBase(GL_SHADER_STORAGE_BUFFER, MATERIAL_PALETTE_BINDING, paletteBuffer);
+		glState.bindBufferBase(GL_SHADER_STORAGE_BUFFER, EXACT_TRANSFORM_BINDING, exactBuffer);
+	}
+
+	void printStats() const
+	{
+		double packedKilobytes = (stats.objects * sizeof(PackedInstance) + stats.cells * sizeof(glm::vec4) + stats.materials * sizeof(Material)
+			+ stats.exactObjects * sizeof(ObjectTransform)) / 1024.0;
+		double unpackedKilobytes = stats.objects * (sizeof(ObjectData) + sizeof(ObjectMatrices)) / 1024.0;
+		std::cout << "Packed instances: " << stats.objects << " objects in " << packedKilobytes << " KB instead of " << unpackedKilobytes
+			<< " KB of records and matrices (" << (packedKilobytes > 0.0 ? unpackedKilobytes / packedKilobytes : 0.0) << "x), "
+			<< stats.cells << " cells of " << stats.cellSize << ", " << stats.materials << " palette materials";
+		if (stats.colorStep > 0.0f)
+		{
+			std::cout << " with colors in steps of " << stats.colorStep;
+		}
+		std::cout << ", " << stats.exactObjects << " kept exact; largest error: position " << stats.positionError * 1000.0f << " mm, scale "
+			<< stats.scaleError * 100.0f << "%, rotation " << stats.rotationError << " degrees, matrix " << stats.matrixError * 1000.0f
+			<< " mm, color " << stats.colorError << "; packed in " << stats.milliseconds << " ms" << std::endl;
+	}
+
+	// the GPU buffers and the CPU copy of the records
+	// ------------------------------------------------------------------------
+	void release()
+	{
+		releaseBuffers();
+		std::vector<PackedInstance>().swap(records);
+		std::vector<Material>().swap(palette);
+		std::vector<glm::vec4>().swap(cellOrigins);
+		std::vector<ObjectTransform>().swap(exactTransforms);
+		paletteIndices.clear();
+		cellIndices.clear();
+	}
+
+private:
+	// the colors of a material in steps of the palette precision, the rest as bits so the opacity, which
+	// decides about the translucent pass, stays exact
+	struct MaterialKey {
+		int values[17];
+
+		bool operator<(const MaterialKey& other) const
+		{
+			return memcmp(values, other.values, sizeof(values)) < 0;
+		}
+	};
+
+	GLuint instanceBuffer = 0;
+	GLuint paletteBuffer = 0;
+	GLuint cellBuffer = 0;
+	GLuint exactBuffer = 0;
+	GLsizeiptr instanceBytes = 0;
+	GLsizeiptr paletteCapacity = 0;
+	GLsizeiptr cellCapacity = 0;
+	GLsizeiptr exactCapacity = 0;
+
+	// CPU copy of the uploaded records, for the ranges that are packed again
+	std::vector<PackedInstance> records;
+
+	std::vector<Material> palette;
+	std::map<MaterialKey, unsigned int> paletteIndices;
+	float colorStep = 0.0f;
+
+	std::vector<glm::vec4> cellOrigins;		// xyz the origin, w the size
+	std::map<long long, unsigned int> cellIndices;
+	float cellSize = MIN_CELL_SIZE;
+
+	// of the objects the encoding is not precise enough for, or that found no cell
+	std::vector<ObjectTransform> exactTransforms;
+
+	// exact colors first, then coarser steps until the materials fit the palette
+	bool buildPalette(const std::vector<ObjectData>& objects)
+	{
+		static const float colorSteps[] = { 0.0f, 1.0f / 1024.0f, 1.0f / 512.0f, 1.0f / 256.0f, 1.0f / 128.0f, 1.0f / 64.0f };
+
+		MemoryScope scope(MEMORY_TAG_GPU_DRIVEN);
+		for (size_t step = 0; step < sizeof(colorSteps) / sizeof(colorSteps[0]); step++)
+		{
+			colorStep = colorSteps[step];
+			palette.clear();
+			paletteIndices.clear();
+
+			bool fits = true;
+			for (size_t i = 0; i < objects.size() && fits; i++)
+			{
+				fits = findMaterial(objects[i].material) < MAX_MATERIALS;
+			}
+			if (fits)
+			{
+				stats.colorStep = colorStep;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// index of the palette entry of material, added when there is room. MAX_MATERIALS when there is none
+	unsigned int findMaterial(const Material& material)
+	{
+		MaterialKey key = getKey(material);
+		std::map<MaterialKey, unsigned int>::iterator it = paletteIndices.find(key);
+		if (it != paletteIndices.end())
+		{
+			return it->second;
+		}
+		if (palette.size() >= MAX_MATERIALS)
+		{
+			return MAX_MATERIALS;
+		}
+
+		Material entry = material;
+		if (colorStep > 0.0f)
+		{
+			float* colors[4] = { &entry.emission.x, &entry.ambient.x, &entry.diffuse.x, &entry.specular.x };
+			for (int i = 0; i < 12; i++)
+			{
+				float& channel = colors[i / 3][i % 3];
+				channel = key.values[i] * colorStep;
+			}
+		}
+
+		MemoryScope scope(MEMORY_TAG_GPU_DRIVEN);
+		unsigned int index = (unsigned int)palette.size();
+		palette.push_back(entry);
+		paletteIndices[key] = index;
+		return index;
+	}
+
+	MaterialKey getKey(const Material& material) const
+	{
+		MaterialKey key;
+		const float* colors[4] = { &material.emission.x, &material.ambient.x, &material.diffuse.x, &material.specular.x };
+		for (int i = 0; i < 12; i++)
+		{
+			float channel = colors[i / 3][i % 3];
+			if (colorStep > 0.0f)
+			{
+				key.values[i] = (int)std::floor(channel / colorStep + 0.5f);
+			}
+			else
+			{
+				memcpy(&key.values[i], &channel, sizeof(float));
+			}
+		}
+		const float exact[5] = { material.opacity, material.ka, material.kd, material.ks, material.shininess };
+		memcpy(&key.values[12], exact, sizeof(exact));
+		return key;
+	}
+
+	// the smallest power of two from MIN_CELL_SIZE on at which the cells of objects fit MAX_CELLS. The
+	// objects that do not find room even in the cells of MAX_CELL_SIZE keep their exact transform
+	float chooseCellSize(const std::vector<ObjectData>& objects) const
+	{
+		std::set<long long> cells;
+		for (float size = MIN_CELL_SIZE; size < MAX_CELL_SIZE; size *= 2.0f)
+		{
+			cells.clear();
+			for (size_t i = 0; i < objects.size() && cells.size() <= MAX_CELLS; i++)
+			{
+				cells.insert(getCellKey(objects[i].transform.translation, size));
+			}
+			if (cells.size() <= MAX_CELLS)
+			{
+				return size;
+			}
+		}
+		return MAX_CELL_SIZE;
+	}
+
+	static long long getCellKey(const glm::vec3& translation, float size)
+	{
+		long long x = (long long)std::floor(translation.x / size);
+		long long y = (long long)std::floor(translation.y / size);
+		long long z = (long long)std::floor(translation.z / size);
+		return ((x & 0x1FFFFF) << 42) | ((y & 0x1FFFFF) << 21) | (z & 0x1FFFFF);
+	}
+
+	// index of the cell translation lies in, a new one is added when there is room, MAX_CELLS when there
+	// is none
+	unsigned int findCell(const glm::vec3& translation)
+	{
+		long long key = getCellKey(translation, cellSize);
+		std::map<long long, unsigned int>::iterator it = cellIndices.find(key);
+		if (it != cellIndices.end())
+		{
+			return it->second;
+		}
+		if (cellOrigins.size() >= MAX_CELLS)
+		{
+			return MAX_CELLS;
+		}
+
+		MemoryScope scope(MEMORY_TAG_GPU_DRIVEN);
+		unsigned int index = (unsigned int)cellOrigins.size();
+		cellOrigins.push_back(glm::vec4(std::floor(translation.x / cellSize) * cellSize, std::floor(translation.y / cellSize) * cellSize,
+			std::floor(translation.z / cellSize) * cellSize, cellSize));
+		cellIndices[key] = index;
+		return index;
+	}
+
+	// writes the record of object, with its exact transform when the encoding is off by more than the
+	// error bound or there is no cell. A record that has an exact transform keeps it until the next pack()
+	void encode(const ObjectData& object, PackedInstance& record)
+	{
+		const ObjectTransform& transform = object.transform;
+
+		unsigned int material = findMaterial(object.material);
+		if (material >= MAX_MATERIALS)
+		{
+			std::cout << "ERROR::PACKED_INSTANCES::TOO_MANY_MATERIALS" << std::endl;
+			material = 0;
+		}
+		record.material = (unsigned short)material;
+		record.mesh = object.mesh;
+		if (record.cell == EXACT_CELL)
+		{
+			exactTransforms[record.rotation] = transform;
+			return;
+		}
+
+		unsigned int cell = findCell(transform.translation);
+		if (cell < MAX_CELLS)
+		{
+			glm::vec4 origin = cellOrigins[cell];
+			for (int i = 0; i < 3; i++)
+			{
+				float position = (transform.translation[i] - origin[i]) / origin.w;
+				position = position < 0.0f ? 0.0f : (position > 1.0f ? 1.0f : position);
+				record.position[i] = (unsigned short)std::floor(position * 65535.0f + 0.5f);
+				record.scale[i] = glm::packHalf1x16(transform.scale[i]);
+			}
+			record.cell = (unsigned short)cell;
+			record.rotation = encodeRotation(transform.rotation);
+
+			if (measure(object, record))
+			{
+				return;
+			}
+		}
+
+		for (int i = 0; i < 3; i++)
+		{
+			record.position[i] = 0;
+			record.scale[i] = 0;
+		}
+		record.cell = (unsigned short)EXACT_CELL;
+		record.rotation = (unsigned int)exactTransforms.size();
+
+		MemoryScope scope(MEMORY_TAG_GPU_DRIVEN);
+		exactTransforms.push_back(transform);
+		stats.exactObjects = (unsigned int)exactTransforms.size();
+	}
+
+	// the component with the largest magnitude is left out and made positive, the others fit in
+	// [-1/sqrt(2), 1/sqrt(2)]. 0 and the components of the quarter turns are exact
+	static unsigned int encodeRotation(const glm::vec4& rotation)
+	{
+		int largest = 0;
+		for (int i = 1; i < 4; i++)
+		{
+			if (std::fabs(rotation[i]) > std::fabs(rotation[largest]))
+			{
+				largest = i;
+			}
+		}
+		float sign = rotation[largest] < 0.0f ? -1.0f : 1.0f;
+
+		unsigned int bits = (unsigned int)largest << 30;
+		int shift = 20;
+		for (int i = 0; i < 4; i++)
+		{
+			if (i == largest)
+			{
+				continue;
+			}
+			float component = sign * rotation[i] * 1.41421356f;
+			component = component < -1.0f ? -1.0f : (component > 1.0f ? 1.0f : component);
+			bits |= (unsigned int)std::floor(component * 511.0f + 511.5f) << shift;
+			shift -= 10;
+		}
+		return bits;
+	}
+
+	// the decoding of vertex.vert
+	static glm::vec4 decodeRotation(unsigned int bits)
+	{
+		int largest = (int)(bits >> 30);
+		glm::vec4 rotation;
+		float sum = 0.0f;
+		int shift = 20;
+		for (int i = 0; i < 4; i++)
+		{
+			if (i == largest)
+			{
+				continue;
+			}
+			rotation[i] = (((bits >> shift) & 1023u) / 511.0f - 1.0f) * 0.70710678f;
+			sum += rotation[i] * rotation[i];
+			shift -= 10;
+		}
+		rotation[largest] = std::sqrt(sum < 1.0f ? 1.0f - sum : 0.0f);
+		return rotation;
+	}
+
+	// the decoding of vertex.vert
+	glm::mat4 decodeModelMatrix(const PackedInstance& record) const
+	{
+		ObjectTransform decoded;
+		glm::vec4 origin = cellOrigins[record.cell];
+		for (int i = 0; i < 3; i++)
+		{
+			decoded.translation[i] = origin[i] + record.position[i] / 65535.0f * origin.w;
+			decoded.scale[i] = glm::unpackHalf1x16(record.scale[i]);
+		}
+		decoded.rotation = decodeRotation(record.rotation);
+		return getModelMatrix(decoded);
+	}
+
+	// compares the decoded model matrix of record to the one of object, false when it is off by more than
+	// the error bound. The errors of the records that stay packed go into the stats
+	bool measure(const ObjectData& object, const PackedInstance& record)
+	{
+		const ObjectTransform& transform = object.transform;
+
+		//the largest distance a corner of the unit cube moved
+		glm::mat4 decoded = decodeModelMatrix(record);
+		glm::mat4 model = getModelMatrix(transform);
+		float matrixError = glm::length(glm::vec3(decoded[3] - model[3]));
+		for (int i = 0; i < 3; i++)
+		{
+			matrixError += 0.5f * glm::length(glm::vec3(decoded[i] - model[i]));
+		}
+		glm::vec3 size = glm::abs(transform.scale);
+		float thinnest = size.x < size.y ? (size.x < size.z ? size.x : size.z) : (size.y < size.z ? size.y : size.z);
+		if (matrixError > MAX_ERROR || matrixError > MAX_THIN_ERROR * thinnest)
+		{
+			return false;
+		}
+		stats.matrixError = matrixError > stats.matrixError ? matrixError : stats.matrixError;
+
+		glm::vec4 origin = cellOrigins[record.cell];
+		glm::vec3 offset;
+		for (int i = 0; i < 3; i++)
+		{
+			offset[i] = origin[i] + record.position[i] / 65535.0f * origin.w - transform.translation[i];
+
+			float scale = transform.scale[i];
+			if (scale != 0.0f)
+			{
+				float scaleError = std::fabs(glm::unpackHalf1x16(record.scale[i]) - scale) / std::fabs(scale);
+				stats.scaleError = scaleError > stats.scaleError ? scaleError : stats.scaleError;
+			}
+		}
+		float positionError = std::sqrt(glm::dot(offset, offset));
+		stats.positionError = positionError > stats.positionError ? positionError : stats.positionError;
+
+		glm::vec4 rotation = decodeRotation(record.rotation);
+		double cosine = std::fabs((double)rotation.x * transform.rotation.x + (double)rotation.y * transform.rotation.y
+			+ (double)rotation.z * transform.rotation.z + (double)rotation.w * transform.rotation.w);
+		float rotationError = (float)(2.0 * std::acos(cosine < 1.0 ? cosine : 1.0) * 57.29577951);
+		stats.rotationError = rotationError > stats.rotationError ? rotationError : stats.rotationError;
+
+		const Material& entry = palette[record.material];
+		const float* colors[4] = { &object.material.emission.x, &object.material.ambient.x, &object.material.diffuse.x, &object.material.specular.x };
+		const float* entryColors[4] = { &entry.emission.x, &entry.ambient.x, &entry.diffuse.x, &entry.specular.x };
+		for (int i = 0; i < 12; i++)
+		{
+			float colorError = std::fabs(colors[i / 3][i % 3] - entryColors[i / 3][i % 3]);
+			stats.colorError = colorError > stats.colorError ? colorError : stats.colorError;
+		}
+		return true;
+	}
+
+	// recreates buffer when bytes do not fit its capacity, with room for the tables to grow
+	void reserve(GLuint& buffer, GLsizeiptr& capacity, GLsizeiptr bytes)
+	{
+		if (bytes <= capacity)
+		{
+			return;
+		}
+		glState.deleteBuffers(1, &buffer);
+		capacity = bytes > 2 * capacity ? bytes : 2 * capacity;
+
+		MemoryScope scope(MEMORY_TAG_GPU_DRIVEN);
+		buffer = gpuMemory.createBuffer(capacity, NULL, GL_DYNAMIC_STORAGE_BIT);
+	}
+
+	void uploadPalette()
+	{
+		stats.materials = (unsigned int)palette.size();
+		reserve(paletteBuffer, paletteCapacity, palette.size() * sizeof(Material));
+		glNamedBufferSubData(paletteBuffer, 0, palette.size() * sizeof(Material), palette.data());
+	}
+
+	void uploadCells()
+	{
+		stats.cells = (unsigned int)cellOrigins.size();
+		if (cellOrigins.empty())
+		{
+			return;
+		}
+		reserve(cellBuffer, cellCapacity, cellOrigins.size() * sizeof(glm::vec4));
+		glNamedBufferSubData(cellBuffer, 0, cellOrigins.size() * sizeof(glm::vec4), cellOrigins.data());
+	}
+
+	// the exact transforms from first to end, all of them when the buffer had to grow
+	void uploadExactTransforms(unsigned int first, unsigned int end)
+	{
+		if (first >= end)
+		{
+			return;
+		}
+		GLsizeiptr capacity = exactCapacity;
+		reserve(exactBuffer, exactCapacity, exactTransforms.size() * sizeof(ObjectTransform));
+		if (exactCapacity != capacity)
+		{
+			first = 0;
+			end = (unsigned int)exactTransforms.size();
+		}
+		glNamedBufferSubData(exactBuffer, first * sizeof(ObjectTransform), (end - first) * sizeof(ObjectTransform), &exactTransforms[first]);
+	}
+
+	void releaseBuffers()
+	{
+		glState.deleteBuffers(1, &instanceBuffer);
+		glState.deleteBuffers(1, &paletteBuffer);
+		glState.deleteBuffers(1, &cellBuffer);
+		glState.deleteBuffers(1, &exactBuffer);
+		instanceBuffer = 0;
+		paletteBuffer = 0;
+		cellBuffer = 0;
+		exactBuffer = 0;
+		instanceBytes = 0;
+		paletteCapacity = 0;
+		cellCapacity = 0;
+		exactCapacity = 0;
+	}
+};
@@ -0,0 +1,460 @@
+#pragma once
+
+/*
+ Planar reflection of the mirror.
+ The opaque scene is rendered from the camera mirrored in the mirror's plane into a texture that covers
+ the render size at a fraction of its resolution. The near plane of the mirrored projection is moved
+ onto the mirror (Lengyel's oblique near plane), so nothing behind the mirror gets into the reflection,
+ and a scissor keeps the drawing inside the rectangle the mirror covers on screen. The objects are culled
+ against the mirrored frustum narrowed to that rectangle, by the culling shader on the GPU-driven path.
+ A second pass draws the mirror's front face over the scene color with the reflection at the same
+ screen position.
+ The texture is kept from frame to frame. It is rendered again when the camera moves, when the lamps
+ change or when an object that moved can be seen in the mirror, otherwise the mirror pass reuses it.
+ While the mirror is outside the view or the camera is behind it neither pass is declared.
+*/
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+
+#include "Shader.h"
+#include "GLState.h"
+#include "Scene.h"
+#include "FrameGraph.h"
+#include "StartupLoader.h"
+#include "GpuDrivenRenderer.h"
+#include "MemoryTracker.h"
+
+struct PlanarReflectionStats {
+	unsigned int renderedFrames = 0;	// the reflection was rendered
+	unsigned int cachedFrames = 0;		// the mirror was drawn with the reflection of an earlier frame
+	unsigned int hiddenFrames = 0;		// the mirror was not in view, nothing was done for it
+	unsigned int drawnObjects = 0;		// by the classic path in the last rendered reflection
+	unsigned int culledObjects = 0;
+};
+
+class PlanarReflection
+{
+public:
+	static const int SCALE_COUNT = 3;
+	static constexpr float CLIP_OFFSET = 0.002f;	// of the near plane in front of the mirror
+
+	bool enabled = true;
+	float resolutionScale = 0.5f;	// of the render size
+	glm::vec3 tint = glm::vec3(0.85f, 0.93f, 0.95f);
+
+	PlanarReflectionStats stats;
+
+	PlanarReflection() {}
+
+	// the mirror is in the start view
+	void requestShaders(StartupLoader& loader)
+	{
+		loader.addProgram(mirrorShader, "./Shaders/mirror.vert", "./Shaders/mirror.frag", "", true);
+	}
+
+	void init()
+	{
+		glCreateVertexArrays(1, &emptyVertexArray);
+	}
+
+	// steps through full, half and quarter resolution and switches the reflection off after the last one
+	// ------------------------------------------------------------------------
+	void cycleSetting()
+	{
+		static const float scales[SCALE_COUNT] = { 1.0f, 0.5f, 0.25f };
+
+		int next = 0;
+		if (enabled)
+		{
+			next = SCALE_COUNT;
+			for (int i = 0; i < SCALE_COUNT; i++)
+			{
+				if (resolutionScale > scales[i] * 0.99f)
+				{
+					next = i + 1;
+					break;
+				}
+			}
+		}
+
+		enabled = next < SCALE_COUNT;
+		if (enabled)
+		{
+			resolutionScale = scales[next];
+			std::cout << "Mirror reflection at " << resolutionScale << " of the render resolution" << std::endl;
+		}
+		else
+		{
+			std::cout << "Mirror reflection off" << std::endl;
+		}
+	}
+
+	// front face of the mirror as a corner and its two edges, the reflecting side is the one edgeU x edgeV
+	// points to
+	// ------------------------------------------------------------------------
+	void setMirror(const glm::vec3& corner, const glm::vec3& edgeU, const glm::vec3& edgeV)
+	{
+		mirrorCorner = corner;
+		mirrorEdgeU = edgeU;
+		mirrorEdgeV = edgeV;
+
+		glm::vec3 normal = glm::normalize(glm::cross(edgeU, edgeV));
+		plane = glm::vec4(normal, -glm::dot(normal, corner));
+		valid = false;
+	}
+
+	// finds out whether the mirror is in view and sets up the mirrored camera of the frame, it comes before
+	// the scene is recorded or animated so objectMoved() can test against the mirrored frustum
+	// ------------------------------------------------------------------------
+	void beginFrame(const FrameData& frame, int renderWidth, int renderHeight, unsigned int features)
+	{
+		//what moves while the mirror is not drawn is not followed, it is rendered again when it comes back
+		visible = false;
+		stale = false;
+		if (!enabled)
+		{
+			valid = false;
+			return;
+		}
+
+		glm::vec3 normal = glm::vec3(plane);
+		glm::vec3 cameraPosition = glm::vec3(frame.viewPos);
+		float cameraDistance = glm::dot(normal, cameraPosition) + plane.w;
+		glm::mat4 viewProjection = frame.projection * frame.view;
+
+		glm::vec4 rect;
+		if (cameraDistance <= 0.0f || !getScreenRect(viewProjection, rect))
+		{
+			stats.hiddenFrames++;
+			valid = false;
+			return;
+		}
+		visible = true;
+
+		reflectedFrame.view = frame.view * getReflectionMatrix(plane);
+		reflectedFrame.viewPos = glm::vec4(cameraPosition - 2.0f * cameraDistance * normal, 1.0f);
+		//the plane in the mirrored view space, in front of the mirror is its positive side. It is moved off
+		//the mirror a little, so the mirror's own face does not end up on the near plane
+		glm::vec4 clipPlane = glm::vec4(normal, plane.w - CLIP_OFFSET);
+		glm::vec4 viewPlane = glm::transpose(glm::inverse(reflectedFrame.view)) * clipPlane;
+		reflectedFrame.projection = getObliqueProjection(frame.projection, viewPlane);
+
+		//the frustum through the mirror's rectangle, x and y of the rectangle are stretched to the clip range
+		glm::mat4 narrow(1.0f);
+		narrow[0][0] = 2.0f / (rect.z - rect.x);
+		narrow[3][0] = -(rect.z + rect.x) / (rect.z - rect.x);
+		narrow[1][1] = 2.0f / (rect.w - rect.y);
+		narrow[3][1] = -(rect.w + rect.y) / (rect.w - rect.y);
+		cullMatrix = narrow * reflectedFrame.projection * reflectedFrame.view;
+		GpuDrivenRenderer::extractFrustumPlanes(cullMatrix, cullPlanes);
+
+		int width = std::max(1, (int)(renderWidth * resolutionScale));
+		int height = std::max(1, (int)(renderHeight * resolutionScale));
+		if (width != textureWidth || height != textureHeight)
+		{
+			resize(width, height);
+		}
+
+		//a texel of margin for the bilinear filter of the mirror pass
+		int x0 = std::max(0, (int)std::floor((rect.x * 0.5f + 0.5f) * width) - 1);
+		int y0 = std::max(0, (int)std::floor((rect.y * 0.5f + 0.5f) * height) - 1);
+		int x1 = std::min(width, (int)std::ceil((rect.z * 0.5f + 0.5f) * width) + 1);
+		int y1 = std::min(height, (int)std::ceil((rect.w * 0.5f + 0.5f) * height) + 1);
+		scissor[0] = x0;
+		scissor[1] = y0;
+		scissor[2] = x1 - x0;
+		scissor[3] = y1 - y0;
+
+		stale = !valid || features != validFeatures || viewProjection != validViewProjection;
+		nextFeatures = features;
+		nextViewProjection = viewProjection;
+	}
+
+	bool isVisible() const
+	{
+		return visible;
+	}
+
+	// bounds an object that moved this frame had before or has after the motion, given once for each so
+	// the reflection is rendered again when the object moves out of it as well as into it
+	void objectMoved(const ObjectBounds& bounds)
+	{
+		if (visible && !stale && intersects(bounds))
+		{
+			stale = true;
+		}
+	}
+
+	// the scene changed as a whole
+	void invalidate()
+	{
+		valid = false;
+	}
+
+	// whether the bounds are inside the mirrored frustum of this frame
+	// ------------------------------------------------------------------------
+	bool intersects(const ObjectBounds& bounds) const
+	{
+		for (int i = 0; i < 6; i++)
+		{
+			const glm::vec4& cullPlane = cullPlanes[i];
+			float radius = glm::dot(glm::abs(glm::vec3(cullPlane)), glm::vec3(bounds.extents));
+			if (glm::dot(glm::vec3(cullPlane), glm::vec3(bounds.center)) + cullPlane.w < -radius)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// the reflection texture as a resource of this frame and, when it is out of date, the pass that renders
+	// it: draw is called with the texture and a depth target bound and the scissor set, it binds the
+	// mirrored frame data itself. -1 while the mirror is not in view
+	// ------------------------------------------------------------------------
+	template<typename Callback>
+	FrameGraphResource addReflectionPass(FrameGraph& graph, Callback&& draw)
+	{
+		if (!visible)
+		{
+			return -1;
+		}
+
+		if (targetsResized)
+		{
+			graph.forgetFramebuffers();
+			targetsResized = false;
+		}
+
+		FrameGraphTextureDesc desc(textureWidth, textureHeight, GL_R11F_G11F_B10F);
+		FrameGraphResource reflection = graph.importTexture("Reflection", texture, desc);
+		if (!stale)
+		{
+			stats.cachedFrames++;
+			return reflection;
+		}
+
+		//the depth target is kept with the texture, a transient one would idle in the pool while the
+		//reflection is reused and be deleted and created again
+		FrameGraphResource depth = graph.importTexture("ReflectionDepth", depthTexture, FrameGraphTextureDesc(textureWidth, textureHeight, GL_DEPTH_COMPONENT32F));
+		int reflectionPass = graph.addPass("Reflection", [this, draw](const FrameGraph&) {
+			glState.setEnabled(GL_SCISSOR_TEST, true);
+			glScissor(scissor[0], scissor[1], scissor[2], scissor[3]);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			draw();
+			glState.setEnabled(GL_SCISSOR_TEST, false);
+		});
+		graph.writeColor(reflectionPass, reflection);
+		graph.writeDepth(reflectionPass, depth);
+
+		//an imported target keeps the pass alive, so the texture is up to date once the frame has run
+		valid = true;
+		validFeatures = nextFeatures;
+		validViewProjection = nextViewProjection;
+		stats.renderedFrames++;
+		return reflection;
+	}
+
+	// draws the mirror with the reflection over the scene color, after the scene pass
+	// ------------------------------------------------------------------------
+	void addMirrorPass(FrameGraph& graph, FrameGraphResource reflection, FrameGraphResource sceneColor, FrameGraphResource sceneDepth)
+	{
+		int mirrorPass = graph.addPass("Mirror", [this, reflection, sceneColor](const FrameGraph& graph) {
+			drawMirror(graph.getTexture(reflection), graph.getDesc(sceneColor));
+		});
+		graph.read(mirrorPass, reflection);
+		graph.writeColor(mirrorPass, sceneColor);
+		//only tested, objects in front of the mirror cover it
+		graph.writeDepth(mirrorPass, sceneDepth);
+	}
+
+	// frame data of the mirrored camera, for the scene shader in the reflection pass
+	const FrameData& getReflectedFrame() const
+	{
+		return reflectedFrame;
+	}
+
+	// mirrored frustum narrowed to the mirror, for the culling shader
+	const glm::mat4& getCullMatrix() const
+	{
+		return cullMatrix;
+	}
+
+	void printStats() const
+	{
+		std::cout << "Mirror reflection: rendered in " << stats.renderedFrames << " frames, reused in " << stats.cachedFrames
+			<< ", not in view in " << stats.hiddenFrames << "; the last one drew " << stats.drawnObjects << " objects and culled "
+			<< stats.culledObjects << " on the classic path, " << textureWidth << "x" << textureHeight << std::endl;
+	}
+
+	void release()
+	{
+		glState.deleteTextures(1, &texture);
+		glState.deleteTextures(1, &depthTexture);
+		glState.deleteVertexArrays(1, &emptyVertexArray);
+		glState.deleteProgram(mirrorShader.ID);
+		texture = 0;
+		depthTexture = 0;
+		emptyVertexArray = 0;
+		textureWidth = 0;
+		textureHeight = 0;
+		valid = false;
+	}
+
+	// reflection in the plane dot(plane.xyz, x) + plane.w = 0, plane.xyz of unit length
+	static glm::mat4 getReflectionMatrix(const glm::vec4& plane)
+	{
+		glm::vec3 n = glm::vec3(plane);
+		glm::mat4 reflection(1.0f);
+		for (int column = 0; column < 3; column++)
+		{
+			for (int row = 0; row < 3; row++)
+			{
+				reflection[column][row] -= 2.0f * n[row] * n[column];
+			}
+			reflection[3][column] = -2.0f * plane.w * n[column];
+		}
+		return reflection;
+	}
+
+	// replaces the near plane of an OpenGL projection with a view space plane the camera is behind,
+	// Lengyel's oblique near plane clipping
+	static glm::mat4 getObliqueProjection(glm::mat4 projection, const glm::vec4& viewPlane)
+	{
+		//the corner of the frustum opposite to the plane, in clip space at the far plane
+		glm::vec4 q;
+		q.x = (sign(viewPlane.x) + projection[2][0]) / projection[0][0];
+		q.y = (sign(viewPlane.y) + projection[2][1]) / projection[1][1];
+		q.z = -1.0f;
+		q.w = (1.0f + projection[2][2]) / projection[3][2];
+
+		glm::vec4 c = viewPlane * (2.0f / glm::dot(viewPlane, q));
+		projection[0][2] = c.x;
+		projection[1][2] = c.y;
+		projection[2][2] = c.z + 1.0f;
+		projection[3][2] = c.w;
+		return projection;
+	}
+
+private:
+	Shader mirrorShader;
+	GLuint emptyVertexArray = 0;
+
+	glm::vec3 mirrorCorner = glm::vec3(0.0f);
+	glm::vec3 mirrorEdgeU = glm::vec3(1.0f, 0.0f, 0.0f);
+	glm::vec3 mirrorEdgeV = glm::vec3(0.0f, 1.0f, 0.0f);
+	glm::vec4 plane = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+
+	GLuint texture = 0;
+	GLuint depthTexture = 0;
+	int textureWidth = 0;
+	int textureHeight = 0;
+	bool targetsResized = false;	// the graph may still have framebuffers with the old ones
+
+	// this frame
+	bool visible = false;
+	bool stale = false;
+	FrameData reflectedFrame;
+	glm::mat4 cullMatrix = glm::mat4(1.0f);
+	glm::vec4 cullPlanes[6];
+	GLint scissor[4] = { 0, 0, 0, 0 };
+	unsigned int nextFeatures = 0;
+	glm::mat4 nextViewProjection = glm::mat4(1.0f);
+
+	// what the texture holds
+	bool valid = false;
+	unsigned int validFeatures = 0;
+	glm::mat4 validViewProjection = glm::mat4(1.0f);
+
+	static float sign(float value)
+	{
+		return value > 0.0f ? 1.0f : (value < 0.0f ? -1.0f : 0.0f);
+	}
+
+	void resize(int width, int height)
+	{
+		glState.deleteTextures(1, &texture);
+		glState.deleteTextures(1, &depthTexture);
+
+		MemoryScope scope(MEMORY_TAG_RENDER_TARGETS);
+		depthTexture = gpuMemory.createTexture2D(1, GL_DEPTH_COMPONENT32F, width, height);
+		texture = gpuMemory.createTexture2D(1, GL_R11F_G11F_B10F, width, height);
+		glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+		textureWidth = width;
+		textureHeight = height;
+		targetsResized = true;
+		valid = false;
+	}
+
+	// NDC rectangle (x0, y0, x1, y1) of the mirror clipped to the screen, false when it is outside the
+	// view. The whole screen when the mirror reaches behind the camera
+	bool getScreenRect(const glm::mat4& viewProjection, glm::vec4& rect) const
+	{
+		glm::vec4 planes[6];
+		GpuDrivenRenderer::extractFrustumPlanes(viewProjection, planes);
+
+		glm::vec3 corners[4] = { mirrorCorner, mirrorCorner + mirrorEdgeU, mirrorCorner + mirrorEdgeV, mirrorCorner + mirrorEdgeU + mirrorEdgeV };
+		for (int i = 0; i < 6; i++)
+		{
+			bool outside = true;
+			for (int j = 0; j < 4 && outside; j++)
+			{
+				outside = glm::dot(glm::vec3(planes[i]), corners[j]) + planes[i].w < 0.0f;
+			}
+			if (outside)
+			{
+				return false;
+			}
+		}
+
+		rect = glm::vec4(1.0f, 1.0f, -1.0f, -1.0f);
+		for (int j = 0; j < 4; j++)
+		{
+			glm::vec4 clip = viewProjection * glm::vec4(corners[j], 1.0f);
+			if (clip.w <= 0.0f)
+			{
+				rect = glm::vec4(-1.0f, -1.0f, 1.0f, 1.0f);
+				return true;
+			}
+			float x = clip.x / clip.w;
+			float y = clip.y / clip.w;
+			rect.x = std::min(rect.x, x);
+			rect.y = std::min(rect.y, y);
+			rect.z = std::max(rect.z, x);
+			rect.w = std::max(rect.w, y);
+		}
+		rect.x = std::max(rect.x, -1.0f);
+		rect.y = std::max(rect.y, -1.0f);
+		rect.z = std::min(rect.z, 1.0f);
+		rect.w = std::min(rect.w, 1.0f);
+		return rect.z > rect.x && rect.w > rect.y;
+	}
+
+	// the front face a millimeter in front of the mirror cube, with the reflection at the same screen position
+	void drawMirror(GLuint reflectionTexture, const FrameGraphTextureDesc& colorDesc)
+	{
+		mirrorShader.use();
+		mirrorShader.setVec3("corner", mirrorCorner + glm::vec3(plane) * 0.001f);
+		mirrorShader.setVec3("edgeU", mirrorEdgeU);
+		mirrorShader.setVec3("edgeV", mirrorEdgeV);
+		mirrorShader.setVec3("tint", tint);
+		mirrorShader.setVec2("targetSize", glm::vec2((float)colorDesc.width, (float)colorDesc.height));
+
+		glState.bindTextureUnit(0, reflectionTexture);
+		glState.bindVertexArray(emptyVertexArray);
+		glState.setDepthMask(false);
+
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+		glState.countDraw();
+
+		glState.setDepthMask(true);
+	}
+};
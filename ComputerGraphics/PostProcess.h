@@ -0,0 +1,189 @@
+#pragma once
+
+/*
+ HDR post processing chain.
+ The scene is rendered to an R11G11B10F target. Bloom builds a BLOOM_LEVELS deep mip chain of the
+ bright parts at half resolution in a single dispatch, then walks back up adding a separable
+ gaussian blur of every coarser level to the next finer one. A last compute pass applies exposure and
+ bloom and tonemaps into an 8 bit target. That target is drawn to the window by a fullscreen triangle
+ that upscales it with contrast adaptive sharpening when the render size is below the window size.
+*/
+
+#include <GL/glew.h>
+
+#include "Shader.h"
+#include "GLState.h"
+#include "FrameGraph.h"
+#include "StartupLoader.h"
+
+class PostProcess
+{
+public:
+	// levels written by bloom_downsample.comp, keep in sync with BLOOM_LEVELS there
+	static const int BLOOM_LEVELS = 6;
+
+	bool bloom = true;
+	float exposure = 1.0f;
+	float bloomIntensity = 0.08f;
+	float bloomThreshold = 1.0f;
+	float bloomKnee = 0.5f;
+	float shoulderStart = 0.8f;	// colors below it leave the tonemapper unchanged
+	float sharpness = 0.5f;		// of the upscale, only applied when the frame is rendered below window size
+
+	PostProcess() {}
+
+	// every frame runs the whole chain, so all of it is needed for the first one
+	void requestShaders(StartupLoader& loader)
+	{
+		loader.addComputeProgram(downsampleShader, "./Shaders/bloom_downsample.comp", true);
+		loader.addComputeProgram(upsampleShader, "./Shaders/bloom_upsample.comp", true);
+		loader.addComputeProgram(tonemapShader, "./Shaders/tonemap.comp", true);
+		loader.addProgram(presentShader, "./Shaders/present.vert", "./Shaders/upscale.frag", "", true);
+	}
+
+	void init()
+	{
+		MemoryScope scope(MEMORY_TAG_POST_PROCESS);
+
+		//the fullscreen triangle is generated from gl_VertexID, core profile still needs a vertex array
+		glCreateVertexArrays(1, &emptyVertexArray);
+	}
+
+	// declares the post passes reading the HDR scene color, returns the tonemapped 8 bit target
+	// ------------------------------------------------------------------------
+	FrameGraphResource addPasses(FrameGraph& graph, FrameGraphResource sceneColor)
+	{
+		const FrameGraphTextureDesc& sceneDesc = graph.getDesc(sceneColor);
+
+		FrameGraphResource bloomChain = graph.createTexture("BloomChain",
+			FrameGraphTextureDesc(halve(sceneDesc.width), halve(sceneDesc.height), GL_R11F_G11F_B10F, BLOOM_LEVELS));
+		FrameGraphResource ldrColor = graph.createTexture("LdrColor", FrameGraphTextureDesc(sceneDesc.width, sceneDesc.height, GL_RGBA8));
+
+		int downsamplePass = graph.addPass("BloomDownsample", [this, sceneColor, bloomChain](const FrameGraph& graph) {
+			downsample(graph.getTexture(sceneColor), graph.getDesc(bloomChain), graph.getTexture(bloomChain));
+		});
+		graph.read(downsamplePass, sceneColor);
+		graph.write(downsamplePass, bloomChain);
+
+		int upsamplePass = graph.addPass("BloomUpsample", [this, bloomChain](const FrameGraph& graph) {
+			upsample(graph.getDesc(bloomChain), graph.getTexture(bloomChain));
+		});
+		graph.read(upsamplePass, bloomChain);
+		graph.write(upsamplePass, bloomChain);
+
+		//without bloom nothing reads the chain and the bloom passes are culled
+		bool useBloom = bloom;
+		int tonemapPass = graph.addPass("Tonemap", [this, sceneColor, bloomChain, ldrColor, useBloom](const FrameGraph& graph) {
+			tonemap(graph.getTexture(sceneColor), useBloom ? graph.getTexture(bloomChain) : 0, graph.getDesc(ldrColor), graph.getTexture(ldrColor));
+		});
+		graph.read(tonemapPass, sceneColor);
+		if (useBloom)
+		{
+			graph.read(tonemapPass, bloomChain);
+		}
+		graph.write(tonemapPass, ldrColor);
+
+		return ldrColor;
+	}
+
+	// draws the 8 bit frame into the window's backbuffer
+	// ------------------------------------------------------------------------
+	void addPresentPass(FrameGraph& graph, FrameGraphResource ldrColor, FrameGraphResource backbuffer)
+	{
+		int presentPass = graph.addPass("Present", [this, ldrColor, backbuffer](const FrameGraph& graph) {
+			const FrameGraphTextureDesc& sourceDesc = graph.getDesc(ldrColor);
+			const FrameGraphTextureDesc& windowDesc = graph.getDesc(backbuffer);
+			bool upscaling = sourceDesc.width != windowDesc.width || sourceDesc.height != windowDesc.height;
+			present(graph.getTexture(ldrColor), upscaling ? sharpness : 0.0f);
+		});
+		graph.read(presentPass, ldrColor);
+		graph.writeColor(presentPass, backbuffer);
+	}
+
+	void release()
+	{
+		glState.deleteProgram(downsampleShader.ID);
+		glState.deleteProgram(upsampleShader.ID);
+		glState.deleteProgram(tonemapShader.ID);
+		glState.deleteProgram(presentShader.ID);
+		glState.deleteVertexArrays(1, &emptyVertexArray);
+	}
+
+private:
+	Shader downsampleShader;
+	Shader upsampleShader;
+	Shader tonemapShader;
+	Shader presentShader;
+	GLuint emptyVertexArray = 0;
+
+	static int halve(int size)
+	{
+		return size / 2 > 1 ? size / 2 : 1;
+	}
+
+	void downsample(GLuint sceneTexture, const FrameGraphTextureDesc& chainDesc, GLuint chainTexture)
+	{
+		downsampleShader.use();
+		downsampleShader.setFloat("threshold", bloomThreshold);
+		downsampleShader.setFloat("knee", bloomKnee);
+
+		glState.bindTextureUnit(0, sceneTexture);
+		for (int level = 0; level < BLOOM_LEVELS; level++)
+		{
+			glBindImageTexture(level, chainTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R11F_G11F_B10F);
+		}
+
+		//one workgroup per 32x32 texels of the first level
+		glDispatchCompute((chainDesc.width + 31) / 32, (chainDesc.height + 31) / 32, 1);
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+	}
+
+	void upsample(const FrameGraphTextureDesc& chainDesc, GLuint chainTexture)
+	{
+		upsampleShader.use();
+		glState.bindTextureUnit(0, chainTexture);
+
+		for (int level = BLOOM_LEVELS - 2; level >= 0; level--)
+		{
+			int width = chainDesc.width >> level;
+			int height = chainDesc.height >> level;
+			width = width > 1 ? width : 1;
+			height = height > 1 ? height : 1;
+
+			upsampleShader.setInt("sourceLevel", level + 1);
+			glBindImageTexture(0, chainTexture, level, GL_FALSE, 0, GL_READ_WRITE, GL_R11F_G11F_B10F);
+
+			glDispatchCompute((width + 15) / 16, (height + 15) / 16, 1);
+			glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+		}
+	}
+
+	void tonemap(GLuint sceneTexture, GLuint chainTexture, const FrameGraphTextureDesc& destinationDesc, GLuint destinationTexture)
+	{
+		tonemapShader.use();
+		tonemapShader.setFloat("exposure", exposure);
+		tonemapShader.setFloat("bloomIntensity", chainTexture != 0 ? bloomIntensity : 0.0f);
+		tonemapShader.setFloat("shoulderStart", shoulderStart);
+
+		glState.bindTextureUnit(0, sceneTexture);
+		glState.bindTextureUnit(1, chainTexture);
+		glBindImageTexture(0, destinationTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+
+		glDispatchCompute((destinationDesc.width + 7) / 8, (destinationDesc.height + 7) / 8, 1);
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	}
+
+	// the window's depth buffer is never cleared, the triangle must not be depth tested
+	void present(GLuint sourceTexture, float presentSharpness)
+	{
+		presentShader.use();
+		presentShader.setFloat("sharpness", presentSharpness);
+		glState.bindTextureUnit(0, sourceTexture);
+		glState.bindVertexArray(emptyVertexArray);
+
+		glState.setEnabled(GL_DEPTH_TEST, false);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		glState.countDraw();
+		glState.setEnabled(GL_DEPTH_TEST, true);
+	}
+};
@@ -0,0 +1,216 @@
+#pragma once
+
+/*
+ Scene data shared between the CPU and the shaders.
+ The structs below mirror the std140/std430 blocks declared in the shaders, keep them in sync.
+*/
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+// Phong material, same layout as struct Material in the shaders (vec3 members are 16 byte aligned)
+struct Material {
+	glm::vec3 emission;
+	float opacity;	// below 1 the object is drawn in the translucent pass
+	glm::vec3 ambient;
+	float padding1;
+	glm::vec3 diffuse;
+	float padding2;
+	glm::vec3 specular;
+	float ka; //ambient coefficient
+	float kd; //diffuse coefficient
+	float ks; //specular coefficient
+	float shininess;
+	float padding3;
+};
+
+// Placement of an object, its model matrix is translation * rotation * scale. object_transforms.comp
+// turns it into the model and normal matrix on the GPU, the CPU builds them with getModelMatrix().
+struct ObjectTransform {
+	glm::vec3 translation;
+	float padding0;
+	glm::vec4 rotation;	// unit quaternion as x, y, z, w
+	glm::vec3 scale;
+	float padding1;
+
+	ObjectTransform()
+		: translation(0.0f), padding0(0.0f), rotation(0.0f, 0.0f, 0.0f, 1.0f), scale(1.0f), padding1(0.0f)
+	{
+	}
+};
+
+// Per-object record of the ObjectBuffer shader storage block
+struct ObjectData {
+	ObjectTransform transform;
+	Material material;
+	unsigned int mesh;	// into the MeshRegistry, CUBE_MESH for the furniture
+	unsigned int animationNode;	// of the SceneAnimation that moves the object, only read on the CPU
+	unsigned int lamp;	// whose switch lights the object up, NO_LAMP for the rest, only read on the CPU
+	unsigned int padding;
+};
+
+// Record of the ObjectMatrixBuffer written by object_transforms.comp and read by vertex.vert,
+// the std430 mat3 of the normal matrix has its columns padded to vec4
+struct ObjectMatrices {
+	glm::mat4 model;
+	glm::vec4 normal[3];
+};
+
+// Record of the PackedInstanceBuffer, the compact alternative to ObjectData and ObjectMatrices on the
+// GPU-driven path, decoded by the PACKED_INSTANCES variant of vertex.vert. See PackedInstances.h
+struct PackedInstance {
+	unsigned short position[3];	// 16 bit fixed point inside the cell
+	unsigned short cell;		// into the cell origins, EXACT_CELL when the object has an exact transform
+	unsigned short scale[3];	// half floats
+	unsigned short material;	// into the material palette
+	unsigned int rotation;		// 10 bits of each of the three smallest quaternion components, the index of the largest on top, or the index of the exact transform
+	unsigned int mesh;			// into the MeshRegistry
+};
+
+// Index range of a mesh in the shared vertex and index buffers, the culling shader builds the indirect
+// command of an object from the range of its mesh
+struct MeshRange {
+	unsigned int firstIndex;
+	unsigned int indexCount;
+	int baseVertex;
+	unsigned int padding;
+};
+
+// World-space axis aligned bounds used by the culling shader
+struct ObjectBounds {
+	glm::vec4 center;
+	glm::vec4 extents;
+};
+
+// Run of consecutive object records, for partial updates of a scene
+struct ObjectRange {
+	unsigned int first;
+	unsigned int count;
+};
+
+// Lightmap atlas rectangle of every cube side (xy offset, zw size in uv), in the order of cubeVertices
+struct LightmapRects {
+	glm::vec4 faces[6];
+};
+
+// Per-frame values of the FrameData uniform block
+struct FrameData {
+	glm::mat4 projection;
+	glm::mat4 view;
+	glm::vec4 viewPos;
+};
+
+static_assert(sizeof(Material) == 80, "Material must match the std430 layout");
+static_assert(sizeof(ObjectTransform) == 48, "ObjectTransform must match the std430 layout");
+static_assert(sizeof(ObjectData) == 144, "ObjectData must match the std430 layout");
+static_assert(sizeof(ObjectMatrices) == 112, "ObjectMatrices must match the std430 layout");
+static_assert(sizeof(PackedInstance) == 24, "PackedInstance must match the std430 layout");
+static_assert(sizeof(MeshRange) == 16, "MeshRange must match the std430 layout");
+static_assert(sizeof(ObjectBounds) == 32, "ObjectBounds must match the std430 layout");
+static_assert(sizeof(LightmapRects) == 96, "LightmapRects must match the std430 layout");
+static_assert(sizeof(FrameData) == 144, "FrameData must match the std140 layout");
+
+// Binding points shared with the shaders
+const unsigned int FRAME_DATA_BINDING = 0;
+const unsigned int OBJECT_BUFFER_BINDING = 1;
+const unsigned int BOUNDS_BUFFER_BINDING = 2;
+const unsigned int COMMAND_BUFFER_BINDING = 3;
+const unsigned int DRAW_COUNT_BINDING = 4;
+const unsigned int LIGHTMAP_RECTS_BINDING = 5;
+const unsigned int OBJECT_MATRIX_BINDING = 6;
+const unsigned int MESH_RANGE_BINDING = 7;
+const unsigned int HUD_QUAD_BINDING = 8;
+const unsigned int PACKED_INSTANCE_BINDING = 9;
+const unsigned int CELL_ORIGIN_BINDING = 10;
+const unsigned int MATERIAL_PALETTE_BINDING = 11;
+const unsigned int EXACT_TRANSFORM_BINDING = 12;
+
+// Mesh every registry starts with, imported meshes follow it
+const unsigned int CUBE_MESH = 0;
+
+// Animation node of the objects that do not move
+const unsigned int NO_ANIMATION_NODE = 0xFFFFFFFFu;
+
+// Lamp of the objects no switch lights up
+const unsigned int NO_LAMP = 0xFFFFFFFFu;
+
+// Texture units of the lamp lightmaps
+const unsigned int CEILING_LAMP_LIGHTMAP_UNIT = 1;
+const unsigned int NIGHT_LAMP_LIGHTMAP_UNIT = 2;
+
+inline glm::quat getRotation(const ObjectTransform& transform)
+{
+	return glm::quat(transform.rotation.w, transform.rotation.x, transform.rotation.y, transform.rotation.z);
+}
+
+// The scene code places objects with the same chains of translate, rotate and scale it used on
+// matrices, every step is applied in the object space of the steps before it like in glm.
+// ------------------------------------------------------------------------
+inline ObjectTransform translate(const ObjectTransform& transform, const glm::vec3& offset)
+{
+	ObjectTransform result = transform;
+	result.translation += getRotation(transform) * (transform.scale * offset);
+	return result;
+}
+
+// a rotation after a non-uniform scale would shear, which a TRS cannot hold, the scene rotates first
+inline ObjectTransform rotate(const ObjectTransform& transform, float angle, const glm::vec3& axis)
+{
+	glm::quat rotation = glm::normalize(getRotation(transform) * glm::angleAxis(angle, glm::normalize(axis)));
+
+	ObjectTransform result = transform;
+	result.rotation = glm::vec4(rotation.x, rotation.y, rotation.z, rotation.w);
+	return result;
+}
+
+inline ObjectTransform scale(const ObjectTransform& transform, const glm::vec3& factors)
+{
+	ObjectTransform result = transform;
+	result.scale *= factors;
+	return result;
+}
+
+// child placed in the space of parent, exact as long as the parent is not scaled non-uniformly
+inline ObjectTransform combine(const ObjectTransform& parent, const ObjectTransform& child)
+{
+	ObjectTransform result = translate(parent, child.translation);
+	glm::quat rotation = glm::normalize(getRotation(parent) * getRotation(child));
+	result.rotation = glm::vec4(rotation.x, rotation.y, rotation.z, rotation.w);
+	result.scale = parent.scale * child.scale;
+	return result;
+}
+
+// ------------------------------------------------------------------------
+inline glm::mat4 getModelMatrix(const ObjectTransform& transform)
+{
+	glm::mat3 rotation = glm::mat3_cast(getRotation(transform));
+
+	glm::mat4 model(1.0f);
+	model[0] = glm::vec4(rotation[0] * transform.scale.x, 0.0f);
+	model[1] = glm::vec4(rotation[1] * transform.scale.y, 0.0f);
+	model[2] = glm::vec4(rotation[2] * transform.scale.z, 0.0f);
+	model[3] = glm::vec4(transform.translation, 1.0f);
+	return model;
+}
+
+// transpose(inverse(model)) of a TRS is rotation * inverse(scale), no general inverse needed
+inline glm::mat3 getNormalMatrix(const ObjectTransform& transform)
+{
+	glm::mat3 rotation = glm::mat3_cast(getRotation(transform));
+	return glm::mat3(rotation[0] / transform.scale.x, rotation[1] / transform.scale.y, rotation[2] / transform.scale.z);
+}
+
+// Bounds of the unit cube centered at the origin after transforming it with model
+inline ObjectBounds computeCubeBounds(const glm::mat4& model)
+{
+	ObjectBounds bounds;
+	bounds.center = model * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	glm::vec3 extents = 0.5f * (glm::abs(glm::vec3(model[0])) + glm::abs(glm::vec3(model[1])) + glm::abs(glm::vec3(model[2])));
+	bounds.extents = glm::vec4(extents, 0.0f);
+	return bounds;
+}
+
+inline ObjectBounds computeCubeBounds(const ObjectTransform& transform)
+{
+	return computeCubeBounds(getModelMatrix(transform));
+}
@@ -0,0 +1,371 @@
+#pragma once
+
+/*
+ Keyframed and procedural animation of the parts of the furniture that move, doors and drawers.
+ A node is such a part. Its objects are drawn one after the other with the node set, so the recorded
+ scene holds them as a run of consecutive records. The first record of a run is its anchor: the
+ node's track moves the run in the frame of the anchor's rest transform, its center and rotation
+ without the scale. That way every instance of a replicated prefab moves in its own frame, turned
+ rooms included, and the replicator does not need to know about nodes.
+ toggle() plays every track towards its end or back to its start, looping plays them back and forth.
+ advance() moves the nodes along their tracks, apply() evaluates the runs of the nodes that moved on
+ the thread pool and writes their records and bounds in place. The runs it wrote are merged into
+ ranges of records, so a GPU copy of the scene only has to take what moved.
+*/
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <iostream>
+
+#include "Scene.h"
+#include "ThreadPool.h"
+
+enum AnimationTrackType {
+	ANIMATION_KEYFRAMES,	// interpolated between keys, held at the first and the last one
+	ANIMATION_SWING,		// rotation by up to amount radians about axis through the pivot
+	ANIMATION_SLIDE			// translation by up to amount along axis
+};
+
+struct AnimationKey {
+	float time;
+	glm::vec3 translation;
+	glm::quat rotation;
+};
+
+struct AnimationTrack {
+	AnimationTrackType type = ANIMATION_KEYFRAMES;
+	std::vector<AnimationKey> keys;		// sorted by time, the track ends at the last one
+	glm::vec3 axis = glm::vec3(0.0f, 1.0f, 0.0f);	// in the anchor frame
+	float amount = 0.0f;
+	float duration = 1.0f;				// of the procedural tracks, eased in and out
+};
+
+struct AnimationNode {
+	std::string name;
+	AnimationTrack track;
+	glm::vec3 pivot;		// in the anchor frame, the rotations of the track are about it
+	float time = 0.0f;
+	float direction = -1.0f;	// 1 plays towards the end of the track, -1 back to its start
+	bool moved = false;		// in the last advance()
+};
+
+struct SceneAnimationStats {
+	unsigned int runs = 0;
+	unsigned int animatedObjects = 0;
+	unsigned int movedObjects = 0;		// by the last apply() that moved anything
+	unsigned int ranges = 0;
+	size_t rangeBytes = 0;				// of the records and bounds in its ranges
+	size_t totalRangeBytes = 0;
+	unsigned int movingFrames = 0;
+	unsigned int threads = 0;
+	double milliseconds = 0.0;
+};
+
+class SceneAnimation
+{
+public:
+	bool looping = false;
+	unsigned int mergeGap = 4;	// static records between two runs that are uploaded rather than split the range
+
+	SceneAnimationStats stats;
+
+	SceneAnimation() {}
+
+	// ------------------------------------------------------------------------
+	unsigned int addNode(const std::string& name, const AnimationTrack& track, const glm::vec3& pivot)
+	{
+		AnimationNode node;
+		node.name = name;
+		node.track = track;
+		node.pivot = pivot;
+		nodes.push_back(node);
+		return (unsigned int)nodes.size() - 1;
+	}
+
+	// opens what is closed or closing and closes the rest
+	// ------------------------------------------------------------------------
+	void toggle()
+	{
+		for (size_t i = 0; i < nodes.size(); i++)
+		{
+			nodes[i].direction = -nodes[i].direction;
+		}
+	}
+
+	// true when the tracks play towards their end
+	bool isOpening() const
+	{
+		return !nodes.empty() && nodes[0].direction > 0.0f;
+	}
+
+	// ------------------------------------------------------------------------
+	void advance(float deltaTime)
+	{
+		for (size_t i = 0; i < nodes.size(); i++)
+		{
+			AnimationNode& node = nodes[i];
+			float end = getDuration(node.track);
+			float time = node.time + node.direction * deltaTime;
+			if (looping && (time > end || time < 0.0f))
+			{
+				node.direction = -node.direction;
+			}
+			time = glm::clamp(time, 0.0f, end);
+
+			node.moved = time != node.time;
+			node.time = time;
+		}
+	}
+
+	// finds the runs of animated records and keeps their rest transforms, the next apply() writes all of them
+	// ------------------------------------------------------------------------
+	void bind(const std::vector<ObjectData>& objects)
+	{
+		runs.clear();
+		restTransforms.clear();
+
+		for (size_t i = 0; i < objects.size(); i++)
+		{
+			unsigned int node = objects[i].animationNode;
+			if (node == NO_ANIMATION_NODE || node >= nodes.size())
+			{
+				continue;
+			}
+
+			if (runs.empty() || node != runs.back().node || runs.back().first + runs.back().count != i)
+			{
+				AnimationRun run;
+				run.node = node;
+				run.first = (unsigned int)i;
+				run.count = 0;
+				run.firstRest = (unsigned int)restTransforms.size();
+				runs.push_back(run);
+			}
+			runs.back().count++;
+			restTransforms.push_back(objects[i].transform);
+		}
+
+		//every run can become a range of its own, so apply() never grows the vector
+		ranges.clear();
+		ranges.reserve(runs.size());
+
+		stats.runs = (unsigned int)runs.size();
+		stats.animatedObjects = (unsigned int)restTransforms.size();
+		bound = true;
+		forceApply = true;
+	}
+
+	// the ranges of records the next apply() writes, for a look at them before they move. Empty when
+	// nothing moved in the last advance()
+	// ------------------------------------------------------------------------
+	const std::vector<ObjectRange>& findRanges()
+	{
+		ranges.clear();
+		if (!bound)
+		{
+			return ranges;
+		}
+
+		stats.movedObjects = 0;
+		for (size_t i = 0; i < runs.size(); i++)
+		{
+			const AnimationRun& run = runs[i];
+			if (!forceApply && !nodes[run.node].moved)
+			{
+				continue;
+			}
+
+			stats.movedObjects += run.count;
+			if (!ranges.empty() && run.first <= ranges.back().first + ranges.back().count + mergeGap)
+			{
+				ranges.back().count = run.first + run.count - ranges.back().first;
+			}
+			else
+			{
+				ObjectRange range;
+				range.first = run.first;
+				range.count = run.count;
+				ranges.push_back(range);
+			}
+		}
+		return ranges;
+	}
+
+	// writes the records and bounds of the runs whose node moved, objects has to be what bind() saw
+	// ------------------------------------------------------------------------
+	void apply(ThreadPool& pool, std::vector<ObjectData>& objects, std::vector<ObjectBounds>& bounds)
+	{
+		findRanges();
+		if (ranges.empty())
+		{
+			return;
+		}
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		//only this is captured, a larger capture would make std::function allocate every frame
+		applyObjects = &objects;
+		applyBounds = &bounds;
+		pool.parallelFor((int)runs.size(), 64, [this](int begin, int end) {
+			for (int i = begin; i < end; i++)
+			{
+				const AnimationRun& run = runs[i];
+				if (forceApply || nodes[run.node].moved)
+				{
+					writeRun(run);
+				}
+			}
+		});
+		applyObjects = NULL;
+		applyBounds = NULL;
+
+		forceApply = false;
+
+		stats.rangeBytes = 0;
+		for (size_t i = 0; i < ranges.size(); i++)
+		{
+			stats.rangeBytes += ranges[i].count * (sizeof(ObjectData) + sizeof(ObjectBounds));
+		}
+		stats.ranges = (unsigned int)ranges.size();
+		stats.totalRangeBytes += stats.rangeBytes;
+		stats.movingFrames++;
+		stats.threads = pool.getThreadCount();
+		stats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// the records apply() wrote, empty when nothing moved
+	const std::vector<ObjectRange>& getRanges() const
+	{
+		return ranges;
+	}
+
+	// placement of the objects of node drawn after anchor at rest, to be combined with their rest transform
+	// ------------------------------------------------------------------------
+	ObjectTransform getMotion(unsigned int node, const ObjectTransform& anchor) const
+	{
+		const AnimationNode& animationNode = nodes[node];
+
+		glm::quat rotation;
+		glm::vec3 translation;
+		evaluate(animationNode.track, animationNode.time, rotation, translation);
+
+		//the track about the pivot, then moved from the anchor frame to the world and back
+		translation += animationNode.pivot - rotation * animationNode.pivot;
+
+		glm::quat frameRotation = getRotation(anchor);
+		glm::quat inverseFrameRotation(frameRotation.w, -frameRotation.x, -frameRotation.y, -frameRotation.z);
+		glm::quat worldRotation = glm::normalize(frameRotation * rotation * inverseFrameRotation);
+
+		ObjectTransform motion;
+		motion.translation = anchor.translation + frameRotation * translation - worldRotation * anchor.translation;
+		motion.rotation = glm::vec4(worldRotation.x, worldRotation.y, worldRotation.z, worldRotation.w);
+		return motion;
+	}
+
+	// in the last advance()
+	bool hasMoved(unsigned int node) const
+	{
+		return nodes[node].moved;
+	}
+
+	unsigned int getNodeCount() const
+	{
+		return (unsigned int)nodes.size();
+	}
+
+	void printStats() const
+	{
+		std::cout << "Animation: " << nodes.size() << " nodes, " << stats.runs << " runs of " << stats.animatedObjects
+			<< " objects; the last moving frame updated " << stats.movedObjects << " objects in " << stats.ranges << " ranges ("
+			<< stats.rangeBytes << " bytes of records and bounds) in " << stats.milliseconds << " ms on " << stats.threads
+			<< " threads, " << stats.totalRangeBytes << " bytes over " << stats.movingFrames << " moving frames" << std::endl;
+	}
+
+private:
+	// consecutive records of one node, the first one anchors the motion
+	struct AnimationRun {
+		unsigned int node;
+		unsigned int first;
+		unsigned int count;
+		unsigned int firstRest;	// into restTransforms
+	};
+
+	std::vector<AnimationNode> nodes;
+	std::vector<AnimationRun> runs;
+	std::vector<ObjectTransform> restTransforms;
+	std::vector<ObjectRange> ranges;
+	bool bound = false;
+	bool forceApply = false;
+
+	std::vector<ObjectData>* applyObjects = NULL;
+	std::vector<ObjectBounds>* applyBounds = NULL;
+
+	void writeRun(const AnimationRun& run) const
+	{
+		ObjectTransform motion = getMotion(run.node, restTransforms[run.firstRest]);
+		for (unsigned int i = 0; i < run.count; i++)
+		{
+			ObjectTransform transform = combine(motion, restTransforms[run.firstRest + i]);
+			(*applyObjects)[run.first + i].transform = transform;
+			(*applyBounds)[run.first + i] = computeCubeBounds(transform);
+		}
+	}
+
+	static float getDuration(const AnimationTrack& track)
+	{
+		if (track.type == ANIMATION_KEYFRAMES)
+		{
+			return track.keys.empty() ? 0.0f : track.keys.back().time;
+		}
+		return track.duration;
+	}
+
+	static void evaluate(const AnimationTrack& track, float time, glm::quat& rotation, glm::vec3& translation)
+	{
+		rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+		translation = glm::vec3(0.0f);
+
+		if (track.type != ANIMATION_KEYFRAMES)
+		{
+			float t = track.duration > 0.0f ? glm::clamp(time / track.duration, 0.0f, 1.0f) : 1.0f;
+			t = t * t * (3.0f - 2.0f * t);
+			if (track.type == ANIMATION_SWING)
+			{
+				rotation = glm::angleAxis(track.amount * t, glm::normalize(track.axis));
+			}
+			else
+			{
+				translation = glm::normalize(track.axis) * (track.amount * t);
+			}
+			return;
+		}
+
+		if (track.keys.empty())
+		{
+			return;
+		}
+
+		size_t next = 0;
+		while (next < track.keys.size() && track.keys[next].time <= time)
+		{
+			next++;
+		}
+		if (next == 0 || next == track.keys.size())
+		{
+			const AnimationKey& key = track.keys[next == 0 ? 0 : next - 1];
+			rotation = key.rotation;
+			translation = key.translation;
+			return;
+		}
+
+		const AnimationKey& from = track.keys[next - 1];
+		const AnimationKey& to = track.keys[next];
+		float t = (time - from.time) / (to.time - from.time);
+		rotation = glm::slerp(from.rotation, to.rotation, t);
+		translation = glm::mix(from.translation, to.translation, t);
+	}
+};
@@ -0,0 +1,241 @@
+#pragma once
+
+/*
+ Procedural scene replicator for stress tests.
+ The furniture groups of the room are recorded once as prefabs and instantiated over a grid of rooms
+ and floors. Every room is placed in a cell the size of the room prefab's bounds, and may be turned
+ by 180 degrees inside its cell. Within a room the optional prefabs can be left out, shifted a little
+ and tinted, all drawn from a seeded generator so the same seed always builds the same scene. The
+ first room keeps the authored layout, the lamps and the start camera still belong to it.
+ The variations are picked on the calling thread, the object records and bounds are then written by
+ the thread pool since that is where the time goes for a million objects.
+*/
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+
+#include "Scene.h"
+#include "ThreadPool.h"
+
+// A group of objects that is placed as one, in the coordinates of the authored room
+struct ScenePrefab {
+	std::string name;
+	std::vector<ObjectData> objects;
+	bool optional;	// may be left out, moved and tinted in the replicated rooms
+};
+
+struct SceneReplicatorStats {
+	unsigned int rooms = 0;
+	unsigned int objects = 0;
+	unsigned int prefabInstances = 0;
+	unsigned int droppedPrefabs = 0;
+	unsigned int threads = 0;
+	double milliseconds = 0.0;
+};
+
+class SceneReplicator
+{
+public:
+	bool enabled = false;
+	int roomsX = 1;
+	int roomsZ = 1;
+	int floors = 1;
+	unsigned int seed = 1;
+	unsigned int targetObjects = 0;	// when set, build() picks the grid to get close to this many objects
+
+	float dropChance = 0.1f;		// of an optional prefab being left out of a room
+	float maxOffset = 0.25f;		// of an optional prefab along the floor
+	float tintVariation = 0.15f;	// relative, per color channel
+	float turnChance = 0.5f;		// of a room being turned by 180 degrees
+
+	SceneReplicatorStats stats;
+
+	SceneReplicator() {}
+
+	void setGrid(int x, int z, int floorCount)
+	{
+		enabled = true;
+		roomsX = std::max(1, x);
+		roomsZ = std::max(1, z);
+		floors = std::max(1, floorCount);
+		targetObjects = 0;
+	}
+
+	void setObjectTarget(unsigned int objectCount)
+	{
+		enabled = true;
+		targetObjects = objectCount;
+	}
+
+	void clearPrefabs()
+	{
+		prefabs.clear();
+	}
+
+	// the first prefab is the room itself, its bounds give the size of a grid cell
+	void addPrefab(const std::string& name, const std::vector<ObjectData>& objects, bool optional)
+	{
+		ScenePrefab prefab;
+		prefab.name = name;
+		prefab.objects = objects;
+		prefab.optional = optional;
+		prefabs.push_back(prefab);
+	}
+
+	// instantiates the prefabs over the grid, replacing the contents of objects and bounds
+	// ------------------------------------------------------------------------
+	void build(ThreadPool& pool, std::vector<ObjectData>& objects, std::vector<ObjectBounds>& bounds)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		objects.clear();
+		bounds.clear();
+		stats = SceneReplicatorStats();
+		if (prefabs.empty())
+		{
+			std::cout << "ERROR::SCENE_REPLICATOR::NO_PREFABS" << std::endl;
+			return;
+		}
+
+		glm::vec3 cellMin, cellMax;
+		computeCell(cellMin, cellMax);
+		glm::vec3 cellSize = cellMax - cellMin;
+		glm::vec3 cellCenter = 0.5f * (cellMin + cellMax);
+
+		if (targetObjects > 0)
+		{
+			chooseGrid();
+		}
+
+		std::mt19937 random(seed);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+		std::vector<PrefabInstance> instances;
+		unsigned int objectCount = 0;
+		for (int floor = 0; floor < floors; floor++)
+		{
+			for (int z = 0; z < roomsZ; z++)
+			{
+				for (int x = 0; x < roomsX; x++)
+				{
+					bool authored = floor == 0 && z == 0 && x == 0;
+
+					ObjectTransform room = translate(ObjectTransform(), glm::vec3(x, floor, z) * cellSize);
+					if (!authored && unit(random) < turnChance)
+					{
+						room = translate(room, cellCenter);
+						room = rotate(room, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+						room = translate(room, -cellCenter);
+					}
+
+					for (size_t i = 0; i < prefabs.size(); i++)
+					{
+						PrefabInstance instance;
+						instance.prefab = (unsigned int)i;
+						instance.transform = room;
+						instance.tint = glm::vec3(1.0f);
+
+						if (!authored && prefabs[i].optional)
+						{
+							if (unit(random) < dropChance)
+							{
+								stats.droppedPrefabs++;
+								continue;
+							}
+
+							glm::vec3 offset((unit(random) * 2.0f - 1.0f) * maxOffset, 0.0f, (unit(random) * 2.0f - 1.0f) * maxOffset);
+							instance.transform = translate(room, offset);
+							for (int c = 0; c < 3; c++)
+							{
+								instance.tint[c] = 1.0f + (unit(random) * 2.0f - 1.0f) * tintVariation;
+							}
+						}
+
+						instance.firstObject = objectCount;
+						objectCount += (unsigned int)prefabs[i].objects.size();
+						instances.push_back(instance);
+					}
+				}
+			}
+		}
+
+		objects.resize(objectCount);
+		bounds.resize(objectCount);
+
+		pool.parallelFor((int)instances.size(), 64, [this, &instances, &objects, &bounds](int begin, int end) {
+			for (int i = begin; i < end; i++)
+			{
+				const PrefabInstance& instance = instances[i];
+				const std::vector<ObjectData>& source = prefabs[instance.prefab].objects;
+				for (size_t j = 0; j < source.size(); j++)
+				{
+					ObjectData& object = objects[instance.firstObject + j];
+					object = source[j];
+					object.transform = combine(instance.transform, source[j].transform);
+					object.material.ambient *= instance.tint;
+					object.material.diffuse *= instance.tint;
+					bounds[instance.firstObject + j] = computeCubeBounds(object.transform);
+				}
+			}
+		});
+
+		stats.rooms = (unsigned int)(roomsX * roomsZ * floors);
+		stats.objects = objectCount;
+		stats.prefabInstances = (unsigned int)instances.size();
+		stats.threads = pool.getThreadCount();
+		stats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	void printStats() const
+	{
+		std::cout << "Replicated scene: " << stats.rooms << " rooms (" << roomsX << "x" << roomsZ << ", " << floors << " floors), "
+			<< stats.objects << " objects from " << prefabs.size() << " prefabs, " << stats.prefabInstances << " placed, "
+			<< stats.droppedPrefabs << " left out, seed " << seed << ", built in " << stats.milliseconds << " ms on "
+			<< stats.threads << " threads" << std::endl;
+	}
+
+private:
+	struct PrefabInstance {
+		ObjectTransform transform;
+		glm::vec3 tint;
+		unsigned int prefab;
+		unsigned int firstObject;
+	};
+
+	std::vector<ScenePrefab> prefabs;
+
+	void computeCell(glm::vec3& cellMin, glm::vec3& cellMax) const
+	{
+		cellMin = glm::vec3(1e30f);
+		cellMax = glm::vec3(-1e30f);
+		for (size_t i = 0; i < prefabs[0].objects.size(); i++)
+		{
+			ObjectBounds objectBounds = computeCubeBounds(prefabs[0].objects[i].transform);
+			cellMin = glm::min(cellMin, glm::vec3(objectBounds.center - objectBounds.extents));
+			cellMax = glm::max(cellMax, glm::vec3(objectBounds.center + objectBounds.extents));
+		}
+	}
+
+	// a building wider than it is tall with about targetObjects objects
+	void chooseGrid()
+	{
+		float objectsPerRoom = 0.0f;
+		for (size_t i = 0; i < prefabs.size(); i++)
+		{
+			objectsPerRoom += prefabs[i].objects.size() * (prefabs[i].optional ? 1.0f - dropChance : 1.0f);
+		}
+
+		int rooms = std::max(1, (int)std::ceil(targetObjects / std::max(objectsPerRoom, 1.0f)));
+		floors = std::max(1, std::min(10, (int)std::cbrt((float)rooms / 4.0f)));
+		roomsX = std::max(1, (int)std::ceil(std::sqrt((float)rooms / floors)));
+		roomsZ = std::max(1, (rooms + roomsX * floors - 1) / (roomsX * floors));
+	}
+};
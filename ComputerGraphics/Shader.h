@@ -8,147 +8,359 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
+#include <cstring>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "GLState.h"
+
 class Shader
 {
 public:
 	Shader() {}
 	unsigned int ID;
-	// generates the shader
+	// generates the shader, defines are inserted right after the #version line of both stages
 	// ------------------------------------------------------------------------
-	void Load(const char* vertexPath, const char* fragmentPath)
+	void Load(const char* vertexPath, const char* fragmentPath, const std::string& defines = "")
 	{
 		// 1. retrieve the vertex/fragment source code from filePath
 		std::string vertexCode;
 		std::string fragmentCode;
-		std::ifstream vShaderFile;
-		std::ifstream fShaderFile;
+		bool vertexRead = readSource(vertexPath, defines, vertexCode);
+		bool fragmentRead = readSource(fragmentPath, defines, fragmentCode);
+		if (!vertexRead || !fragmentRead)
+		{
+			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+		}
+		// 2. compile shaders and link the program
+		beginLoad(vertexCode, fragmentCode);
+		finishLoad();
+	}
+
+	// generates a compute shader program
+	// ------------------------------------------------------------------------
+	void LoadCompute(const char* computePath, const std::string& defines = "")
+	{
+		// 1. retrieve the compute source code from filePath
+		std::string computeCode;
+		if (!readSource(computePath, defines, computeCode))
+		{
+			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+		}
+		// 2. compile shader and link the program
+		beginLoadCompute(computeCode);
+		finishLoad();
+	}
+
+	// The steps of Load for programs that are built while other work goes on. readSource can run on any
+	// thread. beginLoad hands the sources to the driver and starts linking, with KHR_parallel_shader_compile
+	// neither waits for the compiler. finishLoad has to be called before the program is used.
+	// ------------------------------------------------------------------------
+	static bool readSource(const char* path, const std::string& defines, std::string& code)
+	{
+		std::ifstream shaderFile;
 		// ensure ifstream objects can throw exceptions:
-		vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+		shaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
 		try
 		{
-			// open files
-			vShaderFile.open(vertexPath);
-			fShaderFile.open(fragmentPath);
-			std::stringstream vShaderStream, fShaderStream;
-			// read file's buffer contents into streams
-			vShaderStream << vShaderFile.rdbuf();
-			fShaderStream << fShaderFile.rdbuf();
-			// close file handlers
-			vShaderFile.close();
-			fShaderFile.close();
-			// convert stream into string
-			vertexCode = vShaderStream.str();
-			fragmentCode = fShaderStream.str();
+			shaderFile.open(path);
+			std::stringstream shaderStream;
+			shaderStream << shaderFile.rdbuf();
+			shaderFile.close();
+			code = shaderStream.str();
 		}
 		catch (std::ifstream::failure e)
 		{
-			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+			code.clear();
+			return false;
+		}
+		injectDefines(code, defines);
+		return true;
+	}
+	// ------------------------------------------------------------------------
+	void beginLoad(const std::string& vertexCode, const std::string& fragmentCode)
+	{
+		pendingShaderCount = 0;
+		addStage(GL_VERTEX_SHADER, "VERTEX", vertexCode);
+		addStage(GL_FRAGMENT_SHADER, "FRAGMENT", fragmentCode);
+		linkStages();
+	}
+	// ------------------------------------------------------------------------
+	void beginLoadCompute(const std::string& computeCode)
+	{
+		pendingShaderCount = 0;
+		addStage(GL_COMPUTE_SHADER, "COMPUTE", computeCode);
+		linkStages();
+	}
+	// whether finishLoad would return without waiting for the driver
+	// ------------------------------------------------------------------------
+	bool isReady() const
+	{
+		if (!pending || (!GLEW_KHR_parallel_shader_compile && !GLEW_ARB_parallel_shader_compile))
+		{
+			return true;
+		}
+
+		GLint complete = GL_FALSE;
+		glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &complete);
+		return complete == GL_TRUE;
+	}
+	// waits for the program started by beginLoad and reports errors, false when nothing was pending
+	// ------------------------------------------------------------------------
+	bool finishLoad()
+	{
+		if (!pending)
+		{
+			return false;
+		}
+
+		for (int i = 0; i < pendingShaderCount; i++)
+		{
+			checkCompileErrors(pendingShaders[i], pendingTypes[i]);
 		}
-		const char* vShaderCode = vertexCode.c_str();
-		const char * fShaderCode = fragmentCode.c_str();
-		// 2. compile shaders
-		unsigned int vertex, fragment;
-		int success;
-		char infoLog[512];
-		// vertex shader
-		vertex = glCreateShader(GL_VERTEX_SHADER);
-		glShaderSource(vertex, 1, &vShaderCode, NULL);
-		glCompileShader(vertex);
-		checkCompileErrors(vertex, "VERTEX");
-		// fragment Shader
-		fragment = glCreateShader(GL_FRAGMENT_SHADER);
-		glShaderSource(fragment, 1, &fShaderCode, NULL);
-		glCompileShader(fragment);
-		checkCompileErrors(fragment, "FRAGMENT");
-		// shader Program
-		ID = glCreateProgram();
-		glAttachShader(ID, vertex);
-		glAttachShader(ID, fragment);
-		glLinkProgram(ID);
 		checkCompileErrors(ID, "PROGRAM");
+		gpuMemory.trackProgram(ID);
 		// delete the shaders as they're linked into our program now and no longer necessary
-		glDeleteShader(vertex);
-		glDeleteShader(fragment);
+		for (int i = 0; i < pendingShaderCount; i++)
+		{
+			glDeleteShader(pendingShaders[i]);
+		}
+		pendingShaderCount = 0;
+		pending = false;
+		return true;
+	}
+
+	bool isPending() const
+	{
+		return pending;
 	}
 
 	// activate the shader
 	// ------------------------------------------------------------------------
 	void use()
 	{
-		glUseProgram(ID);
+		glState.useProgram(ID);
 	}
-	// utility uniform functions
+	// utility uniform functions, they target the program directly so it does not have to be bound.
+	// The last value of every uniform is kept and setting the same value again is skipped.
 	// ------------------------------------------------------------------------
-	void setBool(const std::string& name, bool value) const
+	void setBool(const char* name, bool value) const
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+		int v = (int)value;
+		GLint location;
+		if (changed(name, &v, sizeof(v), location))
+		{
+			glProgramUniform1i(ID, location, v);
+		}
 	}
 	// ------------------------------------------------------------------------
-	void setInt(const std::string& name, int value) const
+	void setInt(const char* name, int value) const
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+		GLint location;
+		if (changed(name, &value, sizeof(value), location))
+		{
+			glProgramUniform1i(ID, location, value);
+		}
 	}
 	// ------------------------------------------------------------------------
-	void setFloat(const std::string& name, float value) const
+	void setUint(const char* name, unsigned int value) const
 	{
-		glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+		GLint location;
+		if (changed(name, &value, sizeof(value), location))
+		{
+			glProgramUniform1ui(ID, location, value);
+		}
+	}
+	// ------------------------------------------------------------------------
+	void setFloat(const char* name, float value) const
+	{
+		GLint location;
+		if (changed(name, &value, sizeof(value), location))
+		{
+			glProgramUniform1f(ID, location, value);
+		}
 	}
 	// ------------------------------------------------------------------------
-	void setVec2(const std::string& name, const glm::vec2& value) const
+	void setVec2(const char* name, const glm::vec2& value) const
 	{
-		glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		GLint location;
+		if (changed(name, &value[0], sizeof(value), location))
+		{
+			glProgramUniform2fv(ID, location, 1, &value[0]);
+		}
 	}
-	void setVec2(const std::string& name, float x, float y) const
+	void setVec2(const char* name, float x, float y) const
 	{
-		glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+		setVec2(name, glm::vec2(x, y));
 	}
 	// ------------------------------------------------------------------------
-	void setVec3(const std::string& name, const glm::vec3& value) const
+	void setVec3(const char* name, const glm::vec3& value) const
 	{
-		glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		GLint location;
+		if (changed(name, &value[0], sizeof(value), location))
+		{
+			glProgramUniform3fv(ID, location, 1, &value[0]);
+		}
 	}
-	void setVec3(const std::string& name, float x, float y, float z) const
+	void setVec3(const char* name, float x, float y, float z) const
 	{
-		glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+		setVec3(name, glm::vec3(x, y, z));
 	}
 	// ------------------------------------------------------------------------
-	void setVec4(const std::string& name, const glm::vec4& value) const
+	void setVec4(const char* name, const glm::vec4& value) const
+	{
+		GLint location;
+		if (changed(name, &value[0], sizeof(value), location))
+		{
+			glProgramUniform4fv(ID, location, 1, &value[0]);
+		}
+	}
+	void setVec4(const char* name, float x, float y, float z, float w) const
 	{
-		glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		setVec4(name, glm::vec4(x, y, z, w));
 	}
-	void setVec4(const std::string& name, float x, float y, float z, float w)
+	void setVec4Array(const char* name, const glm::vec4* values, int count) const
 	{
-		glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+		GLint location;
+		if (changed(name, &values[0][0], count * sizeof(glm::vec4), location))
+		{
+			glProgramUniform4fv(ID, location, count, &values[0][0]);
+		}
 	}
 	// ------------------------------------------------------------------------
-	void setMat2(const std::string& name, const glm::mat2& mat) const
+	void setMat2(const char* name, const glm::mat2& mat) const
 	{
-		glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		GLint location;
+		if (changed(name, &mat[0][0], sizeof(mat), location))
+		{
+			glProgramUniformMatrix2fv(ID, location, 1, GL_FALSE, &mat[0][0]);
+		}
 	}
 	// ------------------------------------------------------------------------
-	void setMat3(const std::string& name, const glm::mat3& mat) const
+	void setMat3(const char* name, const glm::mat3& mat) const
 	{
-		glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		GLint location;
+		if (changed(name, &mat[0][0], sizeof(mat), location))
+		{
+			glProgramUniformMatrix3fv(ID, location, 1, GL_FALSE, &mat[0][0]);
+		}
 	}
 	// ------------------------------------------------------------------------
-	void setMat4(const std::string& name, const glm::mat4& mat) const
+	void setMat4(const char* name, const glm::mat4& mat) const
 	{
-		glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		GLint location;
+		if (changed(name, &mat[0][0], sizeof(mat), location))
+		{
+			glProgramUniformMatrix4fv(ID, location, 1, GL_FALSE, &mat[0][0]);
+		}
 	}
 
 private:
+	// stages of a program started by beginLoad that finishLoad still has to check and delete
+	unsigned int pendingShaders[2];
+	const char* pendingTypes[2];
+	int pendingShaderCount = 0;
+	bool pending = false;
+
+	// location and last value sent for every uniform that has been set, a program has few uniforms
+	// so they are searched in order, which also keeps a lookup by string literal free of allocations
+	struct UniformValue {
+		std::string name;
+		GLint location;
+		std::vector<unsigned char> value;
+	};
+	mutable std::vector<UniformValue> uniforms;
+
+	// looks up the location once and reports whether value differs from the one last sent
+	// ------------------------------------------------------------------------
+	bool changed(const char* name, const void* value, size_t size, GLint& location) const
+	{
+		UniformValue* uniform = NULL;
+		for (size_t i = 0; i < uniforms.size(); i++)
+		{
+			if (strcmp(uniforms[i].name.c_str(), name) == 0)
+			{
+				uniform = &uniforms[i];
+				break;
+			}
+		}
+		if (uniform == NULL)
+		{
+			UniformValue added;
+			added.name = name;
+			added.location = glGetUniformLocation(ID, name);
+			uniforms.push_back(added);
+			uniform = &uniforms.back();
+		}
+
+		location = uniform->location;
+		if (uniform->value.size() == size && memcmp(uniform->value.data(), value, size) == 0)
+		{
+			glState.countUniform(false);
+			return false;
+		}
+
+		//same size as last time, so the storage is reused
+		uniform->value.assign((const unsigned char*)value, (const unsigned char*)value + size);
+		glState.countUniform(true);
+		return true;
+	}
+
+	// ------------------------------------------------------------------------
+	void addStage(GLenum stage, const char* type, const std::string& code)
+	{
+		const char* shaderCode = code.c_str();
+		unsigned int shader = glCreateShader(stage);
+		glShaderSource(shader, 1, &shaderCode, NULL);
+		glCompileShader(shader);
+		pendingShaders[pendingShaderCount] = shader;
+		pendingTypes[pendingShaderCount] = type;
+		pendingShaderCount++;
+	}
+
+	// linking does not wait for the compiles, the driver chains them
+	void linkStages()
+	{
+		uniforms.clear();
+		ID = glCreateProgram();
+		for (int i = 0; i < pendingShaderCount; i++)
+		{
+			glAttachShader(ID, pendingShaders[i]);
+		}
+		glLinkProgram(ID);
+		pending = true;
+	}
+
+	// the #version directive has to stay the first line of the source
+	// ------------------------------------------------------------------------
+	static void injectDefines(std::string& code, const std::string& defines)
+	{
+		if (defines.empty())
+		{
+			return;
+		}
+
+		if (code.compare(0, 8, "#version") != 0)
+		{
+			code.insert(0, defines + "#line 1\n");
+			return;
+		}
+
+		size_t position = code.find('\n');
+		position = position == std::string::npos ? code.size() : position + 1;
+		// keep the line numbers of compile errors matching the file
+		code.insert(position, defines + "#line 2\n");
+	}
+
 	// utility function for checking shader compilation/linking errors.
 	// ------------------------------------------------------------------------
-	void checkCompileErrors(unsigned int shader, std::string type)
+	void checkCompileErrors(unsigned int shader, const char* type)
 	{
 		int success;
 		char infoLog[1024];
-		if (type != "PROGRAM")
+		if (strcmp(type, "PROGRAM") != 0)
 		{
 			glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
 			if (!success)
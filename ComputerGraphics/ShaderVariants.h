@@ -0,0 +1,133 @@
+#pragma once
+
+/*
+ Compile-time permutations of one vertex/fragment shader pair.
+ A variant is selected by a bit set of features, every set bit becomes a #define in both stages.
+ Variants are compiled the first time they are requested and cached by their key, so switching
+ back and forth between them only costs a program bind. Variants that are likely to be needed can be
+ handed to the startup loader ahead of time, get() waits for one that is still compiling.
+*/
+
+#include <GL/glew.h>
+
+#include <map>
+#include <string>
+#include <sstream>
+
+#include "Shader.h"
+#include "GLState.h"
+#include "StartupLoader.h"
+
+// Features of the scene shader, each one is injected as a #define of the same name
+enum ShaderFeature {
+	FEATURE_CEILING_LAMP = 1 << 0,		// CEILING_LAMP, ceiling light contributes
+	FEATURE_NIGHT_LAMP = 1 << 1,		// NIGHT_LAMP, night stand light contributes
+	FEATURE_NIGHT_LAMP_SPOT = 1 << 2,	// NIGHT_LAMP_SPOT, night stand light is limited to its cone
+	FEATURE_LIGHTMAP = 1 << 3,			// LIGHTMAP, diffuse light comes from the baked lamp lightmaps
+	FEATURE_TRANSLUCENT = 1 << 4,		// TRANSLUCENT, writes the weighted blended OIT targets instead of the scene color
+	FEATURE_PACKED_INSTANCES = 1 << 5,	// PACKED_INSTANCES, objects are read from the packed records and the material palette
+	FEATURE_COUNT = 6
+};
+
+class ShaderVariants
+{
+public:
+	// called once for every newly compiled variant to set the uniforms that never change
+	typedef void (*InitCallback)(Shader&);
+
+	ShaderVariants() {}
+
+	void init(const char* vertexPath, const char* fragmentPath, InitCallback callback)
+	{
+		this->vertexPath = vertexPath;
+		this->fragmentPath = fragmentPath;
+		initCallback = callback;
+	}
+
+	// returns the variant for the feature bits, compiles it on first use
+	// ------------------------------------------------------------------------
+	Shader& get(unsigned int features)
+	{
+		std::map<unsigned int, Shader>::iterator it = variants.find(features);
+		if (it != variants.end())
+		{
+			if (it->second.finishLoad() && initCallback != NULL)
+			{
+				initCallback(it->second);
+			}
+			return it->second;
+		}
+
+		MemoryScope scope(MEMORY_TAG_SHADERS);
+		Shader& shader = variants[features];
+		shader.Load(vertexPath.c_str(), fragmentPath.c_str(), getDefines(features));
+		if (initCallback != NULL)
+		{
+			initCallback(shader);
+		}
+
+		return shader;
+	}
+
+	// compiles the variant with the other startup programs instead of on first use
+	// ------------------------------------------------------------------------
+	void request(StartupLoader& loader, unsigned int features, bool required)
+	{
+		if (variants.find(features) != variants.end())
+		{
+			return;
+		}
+
+		MemoryScope scope(MEMORY_TAG_SHADERS);
+		Shader& shader = variants[features];
+		loader.addProgram(shader, vertexPath.c_str(), fragmentPath.c_str(), getDefines(features), required, initCallback);
+	}
+
+	// ------------------------------------------------------------------------
+	static std::string getDefines(unsigned int features)
+	{
+		static const char* names[FEATURE_COUNT] = { "CEILING_LAMP", "NIGHT_LAMP", "NIGHT_LAMP_SPOT", "LIGHTMAP", "TRANSLUCENT", "PACKED_INSTANCES" };
+
+		std::stringstream defines;
+		int lightCount = 0;
+		for (int i = 0; i < FEATURE_COUNT; i++)
+		{
+			if (features & (1u << i))
+			{
+				defines << "#define " << names[i] << "\n";
+			}
+		}
+
+		if (features & FEATURE_CEILING_LAMP)
+		{
+			lightCount++;
+		}
+		if (features & FEATURE_NIGHT_LAMP)
+		{
+			lightCount++;
+		}
+		defines << "#define LIGHT_COUNT " << lightCount << "\n";
+
+		return defines.str();
+	}
+
+	size_t getVariantCount() const
+	{
+		return variants.size();
+	}
+
+	void release()
+	{
+		for (std::map<unsigned int, Shader>::iterator it = variants.begin(); it != variants.end(); ++it)
+		{
+			glState.deleteProgram(it->second.ID);
+		}
+		variants.clear();
+	}
+
+private:
+	std::string vertexPath;
+	std::string fragmentPath;
+	InitCallback initCallback = NULL;
+	std::map<unsigned int, Shader> variants;
+};
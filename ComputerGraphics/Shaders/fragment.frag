@@ -1,6 +1,7 @@
-#version 330 core
+#version 450 core
 struct Material {
     vec3 emission;
+    float opacity; //below 1 the object is drawn by the TRANSLUCENT variant
     vec3 ambient;
     vec3 diffuse;
     vec3 specular;    
@@ -10,6 +11,18 @@ struct Material {
     float shininess;
 }; 
 
+struct ObjectTransform {
+    vec3 translation;
+    vec4 rotation;
+    vec3 scale;
+};
+
+struct ObjectData {
+    ObjectTransform transform;
+    Material material;
+    uint mesh; //into the shared geometry, the std430 stride of the record is 144 bytes
+};
+
 struct Light {
     vec3 position;
     vec3 diffuse; //the color of the light
@@ -27,68 +40,141 @@ struct Light {
 };*/
 
 
-vec3 getAmbient(Material);
-vec3 getDiffuse(Material, Light);
-vec3 getSpecular(Material, Light);
-
+//variant defines injected by ShaderVariants: CEILING_LAMP, NIGHT_LAMP, NIGHT_LAMP_SPOT, LIGHTMAP, TRANSLUCENT, PACKED_INSTANCES
+//and LIGHT_COUNT
+#ifndef LIGHT_COUNT
+#define LIGHT_COUNT 0
+#endif
 
-out vec4 FragColor;
+vec3 getAmbient(Material);
+vec3 getDiffuse(Material, Light, vec3);
+vec3 getSpecular(Material, Light, vec3, vec3);
+
+
+#ifdef TRANSLUCENT
+//weighted blended order independent transparency: the weighted premultiplied colors are summed in the
+//accumulation target, the product of the transparencies is kept in the revealage target
+layout(location = 0) out vec4 FragAccumulation;
+layout(location = 1) out float FragRevealage;
+#else
+layout(location = 0) out vec4 FragColor;
+//read by the SSAO passes, nothing is attached to them while SSAO is off
+layout(location = 1) out vec4 FragAmbient;
+layout(location = 2) out vec4 FragNormal;
+#endif
 uniform vec4 color; //Test 
 
 in vec3 FragPos;  
 in vec3 Normal;  
-  
-uniform vec3 viewPos;
+flat in uint ObjectIndex;
 
-uniform Material fragMaterial;
+layout(std140, binding = 0) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec4 viewPos;
+};
 
-uniform Light ceilingLampLight;
-uniform Light nightLampLight;
+#ifdef PACKED_INSTANCES
+//the packed records only hold the index of the material
+flat in uint MaterialIndex;
 
-uniform bool ceilingLampStatus;
-uniform bool nightLampStatus;
+layout(std430, binding = 11) readonly buffer MaterialPaletteBuffer {
+    Material materials[];
+};
+#else
+layout(std430, binding = 1) readonly buffer ObjectBuffer {
+    ObjectData objects[];
+};
+#endif
+
+#ifdef LIGHTMAP
+in vec2 LightmapUV;
+#endif
+
+#ifdef CEILING_LAMP
+uniform Light ceilingLampLight;
+#ifdef LIGHTMAP
+layout(binding = 1) uniform sampler2D ceilingLampLightmap;
+#endif
+#endif
 
+#ifdef NIGHT_LAMP
+uniform Light nightLampLight;
+#ifdef LIGHTMAP
+layout(binding = 2) uniform sampler2D nightLampLightmap;
+#endif
+#ifdef NIGHT_LAMP_SPOT
 uniform vec3 nightLampLightDirection;
 uniform float nightLampLightCutOff;
 uniform float nightLampLightOuterCutOff;
+#endif
+#endif
 
 void main()
 {
+#ifdef PACKED_INSTANCES
+    Material fragMaterial = materials[MaterialIndex];
+#else
+    Material fragMaterial = objects[ObjectIndex].material;
+#endif
+
     vec3 ambient = getAmbient(fragMaterial);
-    
-    vec3 diffuseCeilingLampLight = getDiffuse(fragMaterial,ceilingLampLight);
-    vec3 specularCeilingLampLight = getSpecular(fragMaterial, ceilingLampLight);
-
-    vec3 diffuseNightLampLight = getDiffuse(fragMaterial,nightLampLight);
-    vec3 specularNightLampLight = getSpecular(fragMaterial, nightLampLight);
-
-    if(!ceilingLampStatus)
-    {
-        diffuseCeilingLampLight = vec3(0.0f,0.0f,0.0f);
-        specularCeilingLampLight = vec3(0.0f,0.0f,0.0f);
-    }
-
-    if(nightLampStatus)
-    {
-        vec3 lightDirection = normalize(nightLampLight.position - FragPos);
-        float theta = dot(lightDirection, normalize(-nightLampLightDirection));
-        float epsilon = (nightLampLightCutOff - nightLampLightOuterCutOff);
-        float intensity = clamp((theta - nightLampLightOuterCutOff) / epsilon, 0.0, 1.0);
-            
-        diffuseNightLampLight *= intensity;
-        specularNightLampLight *= intensity;
-    }
-    else
-    {
-        diffuseNightLampLight = vec3(0.0f,0.0f,0.0f);
-        specularNightLampLight = vec3(0.0f,0.0f,0.0f);
-    }
-   
-   vec3 result = fragMaterial.emission + ambient + 
-   diffuseCeilingLampLight + specularCeilingLampLight +
-   diffuseNightLampLight + specularNightLampLight;
 
+    vec3 result = fragMaterial.emission + ambient;
+
+#if LIGHT_COUNT > 0
+    vec3 norm = normalize(Normal);
+    vec3 viewDir = normalize(viewPos.xyz - FragPos);
+#endif
+
+#ifdef CEILING_LAMP
+#ifdef LIGHTMAP
+    //baked irradiance with shadows and one indirect bounce, the albedo is applied here
+    vec3 diffuseCeilingLampLight = fragMaterial.kd * fragMaterial.diffuse * texture(ceilingLampLightmap, LightmapUV).rgb;
+#else
+    vec3 diffuseCeilingLampLight = getDiffuse(fragMaterial, ceilingLampLight, norm);
+#endif
+    vec3 specularCeilingLampLight = getSpecular(fragMaterial, ceilingLampLight, norm, viewDir);
+
+    result += diffuseCeilingLampLight + specularCeilingLampLight;
+#endif
+
+#ifdef NIGHT_LAMP
+#ifdef LIGHTMAP
+    //the spotlight cone is already part of the baked irradiance
+    vec3 diffuseNightLampLight = fragMaterial.kd * fragMaterial.diffuse * texture(nightLampLightmap, LightmapUV).rgb;
+#else
+    vec3 diffuseNightLampLight = getDiffuse(fragMaterial, nightLampLight, norm);
+#endif
+    vec3 specularNightLampLight = getSpecular(fragMaterial, nightLampLight, norm, viewDir);
+
+#ifdef NIGHT_LAMP_SPOT
+    vec3 lightDirection = normalize(nightLampLight.position - FragPos);
+    float theta = dot(lightDirection, normalize(-nightLampLightDirection));
+    float epsilon = (nightLampLightCutOff - nightLampLightOuterCutOff);
+    float intensity = clamp((theta - nightLampLightOuterCutOff) / epsilon, 0.0, 1.0);
+
+#ifndef LIGHTMAP
+    diffuseNightLampLight *= intensity;
+#endif
+    specularNightLampLight *= intensity;
+#endif
+
+    result += diffuseNightLampLight + specularNightLampLight;
+#endif
+
+#ifdef TRANSLUCENT
+    //McGuire and Bavoil's depth weight, nearer surfaces dominate the average where layers overlap
+    float alpha = fragMaterial.opacity;
+    float viewDepth = -(view * vec4(FragPos, 1.0)).z;
+    float weight = alpha * clamp(10.0 / (1e-5 + pow(viewDepth / 5.0, 2.0) + pow(viewDepth / 200.0, 6.0)), 1e-2, 3e3);
+    FragAccumulation = vec4(result * alpha, alpha) * weight;
+    FragRevealage = alpha;
+#else
    FragColor = vec4(result, 1.0f);
+   FragAmbient = vec4(ambient, 1.0f);
+   FragNormal = vec4(normalize(Normal) * 0.5 + 0.5, 1.0f);
+#endif
 
     //FragColor = vec4(ambient, 1.0f);
     //FragColor = vec4(result, 1.0f);
@@ -103,9 +189,8 @@ vec3 getAmbient(Material material)
 }
 
 
-vec3 getDiffuse(Material material, Light light)
+vec3 getDiffuse(Material material, Light light, vec3 norm)
 {
-    vec3 norm = normalize(Normal);
     vec3 lightDir = normalize(light.position - FragPos);
     float diff = max(dot(norm, lightDir), 0.0); //cos to light direction
     vec3 diffuse = light.diffuse * material.kd * (diff * material.diffuse);
@@ -114,13 +199,10 @@ vec3 getDiffuse(Material material, Light light)
 }
 
 
-vec3 getSpecular(Material material, Light light)
+vec3 getSpecular(Material material, Light light, vec3 norm, vec3 viewDir)
 {
-    vec3 norm = normalize(Normal);
     vec3 lightDir = normalize(light.position - FragPos);
 
-
-    vec3 viewDir = normalize(viewPos - FragPos);
     vec3 reflectDir = reflect(-lightDir, norm);  
 	//cos to the power of shininess of angle between light reflected ray and view direction
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess); 
@@ -0,0 +1,18 @@
+#version 450 core
+
+//the atlas only holds coverage, the glyphs are scaled by whole pixels so every fragment hits one texel
+in vec2 AtlasCoords;
+flat in vec4 Color;
+out vec4 FragColor;
+
+layout(binding = 0) uniform sampler2D atlas;
+
+void main()
+{
+    float coverage = texelFetch(atlas, ivec2(AtlasCoords), 0).r;
+    if (coverage == 0.0)
+    {
+        discard;
+    }
+    FragColor = vec4(Color.rgb, Color.a * coverage);
+}
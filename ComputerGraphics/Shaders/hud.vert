@@ -0,0 +1,34 @@
+#version 450 core
+
+//six vertices per quad of the overlay, the quads come from the stream buffer, no vertex buffer needed
+struct HudQuad
+{
+    vec4 rect;  //x, y, width, height in pixels from the top left corner
+    vec4 uv;    //the same in texels of the atlas
+    vec4 color;
+};
+
+layout(std430, binding = 8) readonly buffer HudQuadBuffer
+{
+    HudQuad quads[];
+};
+
+uniform vec2 screenSize;
+
+out vec2 AtlasCoords;
+flat out vec4 Color;
+
+const vec2 corners[6] = vec2[](vec2(0.0, 0.0), vec2(1.0, 0.0), vec2(1.0, 1.0), vec2(0.0, 0.0), vec2(1.0, 1.0), vec2(0.0, 1.0));
+
+void main()
+{
+    HudQuad quad = quads[gl_VertexID / 6];
+    vec2 corner = corners[gl_VertexID % 6];
+
+    vec2 position = quad.rect.xy + corner * quad.rect.zw;
+    AtlasCoords = quad.uv.xy + corner * quad.uv.zw;
+    Color = quad.color;
+
+    vec2 ndc = position / screenSize * 2.0 - 1.0;
+    gl_Position = vec4(ndc.x, -ndc.y, 0.0, 1.0);
+}
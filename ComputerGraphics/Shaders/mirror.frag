@@ -0,0 +1,16 @@
+#version 450 core
+
+//the reflection was rendered from the mirrored camera over the same screen, so the texel at the fragment's
+//screen position is what the mirror shows there
+out vec4 FragColor;
+
+layout(binding = 0) uniform sampler2D reflection;
+
+uniform vec2 targetSize;
+uniform vec3 tint; //the glass takes a little of the light and colors it
+
+void main()
+{
+    vec3 color = texture(reflection, gl_FragCoord.xy / targetSize).rgb;
+    FragColor = vec4(color * tint, 1.0);
+}
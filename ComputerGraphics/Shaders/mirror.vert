@@ -0,0 +1,19 @@
+#version 450 core
+
+//the mirror's front face as a strip of two triangles, no vertex buffer needed
+layout(std140, binding = 0) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec4 viewPos;
+};
+
+uniform vec3 corner;
+uniform vec3 edgeU;
+uniform vec3 edgeV;
+
+void main()
+{
+    vec2 c = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+    vec3 position = corner + edgeU * c.x + edgeV * c.y;
+    gl_Position = projection * view * vec4(position, 1.0);
+}
@@ -0,0 +1,35 @@
+#version 450 core
+
+//scales the tonemapped frame to the window, a contrast adaptive sharpen restores some of the detail
+//the bilinear upscale loses; the sharpening backs off where the neighbourhood is already contrasty
+in vec2 TexCoords;
+out vec4 FragColor;
+
+layout(binding = 0) uniform sampler2D source;
+
+uniform float sharpness; //0 is a plain bilinear upscale, 1 the strongest sharpening
+
+void main()
+{
+    vec3 center = texture(source, TexCoords).rgb;
+    if (sharpness <= 0.0)
+    {
+        FragColor = vec4(center, 1.0);
+        return;
+    }
+
+    vec2 texelSize = 1.0 / vec2(textureSize(source, 0));
+    vec3 north = texture(source, TexCoords + vec2(0.0, texelSize.y)).rgb;
+    vec3 south = texture(source, TexCoords - vec2(0.0, texelSize.y)).rgb;
+    vec3 east = texture(source, TexCoords + vec2(texelSize.x, 0.0)).rgb;
+    vec3 west = texture(source, TexCoords - vec2(texelSize.x, 0.0)).rgb;
+
+    vec3 minimum = min(center, min(min(north, south), min(east, west)));
+    vec3 maximum = max(center, max(max(north, south), max(east, west)));
+
+    vec3 amplitude = sqrt(clamp(min(minimum, 1.0 - maximum) / max(maximum, 0.0001), 0.0, 1.0));
+    vec3 weight = amplitude * (-1.0 / mix(8.0, 5.0, sharpness));
+
+    vec3 result = (center + (north + south + east + west) * weight) / (1.0 + 4.0 * weight);
+    FragColor = vec4(clamp(result, 0.0, 1.0), 1.0);
+}
@@ -1,21 +1,153 @@
-#version 330 core
+#version 450 core
 layout(location = 0) in vec3 aPos;
 layout(location = 1) in vec3 aNormal;
+layout(location = 2) in uint aObjectIndex; //advances per instance, offset by the draw's base instance
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-  
-uniform mat3 normalMat;
+//written by object_transforms.comp from the translation, rotation and scale of every object
+struct ObjectMatrices {
+    mat4 model;
+    mat3 normal;
+};
+
+layout(std140, binding = 0) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec4 viewPos;
+};
 
 out vec3 FragPos;
 out vec3 Normal;
+flat out uint ObjectIndex;
+
+#ifdef PACKED_INSTANCES
+//compact records of the GPU-driven path, decoded here instead of reading matrices. See PackedInstances.h
+struct PackedInstance {
+    uvec2 positionCell; //16 bit fixed point x, y and z inside the cell, the cell index
+    uvec2 scaleMaterial; //half float x, y and z, the material index
+    uint rotation; //10 bits of each of the three smallest quaternion components, the index of the largest on top
+    uint mesh;
+};
+
+//translation, rotation and scale of the objects the packing is not precise enough for
+struct ObjectTransform {
+    vec3 translation;
+    vec4 rotation;
+    vec3 scale;
+};
+
+const uint EXACT_CELL = 65535u; //the rotation of the record is the index of its exact transform
+
+layout(std430, binding = 9) readonly buffer PackedInstanceBuffer {
+    PackedInstance instances[];
+};
+
+layout(std430, binding = 10) readonly buffer CellOriginBuffer {
+    vec4 cellOrigins[]; //w is the size of the cell
+};
+
+layout(std430, binding = 12) readonly buffer ExactTransformBuffer {
+    ObjectTransform exactTransforms[];
+};
+
+flat out uint MaterialIndex;
+
+vec4 decodeRotation(uint bits)
+{
+    vec3 small = (vec3(uvec3(bits >> 20, bits >> 10, bits) & 1023u) / 511.0 - 1.0) * 0.70710678;
+    float largest = sqrt(max(1.0 - dot(small, small), 0.0));
+
+    //the largest component goes back between the others, they kept their order
+    uint index = bits >> 30;
+    if (index == 0u)
+    {
+        return vec4(largest, small);
+    }
+    if (index == 1u)
+    {
+        return vec4(small.x, largest, small.yz);
+    }
+    if (index == 2u)
+    {
+        return vec4(small.xy, largest, small.z);
+    }
+    return vec4(small, largest);
+}
+
+//the same as in object_transforms.comp
+mat3 getRotationMatrix(vec4 q)
+{
+    vec3 q2 = q.xyz * 2.0;
+    float xx = q.x * q2.x, yy = q.y * q2.y, zz = q.z * q2.z;
+    float xy = q.x * q2.y, xz = q.x * q2.z, yz = q.y * q2.z;
+    float wx = q.w * q2.x, wy = q.w * q2.y, wz = q.w * q2.z;
+
+    return mat3(1.0 - yy - zz, xy + wz, xz - wy,
+                xy - wz, 1.0 - xx - zz, yz + wx,
+                xz + wy, yz - wx, 1.0 - xx - yy);
+}
+#else
+layout(std430, binding = 6) readonly buffer ObjectMatrixBuffer {
+    ObjectMatrices matrices[];
+};
+#endif
+
+#ifdef LIGHTMAP
+struct LightmapRects {
+    vec4 faces[6];
+};
+
+layout(std430, binding = 5) readonly buffer LightmapRectBuffer {
+    LightmapRects lightmapRects[];
+};
+
+out vec2 LightmapUV;
+#endif
 
 void main()
 { 
-	FragPos = vec3(model * vec4(aPos,1.0));
-	Normal = normalMat * aNormal;
+#ifdef PACKED_INSTANCES
+	PackedInstance instance = instances[aObjectIndex];
+	uint cellIndex = instance.positionCell.y >> 16;
+	vec3 position;
+	vec3 scale;
+	mat3 rotation;
+	if (cellIndex == EXACT_CELL)
+	{
+		ObjectTransform transform = exactTransforms[instance.rotation];
+		position = transform.translation;
+		scale = transform.scale;
+		rotation = getRotationMatrix(transform.rotation);
+	}
+	else
+	{
+		vec4 cell = cellOrigins[cellIndex];
+		position = cell.xyz + vec3(unpackUnorm2x16(instance.positionCell.x), unpackUnorm2x16(instance.positionCell.y).x) * cell.w;
+		scale = vec3(unpackHalf2x16(instance.scaleMaterial.x), unpackHalf2x16(instance.scaleMaterial.y).x);
+		rotation = getRotationMatrix(decodeRotation(instance.rotation));
+	}
+
+	//the model matrix of object_transforms.comp, the same operations leave the same depth where parts touch
+	mat4 model = mat4(vec4(rotation[0] * scale.x, 0.0), vec4(rotation[1] * scale.y, 0.0),
+		vec4(rotation[2] * scale.z, 0.0), vec4(position, 1.0));
+	FragPos = vec3(model * vec4(aPos, 1.0));
+	//transpose(inverse(model)) of a TRS, the fragment shader normalizes the result
+	Normal = mat3(rotation[0] / scale.x, rotation[1] / scale.y, rotation[2] / scale.z) * aNormal;
+	MaterialIndex = instance.scaleMaterial.y >> 16;
+#else
+	FragPos = vec3(matrices[aObjectIndex].model * vec4(aPos,1.0));
+	Normal = matrices[aObjectIndex].normal * aNormal;
+#endif
+	ObjectIndex = aObjectIndex;
+
+#ifdef LIGHTMAP
+	//the cube has 4 vertices per side, the side selects the atlas rectangle and the axes of its uv.
+	//imported meshes follow the cube in the vertex buffer and only have the rectangles of their box,
+	//they are clamped to its top
+	int side = min(gl_VertexID / 4, 5);
+	vec2 local = side < 2 ? aPos.xy : (side < 4 ? aPos.zy : aPos.xz);
+	vec4 rect = lightmapRects[aObjectIndex].faces[side];
+	LightmapUV = rect.xy + (local + 0.5) * rect.zw;
+#endif
 
 	gl_Position = projection * view * vec4(FragPos, 1.0);
 }
-
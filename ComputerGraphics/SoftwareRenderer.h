@@ -0,0 +1,485 @@
+#pragma once
+
+/*
+ CPU reference renderer of the scene, no GL needed.
+ It takes the same data as the GL path (cube geometry, object records, FrameData and the lights)
+ and mirrors vertex.vert/fragment.frag. A frame runs in three parallel phases on a ThreadPool:
+ vertices are transformed and triangles set up per object, triangles are binned into screen tiles,
+ and every tile is rasterized on its own with SSE edge functions and a depth test. The image is
+ bottom-up RGBA like a glReadPixels readback, so both can be compared directly.
+*/
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <emmintrin.h>
+
+#include "Scene.h"
+#include "ThreadPool.h"
+#include "MemoryTracker.h"
+
+struct SoftwareLight {
+	bool enabled = false;
+	glm::vec3 position;
+	glm::vec3 diffuse;
+};
+
+// Uniforms of fragment.frag and the tonemapping of tonemap.comp (bloom and SSAO are not reproduced)
+struct SoftwareShading {
+	SoftwareLight ceilingLamp;
+	SoftwareLight nightLamp;
+	glm::vec3 nightLampDirection;
+	float nightLampCutOff = 1.0f;
+	float nightLampOuterCutOff = 1.0f;
+	float exposure = 1.0f;
+	float shoulderStart = 0.8f;
+};
+
+struct SoftwareRenderStats {
+	unsigned int threads = 0;
+	unsigned int triangles = 0;		// after near plane clipping
+	unsigned int binnedTriangles = 0;	// triangle/tile pairs
+	double geometryMilliseconds = 0.0;
+	double binningMilliseconds = 0.0;
+	double rasterMilliseconds = 0.0;
+	double totalMilliseconds = 0.0;
+};
+
+class SoftwareRenderer
+{
+public:
+	static const int TILE_SIZE = 32;
+
+	SoftwareRenderer() {}
+
+	// vertices hold position and normal per vertex like the cube's vertex buffer
+	// ------------------------------------------------------------------------
+	void setMesh(const float* vertices, int vertexCount, const unsigned int* indices, int indexCount)
+	{
+		meshVertices.assign(vertices, vertices + vertexCount * 6);
+		meshIndices.assign(indices, indices + indexCount);
+	}
+
+	// ------------------------------------------------------------------------
+	void resize(int width, int height)
+	{
+		MemoryScope scope(MEMORY_TAG_SOFTWARE);
+
+		this->width = width;
+		this->height = height;
+		tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+		tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+		stride = tilesX * TILE_SIZE;
+
+		//padded to whole tiles so the SIMD loops never need a tail
+		depth.assign((size_t)stride * tilesY * TILE_SIZE, 1.0f);
+		color.assign((size_t)stride * tilesY * TILE_SIZE, 0);
+		image.assign((size_t)width * height * 4, 0);
+	}
+
+	// renders one frame, the result is available through getImage()
+	// ------------------------------------------------------------------------
+	SoftwareRenderStats render(const std::vector<ObjectData>& objects, const FrameData& frame, const SoftwareShading& shading, ThreadPool& pool)
+	{
+		typedef std::chrono::steady_clock Clock;
+		Clock::time_point start = Clock::now();
+
+		MemoryScope scope(MEMORY_TAG_SOFTWARE);
+		SoftwareRenderStats stats;
+		stats.threads = pool.getThreadCount();
+
+		this->frame = &frame;
+		this->shading = &shading;
+		this->objects = &objects;
+
+		int trianglesPerObject = (int)meshIndices.size() / 3 * 2;
+		triangles.resize(objects.size() * trianglesPerObject);
+		triangleCounts.assign(objects.size(), 0);
+
+		glm::mat4 viewProjection = frame.projection * frame.view;
+
+		//1. transform and set up the triangles of every object
+		pool.parallelFor((int)objects.size(), 4, [&](int begin, int end)
+		{
+			for (int i = begin; i < end; i++)
+			{
+				setupObject(i, viewProjection, &triangles[(size_t)i * trianglesPerObject]);
+			}
+		});
+
+		Clock::time_point geometryEnd = Clock::now();
+
+		//2. bin into tiles, objects are split into ordered ranges so the submission order is kept per tile
+		int tileCount = tilesX * tilesY;
+		int rangeCount = (int)stats.threads * 2;
+		int objectsPerRange = ((int)objects.size() + rangeCount - 1) / rangeCount;
+		bins.resize((size_t)rangeCount * tileCount);
+
+		pool.parallelFor(rangeCount, 1, [&](int begin, int end)
+		{
+			for (int range = begin; range < end; range++)
+			{
+				std::vector<int>* rangeBins = &bins[(size_t)range * tileCount];
+				for (int tile = 0; tile < tileCount; tile++)
+				{
+					rangeBins[tile].clear();
+				}
+
+				int firstObject = range * objectsPerRange;
+				int lastObject = std::min((int)objects.size(), firstObject + objectsPerRange);
+				for (int object = firstObject; object < lastObject; object++)
+				{
+					for (int t = 0; t < triangleCounts[object]; t++)
+					{
+						int index = object * trianglesPerObject + t;
+						const Triangle& triangle = triangles[index];
+						for (int ty = triangle.minY / TILE_SIZE; ty <= triangle.maxY / TILE_SIZE; ty++)
+						{
+							for (int tx = triangle.minX / TILE_SIZE; tx <= triangle.maxX / TILE_SIZE; tx++)
+							{
+								rangeBins[ty * tilesX + tx].push_back(index);
+							}
+						}
+					}
+				}
+			}
+		});
+
+		Clock::time_point binningEnd = Clock::now();
+
+		//3. every tile owns its pixels, no synchronisation while rasterizing
+		pool.parallelFor(tileCount, 1, [&](int begin, int end)
+		{
+			for (int tile = begin; tile < end; tile++)
+			{
+				rasterizeTile(tile, rangeCount, tileCount);
+			}
+		});
+
+		for (int y = 0; y < height; y++)
+		{
+			memcpy(&image[(size_t)y * width * 4], &color[(size_t)y * stride], (size_t)width * 4);
+		}
+
+		Clock::time_point end = Clock::now();
+
+		for (size_t i = 0; i < triangleCounts.size(); i++)
+		{
+			stats.triangles += triangleCounts[i];
+		}
+		for (size_t i = 0; i < bins.size(); i++)
+		{
+			stats.binnedTriangles += (unsigned int)bins[i].size();
+		}
+		stats.geometryMilliseconds = std::chrono::duration<double, std::milli>(geometryEnd - start).count();
+		stats.binningMilliseconds = std::chrono::duration<double, std::milli>(binningEnd - geometryEnd).count();
+		stats.rasterMilliseconds = std::chrono::duration<double, std::milli>(end - binningEnd).count();
+		stats.totalMilliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+		return stats;
+	}
+
+	// bottom-up RGBA8, width * height * 4 bytes
+	const std::vector<unsigned char>& getImage() const
+	{
+		return image;
+	}
+
+	int getWidth() const
+	{
+		return width;
+	}
+
+	int getHeight() const
+	{
+		return height;
+	}
+
+private:
+	// a screen-space triangle ready for rasterization, attributes are divided by w for perspective correction
+	struct Triangle {
+		float x[3];
+		float y[3];
+		float z[3];				// window depth in [0, 1]
+		float inverseW[3];
+		glm::vec3 worldOverW[3];
+		glm::vec3 normal;
+		int object;
+		int minX, minY, maxX, maxY;
+	};
+
+	struct ClipVertex {
+		glm::vec4 position;
+		glm::vec3 world;
+	};
+
+	std::vector<float> meshVertices;
+	std::vector<unsigned int> meshIndices;
+
+	int width = 0;
+	int height = 0;
+	int tilesX = 0;
+	int tilesY = 0;
+	int stride = 0;
+	std::vector<float> depth;
+	std::vector<unsigned int> color;
+	std::vector<unsigned char> image;
+
+	std::vector<Triangle> triangles;
+	std::vector<int> triangleCounts;
+	std::vector<std::vector<int>> bins;
+
+	const FrameData* frame = NULL;
+	const SoftwareShading* shading = NULL;
+	const std::vector<ObjectData>* objects = NULL;
+
+	// vertex.vert plus clipping against the near plane, the only plane that needs real clipping, the
+	// matrices are the ones object_transforms.comp computes
+	void setupObject(int object, const glm::mat4& viewProjection, Triangle* out)
+	{
+		glm::mat4 model = getModelMatrix((*objects)[object].transform);
+		glm::mat4 modelViewProjection = viewProjection * model;
+		glm::mat3 normalMat = getNormalMatrix((*objects)[object].transform);
+		int count = 0;
+
+		for (size_t i = 0; i + 2 < meshIndices.size(); i += 3)
+		{
+			ClipVertex input[3];
+			for (int k = 0; k < 3; k++)
+			{
+				const float* v = &meshVertices[meshIndices[i + k] * 6];
+				glm::vec4 position = glm::vec4(v[0], v[1], v[2], 1.0f);
+				input[k].position = modelViewProjection * position;
+				input[k].world = glm::vec3(model * position);
+			}
+			const float* n = &meshVertices[meshIndices[i] * 6 + 3];
+			glm::vec3 normal = normalMat * glm::vec3(n[0], n[1], n[2]);
+
+			//Sutherland-Hodgman against z >= -w
+			ClipVertex clipped[4];
+			int clippedCount = 0;
+			for (int k = 0; k < 3; k++)
+			{
+				const ClipVertex& a = input[k];
+				const ClipVertex& b = input[(k + 1) % 3];
+				float da = a.position.z + a.position.w;
+				float db = b.position.z + b.position.w;
+				if (da >= 0.0f)
+				{
+					clipped[clippedCount++] = a;
+				}
+				if ((da >= 0.0f) != (db >= 0.0f))
+				{
+					float t = da / (da - db);
+					clipped[clippedCount].position = glm::mix(a.position, b.position, t);
+					clipped[clippedCount].world = glm::mix(a.world, b.world, t);
+					clippedCount++;
+				}
+			}
+
+			for (int k = 1; k + 1 < clippedCount; k++)
+			{
+				if (setupTriangle(clipped[0], clipped[k], clipped[k + 1], normal, object, out[count]))
+				{
+					count++;
+				}
+			}
+		}
+
+		triangleCounts[object] = count;
+	}
+
+	bool setupTriangle(const ClipVertex& a, const ClipVertex& b, const ClipVertex& c, const glm::vec3& normal, int object, Triangle& triangle)
+	{
+		const ClipVertex* vertices[3] = { &a, &b, &c };
+		float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f;
+		for (int k = 0; k < 3; k++)
+		{
+			const glm::vec4& p = vertices[k]->position;
+			float inverseW = 1.0f / p.w;
+			triangle.x[k] = (p.x * inverseW * 0.5f + 0.5f) * width;
+			triangle.y[k] = (p.y * inverseW * 0.5f + 0.5f) * height;
+			triangle.z[k] = p.z * inverseW * 0.5f + 0.5f;
+			triangle.inverseW[k] = inverseW;
+			triangle.worldOverW[k] = vertices[k]->world * inverseW;
+			minX = std::min(minX, triangle.x[k]);
+			minY = std::min(minY, triangle.y[k]);
+			maxX = std::max(maxX, triangle.x[k]);
+			maxY = std::max(maxY, triangle.y[k]);
+		}
+
+		float area = (triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0]) - (triangle.x[2] - triangle.x[0]) * (triangle.y[1] - triangle.y[0]);
+		if (area == 0.0f || maxX < 0.0f || maxY < 0.0f || minX >= width || minY >= height)
+		{
+			return false;
+		}
+
+		triangle.minX = std::max(0, (int)std::floor(minX));
+		triangle.minY = std::max(0, (int)std::floor(minY));
+		triangle.maxX = std::min(width - 1, (int)std::ceil(maxX));
+		triangle.maxY = std::min(height - 1, (int)std::ceil(maxY));
+		triangle.normal = normal;
+		triangle.object = object;
+		return true;
+	}
+
+	void rasterizeTile(int tile, int rangeCount, int tileCount)
+	{
+		int tileX = (tile % tilesX) * TILE_SIZE;
+		int tileY = (tile / tilesX) * TILE_SIZE;
+
+		for (int y = tileY; y < tileY + TILE_SIZE; y++)
+		{
+			float* depthRow = &depth[(size_t)y * stride + tileX];
+			unsigned int* colorRow = &color[(size_t)y * stride + tileX];
+			for (int x = 0; x < TILE_SIZE; x++)
+			{
+				depthRow[x] = 1.0f;
+				colorRow[x] = 0xFF000000u;
+			}
+		}
+
+		for (int range = 0; range < rangeCount; range++)
+		{
+			const std::vector<int>& bin = bins[(size_t)range * tileCount + tile];
+			for (size_t i = 0; i < bin.size(); i++)
+			{
+				rasterizeTriangle(triangles[bin[i]], tileX, tileY);
+			}
+		}
+	}
+
+	void rasterizeTriangle(const Triangle& triangle, int tileX, int tileY)
+	{
+		int minX = std::max(triangle.minX, tileX) & ~3;
+		int minY = std::max(triangle.minY, tileY);
+		int maxX = std::min(triangle.maxX, tileX + TILE_SIZE - 1);
+		int maxY = std::min(triangle.maxY, tileY + TILE_SIZE - 1);
+
+		//edge function of the edge opposite to vertex k is the unnormalized barycentric of vertex k
+		float area = (triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0]) - (triangle.x[2] - triangle.x[0]) * (triangle.y[1] - triangle.y[0]);
+		float inverseArea = 1.0f / area;
+		float edgeA[3], edgeB[3], edgeC[3];
+		for (int k = 0; k < 3; k++)
+		{
+			int i = (k + 1) % 3;
+			int j = (k + 2) % 3;
+			edgeA[k] = (triangle.y[i] - triangle.y[j]) * inverseArea;
+			edgeB[k] = (triangle.x[j] - triangle.x[i]) * inverseArea;
+			edgeC[k] = (triangle.x[i] * triangle.y[j] - triangle.x[j] * triangle.y[i]) * inverseArea;
+		}
+
+		__m128 zero = _mm_setzero_ps();
+		__m128 laneOffsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+		__m128 a0 = _mm_set1_ps(edgeA[0]), a1 = _mm_set1_ps(edgeA[1]), a2 = _mm_set1_ps(edgeA[2]);
+		__m128 z0 = _mm_set1_ps(triangle.z[0]), z1 = _mm_set1_ps(triangle.z[1]), z2 = _mm_set1_ps(triangle.z[2]);
+
+		for (int y = minY; y <= maxY; y++)
+		{
+			float centerY = y + 0.5f;
+			__m128 row0 = _mm_set1_ps(edgeB[0] * centerY + edgeC[0]);
+			__m128 row1 = _mm_set1_ps(edgeB[1] * centerY + edgeC[1]);
+			__m128 row2 = _mm_set1_ps(edgeB[2] * centerY + edgeC[2]);
+			float* depthRow = &depth[(size_t)y * stride];
+
+			for (int x = minX; x <= maxX; x += 4)
+			{
+				__m128 centerX = _mm_add_ps(_mm_set1_ps((float)x), laneOffsets);
+				__m128 b0 = _mm_add_ps(_mm_mul_ps(a0, centerX), row0);
+				__m128 b1 = _mm_add_ps(_mm_mul_ps(a1, centerX), row1);
+				__m128 b2 = _mm_add_ps(_mm_mul_ps(a2, centerX), row2);
+
+				__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(b0, zero), _mm_cmpge_ps(b1, zero)), _mm_cmpge_ps(b2, zero));
+				if (_mm_movemask_ps(inside) == 0)
+				{
+					continue;
+				}
+
+				//depth is affine in screen space, GL_LESS like the GL path
+				__m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(b0, z0), _mm_mul_ps(b1, z1)), _mm_mul_ps(b2, z2));
+				__m128 stored = _mm_loadu_ps(&depthRow[x]);
+				__m128 pass = _mm_and_ps(inside, _mm_cmplt_ps(z, stored));
+				int mask = _mm_movemask_ps(pass);
+				if (mask == 0)
+				{
+					continue;
+				}
+
+				_mm_storeu_ps(&depthRow[x], _mm_or_ps(_mm_and_ps(pass, z), _mm_andnot_ps(pass, stored)));
+
+				float weights0[4], weights1[4], weights2[4];
+				_mm_storeu_ps(weights0, b0);
+				_mm_storeu_ps(weights1, b1);
+				_mm_storeu_ps(weights2, b2);
+				for (int lane = 0; lane < 4; lane++)
+				{
+					if (mask & (1 << lane))
+					{
+						color[(size_t)y * stride + x + lane] = shadePixel(triangle, weights0[lane], weights1[lane], weights2[lane]);
+					}
+				}
+			}
+		}
+	}
+
+	// fragment.frag with perspective-correct world position
+	unsigned int shadePixel(const Triangle& triangle, float b0, float b1, float b2) const
+	{
+		float inverseW = b0 * triangle.inverseW[0] + b1 * triangle.inverseW[1] + b2 * triangle.inverseW[2];
+		glm::vec3 fragPos = (triangle.worldOverW[0] * b0 + triangle.worldOverW[1] * b1 + triangle.worldOverW[2] * b2) / inverseW;
+
+		const Material& material = (*objects)[triangle.object].material;
+		glm::vec3 result = material.emission + material.ka * material.ambient;
+
+		glm::vec3 norm = glm::normalize(triangle.normal);
+		glm::vec3 viewDir = glm::normalize(glm::vec3(frame->viewPos) - fragPos);
+
+		if (shading->ceilingLamp.enabled)
+		{
+			result += getLight(material, shading->ceilingLamp, fragPos, norm, viewDir);
+		}
+
+		if (shading->nightLamp.enabled)
+		{
+			glm::vec3 lightDirection = glm::normalize(shading->nightLamp.position - fragPos);
+			float theta = glm::dot(lightDirection, glm::normalize(-shading->nightLampDirection));
+			float epsilon = shading->nightLampCutOff - shading->nightLampOuterCutOff;
+			float intensity = glm::clamp((theta - shading->nightLampOuterCutOff) / epsilon, 0.0f, 1.0f);
+			result += intensity * getLight(material, shading->nightLamp, fragPos, norm, viewDir);
+		}
+
+		result = tonemap(result * shading->exposure, shading->shoulderStart);
+		unsigned int r = (unsigned int)(result.x * 255.0f + 0.5f);
+		unsigned int g = (unsigned int)(result.y * 255.0f + 0.5f);
+		unsigned int b = (unsigned int)(result.z * 255.0f + 0.5f);
+		return 0xFF000000u | (b << 16) | (g << 8) | r;
+	}
+
+	static glm::vec3 tonemap(const glm::vec3& color, float shoulderStart)
+	{
+		glm::vec3 result;
+		for (int i = 0; i < 3; i++)
+		{
+			float over = std::max(color[i] - shoulderStart, 0.0f);
+			result[i] = std::min(color[i], shoulderStart) + (1.0f - shoulderStart) * (1.0f - std::exp(-over / (1.0f - shoulderStart)));
+		}
+		return glm::clamp(result, glm::vec3(0.0f), glm::vec3(1.0f));
+	}
+
+	// diffuse plus specular of one light, getDiffuse() + getSpecular() of the shader
+	static glm::vec3 getLight(const Material& material, const SoftwareLight& light, const glm::vec3& fragPos, const glm::vec3& norm, const glm::vec3& viewDir)
+	{
+		glm::vec3 lightDir = glm::normalize(light.position - fragPos);
+		float diff = std::max(glm::dot(norm, lightDir), 0.0f);
+		glm::vec3 diffuse = light.diffuse * material.kd * (diff * material.diffuse);
+
+		glm::vec3 reflectDir = glm::reflect(-lightDir, norm);
+		float spec = std::pow(std::max(glm::dot(viewDir, reflectDir), 0.0f), material.shininess);
+		glm::vec3 specular = material.ks * (spec * material.specular);
+
+		return diffuse + specular;
+	}
+};
@@ -0,0 +1,181 @@
+#pragma once
+
+/*
+ Screen space ambient occlusion.
+ The scene pass writes its ambient term and the world normal to two extra targets. The occlusion is
+ computed at half or quarter of the render size from the scene depth and those normals, with the
+ kernel rotated in a 4x4 interleaved pattern so a few samples per texel are enough. A compute pass
+ with the tile in shared memory blurs the pattern away within 4x4 texels of similar depth, and a last
+ pass upsamples the result with the scene depth as guide and takes the occluded part of the ambient
+ term out of the HDR scene color, before bloom and tonemapping see it.
+*/
+
+#include <GL/glew.h>
+
+#include <iostream>
+
+#include "Shader.h"
+#include "GLState.h"
+#include "FrameGraph.h"
+#include "StartupLoader.h"
+
+struct SsaoSetting {
+	int resolutionDivisor;	// 2 for half, 4 for quarter of the render size
+	int sampleCount;
+	const char* name;
+};
+
+class Ssao
+{
+public:
+	static const int SETTING_COUNT = 4;
+
+	bool enabled = true;
+	int setting = 0;			// into getSettings()
+	float radius = 0.5f;		// of the sampled hemisphere in world units
+	float bias = 0.02f;			// depth difference below which a sample does not occlude
+	float intensity = 1.0f;		// 0 leaves the ambient term as it was
+	float depthTolerance = 0.05f;	// relative depth difference that separates surfaces in blur and upsample
+
+	Ssao() {}
+
+	// from the best to the cheapest
+	static const SsaoSetting* getSettings()
+	{
+		static const SsaoSetting settings[SETTING_COUNT] = {
+			{ 2, 16, "half resolution, 16 samples" },
+			{ 2, 8, "half resolution, 8 samples" },
+			{ 4, 16, "quarter resolution, 16 samples" },
+			{ 4, 8, "quarter resolution, 8 samples" },
+		};
+		return settings;
+	}
+
+	const SsaoSetting& getSetting() const
+	{
+		return getSettings()[setting];
+	}
+
+	// steps through the settings and switches SSAO off after the cheapest one
+	// ------------------------------------------------------------------------
+	void cycleSetting()
+	{
+		if (!enabled)
+		{
+			enabled = true;
+			setting = 0;
+		}
+		else if (setting + 1 < SETTING_COUNT)
+		{
+			setting++;
+		}
+		else
+		{
+			enabled = false;
+		}
+
+		std::cout << "SSAO " << (enabled ? getSetting().name : "off") << std::endl;
+	}
+
+	// SSAO is on by default, so the first frame needs it
+	void requestShaders(StartupLoader& loader)
+	{
+		loader.addComputeProgram(occlusionShader, "./Shaders/ssao.comp", true);
+		loader.addComputeProgram(blurShader, "./Shaders/ssao_blur.comp", true);
+		loader.addComputeProgram(applyShader, "./Shaders/ssao_apply.comp", true);
+	}
+
+	// declares the passes that darken the ambient part of the scene color, the scene pass has to write
+	// sceneAmbient and sceneNormal as its second and third color target
+	// ------------------------------------------------------------------------
+	void addPasses(FrameGraph& graph, FrameGraphResource sceneColor, FrameGraphResource sceneAmbient, FrameGraphResource sceneNormal, FrameGraphResource sceneDepth)
+	{
+		const FrameGraphTextureDesc& sceneDesc = graph.getDesc(sceneColor);
+		int divisor = getSetting().resolutionDivisor;
+		int sampleCount = getSetting().sampleCount;
+		FrameGraphTextureDesc occlusionDesc((sceneDesc.width + divisor - 1) / divisor, (sceneDesc.height + divisor - 1) / divisor, GL_RG16F);
+
+		FrameGraphResource occlusion = graph.createTexture("SsaoOcclusion", occlusionDesc);
+		FrameGraphResource blurred = graph.createTexture("SsaoBlurred", occlusionDesc);
+
+		int occlusionPass = graph.addPass("SsaoOcclusion", [this, sceneDepth, sceneNormal, occlusion, divisor, sampleCount](const FrameGraph& graph) {
+			computeOcclusion(graph.getTexture(sceneDepth), graph.getTexture(sceneNormal), graph.getDesc(occlusion), graph.getTexture(occlusion), divisor, sampleCount);
+		});
+		graph.read(occlusionPass, sceneDepth);
+		graph.read(occlusionPass, sceneNormal);
+		graph.write(occlusionPass, occlusion);
+
+		int blurPass = graph.addPass("SsaoBlur", [this, occlusion, blurred](const FrameGraph& graph) {
+			blur(graph.getTexture(occlusion), graph.getDesc(blurred), graph.getTexture(blurred));
+		});
+		graph.read(blurPass, occlusion);
+		graph.write(blurPass, blurred);
+
+		int applyPass = graph.addPass("SsaoApply", [this, sceneColor, sceneAmbient, sceneDepth, blurred, divisor](const FrameGraph& graph) {
+			apply(graph.getTexture(sceneDepth), graph.getTexture(blurred), graph.getTexture(sceneAmbient), graph.getDesc(sceneColor), graph.getTexture(sceneColor), divisor);
+		});
+		graph.read(applyPass, sceneDepth);
+		graph.read(applyPass, blurred);
+		graph.read(applyPass, sceneAmbient);
+		graph.read(applyPass, sceneColor);
+		graph.write(applyPass, sceneColor);
+	}
+
+	void release()
+	{
+		glState.deleteProgram(occlusionShader.ID);
+		glState.deleteProgram(blurShader.ID);
+		glState.deleteProgram(applyShader.ID);
+	}
+
+private:
+	Shader occlusionShader;
+	Shader blurShader;
+	Shader applyShader;
+
+	// reads the view and projection from the frame data uniform block the scene pass used
+	void computeOcclusion(GLuint depthTexture, GLuint normalTexture, const FrameGraphTextureDesc& occlusionDesc, GLuint occlusionTexture, int divisor, int sampleCount)
+	{
+		occlusionShader.use();
+		occlusionShader.setInt("scale", divisor);
+		occlusionShader.setInt("sampleCount", sampleCount);
+		occlusionShader.setFloat("radius", radius);
+		occlusionShader.setFloat("bias", bias);
+
+		glState.bindTextureUnit(0, depthTexture);
+		glState.bindTextureUnit(1, normalTexture);
+		glBindImageTexture(0, occlusionTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG16F);
+
+		glDispatchCompute((occlusionDesc.width + 7) / 8, (occlusionDesc.height + 7) / 8, 1);
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	}
+
+	void blur(GLuint sourceTexture, const FrameGraphTextureDesc& destinationDesc, GLuint destinationTexture)
+	{
+		blurShader.use();
+		blurShader.setFloat("depthTolerance", depthTolerance);
+
+		glState.bindTextureUnit(0, sourceTexture);
+		glBindImageTexture(0, destinationTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG16F);
+
+		glDispatchCompute((destinationDesc.width + 15) / 16, (destinationDesc.height + 15) / 16, 1);
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	}
+
+	// the scene color is updated in place, bloom and tonemapping sample it afterwards
+	void apply(GLuint depthTexture, GLuint occlusionTexture, GLuint ambientTexture, const FrameGraphTextureDesc& colorDesc, GLuint colorTexture, int divisor)
+	{
+		applyShader.use();
+		applyShader.setInt("scale", divisor);
+		applyShader.setFloat("intensity", intensity);
+		applyShader.setFloat("depthTolerance", depthTolerance);
+
+		glState.bindTextureUnit(0, depthTexture);
+		glState.bindTextureUnit(1, occlusionTexture);
+		glState.bindTextureUnit(2, ambientTexture);
+		glBindImageTexture(0, colorTexture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R11F_G11F_B10F);
+
+		glDispatchCompute((colorDesc.width + 7) / 8, (colorDesc.height + 7) / 8, 1);
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+	}
+};
@@ -0,0 +1,347 @@
+#pragma once
+
+/*
+ Startup pipeline.
+ Subsystems register the programs they need before the window exists. A loader thread reads the
+ shader sources and injects their defines on the thread pool while the main thread creates the window
+ and the GL context. With a context, every program whose sources have arrived is handed to the
+ driver, which compiles and links them in parallel when KHR_parallel_shader_compile is available, and
+ the main thread goes on creating buffers in between. The first frame only waits for the programs
+ marked as required, the others are finished by update() in later frames once the driver reports them
+ done. Serial mode reads, compiles and links one program after the other, the way startup used to.
+*/
+
+#include <GL/glew.h>
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <iostream>
+
+#include "Shader.h"
+#include "ThreadPool.h"
+#include "MemoryTracker.h"
+
+struct StartupStats {
+	unsigned int programs = 0;
+	unsigned int requiredPrograms = 0;
+	unsigned int finishedLater = 0;			// programs finished after the first frame
+	unsigned int readThreads = 0;
+	double contextMilliseconds = 0.0;		// until the GL context existed
+	double readMilliseconds = 0.0;			// of the loader thread, from the first to the last source
+	double blockedMilliseconds = 0.0;		// the main thread spent in the loader before the first frame
+	double firstFrameMilliseconds = 0.0;	// until the first frame was presented
+};
+
+class StartupLoader
+{
+public:
+	// called once a program is linked, to set the uniforms that never change
+	typedef void (*ReadyCallback)(Shader&);
+
+	bool serial = false;
+	StartupStats stats;
+
+	StartupLoader() {}
+
+	~StartupLoader()
+	{
+		joinReader();
+	}
+
+	// the time the startup report counts from
+	void begin()
+	{
+		start = std::chrono::steady_clock::now();
+	}
+
+	// programs can only be added before startReading()
+	// ------------------------------------------------------------------------
+	void addProgram(Shader& shader, const char* vertexPath, const char* fragmentPath, const std::string& defines, bool required, ReadyCallback callback = NULL)
+	{
+		Job job;
+		job.shader = &shader;
+		job.paths[0] = vertexPath;
+		job.paths[1] = fragmentPath;
+		job.stageCount = 2;
+		job.defines = defines;
+		job.required = required;
+		job.callback = callback;
+		addJob(job);
+	}
+
+	void addComputeProgram(Shader& shader, const char* computePath, bool required, ReadyCallback callback = NULL)
+	{
+		Job job;
+		job.shader = &shader;
+		job.paths[0] = computePath;
+		job.stageCount = 1;
+		job.required = required;
+		job.callback = callback;
+		addJob(job);
+	}
+
+	// reads every source on the pool from a loader thread, the pool must not be used until submit(true)
+	// ------------------------------------------------------------------------
+	void startReading(ThreadPool& pool)
+	{
+		reading = true;
+		stats.readThreads = pool.getThreadCount();
+		if (serial)
+		{
+			return;
+		}
+
+		reader = std::thread([this, &pool] {
+			MemoryScope scope(MEMORY_TAG_SHADERS);
+			std::chrono::steady_clock::time_point readStart = std::chrono::steady_clock::now();
+			pool.parallelFor((int)jobs.size(), 1, [this](int begin, int end) {
+				for (int i = begin; i < end; i++)
+				{
+					readJob(jobs[i]);
+
+					std::lock_guard<std::mutex> lock(mutex);
+					jobs[i].read = true;
+					readCondition.notify_all();
+				}
+			});
+			stats.readMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - readStart).count();
+		});
+	}
+
+	void contextCreated()
+	{
+		stats.contextMilliseconds = getMilliseconds();
+		if (!serial && GLEW_KHR_parallel_shader_compile)
+		{
+			glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+		}
+		else if (!serial && GLEW_ARB_parallel_shader_compile)
+		{
+			glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+		}
+	}
+
+	// hands the programs whose sources have arrived to the driver, with wait it waits for all of them
+	// ------------------------------------------------------------------------
+	void submit(bool wait)
+	{
+		std::chrono::steady_clock::time_point blockStart = std::chrono::steady_clock::now();
+		submitJobs(wait);
+		stats.blockedMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - blockStart).count();
+	}
+
+	// everything the first frame needs, the other programs keep compiling
+	// ------------------------------------------------------------------------
+	void finishRequired()
+	{
+		std::chrono::steady_clock::time_point blockStart = std::chrono::steady_clock::now();
+		submitJobs(true);
+		for (size_t i = 0; i < jobs.size(); i++)
+		{
+			if (jobs[i].required)
+			{
+				finishJob(jobs[i]);
+			}
+		}
+		stats.blockedMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - blockStart).count();
+	}
+
+	// once per frame, finishes the programs the driver is done with
+	// ------------------------------------------------------------------------
+	void update()
+	{
+		if (remaining == 0)
+		{
+			return;
+		}
+
+		for (size_t i = 0; i < jobs.size(); i++)
+		{
+			if (jobs[i].submitted && !jobs[i].finished && jobs[i].shader->isReady() && finishJob(jobs[i]))
+			{
+				stats.finishedLater++;
+			}
+		}
+	}
+
+	// waits for every program, before measuring or releasing them
+	void finishAll()
+	{
+		submitJobs(true);
+		for (size_t i = 0; i < jobs.size(); i++)
+		{
+			finishJob(jobs[i]);
+		}
+	}
+
+	// waits for the sources to be read, for an exit before there is a context to hand them to
+	void stopReading()
+	{
+		joinReader();
+	}
+
+	// ------------------------------------------------------------------------
+	void firstFramePresented()
+	{
+		if (stats.firstFrameMilliseconds > 0.0)
+		{
+			return;
+		}
+
+		stats.firstFrameMilliseconds = getMilliseconds();
+		std::cout << "Time to first frame: " << stats.firstFrameMilliseconds << " ms (" << (serial ? "serial" : "parallel") << " startup), context after "
+			<< stats.contextMilliseconds << " ms, " << stats.programs << " programs read in " << stats.readMilliseconds << " ms"
+			<< " on " << (serial ? 1 : stats.readThreads) << " threads, " << stats.blockedMilliseconds << " ms spent waiting for "
+			<< stats.requiredPrograms << " required programs" << std::endl;
+	}
+
+	void printStats() const
+	{
+		std::cout << "Startup: first frame after " << stats.firstFrameMilliseconds << " ms, " << stats.programs << " programs, "
+			<< stats.requiredPrograms << " required, " << stats.finishedLater << " finished after the first frame, "
+			<< remaining << " still compiling" << std::endl;
+	}
+
+private:
+	struct Job {
+		Shader* shader = NULL;
+		std::string paths[2];
+		int stageCount = 0;
+		std::string defines;
+		std::string code[2];
+		bool sourcesRead = false;	// false when a file could not be read
+		bool required = false;
+		ReadyCallback callback = NULL;
+		bool read = false;			// set by the loader thread under the mutex
+		bool submitted = false;
+		bool finished = false;
+	};
+
+	std::vector<Job> jobs;
+	std::thread reader;
+	std::mutex mutex;
+	std::condition_variable readCondition;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	bool reading = false;
+	unsigned int remaining = 0;	// programs that are not finished yet
+
+	// hands the programs whose sources have arrived to the driver, with wait it waits for all of them
+	void submitJobs(bool wait)
+	{
+		MemoryScope scope(MEMORY_TAG_SHADERS);
+		for (size_t i = 0; i < jobs.size(); i++)
+		{
+			Job& job = jobs[i];
+			if (job.submitted)
+			{
+				continue;
+			}
+
+			if (serial)
+			{
+				std::chrono::steady_clock::time_point readStart = std::chrono::steady_clock::now();
+				readJob(job);
+				stats.readMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - readStart).count();
+				beginJob(job);
+				finishJob(job);
+				continue;
+			}
+
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				if (!job.read && !wait)
+				{
+					continue;
+				}
+				readCondition.wait(lock, [&job] { return job.read; });
+			}
+			beginJob(job);
+		}
+
+		if (wait)
+		{
+			joinReader();
+		}
+	}
+
+	double getMilliseconds() const
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	void addJob(const Job& job)
+	{
+		if (reading)
+		{
+			std::cout << "ERROR::STARTUP_LOADER::PROGRAM_ADDED_AFTER_START " << job.paths[0] << std::endl;
+			return;
+		}
+
+		jobs.push_back(job);
+		stats.programs++;
+		stats.requiredPrograms += job.required ? 1 : 0;
+		remaining++;
+	}
+
+	static void readJob(Job& job)
+	{
+		job.sourcesRead = true;
+		for (int i = 0; i < job.stageCount; i++)
+		{
+			job.sourcesRead = Shader::readSource(job.paths[i].c_str(), job.defines, job.code[i]) && job.sourcesRead;
+		}
+	}
+
+	void beginJob(Job& job)
+	{
+		if (!job.sourcesRead)
+		{
+			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ " << job.paths[0] << std::endl;
+		}
+
+		if (job.stageCount == 1)
+		{
+			job.shader->beginLoadCompute(job.code[0]);
+		}
+		else
+		{
+			job.shader->beginLoad(job.code[0], job.code[1]);
+		}
+		job.submitted = true;
+	}
+
+	// false when the program was finished elsewhere, ShaderVariants::get finishes a variant it needs at once
+	bool finishJob(Job& job)
+	{
+		if (!job.submitted || job.finished)
+		{
+			return false;
+		}
+
+		bool finishedHere = job.shader->finishLoad();
+		if (finishedHere && job.callback != NULL)
+		{
+			job.callback(*job.shader);
+		}
+
+		for (int i = 0; i < job.stageCount; i++)
+		{
+			std::string().swap(job.code[i]);
+		}
+		job.finished = true;
+		remaining--;
+		return finishedHere;
+	}
+
+	void joinReader()
+	{
+		if (reader.joinable())
+		{
+			reader.join();
+		}
+	}
+};
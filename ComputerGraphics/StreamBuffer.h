@@ -0,0 +1,197 @@
+#pragma once
+
+/*
+ Streaming allocator for per-frame dynamic data.
+ One buffer is created with glBufferStorage and stays persistently and coherently mapped for its
+ whole lifetime. It is split into FRAME_COUNT regions; each frame bump-allocates from its own region
+ and fences it at the end, and the region is only reused once that fence has signalled. Data is
+ written straight into the mapped memory, there are no glBufferData/glBufferSubData copies. A GL
+ trace does not see those writes, so the code that writes reports them with written().
+*/
+
+#include <GL/glew.h>
+
+#include <iostream>
+#include <chrono>
+
+#include "GLState.h"
+
+// A range of the stream buffer, data points into mapped memory and offset is relative to the buffer start
+struct StreamAllocation {
+	void* data;
+	GLintptr offset;
+	GLsizeiptr size;
+};
+
+struct StreamBufferStats {
+	unsigned long long bytesStreamed = 0;		// total bytes handed out since init
+	unsigned long long frameBytesStreamed = 0;	// bytes handed out during the last completed frame
+	unsigned int fenceWaits = 0;				// frames that had to wait for the GPU to release their region
+	unsigned int failedAllocations = 0;			// requests that did not fit into the frame region
+	double fenceWaitMilliseconds = 0.0;
+};
+
+class StreamBuffer
+{
+public:
+	// Number of frames the CPU may run ahead of the GPU
+	static const int FRAME_COUNT = 3;
+
+	unsigned int ID = 0;
+	StreamBufferStats stats;
+
+	StreamBuffer() {}
+
+	// creates and maps the buffer, bytesPerFrame is the capacity of each frame region
+	// ------------------------------------------------------------------------
+	bool init(GLsizeiptr bytesPerFrame)
+	{
+		if (!GLEW_ARB_buffer_storage)
+		{
+			std::cout << "ERROR::STREAM_BUFFER::ARB_BUFFER_STORAGE_NOT_SUPPORTED" << std::endl;
+			return false;
+		}
+
+		regionSize = bytesPerFrame;
+
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+		MemoryScope scope(MEMORY_TAG_STREAMING);
+		ID = gpuMemory.createBuffer(regionSize * FRAME_COUNT, NULL, flags);
+		mapped = (char*)glMapNamedBufferRange(ID, 0, regionSize * FRAME_COUNT, flags);
+
+		if (mapped == NULL)
+		{
+			std::cout << "ERROR::STREAM_BUFFER::MAPPING_FAILED" << std::endl;
+			return false;
+		}
+
+		for (int i = 0; i < FRAME_COUNT; i++)
+		{
+			fences[i] = 0;
+		}
+		frame = 0;
+		head = 0;
+
+		return true;
+	}
+
+	// waits until the GPU has finished reading the region this frame is going to overwrite
+	// ------------------------------------------------------------------------
+	void beginFrame()
+	{
+		GLsync fence = fences[frame];
+		if (fence != 0)
+		{
+			if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+			{
+				stats.fenceWaits++;
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+				stats.fenceWaitMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			}
+			glDeleteSync(fence);
+			fences[frame] = 0;
+		}
+
+		head = 0;
+	}
+
+	// bump-allocates size bytes from the current frame region, returns data == NULL when full
+	// ------------------------------------------------------------------------
+	StreamAllocation allocate(GLsizeiptr size, GLsizeiptr alignment = 16)
+	{
+		StreamAllocation allocation = { NULL, 0, 0 };
+
+		GLsizeiptr alignedHead = (head + alignment - 1) / alignment * alignment;
+		if (alignedHead + size > regionSize)
+		{
+			stats.failedAllocations++;
+			return allocation;
+		}
+
+		allocation.offset = regionSize * frame + alignedHead;
+		allocation.data = mapped + allocation.offset;
+		allocation.size = size;
+
+		head = alignedHead + size;
+		lastAllocationEnd = head;
+
+		return allocation;
+	}
+
+	// gives back the unused tail of the most recent allocation
+	// ------------------------------------------------------------------------
+	void trim(StreamAllocation& allocation, GLsizeiptr usedSize)
+	{
+		if (allocation.data == NULL || usedSize >= allocation.size)
+		{
+			return;
+		}
+
+		GLsizeiptr allocationEnd = allocation.offset - regionSize * frame + allocation.size;
+		if (allocationEnd == lastAllocationEnd && allocationEnd == head)
+		{
+			head -= allocation.size - usedSize;
+			lastAllocationEnd = head;
+		}
+		allocation.size = usedSize;
+	}
+
+	// bytes written into an allocation, only needed while a GL trace is recorded
+	// ------------------------------------------------------------------------
+	void written(const void* data, GLsizeiptr size)
+	{
+		if (glTrace.isRecording())
+		{
+			glTrace.recordMappedWrite(ID, (const char*)data - mapped, size);
+		}
+	}
+
+	// fences the current region and moves on to the next one
+	// ------------------------------------------------------------------------
+	void endFrame()
+	{
+		fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+		stats.frameBytesStreamed = head;
+		stats.bytesStreamed += head;
+
+		frame = (frame + 1) % FRAME_COUNT;
+		head = 0;
+	}
+
+	// ------------------------------------------------------------------------
+	void release()
+	{
+		for (int i = 0; i < FRAME_COUNT; i++)
+		{
+			if (fences[i] != 0)
+			{
+				glDeleteSync(fences[i]);
+				fences[i] = 0;
+			}
+		}
+
+		if (ID != 0)
+		{
+			glUnmapNamedBuffer(ID);
+			glState.deleteBuffers(1, &ID);
+			ID = 0;
+		}
+		mapped = NULL;
+	}
+
+	GLsizeiptr capacityPerFrame() const
+	{
+		return regionSize;
+	}
+
+private:
+	char* mapped = NULL;
+	GLsizeiptr regionSize = 0;
+	GLsizeiptr head = 0;
+	GLsizeiptr lastAllocationEnd = 0;
+	GLsync fences[FRAME_COUNT];
+	int frame = 0;
+};
@@ -0,0 +1,160 @@
+#pragma once
+
+/*
+ Fixed set of worker threads for data-parallel CPU work.
+ parallelFor splits an index range into chunks that the workers and the calling thread pull from a
+ shared atomic counter until the range is exhausted; the call returns once every chunk is done.
+ The workers charge what they allocate to the memory tag of the thread that called parallelFor.
+*/
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <vector>
+
+#include "MemoryTracker.h"
+
+class ThreadPool
+{
+public:
+	ThreadPool() {}
+
+	~ThreadPool()
+	{
+		release();
+	}
+
+	// threadCount includes the calling thread, 0 uses every hardware thread
+	// ------------------------------------------------------------------------
+	void init(unsigned int threadCount = 0)
+	{
+		release();
+
+		if (threadCount == 0)
+		{
+			threadCount = std::thread::hardware_concurrency();
+		}
+		if (threadCount == 0)
+		{
+			threadCount = 1;
+		}
+
+		quit = false;
+		generation = 0;
+		for (unsigned int i = 1; i < threadCount; i++)
+		{
+			workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+		}
+	}
+
+	// calls task(begin, end) for consecutive chunks of [0, count) on all threads, blocks until done
+	// ------------------------------------------------------------------------
+	void parallelFor(int count, int chunkSize, const std::function<void(int, int)>& task)
+	{
+		if (count <= 0)
+		{
+			return;
+		}
+		if (chunkSize < 1)
+		{
+			chunkSize = 1;
+		}
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			currentTask = &task;
+			taskTag = MemoryScope::current();
+			taskCount = count;
+			taskChunkSize = chunkSize;
+			nextIndex = 0;
+			busyWorkers = (unsigned int)workers.size();
+			generation++;
+		}
+		wakeCondition.notify_all();
+
+		runChunks();
+
+		std::unique_lock<std::mutex> lock(mutex);
+		doneCondition.wait(lock, [this] { return busyWorkers == 0; });
+		currentTask = NULL;
+	}
+
+	unsigned int getThreadCount() const
+	{
+		return (unsigned int)workers.size() + 1;
+	}
+
+	// ------------------------------------------------------------------------
+	void release()
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			quit = true;
+		}
+		wakeCondition.notify_all();
+
+		for (size_t i = 0; i < workers.size(); i++)
+		{
+			workers[i].join();
+		}
+		workers.clear();
+	}
+
+private:
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wakeCondition;
+	std::condition_variable doneCondition;
+
+	const std::function<void(int, int)>* currentTask = NULL;
+	MemoryTag taskTag = MEMORY_TAG_GENERAL;
+	int taskCount = 0;
+	int taskChunkSize = 1;
+	std::atomic<int> nextIndex;
+	unsigned int busyWorkers = 0;
+	unsigned int generation = 0;
+	bool quit = false;
+
+	void runChunks()
+	{
+		MemoryScope scope(taskTag);
+		for (;;)
+		{
+			int begin = nextIndex.fetch_add(taskChunkSize);
+			if (begin >= taskCount)
+			{
+				return;
+			}
+			int end = begin + taskChunkSize < taskCount ? begin + taskChunkSize : taskCount;
+			(*currentTask)(begin, end);
+		}
+	}
+
+	void workerLoop()
+	{
+		unsigned int seenGeneration = 0;
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wakeCondition.wait(lock, [&] { return quit || generation != seenGeneration; });
+				if (quit)
+				{
+					return;
+				}
+				seenGeneration = generation;
+			}
+
+			runChunks();
+
+			std::unique_lock<std::mutex> lock(mutex);
+			busyWorkers--;
+			if (busyWorkers == 0)
+			{
+				doneCondition.notify_one();
+			}
+		}
+	}
+};
@@ -0,0 +1,108 @@
+#pragma once
+
+/*
+ Weighted blended order independent transparency (McGuire and Bavoil).
+ Objects whose material opacity is below 1 are left out of the scene pass and drawn afterwards in a
+ single pass with the TRANSLUCENT variant of the scene shader, in any order. It tests against the scene
+ depth without writing it and blends into two targets: the depth weighted sum of the premultiplied
+ colors and opacities, and the product of the transparencies. A compute pass then puts their average
+ over the HDR scene color, before bloom and tonemapping see it. Nothing has to be sorted on the CPU,
+ so the cost grows with the translucent pixels and not with the number of translucent objects.
+*/
+
+#include <GL/glew.h>
+
+#include "Shader.h"
+#include "GLState.h"
+#include "FrameGraph.h"
+#include "StartupLoader.h"
+
+class Translucency
+{
+public:
+	Translucency() {}
+
+	void requestShaders(StartupLoader& loader)
+	{
+		loader.addComputeProgram(compositeShader, "./Shaders/oit_composite.comp", true);
+	}
+
+	// declares the translucent pass, which calls draw with the targets bound, and the pass that composites
+	// it into sceneColor. draw calls beginAccumulation() and endAccumulation() around its draws, the
+	// composite is skipped when it did not
+	// ------------------------------------------------------------------------
+	template<typename Callback>
+	void addPasses(FrameGraph& graph, FrameGraphResource sceneColor, FrameGraphResource sceneDepth, Callback&& draw)
+	{
+		const FrameGraphTextureDesc& sceneDesc = graph.getDesc(sceneColor);
+		FrameGraphResource accumulation = graph.createTexture("OitAccumulation", FrameGraphTextureDesc(sceneDesc.width, sceneDesc.height, GL_RGBA16F));
+		FrameGraphResource revealage = graph.createTexture("OitRevealage", FrameGraphTextureDesc(sceneDesc.width, sceneDesc.height, GL_R8));
+
+		int translucentPass = graph.addPass("Translucent", [this, draw](const FrameGraph&) {
+			accumulated = false;
+			draw();
+		});
+		graph.writeColor(translucentPass, accumulation);
+		graph.writeColor(translucentPass, revealage);
+		//only tested, it is attached so the translucent surfaces hide behind the opaque ones
+		graph.writeDepth(translucentPass, sceneDepth);
+
+		int compositePass = graph.addPass("TranslucentComposite", [this, accumulation, revealage, sceneColor](const FrameGraph& graph) {
+			if (accumulated)
+			{
+				composite(graph.getTexture(accumulation), graph.getTexture(revealage), graph.getDesc(sceneColor), graph.getTexture(sceneColor));
+			}
+		});
+		graph.read(compositePass, accumulation);
+		graph.read(compositePass, revealage);
+		graph.read(compositePass, sceneColor);
+		graph.write(compositePass, sceneColor);
+	}
+
+	// clears the bound targets and sets up the blending, the TRANSLUCENT shader variant draws next
+	// ------------------------------------------------------------------------
+	void beginAccumulation()
+	{
+		const GLfloat zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		const GLfloat one[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+		glClearBufferfv(GL_COLOR, 0, zero);
+		glClearBufferfv(GL_COLOR, 1, one);
+
+		glState.setDepthMask(false);
+		glState.setEnabled(GL_BLEND, true);
+		glState.blendFunci(0, GL_ONE, GL_ONE);
+		glState.blendFunci(1, GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+
+		accumulated = true;
+	}
+
+	// back to the blending and depth writes of the other passes
+	// ------------------------------------------------------------------------
+	void endAccumulation()
+	{
+		glState.setDepthMask(true);
+		glState.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	}
+
+	void release()
+	{
+		glState.deleteProgram(compositeShader.ID);
+	}
+
+private:
+	Shader compositeShader;
+	bool accumulated = false;	// by the translucent pass of the frame in progress
+
+	// the scene color is updated in place, like the SSAO pass does
+	void composite(GLuint accumulationTexture, GLuint revealageTexture, const FrameGraphTextureDesc& colorDesc, GLuint colorTexture)
+	{
+		compositeShader.use();
+
+		glState.bindTextureUnit(0, accumulationTexture);
+		glState.bindTextureUnit(1, revealageTexture);
+		glBindImageTexture(0, colorTexture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R11F_G11F_B10F);
+
+		glDispatchCompute((colorDesc.width + 7) / 8, (colorDesc.height + 7) / 8, 1);
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+	}
+};
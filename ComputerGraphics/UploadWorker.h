@@ -0,0 +1,496 @@
+#pragma once
+
+/*
+ Uploads on a thread of their own.
+ The worker owns a GL context that shares its objects with the render context and is created next to
+ it. init() returns once the worker has made its context current, or failed to. The render thread hands
+ it jobs, a range of a buffer or a level of a 2D texture with a pointer to the data, and gets a ticket
+ back. The persistently mapped staging buffer is created with the first job, so a run that uploads
+ nothing does not pay for it. The worker copies the data into it slot by slot, issues the copies into the destination from there and puts a fence behind the
+ last one. update() on the render thread only polls those fences, it never waits for them: a ticket
+ is complete once its fence has signalled, from then on the destination can be bound and used.
+ Until then the data has to stay valid and the render thread must not touch the destination.
+ A staging slot is reused once the fence of its last copy has signalled, that wait happens on the
+ worker. Jobs live in a fixed ring, a full ring turns jobs away instead of growing.
+ The worker calls the driver's functions directly, so a GL trace does not contain the uploads.
+*/
+
+#include <GL/glew.h>
+#include <SDL.h>
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include "GLState.h"
+#include "MemoryTracker.h"
+
+struct UploadStats {
+	unsigned long long submittedJobs = 0;
+	unsigned long long completedJobs = 0;
+	unsigned long long rejectedJobs = 0;		// the ring was full
+	unsigned long long completedBytes = 0;
+	unsigned int stagingWaits = 0;				// the worker waited for the GPU to release a slot
+	double stagingWaitMilliseconds = 0.0;
+	double copyMilliseconds = 0.0;				// the worker spent copying into the staging buffer
+};
+
+class UploadWorker
+{
+public:
+	static const int MAX_JOBS = 256;
+	static const int STAGING_SLOTS = 8;
+	static const GLsizeiptr SLOT_SIZE = 4 * 1024 * 1024;
+
+	UploadStats stats;
+
+	UploadWorker() {}
+
+	~UploadWorker()
+	{
+		release();
+	}
+
+	// starts the thread and waits until it made context current on its side, false when it could not.
+	// context has to share its objects with the render context
+	// ------------------------------------------------------------------------
+	bool init(SDL_Window* window, SDL_GLContext context)
+	{
+		if (!GLEW_ARB_buffer_storage)
+		{
+			std::cout << "ERROR::UPLOAD_WORKER::ARB_BUFFER_STORAGE_NOT_SUPPORTED" << std::endl;
+			return false;
+		}
+
+		glTrace.getDriverFunctions(gl);
+		for (int i = 0; i < STAGING_SLOTS; i++)
+		{
+			slotFences[i] = 0;
+		}
+		nextSlot = 0;
+		submitted = 0;
+		processed = 0;
+		completed = 0;
+		pendingBytes = 0;
+		quit = false;
+		started = false;
+		running = false;
+
+		this->window = window;
+		this->context = context;
+		worker = std::thread(&UploadWorker::workerLoop, this);
+
+		std::unique_lock<std::mutex> lock(mutex);
+		startCondition.wait(lock, [this] { return started; });
+		if (!running)
+		{
+			lock.unlock();
+			worker.join();
+			return false;
+		}
+		return true;
+	}
+
+	// the thread has its context current and takes jobs
+	bool isRunning() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return running;
+	}
+
+	// copies size bytes of data to offset in buffer, 0 when the job was turned away
+	// ------------------------------------------------------------------------
+	unsigned long long uploadBuffer(GLuint buffer, GLintptr offset, GLsizeiptr size, const void* data)
+	{
+		UploadJob job;
+		job.buffer = buffer;
+		job.offset = offset;
+		job.data = data;
+		job.size = size;
+		return submit(job);
+	}
+
+	// replaces level of a 2D texture, the rows of data are 4 byte aligned like the default unpack alignment.
+	// 0 when the job was turned away
+	// ------------------------------------------------------------------------
+	unsigned long long uploadTexture(GLuint texture, GLint level, GLsizei width, GLsizei height, GLenum format, GLenum type, const void* data)
+	{
+		GLsizeiptr rowBytes = ((GLsizeiptr)width * getPixelBytes(format, type) + 3) & ~(GLsizeiptr)3;
+		if (rowBytes > SLOT_SIZE)
+		{
+			std::cout << "ERROR::UPLOAD_WORKER::ROW_LARGER_THAN_STAGING_SLOT" << std::endl;
+			return 0;
+		}
+
+		UploadJob job;
+		job.texture = texture;
+		job.level = level;
+		job.width = width;
+		job.height = height;
+		job.format = format;
+		job.type = type;
+		job.rowBytes = rowBytes;
+		job.data = data;
+		job.size = rowBytes * height;
+		return submit(job);
+	}
+
+	// takes the jobs whose fence has signalled, on the render thread once a frame. Never blocks on the GPU
+	// ------------------------------------------------------------------------
+	void update()
+	{
+		for (;;)
+		{
+			JobSlot* slot = NULL;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (completed == processed)
+				{
+					return;
+				}
+				slot = &jobs[completed % MAX_JOBS];
+			}
+
+			//the worker flushed the fence, so polling without a flush sees it signal
+			GLenum status = gl.ClientWaitSync(slot->fence, 0, 0);
+			if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			{
+				return;
+			}
+			gl.DeleteSync(slot->fence);
+			slot->fence = 0;
+
+			std::lock_guard<std::mutex> lock(mutex);
+			stats.completedJobs++;
+			stats.completedBytes += slot->job.size;
+			pendingBytes -= slot->job.size;
+			completed++;
+		}
+	}
+
+	bool isComplete(unsigned long long ticket) const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return ticket <= completed;
+	}
+
+	// bytes of the jobs that were handed in and are not complete yet
+	GLsizeiptr getPendingBytes() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return pendingBytes;
+	}
+
+	void printStats() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::cout << "Upload worker: " << stats.completedJobs << " of " << stats.submittedJobs << " jobs complete, "
+			<< stats.completedBytes / (1024 * 1024) << " MB, " << stats.rejectedJobs << " turned away; " << stats.copyMilliseconds
+			<< " ms copying to staging, " << stats.stagingWaits << " staging waits (" << stats.stagingWaitMilliseconds << " ms)" << std::endl;
+	}
+
+	// stops the thread, jobs it did not start are dropped. The render context has to be current
+	// ------------------------------------------------------------------------
+	void release()
+	{
+		if (worker.joinable())
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				quit = true;
+			}
+			wakeCondition.notify_one();
+			worker.join();
+		}
+
+		//the fences are shared objects, the render context can delete what the worker left
+		for (unsigned long long i = completed; i < processed; i++)
+		{
+			gl.DeleteSync(jobs[i % MAX_JOBS].fence);
+			jobs[i % MAX_JOBS].fence = 0;
+		}
+		for (int i = 0; i < STAGING_SLOTS; i++)
+		{
+			if (slotFences[i] != 0)
+			{
+				gl.DeleteSync(slotFences[i]);
+				slotFences[i] = 0;
+			}
+		}
+		completed = processed;
+
+		if (stagingReady != 0)
+		{
+			gl.DeleteSync(stagingReady);
+			stagingReady = 0;
+		}
+		if (stagingBuffer != 0)
+		{
+			glUnmapNamedBuffer(stagingBuffer);
+			glState.deleteBuffers(1, &stagingBuffer);
+			stagingBuffer = 0;
+			staging = NULL;
+		}
+	}
+
+	static GLsizeiptr getPixelBytes(GLenum format, GLenum type)
+	{
+		GLsizeiptr components = 4;
+		if (format == GL_RED)
+		{
+			components = 1;
+		}
+		else if (format == GL_RG)
+		{
+			components = 2;
+		}
+		else if (format == GL_RGB || format == GL_BGR)
+		{
+			components = 3;
+		}
+
+		if (type == GL_FLOAT)
+		{
+			return components * 4;
+		}
+		if (type == GL_HALF_FLOAT || type == GL_UNSIGNED_SHORT)
+		{
+			return components * 2;
+		}
+		return components;
+	}
+
+private:
+	struct UploadJob {
+		GLuint buffer = 0;		// a range of a buffer
+		GLintptr offset = 0;
+		GLuint texture = 0;		// or a level of a 2D texture
+		GLint level = 0;
+		GLsizei width = 0;
+		GLsizei height = 0;
+		GLenum format = GL_RGBA;
+		GLenum type = GL_UNSIGNED_BYTE;
+		GLsizeiptr rowBytes = 0;
+		const void* data = NULL;
+		GLsizeiptr size = 0;
+	};
+
+	struct JobSlot {
+		UploadJob job;
+		GLsync fence = 0;		// behind the last copy of the job
+	};
+
+	// the driver's functions, the worker does not go through the trace wrappers
+	GLTraceFunctions gl;
+
+	SDL_Window* window = NULL;
+	SDL_GLContext context = NULL;
+	std::thread worker;
+	mutable std::mutex mutex;
+	std::condition_variable wakeCondition;
+	std::condition_variable startCondition;
+	bool quit = false;
+	bool started = false;	// the thread tried to make its context current
+	bool running = false;	// and succeeded, until it quits
+
+	// the ring of jobs: [completed, processed) wait for their fence, [processed, submitted) for the worker
+	JobSlot jobs[MAX_JOBS];
+	unsigned long long submitted = 0;
+	unsigned long long processed = 0;
+	unsigned long long completed = 0;
+	GLsizeiptr pendingBytes = 0;
+
+	// created by the first submit() before its job is queued, from then on only used by the worker
+	GLuint stagingBuffer = 0;
+	char* staging = NULL;
+	GLsync stagingReady = 0;	// the render context created the staging buffer
+	GLsync slotFences[STAGING_SLOTS];
+	int nextSlot = 0;
+
+	// the ticket is the count of jobs submitted with this one
+	unsigned long long submit(const UploadJob& job)
+	{
+		if (stagingBuffer == 0 && isRunning() && !createStaging())
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stats.rejectedJobs++;
+			return 0;
+		}
+
+		unsigned long long ticket;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!running || submitted - completed >= MAX_JOBS)
+			{
+				stats.rejectedJobs++;
+				return 0;
+			}
+			jobs[submitted % MAX_JOBS].job = job;
+			submitted++;
+			ticket = submitted;
+			pendingBytes += job.size;
+			stats.submittedJobs++;
+		}
+		wakeCondition.notify_one();
+		return ticket;
+	}
+
+	// on the render thread, the worker waits for stagingReady before it binds the buffer
+	bool createStaging()
+	{
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+		MemoryScope scope(MEMORY_TAG_UPLOADS);
+		GLuint buffer = gpuMemory.createBuffer(SLOT_SIZE * STAGING_SLOTS, NULL, flags);
+		char* data = (char*)glMapNamedBufferRange(buffer, 0, SLOT_SIZE * STAGING_SLOTS, flags);
+		if (data == NULL)
+		{
+			std::cout << "ERROR::UPLOAD_WORKER::MAPPING_FAILED" << std::endl;
+			glState.deleteBuffers(1, &buffer);
+			return false;
+		}
+		GLsync ready = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		glFlush();
+
+		//the worker reads them under the lock once it takes the job that is queued next
+		std::lock_guard<std::mutex> lock(mutex);
+		stagingBuffer = buffer;
+		staging = data;
+		stagingReady = ready;
+		return true;
+	}
+
+	void workerLoop()
+	{
+		bool current = SDL_GL_MakeCurrent(window, context) == 0;
+		if (!current)
+		{
+			std::cout << "ERROR::UPLOAD_WORKER::CONTEXT_NOT_CURRENT " << SDL_GetError() << std::endl;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			started = true;
+			running = current;
+		}
+		startCondition.notify_all();
+		if (!current)
+		{
+			return;
+		}
+
+		bool stagingBound = false;
+		for (;;)
+		{
+			UploadJob job;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wakeCondition.wait(lock, [this] { return quit || processed < submitted; });
+				if (quit)
+				{
+					running = false;
+					break;
+				}
+				job = jobs[processed % MAX_JOBS].job;
+			}
+
+			//texture copies read from the staging buffer, the binding belongs to this context
+			if (!stagingBound)
+			{
+				waitForSync(stagingReady);
+				stagingReady = 0;
+				gl.BindBuffer(GL_PIXEL_UNPACK_BUFFER, stagingBuffer);
+				stagingBound = true;
+			}
+
+			copy(job);
+			GLsync fence = gl.FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			glFlush();
+
+			std::lock_guard<std::mutex> lock(mutex);
+			jobs[processed % MAX_JOBS].fence = fence;
+			processed++;
+		}
+
+		//the staging buffer is deleted by the render context, so the copies from it have to be done
+		glFinish();
+		gl.BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		SDL_GL_MakeCurrent(window, NULL);
+	}
+
+	// the job in pieces of at most a slot, a texture in bands of whole rows
+	void copy(const UploadJob& job)
+	{
+		const char* source = (const char*)job.data;
+		GLsizeiptr pieceLimit = job.texture != 0 ? (SLOT_SIZE / job.rowBytes) * job.rowBytes : SLOT_SIZE;
+
+		for (GLsizeiptr done = 0; done < job.size;)
+		{
+			GLsizeiptr pieceBytes = job.size - done < pieceLimit ? job.size - done : pieceLimit;
+			GLintptr slotOffset = nextSlot * SLOT_SIZE;
+			waitForSlot(nextSlot);
+
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			memcpy(staging + slotOffset, source + done, pieceBytes);
+			double copyMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+			if (job.texture != 0)
+			{
+				GLsizei firstRow = (GLsizei)(done / job.rowBytes);
+				GLsizei rows = (GLsizei)(pieceBytes / job.rowBytes);
+				gl.TextureSubImage2D(job.texture, job.level, 0, firstRow, job.width, rows, job.format, job.type, (const void*)slotOffset);
+			}
+			else
+			{
+				gl.CopyNamedBufferSubData(stagingBuffer, job.buffer, slotOffset, job.offset + done, pieceBytes);
+			}
+			slotFences[nextSlot] = gl.FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			nextSlot = (nextSlot + 1) % STAGING_SLOTS;
+			done += pieceBytes;
+
+			std::lock_guard<std::mutex> lock(mutex);
+			stats.copyMilliseconds += copyMilliseconds;
+		}
+	}
+
+	void waitForSlot(int slot)
+	{
+		if (slotFences[slot] == 0)
+		{
+			return;
+		}
+
+		if (gl.ClientWaitSync(slotFences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED)
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			waitForSync(slotFences[slot]);
+			double waitMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+			std::lock_guard<std::mutex> lock(mutex);
+			stats.stagingWaits++;
+			stats.stagingWaitMilliseconds += waitMilliseconds;
+		}
+		else
+		{
+			gl.DeleteSync(slotFences[slot]);
+		}
+		slotFences[slot] = 0;
+	}
+
+	// blocks until fence signalled and deletes it
+	void waitForSync(GLsync fence)
+	{
+		GLenum status = GL_TIMEOUT_EXPIRED;
+		while (status == GL_TIMEOUT_EXPIRED)
+		{
+			status = gl.ClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+		}
+		if (status == GL_WAIT_FAILED)
+		{
+			std::cout << "ERROR::UPLOAD_WORKER::WAIT_FAILED" << std::endl;
+		}
+		gl.DeleteSync(fence);
+	}
+};